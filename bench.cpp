@@ -0,0 +1,459 @@
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+//                                                                           //
+//               .|'''||            .|'''', '||'''|, '||'''|,                //
+//               ||             ''  ||       ||   ||  ||   ||                //
+//               `|'''|, .|'',  ||  ||       ||...|'  ||...|'                //
+//                .   || ||     ||  ||       ||       ||                     //
+//               ||...|' `|..' .||. `|....' .||      .||                     //
+//                                                                           //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+/// @project scicpp
+/// @file    bench.cpp
+/// @version 0.0.1 (alpha)
+/// @brief   Benchmark suite for the kernels of scicpp.
+/// @date    20-JAN-2019
+/// @author  Sayan Bhattacharjee (aerosayan)
+/// @email   aero.sayan@gmail.com
+/// @license DEFAULT. Will be made Open-Source after development is completed.
+///////////////////////////////////////////////////////////////////////////////
+/// DISCLAIMER :
+/// This is the intellectual property of the author Sayan Bhattacharjee.
+/// Currently this is not being distributed since development is incomplete.
+/// In future, proper licensing will be done and this coding standard and
+/// library will be made Open-Source. We do not give any guarantee for the
+/// correct operation of the library, neither are we to be held responsible
+/// for any kind of damage caused by the use of this software.
+///////////////////////////////////////////////////////////////////////////////
+/// Thank you for your understanding, support and patience.
+///////////////////////////////////////////////////////////////////////////////
+
+// NOTE : DEBUG is not defined, so that ASSERT does not slow the kernels
+#include "scicpp.hpp"
+
+using namespace std;
+
+// Command line options
+struct options
+{
+  f64 min_kb;      // Smallest working set in KB
+  f64 max_kb;      // Largest working set in KB
+  xstr only;       // Run only the kernels whose name contains this
+  xstr csv;        // Write the results to this CSV file
+  xstr json;       // Write the results to this JSON file
+  xbenchopts opt;  // Warm-up and samples of every measurement
+};
+
+// Runs every kernel for working sets from min_kb to max_kb
+void run_benchmarks(const options& o, xbenchreport& rep);
+
+int main(int argc, char** argv)
+{
+  options o;
+  o.min_kb = 4; o.max_kb = 256*1024;
+  for(int k=1;k<argc;++k) {
+    xstr a = argv[k];
+    bool more = k+1 < argc;
+    IF(a == "--quick")
+      o.max_kb = 16*1024; o.opt.samples = 5; o.opt.mintime = 2e-4;
+    ELSEIF(a == "--min-kb" && more) o.min_kb = atof(argv[++k]);
+    ELSEIF(a == "--max-kb" && more) o.max_kb = atof(argv[++k]);
+    ELSEIF(a == "--samples" && more) o.opt.samples = atol(argv[++k]);
+    ELSEIF(a == "--only" && more) o.only = argv[++k];
+    ELSEIF(a == "--csv" && more) o.csv = argv[++k];
+    ELSEIF(a == "--json" && more) o.json = argv[++k];
+    ELSE
+      cout<<"USE : bench_scicpp [--quick] [--min-kb KB] [--max-kb KB] "
+            "[--samples N] [--only NAME] [--csv FILE] [--json FILE]"<<endl;
+      return 1;
+    ENDIF
+  }
+
+  xbenchreport rep;
+  rep.peak = xbench_peak_bandwidth();
+  cout<<"SIMD : "<<xsimd_name()<<" (CPU : "<<xsimd_cpu_name()<<")"
+      <<", threads : "<<xnthreads()<<", NUMA nodes : "<<xnuma().nodes()
+      <<", peak bandwidth : "<<rep.peak<<" GB/s"<<endl;
+
+  run_benchmarks(o,rep);
+
+  IF(!o.csv.empty() && !rep.write(o.csv))
+    cout<<"ERROR :: CSV FILE NOT WRITTEN CORRECTLY"<<endl;
+  ENDIF
+  IF(!o.json.empty() && !rep.write(o.json))
+    cout<<"ERROR :: JSON FILE NOT WRITTEN CORRECTLY"<<endl;
+  ENDIF
+  return 0;
+}
+
+// FTBS for the nonlinear convection, for scalars and packs
+struct ftbs_f
+{
+  f64 dtdx;
+  xtem(xtn PT) xtn PT::value_type operator()(const PT& u) const
+  { return u(0) - u(0)*dtdx*(u(0)-u(-1)); }
+};
+
+// FTBS for the members of an ensemble, each with its own dt/dx
+struct ftbs_ens_f
+{
+  const af64& dtdx;
+  xtem(xtn PT) xtn PT::value_type operator()(const PT& u) const
+  { return u(0) - u(0)*u.param(dtdx)*(u(0)-u(-1)); }
+};
+
+// One FTBS step of the time levels u of n points, stored and computed in
+// the types of the precision P
+xtem(xtn P)
+void ftbs_step(xtimelevels<xtn P::array>& u, s64 n, f64 dtdx)
+{
+  typedef xtn P::compute_type C;
+  const xtn P::store_type* un = u.n().data();
+  xtn P::store_type* un1 = u.np1().data();
+  const C c = C(dtdx);
+  for(s64 i=1;i<n;++i) {
+    const C w = P::load(un[i]);
+    un1[i] = P::store(w - w*c*(w-P::load(un[i-1])));
+  }
+  u.advance();
+}
+
+// Determinants, inverses and solves of N matrices of N*N, n = matrices
+xtem(szt N, xtn RUN)
+void run_small_matrices(const RUN& run, s64 n)
+{
+  s64 e,k;
+  const f64 B = SOF(f64), NN = N*N;
+  // Flops per matrix of the cofactor formulas
+  const f64 fdet[] = {0,0,3,14,47}, finv[] = {0,0,8,42,144};
+  const f64 fsolve = finv[N] + N*(2*N-1);
+  ARR2(f64) a(N*N,n), r(N*N,n), b(N,n), x(N,n);
+  ARR(f64) d(1,n);
+  // Diagonally dominant matrices
+  DO(e,1,N*N)
+    DO(k,1,n)
+      a(e,k) = f64((e*7+k*3) % 11)/11.0 + ((e-1) % (N+1) == 0 ? N : 0);
+    ENDDO
+  ENDDO
+  DO(e,1,N)
+    DO(k,1,n)
+      b(e,k) = 1.0;
+    ENDDO
+  ENDDO
+  const xstr nxn = to_string(N)+"x"+to_string(N);
+  run(("det"+nxn).c_str(),n,(NN+1)*B*n,fdet[N]*n,[&]{
+    xbatchdet<N>(a,d); xdonotoptimize(d); });
+  run(("inv"+nxn).c_str(),n,2*NN*B*n,finv[N]*n,[&]{
+    xbatchinv<N>(a,r); xdonotoptimize(r); });
+  run(("solve"+nxn).c_str(),n,(NN+2*N)*B*n,fsolve*n,[&]{
+    xbatchsolve<N>(a,b,x); xdonotoptimize(x); });
+}
+
+// Every kernel is measured for working sets growing 4 times at a time,
+// from L1 resident to DRAM resident. The working set is the size of all
+// the arrays a kernel uses, so n depends on the no. of arrays.
+// Bytes count every array read or written once per call, except for the
+// temporally blocked stencils, where they count it once per time step,
+// which is the traffic the same steps would need without blocking.
+void run_benchmarks(const options& o, xbenchreport& rep)
+{
+  s64 i,j;
+  const f64 dtdx = 0.1;
+  const f64 B = SOF(f64);
+
+  // Measure and print one kernel
+  auto run = [&](const char* name, s64 n, f64 bytes, f64 flops,
+                 const std::function<void()>& f) {
+    IF(o.only.empty() || xstr(name).find(o.only) != xstr::npos)
+      rep.add(xbench(name,n,bytes,flops,f,o.opt));
+      const xbenchresult& r = rep.results.back();
+      printf("%-14s n = %10lld | %9.3f ns/elem | %9.1f Melem/s"
+             " | %9.3f GB/s | %9.3f GFLOP/s\n",
+             r.name.c_str(),static_cast<long long>(r.n),r.ns_per_element(),
+             1e-6*r.elements_per_second(),r.gbps(),r.gflops());
+      fflush(stdout);
+    ENDIF
+  };
+
+  for(f64 kb=o.min_kb;kb<=o.max_kb;kb*=4) {
+    // Elements per array for a kernel using NARR arrays
+    auto size = [&](s64 narr) {
+      return std::max<s64>(16,static_cast<s64>(kb*1024/(narr*B)));
+    };
+
+    // Array copy, y = x
+    {
+      s64 n = size(2);
+      ARR(f64) x(1,n,1.0), y(1,n,0.0);
+      run("copy",n,2*B*n,0,[&]{ y(1,n) = x(1,n); xdonotoptimize(y); });
+    }
+    // y = a*x + y
+    {
+      s64 n = size(2);
+      ARR(f64) x(1,n,1.0), y(1,n,0.0);
+      run("axpy",n,3*B*n,2*n,[&]{ xaxpy(1e-9,x,y); xdonotoptimize(y); });
+    }
+    // Reductions
+    {
+      s64 n = size(2);
+      ARR(f64) x(1,n,1.0), y(1,n,0.5);
+      run("sum",n,B*n,n,[&]{ xdonotoptimize(xsum(x)); });
+      run("dot",n,2*B*n,2*n,[&]{ xdonotoptimize(xdot(x,y)); });
+      run("maxabs",n,B*n,n,[&]{ xdonotoptimize(xmaxabs(x)); });
+      // In parallel, with the summation modes of "Reductions"
+      run("sum_pairwise",n,B*n,n,[&]{
+        xdonotoptimize(xpartotal(x,PAIRWISE)); });
+      run("sum_kahan",n,B*n,4*n,[&]{ xdonotoptimize(xpartotal(x,KAHAN)); });
+      run("sum_repro",n,B*n,4*n,[&]{ xdonotoptimize(xpartotal(x,REPRO)); });
+      run("dot_repro",n,2*B*n,6*n,[&]{
+        xdonotoptimize(xpardot(x,y,REPRO)); });
+    }
+    // Elementary functions on a whole array : one <cmath> call per element,
+    // then the packs of "Elementary functions" in both accuracies
+    {
+      s64 n = size(2);
+      ARR(f64) x(1,n), y(1,n);
+      DO(i,1,n) x[i] = 0.5 + 1e-3*(i%1000); ENDDO
+      run("exp_libm",n,2*B*n,n,[&]{
+        DO(j,1,n) y[j] = std::exp(x[j]); ENDDO xdonotoptimize(y); });
+      run("exp",n,2*B*n,n,[&]{ y(1,n) = xexp(x(1,n)); xdonotoptimize(y); });
+      run("exp_fast",n,2*B*n,n,[&]{
+        y(1,n) = xexp<FAST>(x(1,n)); xdonotoptimize(y); });
+      run("log_libm",n,2*B*n,n,[&]{
+        DO(j,1,n) y[j] = std::log(x[j]); ENDDO xdonotoptimize(y); });
+      run("log",n,2*B*n,n,[&]{ y(1,n) = xlog(x(1,n)); xdonotoptimize(y); });
+      run("log_fast",n,2*B*n,n,[&]{
+        y(1,n) = xlog<FAST>(x(1,n)); xdonotoptimize(y); });
+      run("sin_libm",n,2*B*n,n,[&]{
+        DO(j,1,n) y[j] = std::sin(x[j]); ENDDO xdonotoptimize(y); });
+      run("sin",n,2*B*n,n,[&]{ y(1,n) = xsin(x(1,n)); xdonotoptimize(y); });
+      run("sin_fast",n,2*B*n,n,[&]{
+        y(1,n) = xsin<FAST>(x(1,n)); xdonotoptimize(y); });
+      run("tanh_libm",n,2*B*n,n,[&]{
+        DO(j,1,n) y[j] = std::tanh(x[j]); ENDDO xdonotoptimize(y); });
+      run("tanh",n,2*B*n,n,[&]{
+        y(1,n) = xtanh(x(1,n)); xdonotoptimize(y); });
+      run("tanh_fast",n,2*B*n,n,[&]{
+        y(1,n) = xtanh<FAST>(x(1,n)); xdonotoptimize(y); });
+      run("pow_libm",n,2*B*n,n,[&]{
+        DO(j,1,n) y[j] = std::pow(x[j],1.4); ENDDO xdonotoptimize(y); });
+      run("pow",n,2*B*n,n,[&]{
+        y(1,n) = xpow(x(1,n),1.4); xdonotoptimize(y); });
+      run("pow_fast",n,2*B*n,n,[&]{
+        y(1,n) = xpow<FAST>(x(1,n),1.4); xdonotoptimize(y); });
+    }
+    // One FTBS step of main.cpp, as an array expression
+    {
+      s64 n = size(2);
+      xtimelevels<af64> u(1,n);
+      u.n() = 1.0; u.replicate();
+      run("ftbs_expr",n,2*B*n,4*n,[&]{
+        af64& un = u.n(); af64& un1 = u.np1();
+        un1(2,n) = un(2,n) - un(2,n)*dtdx*(un(2,n)-un(1,n-1));
+        u.advance();
+      });
+    }
+    // The same step with the threads of the pool, for each schedule of
+    // PARDOS, and with the mass of the new u summed by PARSUM
+    {
+      s64 n = size(2);
+      xtimelevels<af64> u(1,n);
+      u.n() = 1.0; u.replicate();
+      const xsched sc[3] = {xsched(STATIC),xsched(CHUNKED),xsched(GUIDED)};
+      const char* name[3] = {"ftbs_static","ftbs_chunked","ftbs_guided"};
+      for(s64 k=0;k<3;++k)
+        run(name[k],n,2*B*n,4*n,[&]{
+          af64& un = u.n(); af64& un1 = u.np1();
+          PARDOS(j,2,n,sc[k])
+            un1[j] = un[j] - un[j]*dtdx*(un[j]-un[j-1]);
+          ENDPARDO
+          u.advance();
+        });
+      run("ftbs_parsum",n,2*B*n,5*n,[&]{
+        af64& un = u.n(); af64& un1 = u.np1();
+        f64 mass = 0.0;
+        PARDO(j,2,n)
+          un1[j] = un[j] - un[j]*dtdx*(un[j]-un[j-1]);
+        ENDPARDO
+        PARSUM(mass,j,1,n) mass += un1[j]; ENDPARDO
+        xdonotoptimize(mass);
+        u.advance();
+      });
+    }
+    // The same step on f32, computed in f32 and in f64, for the same n as
+    // the f64 loop, moving half the bytes
+    {
+      s64 n = size(2);
+      xtimelevels<af64> u(1,n);
+      u.n() = 1.0; u.replicate();
+      run("ftbs_f64",n,2*B*n,4*n,[&]{ ftbs_step<xprecf64>(u,n,dtdx); });
+      xtimelevels<af32> v(1,n);
+      v.n() = 1.0f; v.replicate();
+      run("ftbs_f32",n,2*SOF(f32)*n,4*n,[&]{
+        ftbs_step<xprecf32>(v,n,dtdx); });
+      run("ftbs_mixed",n,2*SOF(f32)*n,4*n,[&]{
+        ftbs_step<xprecmixed>(v,n,dtdx); });
+    }
+    // The same steps with the stencil engine, blocked in time
+    {
+      s64 n = size(2);
+      xtimelevels<af64> u(1,n);
+      u.n() = 1.0; u.replicate();
+      ftbs_f fn = {dtdx};
+      auto st = xmkstencil(-1,0,fn);
+      s64 nt = st.tsteps;
+      run("ftbs_stencil",n*nt,2*B*n*nt,4*n*nt,[&]{
+        xstencil_run(st,u,nt,2,n);
+      });
+    }
+    // The same steps updating only the blocks around a shock, which starts
+    // at n/8 in every call, with u = 2 behind it and u = 1 ahead of it.
+    // The bytes and flops are those of updating every point.
+    {
+      s64 n = size(2), nt = 64;
+      xtimelevels<af64> u(1,n);
+      af64 u0(1,n,1.0);
+      for(s64 i=1;i<=n/8;++i) u0[i] = 2.0;
+      ftbs_f fn = {dtdx};
+      auto st = xmkstencil(-1,0,fn);
+      xactivity<1> act;
+      run("ftbs_active",n*nt,2*B*n*nt,4*n*nt,[&]{
+        u.n() = u0; act.reset();
+        xstencil_run(st,u,nt,act,2,n);
+      });
+    }
+    // The same step for 64 members of an ensemble, of n/64 points each
+    {
+      const s64 nk = 64, m = std::max<s64>(2,size(2)/nk), n = m*nk;
+      xensemble<f64> e(nk,1,m);
+      e.u().fill(1.0);
+      af64 dtdxk(1,nk,dtdx);
+      ftbs_ens_f fn = {dtdxk};
+      run("ftbs_ensemble",n,2*B*n,4*n,[&]{ e.advance(2,fn); });
+    }
+    // 2D heat equation, 5 point stencil, blocked in time
+    {
+      s64 m = std::max<s64>(4,static_cast<s64>(std::sqrt(f64(size(2)))));
+      xtimelevels<a2f64> T(m,m);
+      T.n().fill(0.0); T.replicate();
+      const f64 r = 0.2;
+      typedef xstpoint<f64,2> pt;
+      auto heat = xmkstencil(-1,1,-1,1,[=](const pt& u) {
+        return u(0,0) + r*(u(-1,0)+u(1,0)+u(0,-1)+u(0,1)-4.0*u(0,0)); });
+      s64 nt = heat.tsteps, n = (m-2)*(m-2);
+      run("heat2d_stencil",n*nt,2*B*n*nt,7*n*nt,[&]{
+        xstencil_run(heat,T,nt,2,m-1,2,m-1);
+      });
+    }
+    // 1D Burgers with a shock on a periodic grid, 4 steps of the finest
+    // cells on a uniform grid, and 1 step of 2 levels of AMR over a grid
+    // 4 times coarser. The elements, bytes and flops are those of the
+    // uniform grid, so the AMR rate is that of an equally fine grid.
+    {
+      const s64 blk = 16, n = std::max<s64>(4*blk,size(5)/(4*blk)*(4*blk));
+      auto u0 = [](const f64* x) {
+        return (x[0] > 0.25 && x[0] < 0.5) ? 2.0 : 1.0; };
+      auto flux = [](szt, f64 ul, f64) { return 0.5*ul*ul; };
+      const f64 dt = 0.2/f64(n);
+      xgrid<1> gf({n},{0.0},{1.0}), gc({n/4},{0.0},{1.0});
+      gf.bc(0,0) = gf.bc(0,1) = gc.bc(0,0) = gc.bc(0,1) = xbc(PERIODIC);
+      xamropts opt;
+      opt.block = blk; opt.tagtol = 0.05; opt.maxlevel = 0;
+      xamr<1> uni(gf,opt);
+      uni.init(u0);
+      opt.maxlevel = 2;
+      xamr<1> amr(gc,opt);
+      amr.init(u0);
+      run("burgers_uniform",4*n,4*5*B*n,4*6*n,[&]{
+        for(s64 k=0;k<4;++k) uni.step(dt,flux);
+      });
+      run("burgers_amr",4*n,4*5*B*n,4*6*n,[&]{ amr.step(4*dt,flux); });
+    }
+    // Cells of irregular cost, 1 to 64 steps of a linear congruential
+    // generator, shared by the GUIDED schedule of PARDOS and by the work
+    // stealing of TASKDO
+    {
+      s64 n = size(1);
+      ARR(f64) y(1,n);
+      auto cell = [](s64 k) {
+        u64 h = u64(k);
+        const s64 m = 1 + (k*7919) % 64;
+        for(s64 q=0;q<m;++q)
+          h = h*6364136223846793005ull+1442695040888963407ull;
+        return f64(h >> 11);
+      };
+      run("irreg_guided",n,B*n,0,[&]{
+        PARDOS(j,1,n,xsched(GUIDED)) y[j] = cell(j); ENDPARDO
+        xdonotoptimize(y); });
+      run("irreg_taskdo",n,B*n,0,[&]{
+        TASKDO(j,1,n) y[j] = cell(j); ENDTASKDO xdonotoptimize(y); });
+    }
+    // Sparse products, 2D 5 point Laplacian on an m*m grid, alone (CSR)
+    // and for 3 coupled unknowns per point (BSR of 3*3 blocks).
+    // 12 bytes per entry, and 3 f64 per row for x, y and the row pointer.
+    {
+      s64 m = std::max<s64>(4,static_cast<s64>(
+                            std::sqrt(kb*1024/(5*12+3*B))));
+      const s64 nb = 3;
+      xcoo<f64> c(1,m*m), c3(1,nb*m*m);
+      DO(i,0,m-1)
+        DO(j,0,m-1)
+          s64 r = i*m+j+1;
+          s64 nbr[5] = {r, i > 0 ? r-m : 0, i < m-1 ? r+m : 0,
+                        j > 0 ? r-1 : 0, j < m-1 ? r+1 : 0};
+          for(s64 q=0;q<5;++q) {
+            if(nbr[q] == 0) continue;
+            c.add(r,nbr[q],q == 0 ? 4.0 : -1.0);
+            for(s64 a=0;a<nb;++a)
+              for(s64 b=0;b<nb;++b)
+                c3.add(nb*(r-1)+a+1,nb*(nbr[q]-1)+b+1,
+                       (q == 0 ? 4.0 : -1.0)*(a == b ? 1.0 : 0.1));
+          }
+        ENDDO
+      ENDDO
+      xcsr<f64> A(c), A3csr(c3);
+      xbsr<f64,nb> A3(A3csr);
+      s64 n = A.rows(), nnz = A.nnz();
+      ARR(f64) x(1,n,1.0), y(1,n,0.0), x3(1,nb*n,1.0), y3(1,nb*n,0.0);
+      run("spmv_csr",n,12.0*nnz+3*B*n,2.0*nnz,[&]{
+        xspmv(A,x,y); xdonotoptimize(y); });
+      const f64 nnz3 = f64(A3.nnzb())*nb*nb;
+      run("spmv_bsr3",nb*n,B*nnz3+4.0*A3.nnzb()+B*(2*nb+1)*n,2.0*nnz3,[&]{
+        xspmv(A3,x3,y3); xdonotoptimize(y3); });
+    }
+    // Implicit line solves, m interleaved systems of 256 unknowns, and
+    // one system for SPIKE. The solvers overwrite c (and band), which is
+    // copied back in every call, and counted in the bytes.
+    {
+      const s64 nx = 256, m = std::max<s64>(1,size(6)/nx), n = nx*m;
+      ARR2(f64) a(nx,m), b(nx,m), c0(nx,m), c(nx,m), d(nx,m);
+      a.fill(-1.0); b.fill(4.0); c0.fill(-1.0); d.fill(1.0);
+      run("tridiag",n,8*B*n,9*n,[&]{
+        c = c0; xtridiag(a,b,c,d); xdonotoptimize(d); });
+    }
+    {
+      const s64 nx = 256, m = std::max<s64>(1,size(11)/nx), n = nx*m;
+      xarraynd<f64,3> band0(5,nx,m), band(5,nx,m);
+      ARR2(f64) d(nx,m);
+      band0.fill(-1.0); d.fill(1.0);
+      DO(i,1,nx)
+        DO(j,1,m)
+          band0(3,i,j) = 6.0;
+        ENDDO
+      ENDDO
+      run("penta",n,16*B*n,20*n,[&]{
+        band = band0; xbanded<2,2>(band,d); xdonotoptimize(d); });
+    }
+    {
+      s64 n = size(6);
+      ARR(f64) a(1,n,-1.0), b(1,n,4.0), c0(1,n,-1.0), c(1,n), d(1,n,1.0);
+      run("tridiag_spike",n,8*B*n,9*n,[&]{
+        c = c0; xtridiag_spike(a,b,c,d); xdonotoptimize(d); });
+    }
+    // Batches of small matrices
+    run_small_matrices<2>(run,size(2*2*2));
+    run_small_matrices<3>(run,size(2*3*3));
+    run_small_matrices<4>(run,size(2*4*4));
+  }
+}
@@ -32,18 +32,65 @@
 // NOTE : For debugging macros define DEBUG before including scicpp.hpp
 #define DEBUG
 #include "scicpp.hpp"
-#include <fstream>
 
 using namespace std;
 
 // Solves the 1D nonliner convection equation using Finite Difference Method
 void run_nonlinear_convection_test();
-
+// Solves the same with SSP Runge-Kutta steps of adaptive dt, in f64, f32
+// and mixed precision
+void run_nonlinear_convection_rk_test();
+// Solves the 2D nonlinear convection equation on blocks of the threads
+void run_burgers_2d_test();
+// Solves the 1D equation for 8 pairs of dt and initial condition at once
+void run_nonlinear_convection_ensemble_test();
+// Solves the 1D equation updating only the parts of u that change
+void run_nonlinear_convection_active_test();
+// Solves the 1D equation in conservation form, refining around the shock
+void run_nonlinear_convection_amr_test();
+// Compares the vectorized exp, log, sin, cos, tanh and pow to <cmath>
+void run_elementary_functions_test();
+// Moves arrays made on the scratch arena out of their scope
+void run_scratch_move_test();
+// Checks the batched det, inv and solve of small matrices to elimination
+void run_small_matrices_test();
+// Solves the 1D equation with implicit upwind steps beyond the CFL limit
+void run_implicit_convection_test();
+// Runs work of irregular cost as tasks, and checks it to the serial loop
+void run_tasks_test();
+// Checks the small vectors and matrices to known values
+void run_small_vectors_test();
+// Solves random banded systems, and prints the residual of each solver
+void run_banded_test();
 
 int main()
 {
   // Run non-linear convection test to show the use of scicpp for science
   run_nonlinear_convection_test();
+  // The same test, to the same time, with fewer and larger steps
+  run_nonlinear_convection_rk_test();
+  // The 2D equation on a grid split into blocks, one per thread
+  run_burgers_2d_test();
+  // A sweep of the FTBS test over dt and the position of the hat
+  run_nonlinear_convection_ensemble_test();
+  // The FTBS test, skipping the flat parts of u around the hat
+  run_nonlinear_convection_active_test();
+  // The same hat on a coarse grid, refined twice where u jumps
+  run_nonlinear_convection_amr_test();
+  // Smooth profiles for the tests, computed on whole arrays
+  run_elementary_functions_test();
+  // Temporaries of a step kept after the step, as the new u
+  run_scratch_move_test();
+  // A small matrix per grid point, the way a mesh has one per cell
+  run_small_matrices_test();
+  // The FTBS test in 60 times fewer steps, solving a sparse system each
+  run_implicit_convection_test();
+  // Cells of very different cost, shared by work stealing
+  run_tasks_test();
+  // The geometry of a cell, with vectors and matrices of compile time size
+  run_small_vectors_test();
+  // The line solvers of implicit schemes, serial and SPIKE
+  run_banded_test();
 
   return 0;
 }
@@ -61,6 +108,7 @@ int main()
 // We shall be using FTBS( Forward in Time Backward in Space) scheme to solve.
 void run_nonlinear_convection_test()
 {
+  PROFSCOPE("nonlinear convection");
   // Loop iterators
   // NOTE: We define the type first
   u32 i,t;
@@ -75,62 +123,944 @@ void run_nonlinear_convection_test()
   // Temporal discretization
   f64 dt = 0.00015;
 
-  // Spatial mesh
-  VEC(f64) x(nx+1);
+  // Spatial mesh x(1:nx)
+  ARR(f64) x(1,nx);
   // NOTE : The type for i is set earlier
   DO(i,1,nx)
     x[i] = min_x + (dx*(i-1));
   ENDDO
 
   // Dependent variable to simulate and solve
-  // un is u at time n
-  // un1 is u at time n+1
-  VEC(f64) un(nx+1),un1(nx+1);
+  // u.n() is u at time n
+  // u.np1() is u at time n+1
+  // NOTE : Arrays are not initialized on construction
+  xtimelevels<af64> u(1,nx);
 
   // Set initial conditions
   DO(i,1,nx)
-    un1[i] = 1.0;
+    u.n()[i] = 1.0;
   ENDDO
   // We shall be using a  hat function for intial condition
   DO(i,30,300)
-    un1[i] = 2.0;
+    u.n()[i] = 2.0;
   ENDDO
+  // u(1) is never updated, so set it once in every time level
+  u.replicate();
 
-  // Write input to file input.dat
-  ofstream input_file;
-  input_file.open("input.dat",ios::out);
+  // Write x and the initial u as the first snapshot of the binary file
+  // nonlinear_convection.xsnap, then u every nsnap steps
+  // NOTE : Snapshots are written by a background thread
+  u32 nsnap = 500;
+  xsnapwriter snap("nonlinear_convection.xsnap");
 
-  IF(input_file.is_open())
-    DO(i,1,nx)
-      input_file<<x[i]<<"\t"<<un1[i]<<"\n";
-    ENDDO
+  IF(snap.is_open())
+    snap.write(0,0.0,{xsnapfield("x",x),xsnapfield("u",u.n())});
   ELSE
-    cout<<"ERROR :: INPUT FILE NOT OPENED CORRECTLY"<<endl;
+    cout<<"ERROR :: SNAPSHOT FILE NOT OPENED CORRECTLY"<<endl;
   ENDIF
 
   f64 dtdx = dt/dx;
   // Start temporal iterations
+  // NOTE : The whole array expression is computed in one fused loop,
+  // the same as the element loop,
+  // >> xdo(i,2,nx)
+  // >>   un1[i] = un[i] - un[i]*dtdx*(un[i]-un[i-1]);
+  // >> ENDDO
+  // NOTE : u.advance() makes n+1 the new n without copying any element
+  // NOTE : The PROF macros time the loop when compiled with -DPROFILE,
+  // and are empty otherwise
   DO(t,1,nt)
-    un = un1;
-    xdo(i,2,nx)
-      un1[i] = un[i] - un[i]*dtdx*(un[i]-un[i-1]);
+    PROFSCOPE("time step");
+    PROFBYTES(2*SOF(f64)*nx); PROFFLOPS(4*(nx-1));
+    af64& un = u.n(); af64& un1 = u.np1();
+    un1(2,nx) = un(2,nx) - un(2,nx)*dtdx*(un(2,nx)-un(1,nx-1));
+    u.advance();
+    IF(t % nsnap == 0)
+      snap.write(t,t*dt,{xsnapfield("u",u.n())});
+    ENDIF
+  ENDDO
+
+  // Wait for the snapshots to be written and close the file
+  snap.close();
+
+  // The same steps from the same initial u, with the threads of PARDO, and
+  // the mass sum(u)*dx of every step with PARSUM and with DO. Every u of
+  // the parallel steps must be the serial one bit for bit, and the sums
+  // agree to rounding, as the threads add their parts in another order.
+  xtimelevels<af64> v(1,nx);
+  v.n() = 1.0;
+  DO(i,30,300)
+    v.n()[i] = 2.0;
+  ENDDO
+  v.replicate();
+  f64 dmass = 0.0;
+  DO(t,1,nt)
+    af64& vn = v.n(); af64& vn1 = v.np1();
+    PARDO(i,2,nx)
+      vn1[i] = vn[i] - vn[i]*dtdx*(vn[i]-vn[i-1]);
+    ENDPARDO
+    f64 pmass = 0.0, smass = 0.0;
+    PARSUM(pmass,i,1,nx) pmass += vn1[i]*dx; ENDPARDO
+    DO(i,1,nx) smass += vn1[i]*dx; ENDDO
+    dmass = std::max(dmass,ABS(pmass-smass)/smass);
+    v.advance();
+  ENDDO
+  u32 nbad = 0;
+  DO(i,1,nx)
+    nbad += (v.n()[i] != u.n()[i]);
+  ENDDO
+  cout<<"FTBS with PARDO on "<<xnthreads()<<" threads : "<<nbad<<" of "<<nx
+      <<" values differ from the serial steps, PARSUM of the mass within a"
+      <<" fraction "<<dmass<<" of DO"<<endl;
+}
+
+// Solves the 1D nonliner convection equation of run_nonlinear_convection_test
+// with the method of lines : the space derivative is the same backward
+// difference, and the time integration is the third order SSP Runge-Kutta
+// scheme, with dt = cfl*dx/max(|u|) in every step.
+// The same source runs in every precision P (see xprecision) : u is stored
+// in P::store_type and computed in P::compute_type.
+struct nonlinear_convection_rk_case
+{
+  xtem(xtn P) xtn P::array operator()(P) const
+  {
+    typedef xtn P::compute_type C;
+    typedef xtn P::array arr;
+    u32 i;
+    // The same mesh, initial condition and final time as the FTBS test
+    u32 nx = 801;
+    f64 min_x = 0.0; f64 max_x = 2.0;
+    f64 dx = (max_x-min_x)/(nx-1);
+    f64 tend = 3000*0.00015;
+
+    arr u(1,nx,1.0);
+    DO(i,30,300)
+      u[i] = 2.0;
     ENDDO
+
+    // Right hand side r = a*r + L(u), with L(u) = -u*d(u)/dx, in C
+    // NOTE : r(1) is never written, so u(1) does not change
+    auto rhs = [&](f64, const arr& v, arr& r, C a) {
+      r(2,nx) = a*xcast<C>(r(2,nx)) - xcast<C>(v(2,nx))*
+                (xcast<C>(v(2,nx))-xcast<C>(v(1,nx-1)))/C(dx);
+    };
+    // Largest wave speed, |u|
+    auto speed = [](const arr& v) { return P::maxabs(v); };
+
+    xrkopts opt;
+    opt.scheme = SSPRK3; opt.cfl = 0.8;
+    xrkstepper<arr,P> rk(u,opt);
+    f64 t = 0.0;
+    s64 nsteps = rk.run(u,t,tend,dx,rhs,speed);
+
+    // The mass, sum(u)*dx, with a sum giving the same bits on any no. of
+    // threads, so that the output can be compared between machines
+    cout<<"SSPRK3 "<<P::name()<<" : "<<nsteps<<" steps of adaptive dt to t = "
+        <<t<<", max(u) = "<<P::maxabs(u)<<", mass = "
+        <<P::total(u,REPRO)*C(dx)<<endl;
+    return u;
+  }
+};
+
+// Runs the case in f64, then in f32 and in mixed precision (stored in f32,
+// computed in f64), and prints how far they are from f64
+void run_nonlinear_convection_rk_test()
+{
+  PROFSCOPE("nonlinear convection rk");
+  xprecision_compare<xprecf64,xprecf32,xprecmixed>(
+    nonlinear_convection_rk_case());
+
+  // A field that has blown up in one value must not have a finite speed,
+  // whether maxabs runs on the packs of STORE or on chunks widened to f32
+  af32 w(1,300001,1.0f);
+  w(150001) = std::numeric_limits<f32>::quiet_NaN();
+  xprecbf16::array wb(1,300001);
+  xprecf16::array wh(1,300001);
+  for(s64 k=1;k<=300001;++k) { wb(k) = w(k); wh(k) = w(k); }
+  const bool nan = std::isnan(xprecf32::maxabs(w)) &&
+                   std::isnan(xprecmixed::maxabs(w)) &&
+                   std::isnan(xprecbf16::maxabs(wb)) &&
+                   std::isnan(xprecf16::maxabs(wh));
+  // and the PARMAX and PARMIN of threads, one of which had a NaN
+  const f64 qnan = std::numeric_limits<f64>::quiet_NaN();
+  const bool rnan = std::isnan(xreduce_max<f64>()(1.0,qnan)) &&
+                    std::isnan(xreduce_max<f64>()(qnan,1.0)) &&
+                    std::isnan(xreduce_min<f64>()(1.0,qnan)) &&
+                    std::isnan(xreduce_min<f64>()(qnan,1.0));
+  cout<<"maxabs of a field with one NaN : "<<(nan ? "NaN" : "finite")
+      <<" in f32, mixed, bf16 and f16, and "<<(rnan ? "NaN" : "finite")
+      <<" when PARMAX and PARMIN combine threads"<<endl;
+}
+
+// Solves the 2D nonlinear convection (inviscid Burgers) equation,
+//
+//                d(u)/dt + u*d(u)/dx + u*d(u)/dy = 0
+//
+// with FTBS in both dimensions, on a grid split into one block per thread.
+// The grid is periodic along x, u = 1 flows in at y = 0 and out at y = 2.
+void run_burgers_2d_test()
+{
+  PROFSCOPE("burgers 2d");
+  // Cells of the grid, time steps and the time step size
+  s64 nx = 200, ny = 200;
+  u32 t, nt = 300;
+  f64 dt = 0.002;
+
+  // One layer of halo cells, as FTBS reads one cell back
+  xgrid<2> g({nx,ny},{0.0,0.0},{2.0,2.0},1);
+  g.bc(0,0) = g.bc(0,1) = xbc(PERIODIC);
+  g.bc(1,0) = xbc(DIRICHLET,1.0);
+  g.bc(1,1) = xbc(EXTRAPOLATE);
+  f64 dtdx = dt/g.dx(0), dtdy = dt/g.dx(1);
+
+  // u at time n and n+1, one array per block with its halo
+  xdecomp<2> dc(g);
+  std::vector<a2f64> un = dc.fields(1.0), un1 = dc.fields(1.0);
+  xlocaltransport tr(dc.blocks());
+  xhaloexchange<2> hx(dc,tr);
+
+  // A square hat for initial condition
+  for(szt b=0;b<dc.blocks();++b) {
+    const xbox<2>& r = dc.block(b).box;
+    for(s64 i=r.lo[0];i<=r.hi[0];++i)
+      for(s64 j=r.lo[1];j<=r.hi[1];++j)
+        IF(g.x(0,i) > 0.5 && g.x(0,i) < 1.0 &&
+           g.x(1,j) > 0.5 && g.x(1,j) < 1.0)
+          un[b](i,j) = 2.0;
+        ENDIF
+  }
+
+  // NOTE : Each block updates the cells it is given, which are its interior
+  // while its halo is exchanged, then the cells along its faces
+  DO(t,1,nt)
+    xgrid_step(hx,un,t,1,[&](szt b, const xbox<2>& r) {
+      const a2f64& u = un[b];
+      a2f64& u1 = un1[b];
+      for(s64 i=r.lo[0];i<=r.hi[0];++i)
+        for(s64 j=r.lo[1];j<=r.hi[1];++j)
+          u1(i,j) = u(i,j) - u(i,j)*(dtdx*(u(i,j)-u(i-1,j)) +
+                                     dtdy*(u(i,j)-u(i,j-1)));
+    });
+    std::swap(un,un1);
   ENDDO
 
-  // Write output to file output.dat
-  ofstream output_file;
-  output_file.open("output.dat",ios::out);
+  f64 umax = 0.0;
+  xcompsum<f64> mass;
+  for(szt b=0;b<dc.blocks();++b) {
+    const xbox<2>& r = dc.block(b).box;
+    for(s64 i=r.lo[0];i<=r.hi[0];++i)
+      for(s64 j=r.lo[1];j<=r.hi[1];++j) {
+        umax = std::max(umax,un[b](i,j));
+        mass.add(un[b](i,j)*g.dx(0)*g.dx(1));
+      }
+  }
+  cout<<"2D FTBS : "<<dc.blocks()<<" blocks, "<<nt<<" steps to t = "<<nt*dt
+      <<", max(u) = "<<umax<<", mass = "<<mass.value()<<endl;
+}
+
+// FTBS of run_nonlinear_convection_test, with the dt/dx of each member.
+// NOTE : As a template it is also called with packs of members.
+struct ftbs_ensemble_f
+{
+  const af64& dtdx;
+  xtem(xtn PT) xtn PT::value_type operator()(const PT& u) const
+  {
+    return u(0) - u(0)*u.param(dtdx)*(u(0)-u(-1));
+  }
+};
+
+// Solves run_nonlinear_convection_test for 8 members : 4 time steps, the
+// largest being that of the test, for each of 2 positions of the hat.
+// Every member runs to the same time, so those of smaller dt take more
+// steps and are the last to stop.
+void run_nonlinear_convection_ensemble_test()
+{
+  PROFSCOPE("nonlinear convection ensemble");
+  u32 i,k;
+  u32 nx = 801, nk = 8;
+  f64 min_x = 0.0; f64 max_x = 2.0;
+  f64 dx = (max_x-min_x)/(nx-1);
+  f64 tend = 3000*0.00015;
 
-  IF(output_file.is_open())
+  xensemble<f64> e(nk,1,nx);
+  af64 dt(1,nk), dtdx(1,nk);
+  DO(k,1,nk)
+    dt[k] = 0.00015/(1+(k-1)%4);
+    dtdx[k] = dt[k]/dx;
+    e.maxsteps(k) = static_cast<s64>(tend/dt[k]+0.5);
+    u32 shift = (k <= 4) ? 0 : 200;
     DO(i,1,nx)
-      output_file<<x[i]<<"\t"<<un1[i]<<"\n";
+      e.u()(i,k) = (i >= 30+shift && i <= 300+shift) ? 2.0 : 1.0;
     ENDDO
-  ELSE
-    cout<<"ERROR :: OUTPUT FILE NOT OPENED CORRECTLY"<<endl;
+  ENDDO
+
+  ftbs_ensemble_f fn = {dtdx};
+  s64 nsteps = e.run(2,fn);
+
+  cout<<"FTBS ensemble : "<<nk<<" members in "<<nsteps<<" steps"<<endl;
+  DO(k,1,nk)
+    f64 umax = 0.0, mass = 0.0;
+    DO(i,1,nx)
+      umax = std::max(umax,e.u()(i,k));
+      mass += e.u()(i,k)*dx;
+    ENDDO
+    cout<<"  member "<<k<<" : dt = "<<dt[k]<<", "<<e.steps(k)
+        <<" steps, max(u) = "<<umax<<", mass = "<<mass<<endl;
+  ENDDO
+}
+
+// Solves run_nonlinear_convection_test with the stencil engine, updating
+// only the blocks of 32 nodes next to a block that changed in the last
+// step. The flat parts ahead of and behind the hat are skipped, with the
+// same result as updating every node.
+void run_nonlinear_convection_active_test()
+{
+  PROFSCOPE("nonlinear convection active");
+  u32 i;
+  u32 nx = 801, nt = 3000;
+  f64 min_x = 0.0; f64 max_x = 2.0;
+  f64 dx = (max_x-min_x)/(nx-1);
+  f64 dtdx = 0.00015/dx;
+
+  // u is updated by active blocks, v everywhere
+  xtimelevels<af64> u(1,nx), v(1,nx);
+  DO(i,1,nx)
+    u.n()[i] = v.n()[i] = (i >= 30 && i <= 300) ? 2.0 : 1.0;
+  ENDDO
+  u.replicate(); v.replicate();
+
+  typedef xstpoint<f64,1> pt;
+  auto ftbs = xmkstencil(-1,0,[=](const pt& w) {
+    return w(0) - w(0)*dtdx*(w(0)-w(-1)); });
+  xactivity<1> act(32);
+  xstencil_run(ftbs,u,nt,act,2,nx);
+  xstencil_run(ftbs,v,nt,2,nx);
+
+  f64 diff = 0.0;
+  DO(i,1,nx)
+    diff = std::max(diff,ABS(u.n()[i]-v.n()[i]));
+  ENDDO
+  cout<<"FTBS active : "<<100.0*act.fraction()<<"% of the blocks updated in "
+      <<nt<<" steps, max |diff| = "<<diff<<endl;
+}
+
+// Solves the 1D nonlinear convection equation in conservation form,
+//
+//                     d(u)/dt + d(u*u/2)/dx = 0
+//
+// with the finite volume upwind scheme, on 200 cells refined twice around
+// the hat with subcycling (see xamr), and on 800 uniform cells with dt/4.
+// Prints the cells used on average, the L1 difference of the two, and the
+// mass, which the flux correction keeps the same on both.
+void run_nonlinear_convection_amr_test()
+{
+  PROFSCOPE("nonlinear convection amr");
+  u32 t;
+  u32 nt = 750;
+  f64 dt = 0.0006;
+  auto u0 = [](const f64* x) { return (x[0] > 0.075 && x[0] < 0.75) ?
+                                      2.0 : 1.0; };
+  // Upwind flux, for u > 0
+  auto flux = [](szt, f64 ul, f64) { return 0.5*ul*ul; };
+
+  // 200 cells refined twice, against 800 cells with dt/4
+  xamropts opt;
+  opt.block = 8; opt.tagtol = 0.02;
+  xgrid<1> g({200},{0.0},{2.0}), gf({800},{0.0},{2.0});
+  g.bc(0,0) = gf.bc(0,0) = xbc(DIRICHLET,1.0);
+  opt.maxlevel = 2;
+  xamr<1> amr(g,opt);
+  opt.maxlevel = 0;
+  xamr<1> uni(gf,opt);
+  amr.init(u0);
+  uni.init(u0);
+
+  f64 cells = 0.0;
+  DO(t,1,nt)
+    amr.step(dt,flux);
+    cells += amr.cells();
+  ENDDO
+  DO(t,1,4*nt)
+    uni.step(0.25*dt,flux);
+  ENDDO
+
+  xarraynd<f64,1> a = amr.sample(2), b = uni.sample(0);
+  f64 l1 = 0.0;
+  for(s64 i=1;i<=800;++i) l1 += ABS(a(i)-b(i));
+  cout<<"Upwind FV AMR : "<<amr.levels()<<" levels, "<<cells/nt
+      <<" cells on average for 800, L1 diff = "<<l1*gf.dx(0)
+      <<", mass = "<<amr.total()<<" ("<<uni.total()<<")"<<endl;
+}
+
+// Computes smooth profiles on the grid of the tests, a gaussian hat and a
+// tanh front, as whole array expressions of the vectorized functions, and
+// their largest difference to <cmath> in ULP, for both accuracies.
+void run_elementary_functions_test()
+{
+  PROFSCOPE("elementary functions");
+  u32 i;
+  u32 nx = 801;
+  f64 min_x = 0.0; f64 max_x = 2.0;
+  f64 dx = (max_x-min_x)/(nx-1);
+
+  af64 x(1,nx), u(1,nx), v(1,nx), w(1,nx);
+  DO(i,1,nx)
+    x[i] = min_x + dx*(i-1);
+  ENDDO
+  // Largest |u-v| in ULP of v
+  auto ulps = [&]() {
+    f64 m = 0.0;
+    DO(i,1,nx)
+      f64 a = ABS(v[i]);
+      m = std::max(m,ABS(u[i]-v[i])/(std::nextafter(a,2.0*a+1.0)-a));
+    ENDDO
+    return m;
+  };
+
+  u(1,nx) = 1.0 + xexp(-xsq((x(1,nx)-0.5)/0.1));
+  DO(i,1,nx) v[i] = 1.0 + std::exp(-xsq((x[i]-0.5)/0.1)); ENDDO
+  f64 e1 = ulps();
+  u(1,nx) = 1.0 + xexp<FAST>(-xsq((x(1,nx)-0.5)/0.1));
+  f64 e2 = ulps();
+  cout<<"Elementary functions, max ULP (ACCURATE, FAST) :"<<endl;
+  cout<<"  exp hat   : "<<e1<<", "<<e2<<endl;
+
+  u(1,nx) = 1.5 + 0.5*xtanh(20.0*(0.5-x(1,nx)));
+  DO(i,1,nx) v[i] = 1.5 + 0.5*std::tanh(20.0*(0.5-x[i])); ENDDO
+  e1 = ulps();
+  u(1,nx) = 1.5 + 0.5*xtanh<FAST>(20.0*(0.5-x(1,nx)));
+  e2 = ulps();
+  cout<<"  tanh front: "<<e1<<", "<<e2<<endl;
+
+  w(1,nx) = 1.0 + x(1,nx);
+  u(1,nx) = xlog(w(1,nx));
+  DO(i,1,nx) v[i] = std::log(w[i]); ENDDO
+  e1 = ulps();
+  u(1,nx) = xlog<FAST>(w(1,nx));
+  e2 = ulps();
+  cout<<"  log       : "<<e1<<", "<<e2<<endl;
+
+  u(1,nx) = xsin(10.0*x(1,nx));
+  DO(i,1,nx) v[i] = std::sin(10.0*x[i]); ENDDO
+  e1 = ulps();
+  u(1,nx) = xsin<FAST>(10.0*x(1,nx));
+  e2 = ulps();
+  cout<<"  sin       : "<<e1<<", "<<e2<<endl;
+
+  u(1,nx) = xcos(10.0*x(1,nx));
+  DO(i,1,nx) v[i] = std::cos(10.0*x[i]); ENDDO
+  e1 = ulps();
+  u(1,nx) = xcos<FAST>(10.0*x(1,nx));
+  e2 = ulps();
+  cout<<"  cos       : "<<e1<<", "<<e2<<endl;
+
+  u(1,nx) = xpow(w(1,nx),2.5);
+  DO(i,1,nx) v[i] = std::pow(w[i],2.5); ENDDO
+  e1 = ulps();
+  u(1,nx) = xpow<FAST>(w(1,nx),2.5);
+  e2 = ulps();
+  cout<<"  pow       : "<<e1<<", "<<e2<<endl;
+
+  // ACCURATE xpow of special values and of y*log(x) beyond the range of
+  // exp, which must give the inf, 0, 1 or NaN of std::pow, and the finite
+  // results to 1 ULP (EPS)
+  auto agree = [](f64 r, f64 e, f64 eps) {
+    return r == e || (r != r && e != e) ||
+           (std::isfinite(e) && ABS(r-e) <= eps*ABS(e));
+  };
+  const f64 inf = std::numeric_limits<f64>::infinity();
+  const f64 px[] = {2.0,0.5,1e308,-1.0,1.0,-2.0,-0.5,0.0,-0.0,inf,-inf,
+                    std::nan(""),1.0+1e-15,1e-310};
+  const f64 py[] = {1e308,-1e308,1e300,-1e300,3e19,3.0,-3.0,2.5,0.0,inf,
+                    -inf,std::nan("")};
+  u32 nbad = 0, npow = 0;
+  for(f64 a : px)
+    for(f64 b : py) {
+      const f64 r = xpow(a,b), e = std::pow(a,b);
+      const f32 rf = xpow(f32(a),f32(b)), ef = std::pow(f32(a),f32(b));
+      nbad += !agree(r,e,std::numeric_limits<f64>::epsilon());
+      nbad += !agree(rf,ef,std::numeric_limits<f32>::epsilon());
+      npow += 2;
+    }
+  cout<<"  pow of special values : "<<nbad<<" of "<<npow
+      <<" differ from std::pow"<<endl;
+}
+
+// Computes the new u of a step in arrays of the scratch arena, and moves or
+// swaps them into arrays of the heap, the way a time loop keeps the new
+// time level. The arena memory is released at the end of the step, and
+// reused by the next scratch arrays, so the heap arrays must have copied
+// the values rather than taken the arena memory.
+void run_scratch_move_test()
+{
+  PROFSCOPE("scratch move");
+  u32 i,j;
+  u32 nx = 801;
+  af64 u(1,nx,1.0), v(1,nx,1.0);
+  a2f64 w(4,nx);
+  w.fill(1.0);
+  {
+    xscratchscope ws;
+    af64 unew(xscratch(),1,nx,2.0), vnew(xscratch(),1,nx,3.0);
+    a2f64 wnew(xscratch(),4,nx);
+    wnew.fill(4.0);
+    u = std::move(unew);
+    v.swap(vnew);
+    w = std::move(wnew);
+  }
+  // The next step overwrites the memory of the last one
+  xscratchscope ws;
+  af64 next(xscratch(),1,4*nx,7.0);
+  a2f64 next2(xscratch(),8,nx);
+  next2.fill(7.0);
+
+  u32 nbad = 0;
+  DO(i,1,nx)
+    nbad += (u[i] != 2.0) + (v[i] != 3.0);
+    DO(j,1,4)
+      nbad += (w(j,i) != 4.0);
+    ENDDO
+  ENDDO
+  cout<<"Scratch moves : "<<nbad<<" values lost, arrays on the "
+      <<(u.arena() || v.arena() || w.arena() ? "arena" : "heap")<<endl;
+}
+
+// No. of the nx matrices of N*N, a(N*N,nx), whose batched determinant,
+// inverse or solution differs from Gaussian elimination with partial
+// pivoting by more than TOL, relative to the largest entry of the result
+xtem(szt N) u32 small_matrices_errors(const a2f64& a, f64 tol)
+{
+  szt r,c,p;
+  const u32 nx = a.size(1);
+  a2f64 inv(N*N,nx), b(N,nx), x(N,nx);
+  af64 det(1,nx);
+  b.fill(1.0);
+  xbatchdet<N>(a,det);
+  xbatchinv<N>(a,inv);
+  xbatchsolve<N>(a,b,x);
+
+  u32 nbad = 0;
+  for(u32 k=1;k<=nx;++k) {
+    // [m | e] is reduced to [U | L^-1 P^T], then to [I | a^-1]
+    f64 m[N][N], e[N][N], d = 1.0;
+    for(r=0;r<N;++r)
+      for(c=0;c<N;++c) {
+        m[r][c] = a(r*N+c+1,k);
+        e[r][c] = (r == c);
+      }
+    for(c=0;c<N;++c) {
+      p = c;
+      for(r=c+1;r<N;++r) if(ABS(m[r][c]) > ABS(m[p][c])) p = r;
+      if(p != c) {
+        std::swap(m[p],m[c]); std::swap(e[p],e[c]); d = -d;
+      }
+      d *= m[c][c];
+      for(r=c+1;r<N;++r) {
+        const f64 l = m[r][c]/m[c][c];
+        for(szt j=0;j<N;++j) { m[r][j] -= l*m[c][j]; e[r][j] -= l*e[c][j]; }
+      }
+    }
+    for(c=N;c-->0;) {
+      for(szt j=0;j<N;++j) {
+        for(r=c+1;r<N;++r) e[c][j] -= m[c][r]*e[r][j];
+        e[c][j] /= m[c][c];
+      }
+    }
+    // Largest difference and entry of the inverse, and of the solution
+    f64 di = 0.0, mi = 0.0, dx = 0.0, mx = 0.0;
+    for(r=0;r<N;++r) {
+      f64 s = 0.0;
+      for(c=0;c<N;++c) {
+        di = std::max(di,ABS(inv(r*N+c+1,k)-e[r][c]));
+        mi = std::max(mi,ABS(e[r][c]));
+        s += e[r][c];
+      }
+      dx = std::max(dx,ABS(x(r+1,k)-s));
+      mx = std::max(mx,ABS(s));
+    }
+    nbad += (ABS(det[k]-d) > tol*ABS(d)) + (di > tol*mi) + (dx > tol*mx);
+  }
+  return nbad;
+}
+
+// Builds a matrix of N*N for every point of the grid of the tests, like the
+// Jacobians of the cells of a mesh : diagonally dominant, with entries
+// varying smoothly along x. Their determinants, inverses and solutions of
+// a*x = 1 come from the SIMD kernels for all but the last points, which
+// take the scalar loop, and are compared to Gaussian elimination.
+void run_small_matrices_test()
+{
+  PROFSCOPE("small matrices");
+  u32 i;
+  u32 nx = 801;
+  f64 dx = 2.0/(nx-1);
+  a2f64 a2(4,nx), a3(9,nx), a4(16,nx);
+  DO(i,1,nx)
+    const f64 x = dx*(i-1);
+    for(u32 e=1;e<=16;++e) {
+      const f64 v = std::cos(x*e + 0.3*e*e);
+      if(e <= 4)  a2(e,i) = v + ((e-1) % 3 == 0 ? 3.0 : 0.0);
+      if(e <= 9)  a3(e,i) = v + ((e-1) % 4 == 0 ? 4.0 : 0.0);
+      a4(e,i) = v + ((e-1) % 5 == 0 ? 5.0 : 0.0);
+    }
+  ENDDO
+  const f64 tol = 1e-13;
+  const u32 nbad = small_matrices_errors<2>(a2,tol) +
+                   small_matrices_errors<3>(a3,tol) +
+                   small_matrices_errors<4>(a4,tol);
+  cout<<"Small matrices : "<<nbad<<" of "<<9*nx<<" det, inv and solve of"
+      <<" 2x2 to 4x4 differ from elimination"<<endl;
+}
+
+// Solves run_nonlinear_convection_test to the same time in 50 backward
+// Euler upwind steps, linearized with u at time n, whose dt is 7.2 times
+// the CFL limit of FTBS. Every step is solved with BiCGSTAB and ILU(0),
+// and with GMRES and Jacobi, which must agree. The last u is then smoothed
+// by an implicit diffusion step, alone with CG on an xcsr, and as 2
+// coupled copies with CG on an xbsr of 2*2 blocks and with BiCGSTAB.
+void run_implicit_convection_test()
+{
+  PROFSCOPE("implicit convection");
+  u32 i,t;
+  u32 nx = 801;
+  u32 nt = 50;
+  f64 dx = 2.0/(nx-1);
+  f64 dt = 0.45/nt;
+
+  xtimelevels<af64> u(1,nx);
+  af64 ftbs(1,nx,1.0), fnew(1,nx), ug(1,nx);
+  u.n() = 1.0;
+  DO(i,30,300)
+    u.n()[i] = 2.0; ftbs[i] = 2.0;
+  ENDDO
+  u.replicate();
+  fnew[1] = 1.0;
+  // The explicit solution of run_nonlinear_convection_test
+  DO(t,1,3000)
+    fnew(2,nx) = ftbs(2,nx) - ftbs(2,nx)*(0.00015/dx)*
+                 (ftbs(2,nx)-ftbs(1,nx-1));
+    ftbs.swap(fnew);
+  ENDDO
+
+  xkrylovopts opt;
+  opt.tol = 1e-12;
+  xcoo<f64> c(1,nx);
+  xcsr<f64> A;
+  s64 itb = 0, itg = 0;
+  bool conv = true;
+  f64 dg = 0.0;
+  DO(t,1,nt)
+    c.clear();
+    c.add(1,1,1.0);
+    DO(i,2,nx)
+      f64 s = dt/dx*u.n()[i];
+      c.add(i,i-1,-s); c.add(i,i,1.0+s);
+    ENDDO
+    IF(t == 1) A.assemble(c); ELSE A.update(c); ENDIF
+    u.np1() = u.n(); ug = u.n();
+    xkrylovinfo ib = xbicgstab(A,u.n(),u.np1(),xilu0<f64>(A),opt);
+    xkrylovinfo ig = xgmres(A,u.n(),ug,xjacobi<f64>(A),opt);
+    conv = conv && ib.converged && ig.converged;
+    itb = std::max(itb,ib.iters); itg = std::max(itg,ig.iters);
+    ug = ug - u.np1();
+    dg = std::max(dg,xmaxabs(ug));
+    u.advance();
+  ENDDO
+  f64 l1 = 0.0, umin = 2.0, umax = 1.0;
+  DO(i,1,nx)
+    l1 += ABS(u.n()[i]-ftbs[i])*dx;
+    umin = std::min(umin,u.n()[i]); umax = std::max(umax,u.n()[i]);
+  ENDDO
+  cout<<"Implicit upwind : "<<nt<<" steps of dt = "<<dt<<" ("<<dt/dx*2.0
+      <<" times the CFL limit), u in ["<<umin<<", "<<umax
+      <<"], L1 diff to FTBS = "<<l1<<endl;
+  cout<<"  BiCGSTAB+ILU(0) "<<itb<<", GMRES+Jacobi "<<itg
+      <<" iterations at most, largest difference "<<dg<<endl;
+
+  // (1 - k*d2/dx2) w = u, with dw/dx = 0 at the ends so that the matrix
+  // is symmetric positive definite, and for 2 coupled copies, with the
+  // second derivatives of the copies mixed by 0.1
+  const f64 k = 1e-4/(dx*dx);
+  xcoo<f64> cd(1,nx), c2(1,2*nx);
+  DO(i,1,nx)
+    for(s64 q=-1;q<=1;q+=2) {
+      const s64 j = i+q;
+      if(j < 1 || j > s64(nx)) continue;
+      // Entries (i,j) and (i,i) of -k*d2/dx2, and of 1
+      const f64 l[2] = {-k,k};
+      const s64 col[2] = {j,i};
+      for(s64 e=0;e<2;++e) {
+        cd.add(i,col[e],l[e]);
+        for(s64 a=0;a<2;++a)
+          for(s64 b=0;b<2;++b)
+            c2.add(2*i-1+a,2*col[e]-1+b,a == b ? l[e] : 0.1*l[e]);
+      }
+    }
+    cd.add(i,i,1.0);
+    c2.add(2*i-1,2*i-1,1.0); c2.add(2*i,2*i,1.0);
+  ENDDO
+  xcsr<f64> D(cd), D2csr(c2);
+  xbsr<f64,2> D2(D2csr);
+  af64 w(1,nx,0.0), b2(1,2*nx), w2(1,2*nx,0.0), w3(1,2*nx,0.0);
+  DO(i,1,nx)
+    b2[2*i-1] = u.n()[i]; b2[2*i] = u.n()[i];
+  ENDDO
+  xkrylovinfo ic = xcg(D,u.n(),w,xjacobi<f64>(D),opt);
+  xkrylovinfo ic2 = xcg(D2,b2,w2,xjacobi<f64>(D2),opt);
+  xkrylovinfo ib2 = xbicgstab(D2,b2,w3,xilu0<f64>(D2csr),opt);
+  conv = conv && ic.converged && ic2.converged && ib2.converged;
+  // By symmetry the copies are equal, and both solvers give them
+  f64 d2 = 0.0;
+  DO(i,1,nx)
+    d2 = std::max(d2,ABS(w2[2*i-1]-w2[2*i])+ABS(w3[2*i]-w2[2*i]));
+  ENDDO
+  cout<<"  CG+Jacobi "<<ic.iters<<" (xcsr), "<<ic2.iters
+      <<" (xbsr), BiCGSTAB+ILU(0) "<<ib2.iters<<" (xbsr) iterations,"
+      <<" copies differ by "<<d2<<", "<<(conv ? "all" : "NOT all")
+      <<" converged"<<endl;
+}
+
+// Value of cell k, from 1 to 400 steps of a linear congruential generator,
+// so that the cost varies 400 times from cell to cell
+s64 cell_work(s64 k)
+{
+  u64 h = u64(k);
+  const s64 m = 1 + (k*7919) % 400;
+  for(s64 q=0;q<m;++q) h = h*6364136223846793005ull+1442695040888963407ull;
+  return s64(h >> 40);
+}
+
+// Sum of cell_work(lo) to cell_work(hi), the first half in a task down to
+// 256 cells, so that every level spawns, steals and waits for its group
+s64 task_sum(xtaskpool& pool, s64 lo, s64 hi)
+{
+  IF(hi-lo < 256)
+    s64 s = 0;
+    for(s64 k=lo;k<=hi;++k) s += cell_work(k);
+    return s;
   ENDIF
+  const s64 mid = lo+(hi-lo)/2;
+  s64 a = 0;
+  xtaskgroup g(pool);
+  SPAWN(g) a = task_sum(pool,lo,mid); ENDSPAWN
+  const s64 b = task_sum(pool,mid+1,hi);
+  SYNC(g)
+  return a+b;
+}
+
+// Computes the cells of cell_work serially, with TASKDO, with a TASKDO in
+// every block of a PARDO, and with SPAWN, and sums them with SPAWN, on a
+// pool of 4 threads whose 3 workers steal whatever the no. of CPUs.
+// The sums are of integers, so every result must be the serial one exactly.
+void run_tasks_test()
+{
+  PROFSCOPE("tasks");
+  s64 i,b;
+  const s64 n = 100000, nb = 8;
+  std::vector<s64> ser(n+1,0), tdo(n+1,0), nest(n+1,0);
+  s64 sum = 0;
+  DO(i,1,n)
+    ser[i] = cell_work(i); sum += ser[i];
+  ENDDO
+  TASKDO(i,1,n)
+    tdo[i] = cell_work(i);
+  ENDTASKDO
+  PARDO(b,1,nb)
+    TASKDO(i,(b-1)*n/nb+1,b*n/nb)
+      nest[i] = cell_work(i);
+    ENDTASKDO
+  ENDPARDO
+  xtaskpool pool(4);
+  const s64 psum = task_sum(pool,1,n);
+  // A worker spawns 1000 tasks at once, more than its deque holds at
+  // first. This thread waits for them to be spawned without running tasks
+  // itself, so that a worker runs the task that spawns them.
+  std::vector<s64> many(n+1,0);
+  std::atomic<bool> spawned(false);
+  xtaskgroup g(pool), h(pool);
+  SPAWN(g)
+    for(s64 c=0;c<n/100;++c) {
+      SPAWNCOPY(h,c)
+        for(s64 k=c*100+1;k<=c*100+100;++k) many[k] = cell_work(k);
+      ENDSPAWN
+    }
+    spawned = true;
+  ENDSPAWN
+  while(!spawned.load()) std::this_thread::yield();
+  SYNC(h)
+  SYNC(g)
+
+  s64 nbad = 0;
+  DO(i,1,n)
+    nbad += (tdo[i] != ser[i]) + (nest[i] != ser[i]) + (many[i] != ser[i]);
+  ENDDO
+  cout<<"Tasks : "<<nbad<<" of "<<3*n<<" cells of TASKDO, TASKDO in PARDO"
+      <<" and SPAWN, and the SPAWN sum, "<<(psum == sum ? "equal" : "DIFFER")
+      <<" to the serial loop"<<endl;
+}
+
+// Computes dot and cross products, determinants, inverses and solutions of
+// small vectors and matrices whose results are known, and prints one
+// matrix with DBGARR2. With -std=c++14 or later, the same are also
+// checked at compile time.
+void run_small_vectors_test()
+{
+  PROFSCOPE("small vectors");
+#if __cplusplus >= 201402L
+  constexpr sv3f64 ca(1.0,2.0,3.0), cb(4.0,5.0,6.0);
+  static_assert(xdot(ca,cb) == 32.0,"xdot at compile time");
+  static_assert(xcross(ca,cb)[0] == -3.0 && xcross(ca,cb)[1] == 6.0 &&
+                xcross(ca,cb)[2] == -3.0,"xcross at compile time");
+  constexpr sm3f64 R(0.0,-1.0,0.0,
+                     1.0, 0.0,0.0,
+                     0.0, 0.0,1.0);
+  static_assert(xdet(R) == 1.0,"xdet at compile time");
+  constexpr sm2f64 D(2.0,0.0,
+                     0.0,4.0);
+  static_assert(xinv(D)(0,0) == 0.5 && xinv(D)(1,1) == 0.25 &&
+                xinv(D)(0,1) == 0.0,"xinv at compile time");
+#endif
+  u32 nbad = 0, nchk = 0;
+  auto check = [&](f64 r, f64 e) {
+    nbad += !(ABS(r-e) <= 1e-14*std::max(1.0,ABS(e))); ++nchk;
+  };
+  const sv3f64 a(1.0,2.0,3.0), b(4.0,5.0,6.0);
+  const sv3f64 c = xcross(a,b);
+  check(xdot(a,b),32.0);
+  check(c[0],-3.0); check(c[1],6.0); check(c[2],-3.0);
+  check(xdot(c,a),0.0); check(xdot(c,b),0.0);
+  check(xcross(sv2f64(1.0,2.0),sv2f64(3.0,4.0)),-2.0);
+
+  // det 10, inverse (0.6,-0.7,-0.2,0.4)
+  const sm2f64 A(4.0,7.0,
+                 2.0,6.0);
+  const sm2f64 Ai = xinv(A);
+  check(xdet(A),10.0);
+  check(Ai(0,0),0.6); check(Ai(0,1),-0.7);
+  check(Ai(1,0),-0.2); check(Ai(1,1),0.4);
+  // det 4*5 - 1*2 = 18, and M*inv(M) = I
+  const sm3f64 M(4.0,1.0,0.0,
+                 1.0,3.0,1.0,
+                 0.0,1.0,2.0);
+  const sm3f64 I3 = M*xinv(M);
+  check(xdet(M),18.0);
+  for(szt r=0;r<3;++r)
+    for(szt q=0;q<3;++q) check(I3(r,q),r == q ? 1.0 : 0.0);
+  // Upper triangular, det 1*2*3*4, and the solution of T*x = T*(1,1,1,1)
+  const sm4f64 T(1.0,5.0,6.0,7.0,
+                 0.0,2.0,8.0,9.0,
+                 0.0,0.0,3.0,1.0,
+                 0.0,0.0,0.0,4.0);
+  const sv4f64 x = xsolve(T,T*sv4f64(1.0,1.0,1.0,1.0));
+  check(xdet(T),24.0);
+  for(szt r=0;r<4;++r) check(x[r],1.0);
 
-  // Close all open files
-  input_file.close();
-  output_file.close();
+  cout<<"Small vectors : "<<nbad<<" of "<<nchk<<" results differ from the"
+      <<" known values"<<endl;
+  DBGARR2(A);
 }
 
+// Uniform values in [lo,hi), from a 64 bit LCG, the same on every machine
+struct banded_random
+{
+  u64 s;
+  f64 operator()(f64 lo, f64 hi)
+  {
+    s = s*6364136223846793005ULL + 1442695040888963407ULL;
+    return lo + (hi-lo)*f64(s>>11)/9007199254740992.0;
+  }
+};
+
+// Solves random diagonally dominant systems and prints the largest residual
+// |A*x-d| of each : one tridiagonal system long enough for SPIKE to split
+// it over 4 threads, solved serially and with SPIKE, then 2048 interleaved
+// periodic tridiagonal and 2048 pentadiagonal systems of 64 unknowns.
+// The diagonal is |off diagonals| + 0.5 to 1.5, and d is in [-1,1].
+void run_banded_test()
+{
+  PROFSCOPE("banded");
+  banded_random rnd = {12345};
+  s64 i, j, k;
+
+  // One long system, the serial Thomas algorithm and SPIKE
+  const s64 n = 4*XBANDED_MIN_ROWS+7;
+  af64 a(1,n), b(1,n), c(1,n), d(1,n);
+  DO(i,1,n)
+    a(i) = rnd(-1.0,1.0); c(i) = rnd(-1.0,1.0);
+    b(i) = ABS(a(i)) + ABS(c(i)) + rnd(0.5,1.5);
+    d(i) = rnd(-1.0,1.0);
+  ENDDO
+  auto resid = [&](const af64& x) {
+    f64 r = 0.0;
+    DO(i,1,n)
+      f64 s = b(i)*x(i) - d(i);
+      if(i > 1) s += a(i)*x(i-1);
+      if(i < n) s += c(i)*x(i+1);
+      r = std::max(r,ABS(s));
+    ENDDO
+    return r;
+  };
+  af64 cs = c, x = d;
+  xtridiag(a,b,cs,x);
+  const f64 rtri = resid(x);
+  cs = c; x = d;
+  xtridiag_spike(a,b,cs,x);
+  const f64 rspike = resid(x);
+  const s64 nspike = std::min<s64>(xnthreads(),n/XBANDED_MIN_ROWS);
+
+  // m interleaved systems of nr unknowns, the columns of (nr,m) arrays
+  const s64 nr = 64, m = 2048;
+  a2f64 pa(nr,m), pb(nr,m), pc(nr,m), pd(nr,m);
+  DO(i,1,nr)
+    DO(k,1,m)
+      pa(i,k) = rnd(-1.0,1.0); pc(i,k) = rnd(-1.0,1.0);
+      pb(i,k) = ABS(pa(i,k)) + ABS(pc(i,k)) + rnd(0.5,1.5);
+      pd(i,k) = rnd(-1.0,1.0);
+    ENDDO
+  ENDDO
+  a2f64 pcs = pc, px = pd;
+  xtridiag_cyclic(pa,pb,pcs,px);
+  // Row 1 and row nr wrap around through a(1) and c(nr)
+  f64 rcyc = 0.0;
+  DO(i,1,nr)
+    const s64 il = i > 1 ? i-1 : nr, ir = i < nr ? i+1 : 1;
+    DO(k,1,m)
+      const f64 s = pa(i,k)*px(il,k) + pb(i,k)*px(i,k) +
+                    pc(i,k)*px(ir,k) - pd(i,k);
+      rcyc = std::max(rcyc,ABS(s));
+    ENDDO
+  ENDDO
+
+  // Diagonal j = -2 to 2 of row i of system k in band(j+3,i,k)
+  xarraynd<f64,3> band(5,nr,m);
+  DO(i,1,nr)
+    DO(k,1,m)
+      f64 off = 0.0;
+      DO(j,-2,2)
+        band(j+3,i,k) = j != 0 && i+j >= 1 && i+j <= nr ? rnd(-1.0,1.0)
+                                                        : 0.0;
+        off += ABS(band(j+3,i,k));
+      ENDDO
+      band(3,i,k) = off + rnd(0.5,1.5);
+    ENDDO
+  ENDDO
+  xarraynd<f64,3> lu = band;
+  px = pd;
+  xbanded<2,2>(lu,px);
+  f64 rpenta = 0.0;
+  DO(i,1,nr)
+    DO(k,1,m)
+      f64 s = -pd(i,k);
+      DO(j,-2,2)
+        if(i+j >= 1 && i+j <= nr) s += band(j+3,i,k)*px(i+j,k);
+      ENDDO
+      rpenta = std::max(rpenta,ABS(s));
+    ENDDO
+  ENDDO
+
+  ASSERT(rtri < 1e-12 && rspike < 1e-12 && rcyc < 1e-12 && rpenta < 1e-12,
+         "Banded residuals "<<rtri<<" "<<rspike<<" "<<rcyc<<" "<<rpenta);
+  cout<<"Banded : max |A*x-d| of "<<rtri<<" tridiagonal, "<<rspike
+      <<" with SPIKE on "<<std::max<s64>(nspike,1)<<" threads, "<<rcyc
+      <<" periodic and "<<rpenta<<" pentadiagonal"<<endl;
+}
@@ -42,7 +42,49 @@
 #include <stdio.h>
 #include <iostream>
 #include <vector>
+#include <string>
 #include <limits>
+#include <cmath>
+#include <functional>
+#include <cstdlib>
+#include <new>
+#include <utility>
+#include <algorithm>
+#include <type_traits>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+#include <deque>
+#include <chrono>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#endif
+#include <cstdio>
+#include <cstring>
+#include <numeric>
+#include <fstream>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+#if defined(PROFILE) && defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#endif
 
 
 //---------------------------------------------------------------------------//
@@ -87,10 +129,11 @@
 
 //---------------------------------------------------------------------------//
 // Print the vector VEC
+// NOTE : Works for VEC(...) and for ARR(...) with any lower bound.
 //---------------------------------------------------------------------------//
   #define DBGVEC(VEC) \
   STREAM<<#VEC<<"\t:\t["; \
-  for(szt i=0;i<(VEC).size();++i) { \
+  for(s64 i=xlbound(VEC);i<=xubound(VEC);++i) { \
     STREAM<<(VEC)[i]<<","; \
   } \
   STREAM<<"]"<<NL;
@@ -117,12 +160,36 @@
 //---------------------------------------------------------------------------//
   #define DBGARR(ARR,START,END) \
   STREAM<<#ARR<<"\t:\t["; \
-  for(szt i=(START);i<=END;++i){ \
+  for(s64 i=(START);i<=(END);++i){ \
     STREAM<<(ARR)[i]<<","; \
   } \
   STREAM<<"]"<<NL;
 
   #define xdbgarr(ARR,START,END) DBGARR((ARR),(START),(END))
+
+//---------------------------------------------------------------------------//
+// Abort with the message MSG if COND is false
+//---------------------------------------------------------------------------//
+// USE :
+// >> ASSERT(a.size() == b.size(),"size mismatch : "<<a.size()<<","<<b.size());
+//---------------------------------------------------------------------------//
+  #define ASSERT(COND,MSG) \
+  do { \
+    if(!(COND)) { \
+      STREAM<<"ERROR :: "<<MSG<<NL; \
+      std::abort(); \
+    } \
+  } while(0)
+
+  #define xassert(COND,MSG) ASSERT((COND),MSG)
+
+//---------------------------------------------------------------------------//
+// Print the 2D array ARR2(...) row by row, and any 2D/3D/4D array or view
+//---------------------------------------------------------------------------//
+  #define DBGARR2(ARR) xprintnd(STREAM,#ARR,(ARR)); STREAM<<std::flush;
+  #define xdbgarr2(ARR) DBGARR2((ARR))
+  #define DBGARRN(ARR) xprintnd(STREAM,#ARR,(ARR)); STREAM<<std::flush;
+  #define xdbgarrn(ARR) DBGARRN((ARR))
 #endif
 
 // If DEBUG is not defined then do not use the debugging features
@@ -141,6 +208,12 @@
   #define xbdgvec2(VEC2)
   #define DBGARR(ARR,START,END)
   #define xdbgarr(ARR,START,END)
+  #define ASSERT(COND,MSG) do {} while(0)
+  #define xassert(COND,MSG) do {} while(0)
+  #define DBGARR2(ARR)
+  #define xdbgarr2(ARR)
+  #define DBGARRN(ARR)
+  #define xdbgarrn(ARR)
 #endif
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -234,8 +307,9 @@
 // Required since C++ has different absolute function for different types.
 // And we would like to use a single one and not worry about the type.
 // Moreover this is better for templated operations .
+// NOTE : xabs is a function (see Mathematics) so that it can be overloaded
+// for array expressions.
 #define   ABS std::abs
-#define  xabs std::abs
 #define  FABS std::fabs
 #define xfabs std::fabs
 
@@ -255,6 +329,16 @@
 // Language extensions
 ///////////////////////////////////////////////////////////////////////////////
 
+//---------------------------------------------------------------------------//
+// constexpr for functions with loops and local variables, which C++11 does
+// not allow : constexpr with -std=c++14 or later, inline otherwise
+//---------------------------------------------------------------------------//
+#if __cplusplus >= 201402L
+#define XCONSTEXPR14 constexpr
+#else
+#define XCONSTEXPR14 inline
+#endif
+
 //---------------------------------------------------------------------------//
 // The ending of a command block.
 // NOTE : END,ENDIF,ENDDO etc are all the same.
@@ -419,11 +503,24 @@
 // OpenMP support
 // WARNING : TESTING AND UNSTABLE FOR NOW ...
 ///////////////////////////////////////////////////////////////////////////////
+// NOTE : For parallel loops without OpenMP see PARDO in "Parallel loops".
 //---------------------------------------------------------------------------//
 // Pragmas
 //---------------------------------------------------------------------------//
 #define xpragma(...) _Pragma( __VA_ARGS__ )
 
+//---------------------------------------------------------------------------//
+// Unroll the next loop completely, for short loops of compile time length
+// (blocks of sparse matrices, small vectors), which -O2 keeps as loops
+//---------------------------------------------------------------------------//
+#if defined(__clang__)
+#define XUNROLL _Pragma("unroll")
+#elif defined(__GNUC__) && __GNUC__ >= 8
+#define XUNROLL _Pragma("GCC unroll 16")
+#else
+#define XUNROLL
+#endif
+
 //---------------------------------------------------------------------------//
 // Multi-line OpenMP command : requires END to brace in the control block
 //---------------------------------------------------------------------------//
@@ -473,9 +570,41 @@
   _Pragma(#PRG) \
   CMD
 
+///////////////////////////////////////////////////////////////////////////////
+// Array expression base
+///////////////////////////////////////////////////////////////////////////////
+//---------------------------------------------------------------------------//
+// Every array, view and whole array expression E derives from xexpr<E>.
+// See "Array expressions" for the operations on them.
+//---------------------------------------------------------------------------//
+xtem(xtn E)
+struct xexpr
+{
+  const E& self() const { return static_cast<const E&>(*this); }
+};
+
+// Is TYPE an array expression ?
+xtem(xtn TYPE)
+struct xisexpr : std::is_base_of<xexpr<TYPE>,TYPE> {};
+
+// Is TYPE a small vector or matrix ? See "Small vectors and matrices".
+xtem(xtn TYPE, szt N) struct xsvec;
+xtem(xtn TYPE, szt M, szt N) struct xsmat;
+xtem(xtn TYPE) struct xissmall : std::false_type {};
+xtem(xtn TYPE, szt N) struct xissmall<xsvec<TYPE,N> > : std::true_type {};
+xtem(xtn TYPE, szt M, szt N)
+struct xissmall<xsmat<TYPE,M,N> > : std::true_type {};
+
+// RET if TYPE is a scalar (i.e. not an array expression or a small vector)
+xtem(xtn TYPE, xtn RET)
+struct xifscalar : std::enable_if<!xisexpr<TYPE>::value &&
+                                  !xissmall<TYPE>::value,RET> {};
+
 ///////////////////////////////////////////////////////////////////////////////
 // Mathematics
 ///////////////////////////////////////////////////////////////////////////////
+// NOTE : The scalar functions here are disabled for array expressions, which
+// have their own overloads in "Array expressions".
 //---------------------------------------------------------------------------//
 // Square of the given expression
 //---------------------------------------------------------------------------//
@@ -487,7 +616,7 @@
 // 25
 //---------------------------------------------------------------------------//
 template<typename t>
-inline t xsq(t x)
+inline typename xifscalar<t,t>::type xsq(t x)
 {
     return x*x;
 }
@@ -503,11 +632,27 @@ inline t xsq(t x)
 // 125
 //---------------------------------------------------------------------------//
 template<typename t>
-inline t xcu(t x)
+inline typename xifscalar<t,t>::type xcu(t x)
 {
   return x*x*x;
 }
 
+//---------------------------------------------------------------------------//
+// Absolute value of the given expression
+//---------------------------------------------------------------------------//
+// USE :
+// >> f64 x = -2.5;
+// >> cout<<xabs(x)<<endl;
+//
+// RESULT : Should print,
+// 2.5
+//---------------------------------------------------------------------------//
+template<typename t>
+inline typename xifscalar<t,t>::type xabs(t x)
+{
+  return std::abs(x);
+}
+
 //---------------------------------------------------------------------------//
 // Extracts the  sign of a number
 //---------------------------------------------------------------------------//
@@ -551,7 +696,7 @@ int xsgn(TYPE X, std::false_type is_signed)
 // Calls xsgn(TYPE X,std::true_type) if x is of a signed type
 // Calls xsgn(TYPE X,std::false_type) if x is of an unsigned type
 xtem(xtn TYPE) inline constexpr
-int xsgn(TYPE X)
+typename xifscalar<TYPE,int>::type xsgn(TYPE X)
 {
   return xsgn(X, std::is_signed<TYPE>());
 }
@@ -562,7 +707,7 @@ int xsgn(TYPE X)
 // C  D
 //---------------------------------------------------------------------------//
 template<typename t>
-inline t xdet2x2(const t& A,const t& B,
+inline constexpr t xdet2x2(const t& A,const t& B,
                  const t& C,const t& D)
 {
   return (A)*(D) - (B)*(C);
@@ -575,7 +720,7 @@ inline t xdet2x2(const t& A,const t& B,
 // I J K
 //---------------------------------------------------------------------------//
 template<typename t>
-inline t xdet3x3(const t& A,const t& B,const t& C,
+inline constexpr t xdet3x3(const t& A,const t& B,const t& C,
                  const t& D,const t& E,const t& F,
                  const t& I,const t& J,const t& K)
 {
@@ -589,12 +734,14 @@ inline t xdet3x3(const t& A,const t& B,const t& C,
 // E F G H
 // I J K L
 // M N O P
+// NOTE : constexpr like xdet2x2 and xdet3x3 if the arguments are.
+// For many matrices use xbatchdet<4> (see Small matrices).
 //---------------------------------------------------------------------------//
 #define DET4X4(A,B,C,D,E,F,G,H,I,J,K,L,M,N,O,P) \
-        ( ((A)*(DET3X3((F),(G),(H),(J),(K),(L),(N),(O),(P)))) - \
-          ((B)*(DET3X3((E),(G),(H),(I),(K),(L),(M),(O),(P)))) + \
-          ((C)*(DET3X3((E),(F),(H),(I),(J),(L),(M),(N),(P)))) - \
-          ((D)*(DET3X3((E),(F),(G),(I),(J),(K),(M),(N),(O))))   \
+        ( ((A)*(xdet3x3((F),(G),(H),(J),(K),(L),(N),(O),(P)))) - \
+          ((B)*(xdet3x3((E),(G),(H),(I),(K),(L),(M),(O),(P)))) + \
+          ((C)*(xdet3x3((E),(F),(H),(I),(J),(L),(M),(N),(P)))) - \
+          ((D)*(xdet3x3((E),(F),(G),(I),(J),(K),(M),(N),(O))))   \
         )
 #define xdet4x4(A,B,C,D,E,F,G,H,I,J,K,L,M,N,O,P) \
         DET4X4((A),(B),(C),(D),(E),(F),(G),(H),(I),(J),(K),(L),(M),(N),(O),(P))
@@ -608,6 +755,9 @@ typedef uint16_t        u16;
 typedef int32_t         s32;
 typedef uint32_t        u32;
 
+typedef int64_t         s64;
+typedef uint64_t        u64;
+
 typedef float           f32;
 typedef double          f64;
 
@@ -626,6 +776,10551 @@ typedef std::vector<std::vector<s32> >   v2s32;
 typedef std::vector<std::vector<u32> >   v2u32;
 typedef std::vector<std::vector<f32> >   v2f32;
 typedef std::vector<std::vector<f64> >   v2f64;
+///////////////////////////////////////////////////////////////////////////////
+// Profiling
+///////////////////////////////////////////////////////////////////////////////
+//---------------------------------------------------------------------------//
+// Instrumentation of the hot paths, active only if PROFILE is defined
+// before including scicpp.hpp. Otherwise, like the debugging macros, every
+// macro is empty and the instrumentation can stay in production code.
+// + PROFSCOPE(NAME)   : Times the rest of the enclosing block as region NAME
+// + PROFREGION(NAME)  : Times the block up to ENDPROFREGION as region NAME
+// + PROFCOUNT(NAME,N) : Adds N to the event counter NAME
+// + PROFBYTES(N)      : Adds N bytes moved to the current region, for GB/s
+// + PROFFLOPS(N)      : Adds N flops to the current region, for GFLOP/s
+// + PROFREPORT(OS)    : Prints the report to the stream OS
+// + PROFFOLDED(PATH)  : Writes the folded stacks to PATH, for flame graphs
+// Regions nest, and are kept as a call tree, separately by every thread,
+// so nothing is locked or shared on the hot path. The trees are merged
+// for the report, which is printed to STREAM at exit.
+//---------------------------------------------------------------------------//
+// Environment variables :
+// + SCICPP_PROFILE_HW=1 : Also count cycles, instructions and cache misses
+//   per region with the hardware counters of Linux perf_event_open.
+//   Reading them costs a system call per region entry and exit.
+// + SCICPP_PROFILE_FOLDED=PATH : Write the folded stacks to PATH at exit.
+//   "flamegraph.pl PATH > flame.svg" then draws the flame graph.
+//---------------------------------------------------------------------------//
+// USE : Compile with -DPROFILE
+// >> PROFSCOPE("solver");
+// >> DO(t,1,nt)
+// >>   PROFREGION("ftbs")
+// >>     PROFBYTES(2*SOF(f64)*nx); PROFFLOPS(4*nx);
+// >>     un1(2,nx) = un(2,nx) - un(2,nx)*dtdx*(un(2,nx)-un(1,nx-1));
+// >>   ENDPROFREGION
+// >>   PROFCOUNT("steps",1);
+// >> ENDDO
+//---------------------------------------------------------------------------//
+// RESULT : At exit,
+// PROFILE :: region       calls  total ms   self ms  %time   GB/s  GFLOP/s
+// PROFILE :: solver           1    15.412     0.391  100.0
+// PROFILE ::   ftbs        3000    15.021    15.021   97.5  2.557    0.639
+// PROFILE :: counter      total
+// PROFILE :: steps         3000
+//---------------------------------------------------------------------------//
+#define XPROF_CAT2(A,B) A##B
+#define XPROF_CAT(A,B) XPROF_CAT2(A,B)
+
+#ifdef PROFILE
+  #define PROFSCOPE(NAME) \
+  static const u32 XPROF_CAT(xprof_id_,__LINE__) = xprof_id(NAME); \
+  xprofguard XPROF_CAT(xprof_guard_,__LINE__)(XPROF_CAT(xprof_id_,__LINE__));
+  #define xprofscope(NAME) PROFSCOPE(NAME)
+
+  #define PROFREGION(NAME) { PROFSCOPE(NAME)
+  #define xprofregion(NAME) PROFREGION(NAME)
+  #define ENDPROFREGION }
+  #define xendprofregion }
+
+  #define PROFCOUNT(NAME,N) { \
+  static const u32 xprof_cid = xprof_id(NAME); \
+  xprof_thread().count(xprof_cid,(N)); }
+  #define xprofcount(NAME,N) PROFCOUNT(NAME,(N))
+
+  #define PROFBYTES(N) xprof_thread().annotate((N),0.0);
+  #define xprofbytes(N) PROFBYTES((N))
+  #define PROFFLOPS(N) xprof_thread().annotate(0.0,(N));
+  #define xprofflops(N) PROFFLOPS((N))
+
+  #define PROFREPORT(OS) xprof_report((OS));
+  #define xprofreport(OS) PROFREPORT((OS))
+  #define PROFFOLDED(PATH) xprof_folded((PATH));
+  #define xproffolded(PATH) PROFFOLDED((PATH))
+#endif
+
+// If PROFILE is not defined then do not use the profiling features
+#ifndef PROFILE
+  #define PROFSCOPE(NAME)
+  #define xprofscope(NAME)
+  #define PROFREGION(NAME) {
+  #define xprofregion(NAME) {
+  #define ENDPROFREGION }
+  #define xendprofregion }
+  #define PROFCOUNT(NAME,N)
+  #define xprofcount(NAME,N)
+  #define PROFBYTES(N)
+  #define xprofbytes(N)
+  #define PROFFLOPS(N)
+  #define xprofflops(N)
+  #define PROFREPORT(OS)
+  #define xprofreport(OS)
+  #define PROFFOLDED(PATH)
+  #define xproffolded(PATH)
+#endif
+
+#ifdef PROFILE
+// No. of hardware counters : cycles, instructions and cache misses
+#define XPROF_NHW 3
+
+// Monotonic time in nanoseconds
+inline s64 xprof_now()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//---------------------------------------------------------------------------//
+// A region in the call tree of a thread, below its parent region
+//---------------------------------------------------------------------------//
+struct xprofnode
+{
+  u32 id;                    // Name of the region
+  s32 parent;                // Enclosing region, -1 for the root
+  std::vector<s32> kids;     // Regions entered from this one
+  u64 calls;                 // No. of times entered
+  f64 ns;                    // Time inside, including the kids
+  f64 kidns;                 // Time inside the kids
+  f64 bytes;                 // Annotated bytes
+  f64 flops;                 // Annotated flops
+  f64 hw[XPROF_NHW];         // Hardware counts inside, including the kids
+
+  xprofnode(u32 i, s32 p)
+    : id(i), parent(p), calls(0), ns(0), kidns(0), bytes(0), flops(0)
+  {
+    for(szt h=0;h<XPROF_NHW;++h) hw[h] = 0;
+  }
+};
+
+//---------------------------------------------------------------------------//
+// Profile of one thread, only ever changed by that thread
+//---------------------------------------------------------------------------//
+class xprofthread
+{
+public:
+  std::vector<xprofnode> nodes;   // Call tree, nodes[0] is the root
+  std::vector<f64> counts;        // Event counters, by id
+
+  xprofthread() : cur_(0), hwfd_(-1)
+  {
+    nodes.push_back(xprofnode(~0u,-1));
+#ifdef __linux__
+    const char* hw = std::getenv("SCICPP_PROFILE_HW");
+    if(hw && std::atoi(hw) != 0) open_hw();
+#endif
+  }
+
+  ~xprofthread()
+  {
+#ifdef __linux__
+    for(szt h=0;h<XPROF_NHW;++h) if(fds_[h] >= 0) ::close(fds_[h]);
+#endif
+  }
+
+  bool has_hw() const { return hwfd_ >= 0; }
+
+  void enter(u32 id)
+  {
+    s32 k = -1;
+    const std::vector<s32>& kids = nodes[cur_].kids;
+    for(szt c=0;c<kids.size();++c)
+      if(nodes[kids[c]].id == id) { k = kids[c]; break; }
+    if(k < 0) {
+      k = static_cast<s32>(nodes.size());
+      nodes.push_back(xprofnode(id,cur_));
+      nodes[cur_].kids.push_back(k);
+    }
+    cur_ = k;
+    stack_.push_back(frame());
+    frame& f = stack_.back();
+    read_hw(f.hw);
+    f.t0 = xprof_now();
+  }
+
+  void leave()
+  {
+    const s64 t1 = xprof_now();
+    f64 hw[XPROF_NHW];
+    read_hw(hw);
+    const frame& f = stack_.back();
+    xprofnode& n = nodes[cur_];
+    const f64 dt = f64(t1-f.t0);
+    n.calls++;
+    n.ns += dt;
+    for(szt h=0;h<XPROF_NHW;++h) n.hw[h] += hw[h]-f.hw[h];
+    cur_ = n.parent;
+    nodes[cur_].kidns += dt;
+    stack_.pop_back();
+  }
+
+  void annotate(f64 bytes, f64 flops)
+  {
+    nodes[cur_].bytes += bytes;
+    nodes[cur_].flops += flops;
+  }
+
+  void count(u32 id, f64 n)
+  {
+    if(id >= counts.size()) counts.resize(id+1,0.0);
+    counts[id] += n;
+  }
+
+private:
+  struct frame { s64 t0; f64 hw[XPROF_NHW]; };
+
+  void read_hw(f64* hw)
+  {
+    for(szt h=0;h<XPROF_NHW;++h) hw[h] = 0;
+#ifdef __linux__
+    if(hwfd_ < 0) return;
+    u64 buf[1+XPROF_NHW];
+    if(::read(hwfd_,buf,SOF(buf)) < ssize_t(SOF(u64))) return;
+    for(u64 h=0;h<buf[0] && h<XPROF_NHW;++h) hw[h] = f64(buf[1+h]);
+#endif
+  }
+
+#ifdef __linux__
+  // One group of counters of the calling thread, on any CPU, so that they
+  // are read together with one system call
+  void open_hw()
+  {
+    const u64 config[XPROF_NHW] = {PERF_COUNT_HW_CPU_CYCLES,
+                                   PERF_COUNT_HW_INSTRUCTIONS,
+                                   PERF_COUNT_HW_CACHE_MISSES};
+    for(szt h=0;h<XPROF_NHW;++h) {
+      perf_event_attr a;
+      std::memset(&a,0,SOF(a));
+      a.type = PERF_TYPE_HARDWARE;
+      a.size = SOF(a);
+      a.config = config[h];
+      a.disabled = (h == 0);
+      a.exclude_kernel = 1;
+      a.exclude_hv = 1;
+      a.read_format = PERF_FORMAT_GROUP;
+      fds_[h] = static_cast<int>(syscall(__NR_perf_event_open,&a,0,-1,
+                                         h == 0 ? -1 : fds_[0],0));
+      if(fds_[h] < 0) {
+        // Not allowed (see /proc/sys/kernel/perf_event_paranoid) or no PMU
+        for(szt g=0;g<h;++g) ::close(fds_[g]);
+        for(szt g=0;g<XPROF_NHW;++g) fds_[g] = -1;
+        return;
+      }
+    }
+    ioctl(fds_[0],PERF_EVENT_IOC_ENABLE,PERF_IOC_FLAG_GROUP);
+    hwfd_ = fds_[0];
+  }
+#endif
+
+  s32 cur_;                       // Current region
+  std::vector<frame> stack_;      // Entry time and counts of the regions
+  int hwfd_;                      // Leader of the counter group, or -1
+  int fds_[XPROF_NHW] = {-1,-1,-1};
+};
+
+//---------------------------------------------------------------------------//
+// Names of the regions and counters, and the profiles of all threads.
+// Only the first use of a region or counter, and of a thread, takes the
+// lock. It is never destroyed, as threads may still use it at exit.
+//---------------------------------------------------------------------------//
+inline void xprof_atexit();
+
+class xprofregistry
+{
+public:
+  std::mutex m;
+  std::vector<xstr> names;
+  std::vector<std::unique_ptr<xprofthread> > threads;
+
+  xprofregistry() { std::atexit(xprof_atexit); }
+
+  u32 id(const char* name)
+  {
+    std::lock_guard<std::mutex> lk(m);
+    for(szt k=0;k<names.size();++k) if(names[k] == name) return k;
+    names.push_back(name);
+    return names.size()-1;
+  }
+
+  xprofthread* add()
+  {
+    std::lock_guard<std::mutex> lk(m);
+    threads.push_back(std::unique_ptr<xprofthread>(new xprofthread()));
+    return threads.back().get();
+  }
+};
+
+inline xprofregistry& xprof_registry()
+{
+  static xprofregistry* r = new xprofregistry();
+  return *r;
+}
+
+// Id of the region or counter NAME
+inline u32 xprof_id(const char* name)
+{
+  return xprof_registry().id(name);
+}
+
+// Profile of the calling thread
+inline xprofthread& xprof_thread()
+{
+  static thread_local xprofthread* t = xprof_registry().add();
+  return *t;
+}
+
+// Times a region from construction to destruction
+class xprofguard
+{
+public:
+  explicit xprofguard(u32 id) : t_(xprof_thread()) { t_.enter(id); }
+  ~xprofguard() { t_.leave(); }
+  xprofguard(const xprofguard&) = delete;
+  xprofguard& operator=(const xprofguard&) = delete;
+private:
+  xprofthread& t_;
+};
+
+//---------------------------------------------------------------------------//
+// Call trees of all threads merged into one, regions with the same path
+// of names from the root being the same. Times and counts are summed over
+// the threads, so they can exceed the wall clock time.
+//---------------------------------------------------------------------------//
+inline void xprof_merge(const xprofthread& t, s32 k,
+                        std::vector<xprofnode>& m, s32 mk)
+{
+  const xprofnode& n = t.nodes[k];
+  for(szt c=0;c<n.kids.size();++c) {
+    const xprofnode& kid = t.nodes[n.kids[c]];
+    s32 mc = -1;
+    for(szt d=0;d<m[mk].kids.size();++d)
+      if(m[m[mk].kids[d]].id == kid.id) { mc = m[mk].kids[d]; break; }
+    if(mc < 0) {
+      mc = static_cast<s32>(m.size());
+      m.push_back(xprofnode(kid.id,mk));
+      m[mk].kids.push_back(mc);
+    }
+    xprofnode& o = m[mc];
+    o.calls += kid.calls; o.ns += kid.ns; o.kidns += kid.kidns;
+    o.bytes += kid.bytes; o.flops += kid.flops;
+    for(szt h=0;h<XPROF_NHW;++h) o.hw[h] += kid.hw[h];
+    xprof_merge(t,n.kids[c],m,mc);
+  }
+}
+
+inline std::vector<xprofnode> xprof_merged(bool& hw,
+                                           std::vector<f64>& counts)
+{
+  xprofregistry& r = xprof_registry();
+  std::vector<xprofnode> m(1,xprofnode(~0u,-1));
+  hw = false;
+  for(szt k=0;k<r.threads.size();++k) {
+    const xprofthread& t = *r.threads[k];
+    xprof_merge(t,0,m,0);
+    hw = hw || t.has_hw();
+    if(counts.size() < t.counts.size()) counts.resize(t.counts.size(),0.0);
+    for(szt c=0;c<t.counts.size();++c) counts[c] += t.counts[c];
+  }
+  // Slowest regions first
+  for(szt k=0;k<m.size();++k)
+    std::sort(m[k].kids.begin(),m[k].kids.end(),
+              [&](s32 a, s32 b) { return m[a].ns > m[b].ns; });
+  return m;
+}
+
+// Width of the name column : the longest indented name of the regions below
+// K, and at least 24
+inline szt xprof_namewidth(const std::vector<xprofnode>& m, s32 k, szt depth)
+{
+  const std::vector<xstr>& names = xprof_registry().names;
+  szt w = 24;
+  for(szt c=0;c<m[k].kids.size();++c) {
+    const xprofnode& n = m[m[k].kids[c]];
+    w = std::max(w,static_cast<szt>(2*depth + names[n.id].size()));
+    w = std::max(w,xprof_namewidth(m,m[k].kids[c],depth+1));
+  }
+  return w;
+}
+
+// "PROFILE :: " and NAME padded to NW characters
+inline void xprof_name(std::ostream& os, const xstr& name, szt nw)
+{
+  os<<"PROFILE :: "<<name<<xstr(nw > name.size() ? nw-name.size() : 0,' ');
+}
+
+inline void xprof_print(std::ostream& os, const std::vector<xprofnode>& m,
+                        s32 k, szt depth, f64 total, bool hw, szt nw)
+{
+  const std::vector<xstr>& names = xprof_registry().names;
+  char line[256];
+  for(szt c=0;c<m[k].kids.size();++c) {
+    const xprofnode& n = m[m[k].kids[c]];
+    xstr name = xstr(2*depth,' ') + names[n.id];
+    const f64 self = n.ns-n.kidns;
+    s32 w = std::snprintf(line,SOF(line)," %9llu %10.3f %10.3f %6.1f",
+                          static_cast<unsigned long long>(n.calls),
+                          1e-6*n.ns,1e-6*self,
+                          total > 0 ? 100.0*n.ns/total : 0.0);
+    if(n.bytes > 0 || n.flops > 0)
+      w += std::snprintf(line+w,SOF(line)-w," %8.3f %8.3f",
+                         n.bytes/n.ns,n.flops/n.ns);
+    else if(hw)
+      w += std::snprintf(line+w,SOF(line)-w," %8s %8s","","");
+    if(hw)
+      std::snprintf(line+w,SOF(line)-w," %12.4g %5.2f %12.4g",n.hw[0],
+                    n.hw[0] > 0 ? n.hw[1]/n.hw[0] : 0.0,n.hw[2]);
+    xprof_name(os,name,nw);
+    os<<line<<nl;
+    xprof_print(os,m,m[k].kids[c],depth+1,total,hw,nw);
+  }
+}
+
+//---------------------------------------------------------------------------//
+// Print the merged call tree and the counters to OS
+// NOTE : Other threads must not be inside a region while it runs.
+//---------------------------------------------------------------------------//
+inline void xprof_report(std::ostream& os)
+{
+  xprofregistry& r = xprof_registry();
+  std::lock_guard<std::mutex> lk(r.m);
+  bool hw;
+  std::vector<f64> counts;
+  std::vector<xprofnode> m = xprof_merged(hw,counts);
+  f64 total = 0;
+  for(szt c=0;c<m[0].kids.size();++c) total += m[m[0].kids[c]].ns;
+
+  // The name column fits the longest region and counter names
+  szt nw = xprof_namewidth(m,0,0);
+  for(szt c=0;c<counts.size();++c)
+    if(counts[c] != 0) nw = std::max(nw,static_cast<szt>(r.names[c].size()));
+
+  char line[256];
+  s32 w = std::snprintf(line,SOF(line)," %9s %10s %10s %6s %8s %8s",
+                        "calls","total ms","self ms","%time",
+                        "GB/s","GFLOP/s");
+  if(hw)
+    std::snprintf(line+w,SOF(line)-w," %12s %5s %12s",
+                  "cycles","IPC","cache misses");
+  xprof_name(os,"region",nw);
+  os<<line<<nl;
+  xprof_print(os,m,0,0,total,hw,nw);
+  if(!counts.empty()) {
+    xprof_name(os,"counter",nw);
+    std::snprintf(line,SOF(line)," %14s","total");
+    os<<line<<nl;
+    for(szt c=0;c<counts.size();++c) {
+      if(counts[c] == 0) continue;
+      xprof_name(os,r.names[c],nw);
+      std::snprintf(line,SOF(line)," %14.6g",counts[c]);
+      os<<line<<nl;
+    }
+  }
+  os<<std::flush;
+}
+
+//---------------------------------------------------------------------------//
+// Write the folded stacks of the merged call tree to PATH, one line per
+// region, with the path of names from the root and the self time in us,
+// like "solver;ftbs 15021"
+//---------------------------------------------------------------------------//
+inline void xprof_folded_node(std::ostream& os,
+                              const std::vector<xprofnode>& m,
+                              s32 k, const xstr& path)
+{
+  const std::vector<xstr>& names = xprof_registry().names;
+  for(szt c=0;c<m[k].kids.size();++c) {
+    const xprofnode& n = m[m[k].kids[c]];
+    xstr p = path.empty() ? names[n.id] : path+";"+names[n.id];
+    os<<p<<" "<<static_cast<u64>(1e-3*(n.ns-n.kidns)+0.5)<<nl;
+    xprof_folded_node(os,m,m[k].kids[c],p);
+  }
+}
+
+inline bool xprof_folded(const xstr& path)
+{
+  xprofregistry& r = xprof_registry();
+  std::lock_guard<std::mutex> lk(r.m);
+  bool hw;
+  std::vector<f64> counts;
+  std::vector<xprofnode> m = xprof_merged(hw,counts);
+  std::ofstream f(path.c_str());
+  if(!f.is_open()) return false;
+  xprof_folded_node(f,m,0,"");
+  return f.good();
+}
+
+inline void xprof_atexit()
+{
+  xprof_report(STREAM);
+  const char* path = std::getenv("SCICPP_PROFILE_FOLDED");
+  if(path && *path && !xprof_folded(path))
+    STREAM<<"ERROR :: PROFILE FOLDED STACKS NOT WRITTEN TO "<<path<<NL;
+}
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// Memory alignment
+///////////////////////////////////////////////////////////////////////////////
+//---------------------------------------------------------------------------//
+// Alignment in bytes for the storage of scicpp arrays.
+// Default : 64 bytes, which is one cache line and one AVX-512 register.
+// NOTE : Define SIMD_ALIGN before including scicpp.hpp to change it.
+//---------------------------------------------------------------------------//
+#ifndef SIMD_ALIGN
+#define SIMD_ALIGN 64
+#endif
+
+//---------------------------------------------------------------------------//
+// Allocate BYTES of raw memory aligned to SIMD_ALIGN.
+// The memory is NOT initialized. Release it with xaligned_free.
+// Throws std::bad_alloc on failure, like new does.
+//---------------------------------------------------------------------------//
+inline void* xaligned_alloc(size_t bytes)
+{
+  if(bytes == 0) bytes = SIMD_ALIGN;
+  void* p = 0;
+#ifdef _WIN32
+  p = _aligned_malloc(bytes,SIMD_ALIGN);
+#else
+  if(posix_memalign(&p,SIMD_ALIGN,bytes) != 0) p = 0;
+#endif
+  if(!p) throw std::bad_alloc();
+  return p;
+}
+
+inline void xaligned_free(void* p)
+{
+#ifdef _WIN32
+  _aligned_free(p);
+#else
+  free(p);
+#endif
+}
+
+//---------------------------------------------------------------------------//
+// No. of elements of type TYPE needed to hold N elements, rounded up so
+// that the storage is a whole number of SIMD_ALIGN blocks.
+// The extra elements are padding that SIMD loops may safely touch.
+//---------------------------------------------------------------------------//
+xtem(xtn TYPE) inline
+s64 xpadded(s64 n)
+{
+  const s64 w = (SIMD_ALIGN % SOF(TYPE) == 0) ? SIMD_ALIGN/SOF(TYPE) : 1;
+  return ((n + w - 1)/w)*w;
+}
+
+//---------------------------------------------------------------------------//
+// Allocate N aligned elements of type TYPE, and release them.
+// Trivial types (f64,f32,s32 etc) are NOT initialized.
+// Other types are default constructed and destroyed.
+//---------------------------------------------------------------------------//
+xtem(xtn TYPE) inline
+TYPE* xalloc_elems(s64 n)
+{
+  TYPE* p = static_cast<TYPE*>(xaligned_alloc(n*SOF(TYPE)));
+  if(!std::is_trivially_default_constructible<TYPE>::value)
+    for(s64 k=0;k<n;++k) new (p+k) TYPE;
+  return p;
+}
+
+xtem(xtn TYPE) inline
+void xdestroy_elems(TYPE* p, s64 n)
+{
+  if(!std::is_trivially_destructible<TYPE>::value)
+    for(s64 k=0;k<n;++k) p[k].~TYPE();
+}
+
+xtem(xtn TYPE) inline
+void xfree_elems(TYPE* p, s64 n)
+{
+  xdestroy_elems(p,n);
+  xaligned_free(p);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Arenas
+///////////////////////////////////////////////////////////////////////////////
+//---------------------------------------------------------------------------//
+// Bump allocation of temporaries, so that a time loop does not call the
+// heap : an xarena hands out aligned memory from large chunks by moving an
+// offset, and releases everything allocated after a mark at once.
+// The chunks are kept when released, so a loop that allocates the same
+// temporaries in every step allocates from the heap only in the first
+// steps, and its pages are faulted in only once.
+// + xscratch() : the arena of the calling thread
+// + xscratchscope : releases what was allocated in its scope, at its end
+// + xarenaalloc<TYPE> : STL allocator, for VEC(TYPE,xarenaalloc<TYPE>)
+// Arrays take an arena as first constructor argument (see "Arrays"), and
+// keep using it when they are reallocated.
+//---------------------------------------------------------------------------//
+// Chunks of 2MB or more are mapped with transparent huge pages on Linux.
+// Default size of the first chunk : 1MB
+// NOTE : Define XARENA_CHUNK (bytes) before including scicpp.hpp to change
+// it, or reserve() an arena for the workspace of a whole time step.
+//---------------------------------------------------------------------------//
+// NOTE : Memory from an arena must not be used after it is released, so
+// arrays on an arena must not outlive the scope they were made in. Move
+// assigning one to an array of the heap copies it, and is safe. The
+// destructors of the elements are run by the arrays, not by the arena.
+// An arena is not thread safe, and each thread has its own xscratch().
+//---------------------------------------------------------------------------//
+// USE : Temporaries of a time step, without heap calls after the first
+// >> DO(t,1,nt)
+// >>   xscratchscope ws;                      // Released at ENDDO
+// >>   ARR(f64) flux(xscratch(),1,nx+1);       // On the arena
+// >>   ARR2(f64) res(xscratch(),nx,ny);
+// >>   f64* tmp = ws.alloc<f64>(nx);          // Raw, aligned
+// >>   VEC(s32,xarenaalloc<s32>) list(xarenaalloc<s32>(xscratch()));
+// >>   ...
+// >> ENDDO
+//---------------------------------------------------------------------------//
+#ifndef XARENA_CHUNK
+#define XARENA_CHUNK (size_t(1) << 20)
+#endif
+
+// Position in an arena, to release to
+struct xarenamark
+{
+  szt chunk;
+  size_t off;
+};
+
+class xarena
+{
+public:
+  explicit xarena(size_t chunk = XARENA_CHUNK)
+    : first_(chunk), cur_(0), off_(0), peak_(0), heapcalls_(0) {}
+
+  xarena(const xarena&) = delete;
+  xarena& operator=(const xarena&) = delete;
+
+  ~xarena()
+  {
+    for(szt k=0;k<chunks_.size();++k) unmap(chunks_[k]);
+  }
+
+  // BYTES of memory aligned to SIMD_ALIGN, not initialized
+  void* allocate(size_t bytes)
+  {
+    bytes = ((bytes + SIMD_ALIGN - 1)/SIMD_ALIGN)*SIMD_ALIGN;
+    while(cur_ < chunks_.size() && off_ + bytes > chunks_[cur_].size) {
+      ++cur_; off_ = 0;
+    }
+    if(cur_ == chunks_.size()) {
+      size_t sz = chunks_.empty() ? first_ : 2*chunks_.back().size;
+      chunks_.push_back(map(std::max(sz,bytes)));
+      off_ = 0;
+    }
+    void* p = chunks_[cur_].p + off_;
+    off_ += bytes;
+    peak_ = std::max(peak_,used());
+    return p;
+  }
+
+  // N elements of TYPE, constructed if TYPE is not trivial
+  xtem(xtn TYPE) TYPE* alloc(s64 n)
+  {
+    TYPE* p = static_cast<TYPE*>(allocate(size_t(n)*SOF(TYPE)));
+    if(!std::is_trivially_default_constructible<TYPE>::value)
+      for(s64 k=0;k<n;++k) new (p+k) TYPE;
+    return p;
+  }
+
+  // Release everything allocated after mark m
+  xarenamark mark() const { xarenamark m = {cur_,off_}; return m; }
+  void release(const xarenamark& m) { cur_ = m.chunk; off_ = m.off; }
+
+  // Release everything. If more than one chunk was needed, they are
+  // replaced by one chunk as large as all of them.
+  void reset()
+  {
+    cur_ = 0; off_ = 0;
+    if(chunks_.size() <= 1) return;
+    size_t total = 0;
+    for(szt k=0;k<chunks_.size();++k) {
+      total += chunks_[k].size;
+      unmap(chunks_[k]);
+    }
+    chunks_.clear();
+    chunks_.push_back(map(total));
+  }
+
+  // Make the first chunk at least BYTES, with its pages touched, so that
+  // a workspace of BYTES needs no heap call and no page fault.
+  // NOTE : Releases everything.
+  void reserve(size_t bytes)
+  {
+    reset();
+    if(chunks_.empty() || chunks_[0].size < bytes) {
+      for(szt k=0;k<chunks_.size();++k) unmap(chunks_[k]);
+      chunks_.clear();
+      chunks_.push_back(map(bytes));
+    }
+    std::memset(chunks_[0].p,0,chunks_[0].size);
+  }
+
+  // Bytes in use, largest no. of bytes in use, bytes of the chunks, and
+  // the no. of chunks obtained from the system so far
+  size_t used() const
+  {
+    size_t u = off_;
+    for(szt k=0;k<cur_ && k<chunks_.size();++k) u += chunks_[k].size;
+    return u;
+  }
+  size_t peak() const { return peak_; }
+  size_t capacity() const
+  {
+    size_t c = 0;
+    for(szt k=0;k<chunks_.size();++k) c += chunks_[k].size;
+    return c;
+  }
+  s64 heap_calls() const { return heapcalls_; }
+
+private:
+  struct chunk
+  {
+    char* p;
+    size_t size;
+    bool mapped;
+  };
+
+  chunk map(size_t bytes)
+  {
+    ++heapcalls_;
+    chunk c = {0,bytes,false};
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    const size_t huge = size_t(2) << 20;
+    if(bytes >= huge) {
+      c.size = ((bytes + huge - 1)/huge)*huge;
+      void* p = ::mmap(0,c.size,PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS,-1,0);
+      if(p != MAP_FAILED) {
+        ::madvise(p,c.size,MADV_HUGEPAGE);
+        c.p = static_cast<char*>(p); c.mapped = true;
+        return c;
+      }
+      c.size = bytes;
+    }
+#endif
+    c.p = static_cast<char*>(xaligned_alloc(bytes));
+    return c;
+  }
+
+  static void unmap(const chunk& c)
+  {
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    if(c.mapped) { ::munmap(c.p,c.size); return; }
+#endif
+    xaligned_free(c.p);
+  }
+
+  std::vector<chunk> chunks_;
+  size_t first_;     // Size of the first chunk
+  szt cur_;          // Chunk being filled
+  size_t off_;       // Bytes used in chunk cur_
+  size_t peak_;
+  s64 heapcalls_;
+};
+
+// Arena of the calling thread, for temporaries
+inline xarena& xscratch()
+{
+  static thread_local xarena a;
+  return a;
+}
+
+//---------------------------------------------------------------------------//
+// Releases the memory allocated from an arena (xscratch() by default)
+// during its lifetime
+//---------------------------------------------------------------------------//
+class xscratchscope
+{
+public:
+  explicit xscratchscope(xarena& a = xscratch()) : a_(a), m_(a.mark()) {}
+  ~xscratchscope() { a_.release(m_); }
+
+  xscratchscope(const xscratchscope&) = delete;
+  xscratchscope& operator=(const xscratchscope&) = delete;
+
+  xarena& arena() { return a_; }
+  xtem(xtn TYPE) TYPE* alloc(s64 n) { return a_.alloc<TYPE>(n); }
+
+private:
+  xarena& a_;
+  xarenamark m_;
+};
+
+//---------------------------------------------------------------------------//
+// STL allocator on an arena. Deallocation does nothing, the memory is
+// released with the arena.
+//---------------------------------------------------------------------------//
+xtem(xtn TYPE)
+struct xarenaalloc
+{
+  typedef TYPE value_type;
+  xarena* a;
+
+  explicit xarenaalloc(xarena& arena) : a(&arena) {}
+  xtem(xtn U) xarenaalloc(const xarenaalloc<U>& o) : a(o.a) {}
+
+  TYPE* allocate(size_t n)
+  {
+    return static_cast<TYPE*>(a->allocate(n*SOF(TYPE)));
+  }
+  void deallocate(TYPE*, size_t) {}
+};
+
+xtem(xtn T, xtn U) inline
+bool operator==(const xarenaalloc<T>& x, const xarenaalloc<U>& y)
+{
+  return x.a == y.a;
+}
+xtem(xtn T, xtn U) inline
+bool operator!=(const xarenaalloc<T>& x, const xarenaalloc<U>& y)
+{
+  return x.a != y.a;
+}
+
+// Vector on an arena, VEC(TYPE,xarenaalloc<TYPE>)
+xtem(xtn TYPE) using xscratchvec = std::vector<TYPE,xarenaalloc<TYPE> >;
+
+///////////////////////////////////////////////////////////////////////////////
+// SIMD packs
+///////////////////////////////////////////////////////////////////////////////
+//---------------------------------------------------------------------------//
+// xpack<TYPE,W> holds W values of TYPE (f32 or f64) in one SIMD register,
+// and every operation on it is done on all W values at once.
+// The instruction set is chosen at build time from the compiler flags :
+// + AVX-512 (-mavx512f) : 8 f64 or 16 f32
+// + AVX/AVX2 (-mavx2)   : 4 f64 or 8 f32
+// + SSE2 (any x86-64)   : 2 f64 or 4 f32
+// Packs of any other width, or on other machines, are plain arrays whose
+// fixed length loops the compiler vectorizes on its own.
+// xnpack<TYPE> is the pack of the widest register of the build.
+//---------------------------------------------------------------------------//
+// NOTE : Define SIMD_SCALAR before including scicpp.hpp to use packs of
+// width 1, for ex. to compare results with the scalar code.
+// NOTE : Define SIMD_DISPATCH to compile the kernels (see "SIMD kernels")
+// for AVX-512, AVX2 and the baseline, and choose one when the program starts
+// from the CPU it runs on. Only for GCC/Clang on x86-64 Linux.
+//---------------------------------------------------------------------------//
+// USE :
+// >> typedef xnpack<f64> pk;
+// >> ARR(f64) x(1,n), y(1,n);
+// >> ...
+// >> s64 i = 0;
+// >> for(;i+pk::width<=n;i+=pk::width) {
+// >>   pk a = pk::loadu(&x[i+1]), b = pk::loadu(&y[i+1]);
+// >>   pk c = xselect(a > 0.0, xfma(a,b,1.0), xsq(b));
+// >>   c.storeu(&y[i+1]);
+// >> }
+// >> ...                             // Scalar loop for the last n%width
+//---------------------------------------------------------------------------//
+// Operations on packs a,b,c of the same type pk, and a mask m
+// + pk(x), pk::load(p), pk::loadu(p) : broadcast x, load aligned/unaligned
+// + a.store(p), a.storeu(p), a[k]    : store aligned/unaligned, lane k
+// + a+b a-b a*b a/b -a, += -= *= /=  : scalars are broadcast, like a*2.0
+// + xfma(a,b,c) = a*b+c, fused when the hardware has FMA
+// + xmin xmax xsqrt xabs xsq xcu xsgn
+// + a<b a<=b a>b a>=b a==b a!=b      : give a mask, pk::mask
+// + m&m m|m ~m xany(m) xall(m)
+// + xselect(m,a,b)                   : a where m is true, else b
+// + xhsum(a) xhmin(a) xhmax(a)       : sum, minimum, maximum of the lanes
+// + xbitand(a,b) xbitor(a,b)         : and, or of the bits of the lanes
+// + xshl(a,n) xshr(a,n)              : shift the bits of every lane, as an
+//                                      unsigned integer, by n to the left
+//                                      or to the right
+//---------------------------------------------------------------------------//
+#if defined(SIMD_SCALAR)
+#define SIMD_BYTES 1
+#elif defined(__AVX512F__)
+#define SIMD_BYTES 64
+#elif defined(__AVX__)
+#define SIMD_BYTES 32
+#else
+#define SIMD_BYTES 16
+#endif
+
+#if defined(SIMD_DISPATCH) && !(defined(__GNUC__) && defined(__x86_64__) && \
+    defined(__linux__))
+#undef SIMD_DISPATCH
+#endif
+
+//---------------------------------------------------------------------------//
+// Name of the instruction set used by the packs, and the best one the CPU
+// running the program has
+//---------------------------------------------------------------------------//
+inline const char* xsimd_name()
+{
+#if defined(SIMD_SCALAR)
+  return "scalar";
+#elif defined(__AVX512F__)
+  return "AVX-512";
+#elif defined(__AVX2__)
+  return "AVX2";
+#elif defined(__AVX__)
+  return "AVX";
+#elif defined(__SSE2__) || defined(_M_X64)
+  return "SSE2";
+#else
+  return "generic";
+#endif
+}
+
+inline const char* xsimd_cpu_name()
+{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx512f")) return "AVX-512";
+  if(__builtin_cpu_supports("avx2")) return "AVX2";
+  if(__builtin_cpu_supports("avx")) return "AVX";
+  if(__builtin_cpu_supports("sse2")) return "SSE2";
+#endif
+  return "generic";
+}
+
+//---------------------------------------------------------------------------//
+// Pack of any width, as a plain array
+//---------------------------------------------------------------------------//
+#define XPACK_ASSIGN_OPS \
+  xpack& operator+=(const xpack& b) { return *this = *this + b; } \
+  xpack& operator-=(const xpack& b) { return *this = *this - b; } \
+  xpack& operator*=(const xpack& b) { return *this = *this * b; } \
+  xpack& operator/=(const xpack& b) { return *this = *this / b; }
+
+#define XPACK_LANES(EXPR) \
+  xpack r; for(szt k=0;k<W;++k) r.v[k] = (EXPR); return r;
+
+#define XPACK_MASK_LANES(EXPR) \
+  mask r; for(szt k=0;k<W;++k) r.b[k] = (EXPR); return r;
+
+xtem(xtn TYPE, szt W)
+struct xpack
+{
+  static_assert(W >= 1,"Packs hold at least 1 value");
+  typedef TYPE value_type;
+  static constexpr szt width = W;
+
+  struct mask
+  {
+    bool b[W];
+    friend mask operator&(const mask& x, const mask& y)
+    { XPACK_MASK_LANES(x.b[k] && y.b[k]) }
+    friend mask operator|(const mask& x, const mask& y)
+    { XPACK_MASK_LANES(x.b[k] || y.b[k]) }
+    friend mask operator~(const mask& x) { XPACK_MASK_LANES(!x.b[k]) }
+    friend bool xany(const mask& x)
+    {
+      for(szt k=0;k<W;++k) if(x.b[k]) return true;
+      return false;
+    }
+    friend bool xall(const mask& x)
+    {
+      for(szt k=0;k<W;++k) if(!x.b[k]) return false;
+      return true;
+    }
+  };
+
+  TYPE v[W];
+
+  // The bits of a lane, as an unsigned integer of the same size
+  typedef xtn std::conditional<SOF(TYPE) == 8,u64,u32>::type bits_type;
+  static bits_type tobits(TYPE x)
+  {
+    bits_type u; std::memcpy(&u,&x,SOF(u)); return u;
+  }
+  static TYPE frombits(bits_type u)
+  {
+    TYPE x; std::memcpy(&x,&u,SOF(x)); return x;
+  }
+
+  xpack() {}
+  xpack(TYPE x) { for(szt k=0;k<W;++k) v[k] = x; }
+  static xpack load(const TYPE* p) { return loadu(p); }
+  static xpack loadu(const TYPE* p) { XPACK_LANES(p[k]) }
+  void store(TYPE* p) const { storeu(p); }
+  void storeu(TYPE* p) const { for(szt k=0;k<W;++k) p[k] = v[k]; }
+  TYPE operator[](szt k) const { return v[k]; }
+
+  friend xpack operator+(const xpack& a, const xpack& b)
+  { XPACK_LANES(a.v[k]+b.v[k]) }
+  friend xpack operator-(const xpack& a, const xpack& b)
+  { XPACK_LANES(a.v[k]-b.v[k]) }
+  friend xpack operator*(const xpack& a, const xpack& b)
+  { XPACK_LANES(a.v[k]*b.v[k]) }
+  friend xpack operator/(const xpack& a, const xpack& b)
+  { XPACK_LANES(a.v[k]/b.v[k]) }
+  friend xpack operator-(const xpack& a) { XPACK_LANES(-a.v[k]) }
+  XPACK_ASSIGN_OPS
+
+  // Fused like the packs of registers, whatever -ffp-contract is
+#ifdef __FMA__
+  friend xpack xfma(const xpack& a, const xpack& b, const xpack& c)
+  { XPACK_LANES(std::fma(a.v[k],b.v[k],c.v[k])) }
+#else
+  friend xpack xfma(const xpack& a, const xpack& b, const xpack& c)
+  { XPACK_LANES(a.v[k]*b.v[k]+c.v[k]) }
+#endif
+  friend xpack xmin(const xpack& a, const xpack& b)
+  { XPACK_LANES(b.v[k] < a.v[k] ? b.v[k] : a.v[k]) }
+  friend xpack xmax(const xpack& a, const xpack& b)
+  { XPACK_LANES(a.v[k] < b.v[k] ? b.v[k] : a.v[k]) }
+  friend xpack xsqrt(const xpack& a) { XPACK_LANES(std::sqrt(a.v[k])) }
+  friend xpack xabs(const xpack& a) { XPACK_LANES(std::abs(a.v[k])) }
+
+  friend mask operator<(const xpack& a, const xpack& b)
+  { XPACK_MASK_LANES(a.v[k] < b.v[k]) }
+  friend mask operator<=(const xpack& a, const xpack& b)
+  { XPACK_MASK_LANES(a.v[k] <= b.v[k]) }
+  friend mask operator>(const xpack& a, const xpack& b)
+  { XPACK_MASK_LANES(a.v[k] > b.v[k]) }
+  friend mask operator>=(const xpack& a, const xpack& b)
+  { XPACK_MASK_LANES(a.v[k] >= b.v[k]) }
+  friend mask operator==(const xpack& a, const xpack& b)
+  { XPACK_MASK_LANES(a.v[k] == b.v[k]) }
+  friend mask operator!=(const xpack& a, const xpack& b)
+  { XPACK_MASK_LANES(a.v[k] != b.v[k]) }
+  friend xpack xselect(const mask& m, const xpack& a, const xpack& b)
+  { XPACK_LANES(m.b[k] ? a.v[k] : b.v[k]) }
+
+  friend xpack xbitand(const xpack& a, const xpack& b)
+  { XPACK_LANES(frombits(tobits(a.v[k]) & tobits(b.v[k]))) }
+  friend xpack xbitor(const xpack& a, const xpack& b)
+  { XPACK_LANES(frombits(tobits(a.v[k]) | tobits(b.v[k]))) }
+  friend xpack xshl(const xpack& a, int n)
+  { XPACK_LANES(frombits(tobits(a.v[k]) << n)) }
+  friend xpack xshr(const xpack& a, int n)
+  { XPACK_LANES(frombits(tobits(a.v[k]) >> n)) }
+};
+
+#undef XPACK_LANES
+#undef XPACK_MASK_LANES
+
+//---------------------------------------------------------------------------//
+// Packs of one SSE2, AVX or AVX-512 register.
+// PF and SF are the prefix and suffix of the intrinsics, like _mm256_add_pd.
+//---------------------------------------------------------------------------//
+#define XPACK_INTRINSICS(TYPE,W,VEC,PF,SF,FMADD) \
+  typedef TYPE value_type; \
+  static constexpr szt width = W; \
+  VEC v; \
+  xpack() {} \
+  xpack(TYPE x) : v(PF##_set1_##SF(x)) {} \
+  xpack(VEC x) : v(x) {} \
+  static xpack load(const TYPE* p) { return PF##_load_##SF(p); } \
+  static xpack loadu(const TYPE* p) { return PF##_loadu_##SF(p); } \
+  void store(TYPE* p) const { PF##_store_##SF(p,v); } \
+  void storeu(TYPE* p) const { PF##_storeu_##SF(p,v); } \
+  TYPE operator[](szt k) const { TYPE t[W]; storeu(t); return t[k]; } \
+  friend xpack operator+(const xpack& a, const xpack& b) \
+  { return PF##_add_##SF(a.v,b.v); } \
+  friend xpack operator-(const xpack& a, const xpack& b) \
+  { return PF##_sub_##SF(a.v,b.v); } \
+  friend xpack operator*(const xpack& a, const xpack& b) \
+  { return PF##_mul_##SF(a.v,b.v); } \
+  friend xpack operator/(const xpack& a, const xpack& b) \
+  { return PF##_div_##SF(a.v,b.v); } \
+  XPACK_ASSIGN_OPS \
+  friend xpack xfma(const xpack& a, const xpack& b, const xpack& c) \
+  { return FMADD(PF,SF,a.v,b.v,c.v); }
+
+#define XPACK_FMA_NATIVE(PF,SF,A,B,C) PF##_fmadd_##SF(A,B,C)
+#define XPACK_FMA_EMULATED(PF,SF,A,B,C) PF##_add_##SF(PF##_mul_##SF(A,B),C)
+#ifdef __FMA__
+#define XPACK_FMA_VEX XPACK_FMA_NATIVE
+#else
+#define XPACK_FMA_VEX XPACK_FMA_EMULATED
+#endif
+
+// SSE2 and AVX : masks are registers with all bits of true lanes set.
+// CMP(PF,SF,A,B,OP,PRED) compares with the SSE2 cmpOP or the AVX predicate.
+#define XPACK_CMP_SSE(PF,SF,A,B,OP,PRED) PF##_cmp##OP##_##SF(A,B)
+#define XPACK_CMP_AVX(PF,SF,A,B,OP,PRED) PF##_cmp_##SF(A,B,PRED)
+#define XPACK_VECTOR_MASK(TYPE,W,VEC,PF,SF,BITS,CMP) \
+  struct mask \
+  { \
+    VEC m; \
+    friend mask operator&(const mask& x, const mask& y) \
+    { mask r = {PF##_and_##SF(x.m,y.m)}; return r; } \
+    friend mask operator|(const mask& x, const mask& y) \
+    { mask r = {PF##_or_##SF(x.m,y.m)}; return r; } \
+    friend mask operator~(const mask& x) \
+    { \
+      mask r = {PF##_xor_##SF(x.m,PF##_castsi##BITS##_##SF( \
+                                   PF##_set1_epi32(-1)))}; \
+      return r; \
+    } \
+    friend bool xany(const mask& x) { return PF##_movemask_##SF(x.m) != 0; } \
+    friend bool xall(const mask& x) \
+    { return PF##_movemask_##SF(x.m) == (1<<W)-1; } \
+  }; \
+  friend xpack operator-(const xpack& a) \
+  { return PF##_xor_##SF(a.v,PF##_set1_##SF(TYPE(-0.0))); } \
+  friend xpack xabs(const xpack& a) \
+  { return PF##_andnot_##SF(PF##_set1_##SF(TYPE(-0.0)),a.v); } \
+  friend xpack xmin(const xpack& a, const xpack& b) \
+  { return PF##_min_##SF(a.v,b.v); } \
+  friend xpack xmax(const xpack& a, const xpack& b) \
+  { return PF##_max_##SF(a.v,b.v); } \
+  friend xpack xsqrt(const xpack& a) { return PF##_sqrt_##SF(a.v); } \
+  friend mask operator<(const xpack& a, const xpack& b) \
+  { mask r = {CMP(PF,SF,a.v,b.v,lt,_CMP_LT_OQ)}; return r; } \
+  friend mask operator<=(const xpack& a, const xpack& b) \
+  { mask r = {CMP(PF,SF,a.v,b.v,le,_CMP_LE_OQ)}; return r; } \
+  friend mask operator>(const xpack& a, const xpack& b) \
+  { mask r = {CMP(PF,SF,a.v,b.v,gt,_CMP_GT_OQ)}; return r; } \
+  friend mask operator>=(const xpack& a, const xpack& b) \
+  { mask r = {CMP(PF,SF,a.v,b.v,ge,_CMP_GE_OQ)}; return r; } \
+  friend mask operator==(const xpack& a, const xpack& b) \
+  { mask r = {CMP(PF,SF,a.v,b.v,eq,_CMP_EQ_OQ)}; return r; } \
+  friend mask operator!=(const xpack& a, const xpack& b) \
+  { mask r = {CMP(PF,SF,a.v,b.v,neq,_CMP_NEQ_UQ)}; return r; } \
+  friend xpack xselect(const mask& m, const xpack& a, const xpack& b) \
+  { \
+    return PF##_or_##SF(PF##_and_##SF(m.m,a.v),PF##_andnot_##SF(m.m,b.v)); \
+  }
+
+// The bits of the lanes with the integer instructions of registers of BITS
+// bits, whose lanes of EPI have the size of TYPE. SHIFT(PF,OP,EPI,A,N) is
+// the shift OP (sll or srl) of the SSE2 and AVX2 form, or of AVX-512.
+#define XPACK_SHIFT_VEX(PF,OP,EPI,A,N) PF##_##OP##_##EPI(A,N)
+#define XPACK_SHIFT_K(PF,OP,EPI,A,N) PF##_mask_##OP##_##EPI(A,-1,A,N)
+#define XPACK_INT_BITS(PF,SF,BITS,EPI,SHIFT) \
+  friend xpack xbitand(const xpack& a, const xpack& b) \
+  { \
+    return PF##_castsi##BITS##_##SF(PF##_and_si##BITS( \
+             PF##_cast##SF##_si##BITS(a.v),PF##_cast##SF##_si##BITS(b.v))); \
+  } \
+  friend xpack xbitor(const xpack& a, const xpack& b) \
+  { \
+    return PF##_castsi##BITS##_##SF(PF##_or_si##BITS( \
+             PF##_cast##SF##_si##BITS(a.v),PF##_cast##SF##_si##BITS(b.v))); \
+  } \
+  friend xpack xshl(const xpack& a, int n) \
+  { \
+    return PF##_castsi##BITS##_##SF(SHIFT(PF,sll,EPI, \
+             PF##_cast##SF##_si##BITS(a.v),_mm_cvtsi32_si128(n))); \
+  } \
+  friend xpack xshr(const xpack& a, int n) \
+  { \
+    return PF##_castsi##BITS##_##SF(SHIFT(PF,srl,EPI, \
+             PF##_cast##SF##_si##BITS(a.v),_mm_cvtsi32_si128(n))); \
+  }
+
+// AVX without AVX2 has no integer instructions on 256 bits : the shifts are
+// done on the two SSE2 halves
+#define XPACK_SPLIT_BITS(TYPE,W,SF) \
+  friend xpack xbitand(const xpack& a, const xpack& b) \
+  { return _mm256_and_##SF(a.v,b.v); } \
+  friend xpack xbitor(const xpack& a, const xpack& b) \
+  { return _mm256_or_##SF(a.v,b.v); } \
+  friend xpack xshl(const xpack& a, int n) \
+  { \
+    return join(xshl(xpack<TYPE,W/2>(_mm256_cast##SF##256_##SF##128(a.v)),n), \
+                xshl(xpack<TYPE,W/2>(_mm256_extractf128_##SF(a.v,1)),n)); \
+  } \
+  friend xpack xshr(const xpack& a, int n) \
+  { \
+    return join(xshr(xpack<TYPE,W/2>(_mm256_cast##SF##256_##SF##128(a.v)),n), \
+                xshr(xpack<TYPE,W/2>(_mm256_extractf128_##SF(a.v,1)),n)); \
+  } \
+  static xpack join(const xpack<TYPE,W/2>& lo, const xpack<TYPE,W/2>& hi) \
+  { \
+    return _mm256_insertf128_##SF(_mm256_cast##SF##128_##SF##256(lo.v), \
+                                  hi.v,1); \
+  }
+
+// AVX-512 : masks are the k registers, one bit per lane.
+// The unmasked AVX-512 intrinsics of GCC 12 merge into an undefined
+// register, which -Wall reports as uninitialized once inlined, so min, max,
+// sqrt and the shifts use the masked forms, merging into A with every lane
+// set. They are the same instructions.
+#define XPACK_BIT_MASK(TYPE,W,PF,SF,MSK) \
+  struct mask \
+  { \
+    MSK m; \
+    friend mask operator&(const mask& x, const mask& y) \
+    { mask r = {MSK(x.m & y.m)}; return r; } \
+    friend mask operator|(const mask& x, const mask& y) \
+    { mask r = {MSK(x.m | y.m)}; return r; } \
+    friend mask operator~(const mask& x) { mask r = {MSK(~x.m)}; return r; } \
+    friend bool xany(const mask& x) { return x.m != 0; } \
+    friend bool xall(const mask& x) { return x.m == MSK((1u<<W)-1); } \
+  }; \
+  friend xpack operator-(const xpack& a) \
+  { \
+    return PF##_castsi512_##SF(PF##_xor_si512(PF##_cast##SF##_si512(a.v), \
+             PF##_cast##SF##_si512(PF##_set1_##SF(TYPE(-0.0))))); \
+  } \
+  friend xpack xabs(const xpack& a) { return PF##_abs_##SF(a.v); } \
+  friend xpack xmin(const xpack& a, const xpack& b) \
+  { return PF##_mask_min_##SF(a.v,MSK(-1),a.v,b.v); } \
+  friend xpack xmax(const xpack& a, const xpack& b) \
+  { return PF##_mask_max_##SF(a.v,MSK(-1),a.v,b.v); } \
+  friend xpack xsqrt(const xpack& a) \
+  { return PF##_mask_sqrt_##SF(a.v,MSK(-1),a.v); } \
+  friend mask operator<(const xpack& a, const xpack& b) \
+  { mask r = {PF##_cmp_##SF##_mask(a.v,b.v,_CMP_LT_OQ)}; return r; } \
+  friend mask operator<=(const xpack& a, const xpack& b) \
+  { mask r = {PF##_cmp_##SF##_mask(a.v,b.v,_CMP_LE_OQ)}; return r; } \
+  friend mask operator>(const xpack& a, const xpack& b) \
+  { mask r = {PF##_cmp_##SF##_mask(a.v,b.v,_CMP_GT_OQ)}; return r; } \
+  friend mask operator>=(const xpack& a, const xpack& b) \
+  { mask r = {PF##_cmp_##SF##_mask(a.v,b.v,_CMP_GE_OQ)}; return r; } \
+  friend mask operator==(const xpack& a, const xpack& b) \
+  { mask r = {PF##_cmp_##SF##_mask(a.v,b.v,_CMP_EQ_OQ)}; return r; } \
+  friend mask operator!=(const xpack& a, const xpack& b) \
+  { mask r = {PF##_cmp_##SF##_mask(a.v,b.v,_CMP_NEQ_UQ)}; return r; } \
+  friend xpack xselect(const mask& m, const xpack& a, const xpack& b) \
+  { return PF##_mask_blend_##SF(m.m,b.v,a.v); }
+
+#if !defined(SIMD_SCALAR) && (defined(__SSE2__) || defined(_M_X64))
+template<> struct xpack<f64,2>
+{
+  XPACK_INTRINSICS(f64,2,__m128d,_mm,pd,XPACK_FMA_VEX)
+  XPACK_VECTOR_MASK(f64,2,__m128d,_mm,pd,128,XPACK_CMP_SSE)
+  XPACK_INT_BITS(_mm,pd,128,epi64,XPACK_SHIFT_VEX)
+};
+template<> struct xpack<f32,4>
+{
+  XPACK_INTRINSICS(f32,4,__m128,_mm,ps,XPACK_FMA_VEX)
+  XPACK_VECTOR_MASK(f32,4,__m128,_mm,ps,128,XPACK_CMP_SSE)
+  XPACK_INT_BITS(_mm,ps,128,epi32,XPACK_SHIFT_VEX)
+};
+#endif
+
+#if !defined(SIMD_SCALAR) && defined(__AVX__)
+template<> struct xpack<f64,4>
+{
+  XPACK_INTRINSICS(f64,4,__m256d,_mm256,pd,XPACK_FMA_VEX)
+  XPACK_VECTOR_MASK(f64,4,__m256d,_mm256,pd,256,XPACK_CMP_AVX)
+#ifdef __AVX2__
+  XPACK_INT_BITS(_mm256,pd,256,epi64,XPACK_SHIFT_VEX)
+#else
+  XPACK_SPLIT_BITS(f64,4,pd)
+#endif
+};
+template<> struct xpack<f32,8>
+{
+  XPACK_INTRINSICS(f32,8,__m256,_mm256,ps,XPACK_FMA_VEX)
+  XPACK_VECTOR_MASK(f32,8,__m256,_mm256,ps,256,XPACK_CMP_AVX)
+#ifdef __AVX2__
+  XPACK_INT_BITS(_mm256,ps,256,epi32,XPACK_SHIFT_VEX)
+#else
+  XPACK_SPLIT_BITS(f32,8,ps)
+#endif
+};
+#endif
+
+#if !defined(SIMD_SCALAR) && defined(__AVX512F__)
+template<> struct xpack<f64,8>
+{
+  XPACK_INTRINSICS(f64,8,__m512d,_mm512,pd,XPACK_FMA_NATIVE)
+  XPACK_BIT_MASK(f64,8,_mm512,pd,__mmask8)
+  XPACK_INT_BITS(_mm512,pd,512,epi64,XPACK_SHIFT_K)
+};
+template<> struct xpack<f32,16>
+{
+  XPACK_INTRINSICS(f32,16,__m512,_mm512,ps,XPACK_FMA_NATIVE)
+  XPACK_BIT_MASK(f32,16,_mm512,ps,__mmask16)
+  XPACK_INT_BITS(_mm512,ps,512,epi32,XPACK_SHIFT_K)
+};
+#endif
+
+#undef XPACK_ASSIGN_OPS
+#undef XPACK_INTRINSICS
+#undef XPACK_FMA_NATIVE
+#undef XPACK_FMA_EMULATED
+#undef XPACK_FMA_VEX
+#undef XPACK_CMP_SSE
+#undef XPACK_CMP_AVX
+#undef XPACK_VECTOR_MASK
+#undef XPACK_BIT_MASK
+#undef XPACK_INT_BITS
+#undef XPACK_SHIFT_VEX
+#undef XPACK_SHIFT_K
+#undef XPACK_SPLIT_BITS
+
+// Pack of the widest register of the build
+xtem(xtn TYPE)
+struct xsimdwidth : std::integral_constant<szt,
+  (SIMD_BYTES/SOF(TYPE) > 0) ? SIMD_BYTES/SOF(TYPE) : 1> {};
+
+xtem(xtn TYPE) using xnpack = xpack<TYPE,xsimdwidth<TYPE>::value>;
+
+//---------------------------------------------------------------------------//
+// Mathematics of packs, lane by lane. See "Mathematics" for the scalars.
+//---------------------------------------------------------------------------//
+xtem(xtn TYPE, szt W) inline
+xpack<TYPE,W> xsq(const xpack<TYPE,W>& x)
+{
+  return x*x;
+}
+
+xtem(xtn TYPE, szt W) inline
+xpack<TYPE,W> xcu(const xpack<TYPE,W>& x)
+{
+  return x*x*x;
+}
+
+// 1, 0 or -1 in every lane, like xsgn(TYPE X)
+xtem(xtn TYPE, szt W) inline
+xpack<TYPE,W> xsgn(const xpack<TYPE,W>& x)
+{
+  const xpack<TYPE,W> zero(TYPE(0)), one(TYPE(1));
+  return xselect(x > zero,one,zero) - xselect(x < zero,one,zero);
+}
+
+// Sum, minimum and maximum of the lanes of a pack
+xtem(xtn TYPE, szt W) inline
+TYPE xhsum(const xpack<TYPE,W>& x)
+{
+  TYPE t[W]; x.storeu(t);
+  // Pairwise, so that the rounding is the same for every instruction set
+  for(szt m=W;m>1;m=(m+1)/2)
+    for(szt k=0;k<m/2;++k) t[k] += t[k+(m+1)/2];
+  return t[0];
+}
+
+xtem(xtn TYPE, szt W) inline
+TYPE xhmin(const xpack<TYPE,W>& x)
+{
+  TYPE t[W]; x.storeu(t);
+  TYPE r = t[0];
+  for(szt k=1;k<W;++k) r = std::min(r,t[k]);
+  return r;
+}
+
+xtem(xtn TYPE, szt W) inline
+TYPE xhmax(const xpack<TYPE,W>& x)
+{
+  TYPE t[W]; x.storeu(t);
+  TYPE r = t[0];
+  for(szt k=1;k<W;++k) r = std::max(r,t[k]);
+  return r;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Elementary functions
+///////////////////////////////////////////////////////////////////////////////
+//---------------------------------------------------------------------------//
+// xexp xlog xsin xcos xtanh xpow of f32 and f64, written with the operations
+// of packs (see "SIMD packs"), so that they are vectorized like the SIMD
+// kernels instead of calling <cmath> once per element. They take a pack,
+// a scalar, which is computed as a pack of width 1, or an array expression
+// (see "Array expressions"), which is computed W elements at a time.
+// The accuracy is chosen by the first template argument :
+// + ACCURATE (default) : within about 1 ULP, and the special values (NaN,
+//   infinities, signed zeros, subnormals) and arguments of any size give
+//   the results of <cmath>. The reduced arguments are kept as sums of two
+//   values, which carry the rounding errors of the reductions.
+// + FAST : the same polynomials, without the rounding errors of the
+//   reductions and the special values. The arguments must be finite and,
+//   for xlog and xpow, positive normal numbers. Results below the smallest
+//   normal number are 0.
+//---------------------------------------------------------------------------//
+// Largest error in ULP, measured against long double on 10^7 arguments
+// spread over the range and on every f32, with and without FMA :
+//             ACCURATE       FAST          Range for FAST
+//             f64    f32     f64    f32
+// xexp        0.82   0.83    1.12   1.11    Any finite x
+// xlog        0.84   0.86    0.84   0.86    x > 0, normal
+// xsin xcos   1.02   1.03    2.42   2.46    |x| < 1e6 (f64), 6000 (f32)
+// xtanh       1.11   1.11    2.65   2.54    Any finite x
+// xpow        1.11   1.06    (*)    (*)     x > 0, normal
+// (*) FAST is xexp(y*xlog(x)), within 1.6 ULP for |y*log(x)| < 1, whose
+// error then grows to about |y*log(x)| ULP.
+// NOTE : ACCURATE xsin and xcos call <cmath> for the lanes beyond the range
+// of FAST, where the reduction by pi/2 of the packs is not exact.
+// NOTE : Do not build with -ffast-math, which removes the operations that
+// round to integers and split products.
+// NOTE : The speed comes from wide packs and FMA. With -march=native on
+// AVX-512, ACCURATE is 2.5 to 7 times as fast as glibc (xpow the least). Built
+// for the x86-64 baseline (SSE2, no FMA), the products of two values are
+// split in halves, while glibc picks FMA code at run time : ACCURATE xexp
+// and xtanh are still faster, xsin is as fast, and xlog and xpow are
+// slower, by about 1.1 and 1.5 times. FAST is faster in both builds.
+//---------------------------------------------------------------------------//
+// USE : On whole arrays, in packs of the widest SIMD register
+// >> ARR(f64) x(1,n), y(1,n);
+// >> y(1,n) = xexp(-xsq(x(1,n)))*xsin(x(1,n));
+// >> y(1,n) = xpow<FAST>(x(1,n),1.4);   // FAST accuracy
+//
+// USE : Inside loops, on scalars and packs
+// >> DO(i,1,n)
+// >>   y[i] = xtanh(x[i]);
+// >> ENDDO
+// >> pk p = xlog(pk::loadu(&x[i+1]));
+//---------------------------------------------------------------------------//
+enum xaccuracy { FAST, ACCURATE };
+
+// RET if TYPE is f32 or f64
+xtem(xtn TYPE, xtn RET)
+struct xifreal : std::enable_if<std::is_same<TYPE,f32>::value ||
+                                std::is_same<TYPE,f64>::value,RET> {};
+
+//---------------------------------------------------------------------------//
+// Constants of the functions for f64 and f32
+//---------------------------------------------------------------------------//
+xtem(xtn TYPE) struct xmathconst;
+
+template<> struct xmathconst<f64>
+{
+  static constexpr int bits = 64, mant = 52;   // Bits of TYPE and mantissa
+  static constexpr f64 bias = 1023.0;          // Bias of the exponent
+  static constexpr f64 shift = 4503599627370496.0;        // 2^mant
+  static constexpr f64 tiny = 2.2250738585072014e-308;    // Smallest normal
+  static constexpr f64 subscale = 18014398509481984.0;    // 2^54
+  static constexpr f64 subbits = 54.0;
+  static constexpr f64 split = 134217729.0;               // 2^27+1
+  // ln(2) = ln2hi + ln2lo, with n*ln2hi exact for |n| < 2^21
+  static constexpr f64 ln2hi = 6.93147180369123816490e-01;
+  static constexpr f64 ln2lo = 1.90821492927058770002e-10;
+  static constexpr f64 log2e = 1.4426950408889634;
+  static constexpr f64 sqrt2 = 1.4142135623730951;
+  // exp overflows above expmax, is 0 below expmin and subnormal below
+  // expnorm
+  static constexpr f64 expmax = 709.782712893384;
+  static constexpr f64 expmin = -745.1332191019412;
+  static constexpr f64 expnorm = -708.3964185322641;
+  // pi/2 = pio2a + pio2b + pio2c + pio2d, with q*pio2a and q*pio2b exact
+  // for |q| < 2^20, and the reduction exact below trigmax
+  static constexpr f64 pio2a = 1.57079632673412561417e+00;
+  static constexpr f64 pio2b = 6.07710050630396597660e-11;
+  static constexpr f64 pio2c = 2.02226624879595063154e-21;
+  static constexpr f64 pio2d = 1.0085854035872483e-37;
+  static constexpr f64 twoopi = 0.63661977236758138;
+  static constexpr f64 trigmax = 1.0e6;
+  // tanh(x) rounds to 1 above tanhmax
+  static constexpr f64 tanhmax = 20.0;
+  // x^y overflows or underflows for |y| above powymax, unless x is 1 :
+  // |log(x)| >= 2^-53 then, and y*log(x) stays finite in two values
+  static constexpr f64 powymax = 18446744073709551616.0;  // 2^64
+};
+
+template<> struct xmathconst<f32>
+{
+  static constexpr int bits = 32, mant = 23;
+  static constexpr f32 bias = 127.0f;
+  static constexpr f32 shift = 8388608.0f;
+  static constexpr f32 tiny = 1.17549435e-38f;
+  static constexpr f32 subscale = 33554432.0f;
+  static constexpr f32 subbits = 25.0f;
+  static constexpr f32 split = 4097.0f;
+  static constexpr f32 ln2hi = 0.693145751953125f;
+  static constexpr f32 ln2lo = 1.42860677e-06f;
+  static constexpr f32 log2e = 1.44269502f;
+  static constexpr f32 sqrt2 = 1.41421354f;
+  static constexpr f32 expmax = 88.7228394f;
+  static constexpr f32 expmin = -103.972076f;
+  static constexpr f32 expnorm = -87.3365479f;
+  // |q| < 2^12
+  static constexpr f32 pio2a = 1.57080078f;
+  static constexpr f32 pio2b = -4.45358455e-06f;
+  static constexpr f32 pio2c = -8.70551575e-10f;
+  static constexpr f32 pio2d = 5.72118892e-18f;
+  static constexpr f32 twoopi = 0.636619747f;
+  static constexpr f32 trigmax = 6000.0f;
+  static constexpr f32 tanhmax = 10.0f;
+  static constexpr f32 powymax = 4294967296.0f;          // 2^32
+};
+
+//---------------------------------------------------------------------------//
+// Polynomial c0 + c1*x + c2*x^2 + ... as E(x^2) + x*O(x^2), the even and
+// odd coefficients being two independent chains of Horner's rule
+//---------------------------------------------------------------------------//
+xtem(xtn PACK, xtn C) inline
+void xmath_poly2(const PACK&, PACK& e, PACK& o, C c0)
+{
+  e = PACK(c0); o = PACK(C(0));
+}
+
+xtem(xtn PACK, xtn C) inline
+void xmath_poly2(const PACK&, PACK& e, PACK& o, C c0, C c1)
+{
+  e = PACK(c0); o = PACK(c1);
+}
+
+xtem(xtn PACK, xtn C, xtn... CS) inline
+void xmath_poly2(const PACK& y, PACK& e, PACK& o, C c0, C c1, CS... cs)
+{
+  xmath_poly2(y,e,o,cs...);
+  e = xfma(e,y,PACK(c0));
+  o = xfma(o,y,PACK(c1));
+}
+
+xtem(xtn PACK, xtn... CS) inline
+PACK xmath_poly(const PACK& x, CS... cs)
+{
+  PACK e, o;
+  xmath_poly2(x*x,e,o,cs...);
+  return xfma(o,x,e);
+}
+
+//---------------------------------------------------------------------------//
+// Building blocks on packs
+//---------------------------------------------------------------------------//
+// Nearest integer, ties to even, for |x| < 2^(mant-1)
+xtem(xtn TYPE, szt W) inline
+xpack<TYPE,W> xmath_round(const xpack<TYPE,W>& x)
+{
+  const TYPE m = TYPE(1.5)*xmathconst<TYPE>::shift;
+  return (x + m) - m;
+}
+
+// 2^n for integer n with 1-bias <= n <= bias
+xtem(xtn TYPE, szt W) inline
+xpack<TYPE,W> xmath_pow2(const xpack<TYPE,W>& n)
+{
+  typedef xmathconst<TYPE> C;
+  // n+bias is in the low bits of the mantissa of t, then in the exponent
+  return xshl(n + (C::shift + C::bias),C::mant);
+}
+
+// x = m*2^e with sqrt(1/2) <= m < sqrt(2), for a positive normal x
+xtem(xtn TYPE, szt W) inline
+void xmath_frexp(const xpack<TYPE,W>& x, xpack<TYPE,W>& m, xpack<TYPE,W>& e)
+{
+  typedef xpack<TYPE,W> pack;
+  typedef xmathconst<TYPE> C;
+  const int top = C::bits - C::mant;
+  e = xbitor(xshr(x,C::mant),pack(C::shift)) - (C::shift + C::bias);
+  m = xbitor(xshr(xshl(x,top),top),pack(TYPE(1)));
+  const xtn pack::mask big = m > pack(C::sqrt2);
+  m = xselect(big,m*TYPE(0.5),m);
+  e = xselect(big,e+TYPE(1),e);
+}
+
+// s = a+b exactly, with the rounding error in t. s and t may be a and b.
+xtem(xtn PACK) inline
+void xmath_twosum(const PACK& a, const PACK& b, PACK& s, PACK& t)
+{
+  const PACK u = a + b, v = u - a;
+  t = (a - (u - v)) + (b - v);
+  s = u;
+}
+
+// p = a*b exactly, with the rounding error in t. Without FMA, a and b are
+// split in halves whose products are exact (Dekker).
+xtem(xtn TYPE, szt W) inline
+void xmath_twoprod(const xpack<TYPE,W>& a, const xpack<TYPE,W>& b,
+                   xpack<TYPE,W>& p, xpack<TYPE,W>& t)
+{
+  p = a*b;
+#ifdef __FMA__
+  t = xfma(a,b,-p);
+#else
+  typedef xpack<TYPE,W> pack;
+  const TYPE sp = xmathconst<TYPE>::split;
+  const pack ca = a*sp, cb = b*sp;
+  const pack ah = ca - (ca - a), al = a - ah;
+  const pack bh = cb - (cb - b), bl = b - bh;
+  t = (((ah*bh - p) + ah*bl) + al*bh) + al*bl;
+#endif
+}
+
+// Is v >= 0 an integer ?
+xtem(xtn TYPE, szt W) inline
+xtn xpack<TYPE,W>::mask xmath_isint(const xpack<TYPE,W>& v)
+{
+  typedef xpack<TYPE,W> pack;
+  const pack s(xmathconst<TYPE>::shift);
+  return (v >= s) | ((v + s) - s == v);
+}
+
+//---------------------------------------------------------------------------//
+// Polynomials, fitted at the Chebyshev nodes of their interval
+//---------------------------------------------------------------------------//
+// (exp(r)-1-r)/r^2 for |r| <= ln(2)/2
+xtem(szt W) inline
+xpack<f64,W> xmath_exppoly(const xpack<f64,W>& r)
+{
+  return xmath_poly(r,0.50000000000000011,0.16666666666666669,
+                    0.041666666666624164,0.008333333333330065,
+                    0.0013888888917196719,0.00019841269863040545,
+                    2.4801521322368692e-05,2.7557268480310024e-06,
+                    2.7620075879983367e-07,2.5100375832561234e-08);
+}
+
+xtem(szt W) inline
+xpack<f32,W> xmath_exppoly(const xpack<f32,W>& r)
+{
+  return xmath_poly(r,0.5f,0.166665778f,0.0416665561f,0.00836317334f,
+                    0.00139261759f);
+}
+
+// (2*atanh(s)-2*s)/s^3 for z = s^2 <= (3-2*sqrt(2))^2
+xtem(szt W) inline
+xpack<f64,W> xmath_logpoly(const xpack<f64,W>& z)
+{
+  return xmath_poly(z,0.66666666666666663,0.40000000000000879,
+                    0.28571428570803614,0.22222222391713917,
+                    0.18181795640132906,0.15386239702814658,
+                    0.13268773138656886,0.13086626147840102);
+}
+
+xtem(szt W) inline
+xpack<f32,W> xmath_logpoly(const xpack<f32,W>& z)
+{
+  return xmath_poly(z,0.666666865f,0.3998878f,0.295799494f);
+}
+
+// (sin(r)-r)/r^3 and (cos(r)-1+r^2/2)/r^4 for z = r^2 <= (pi/4)^2
+xtem(szt W) inline
+xpack<f64,W> xmath_sinpoly(const xpack<f64,W>& z)
+{
+  return xmath_poly(z,-0.16666666666666666,0.008333333333330948,
+                    -0.00019841269836758574,2.7557316102552439e-06,
+                    -2.5051131845003624e-08,1.5918129294866608e-10);
+}
+
+xtem(szt W) inline
+xpack<f32,W> xmath_sinpoly(const xpack<f32,W>& z)
+{
+  return xmath_poly(z,-0.166666642f,0.00833274797f,-0.000195878907f);
+}
+
+xtem(szt W) inline
+xpack<f64,W> xmath_cospoly(const xpack<f64,W>& z)
+{
+  return xmath_poly(z,0.041666666666666664,-0.0013888888888887398,
+                    2.4801587298765689e-05,-2.7557317271729793e-07,
+                    2.0876146268403199e-09,-1.1382632425521717e-11);
+}
+
+xtem(szt W) inline
+xpack<f32,W> xmath_cospoly(const xpack<f32,W>& z)
+{
+  return xmath_poly(z,0.0416666642f,-0.00138883025f,2.45479423e-05f);
+}
+
+//---------------------------------------------------------------------------//
+// exp(x) = 2^n*exp(r), with x = n*ln(2) + r
+//---------------------------------------------------------------------------//
+// exp(a+b) for expmin <= a <= expmax and |b| below the ulp of a, with r
+// and 1+r as sums of two values
+xtem(xtn TYPE, szt W) inline
+xpack<TYPE,W> xmath_exp(const xpack<TYPE,W>& a, const xpack<TYPE,W>& b)
+{
+  typedef xpack<TYPE,W> pack;
+  typedef xmathconst<TYPE> C;
+  const pack one(TYPE(1));
+  const pack n = xmath_round(a*C::log2e);
+  pack rh, rl;
+  xmath_twosum(xfma(n,pack(-C::ln2hi),a),xfma(n,pack(-C::ln2lo),b),rh,rl);
+  const pack q = rh*rh*xmath_exppoly(rh), h = one + rh;
+  const pack p = h + (((one - h) + rh) + (q + xfma(rl,rh,rl)));
+  // 2^n in two factors, for n = bias+1 and the subnormal results
+  const pack n1 = xmath_round(n*TYPE(0.5));
+  return (p*xmath_pow2(n1))*xmath_pow2(n-n1);
+}
+
+xtem(xaccuracy ACC=ACCURATE, xtn TYPE, szt W) inline
+xpack<TYPE,W> xexp(const xpack<TYPE,W>& x)
+{
+  typedef xpack<TYPE,W> pack;
+  typedef xmathconst<TYPE> C;
+  const pack lo(ACC == FAST ? TYPE(C::expnorm) : TYPE(C::expmin));
+  const pack hi(C::expmax);
+  const pack a = xmin(xmax(x,lo),hi);
+  pack y;
+  if(ACC == FAST) {
+    const pack n = xmath_round(a*C::log2e);
+    pack r = xfma(n,pack(-C::ln2hi),a);
+    r = xfma(n,pack(-C::ln2lo),r);
+    const pack p = xfma(r*r,xmath_exppoly(r),r) + TYPE(1);
+    const pack n1 = xmath_round(n*TYPE(0.5));
+    y = (p*xmath_pow2(n1))*xmath_pow2(n-n1);
+  } else {
+    y = xmath_exp(a,pack(TYPE(0)));
+  }
+  y = xselect(x > hi,pack(std::numeric_limits<TYPE>::infinity()),y);
+  y = xselect(x < lo,pack(TYPE(0)),y);
+  if(ACC == ACCURATE) y = xselect(x == x,y,x);
+  return y;
+}
+
+//---------------------------------------------------------------------------//
+// log(x) = e*ln(2) + log(1+f), with x = 2^e*(1+f) and, for s = f/(2+f),
+// log(1+f) = f - f^2/2 + s*(f^2/2 + s^2*P(s^2))
+//---------------------------------------------------------------------------//
+xtem(xaccuracy ACC=ACCURATE, xtn TYPE, szt W) inline
+xpack<TYPE,W> xlog(const xpack<TYPE,W>& x)
+{
+  typedef xpack<TYPE,W> pack;
+  typedef xmathconst<TYPE> C;
+  // Subnormals scaled to normals
+  const xtn pack::mask sub = x < pack(C::tiny);
+  pack m, e;
+  xmath_frexp(ACC == FAST ? x : xselect(sub,x*C::subscale,x),m,e);
+  if(ACC == ACCURATE) e = xselect(sub,e-C::subbits,e);
+  const pack f = m - TYPE(1), s = f/(f + TYPE(2)), z = s*s;
+  const pack hfsq = TYPE(0.5)*f*f, r = z*xmath_logpoly(z);
+  pack y = xfma(e,pack(C::ln2hi),
+                f - (hfsq - xfma(s,hfsq + r,e*C::ln2lo)));
+  if(ACC == ACCURATE) {
+    const TYPE inf = std::numeric_limits<TYPE>::infinity();
+    y = xselect(x == pack(TYPE(0)),pack(-inf),y);
+    y = xselect(x < pack(TYPE(0)),
+                pack(std::numeric_limits<TYPE>::quiet_NaN()),y);
+    y = xselect(x == pack(inf),x,y);
+    y = xselect(x == x,y,x);
+  }
+  return y;
+}
+
+//---------------------------------------------------------------------------//
+// sin(x) or cos(x) (COS) from sin(r) and cos(r), with x = q*pi/2 + r.
+// ACCURATE keeps r as rh + rl, rl being the rounding error of rh, and
+// subtracts q*pio2c exactly, for the x close to a multiple of pi/2.
+//---------------------------------------------------------------------------//
+xtem(xaccuracy ACC, bool COS, xtn TYPE, szt W) inline
+xpack<TYPE,W> xmath_sincos(const xpack<TYPE,W>& x)
+{
+  typedef xpack<TYPE,W> pack;
+  typedef xmathconst<TYPE> C;
+  const pack q = xmath_round(x*C::twoopi);
+  // x - q*pio2a and q*pio2b are exact
+  const pack a = xfma(q,pack(-C::pio2a),x);
+  pack rh, rl(TYPE(0));
+  if(ACC == FAST) {
+    rh = xfma(q,pack(-C::pio2c),xfma(q,pack(-C::pio2b),a));
+  } else {
+    pack ph, pl, e;
+    xmath_twosum(a,-(q*C::pio2b),rh,rl);
+    xmath_twoprod(q,pack(C::pio2c),ph,pl);
+    xmath_twosum(rh,-ph,rh,e);
+    rl = xfma(q,pack(-C::pio2d),(rl + e) - pl);
+    xmath_twosum(rh,rl,rh,rl);
+  }
+  const pack z = rh*rh;
+  const pack s = xfma(rh*z,xmath_sinpoly(z),rl) + rh;
+  const pack hz = TYPE(0.5)*z, w = TYPE(1) - hz;
+  const pack c = w + (((TYPE(1) - w) - hz) +
+                      xfma(z*z,xmath_cospoly(z),-(rh*rl)));
+  // Quadrant k of x, and m = k mod 4 in -2:2, where sin(x) is s, c, -s, -c
+  // for m = 0, 1, 2 or -2, -1
+  const pack k = COS ? q + TYPE(1) : q;
+  const pack m = k - TYPE(4)*xmath_round(k*TYPE(0.25));
+  pack y = xselect(xabs(m) == pack(TYPE(1)),c,s);
+  y = xselect((m < pack(TYPE(0))) | (m > pack(TYPE(1.5))),-y,y);
+  if(ACC == ACCURATE) {
+    const xtn pack::mask big = xabs(x) > pack(C::trigmax);
+    if(xany(big)) {
+      TYPE t[W], u[W];
+      x.storeu(t); y.storeu(u);
+      for(szt l=0;l<W;++l)
+        if(std::abs(t[l]) > C::trigmax)
+          u[l] = COS ? std::cos(t[l]) : std::sin(t[l]);
+      y = pack::loadu(u);
+    }
+    // sin(-0) = -0
+    if(!COS) y = xselect(x == pack(TYPE(0)),x,y);
+  }
+  return y;
+}
+
+xtem(xaccuracy ACC=ACCURATE, xtn TYPE, szt W) inline
+xpack<TYPE,W> xsin(const xpack<TYPE,W>& x)
+{
+  return xmath_sincos<ACC,false>(x);
+}
+
+xtem(xaccuracy ACC=ACCURATE, xtn TYPE, szt W) inline
+xpack<TYPE,W> xcos(const xpack<TYPE,W>& x)
+{
+  return xmath_sincos<ACC,true>(x);
+}
+
+//---------------------------------------------------------------------------//
+// tanh(x) = e/(e+2), with e = exp(2|x|)-1 = 2^n*(exp(r)-1) + 2^n-1, and the
+// sign of x. ACCURATE keeps e and e+2 as sums of two values, and corrects
+// the quotient by its remainder.
+//---------------------------------------------------------------------------//
+xtem(xaccuracy ACC=ACCURATE, xtn TYPE, szt W) inline
+xpack<TYPE,W> xtanh(const xpack<TYPE,W>& x)
+{
+  typedef xpack<TYPE,W> pack;
+  typedef xmathconst<TYPE> C;
+  const pack one(TYPE(1)), two(TYPE(2));
+  const pack u = two*xmin(xabs(x),pack(C::tanhmax));
+  const pack n = xmath_round(u*C::log2e), t = xmath_pow2(n);
+  pack y;
+  if(ACC == FAST) {
+    pack r = xfma(n,pack(-C::ln2hi),u);
+    r = xfma(n,pack(-C::ln2lo),r);
+    const pack e = xfma(t,xfma(r*r,xmath_exppoly(r),r),t - one);
+    y = e/(e + two);
+  } else {
+    pack rh, rl, ph, pl, eh, el, dh, dl;
+    xmath_twosum(xfma(n,pack(-C::ln2hi),u),-(n*C::ln2lo),rh,rl);
+    xmath_twosum(rh,rh*rh*xmath_exppoly(rh),ph,pl);
+    xmath_twosum(t*ph,t - one,eh,el);
+    el = xfma(t,pl + xfma(rl,rh,rl),el);
+    xmath_twosum(eh,two,dh,dl);
+    dl = dl + el;
+    y = eh/dh;
+    xmath_twoprod(y,dh,ph,pl);
+    y = y + ((((eh - ph) - pl) + el) - y*dl)/dh;
+  }
+  y = xbitor(y,xbitand(x,pack(TYPE(-0.0))));
+  if(ACC == ACCURATE) y = xselect(x == x,y,x);
+  return y;
+}
+
+//---------------------------------------------------------------------------//
+// x^y = exp(y*log(x)). ACCURATE computes log(x) and y*log(x) as sums of two
+// values, so that exp gets the bits of y*log(x) that a single value would
+// lose, and gives the special values of std::pow.
+//---------------------------------------------------------------------------//
+xtem(xaccuracy ACC=ACCURATE, xtn TYPE, szt W) inline
+xpack<TYPE,W> xpow(const xpack<TYPE,W>& x, const xpack<TYPE,W>& y)
+{
+  typedef xpack<TYPE,W> pack;
+  typedef xtn pack::mask mask;
+  typedef xmathconst<TYPE> C;
+  if(ACC == FAST) return xexp<FAST>(y*xlog<FAST>(x));
+
+  const TYPE inf = std::numeric_limits<TYPE>::infinity();
+  const pack zero(TYPE(0)), one(TYPE(1)), ax = xabs(x);
+  // log(|x|) = lh + ll, like xlog with f/(2+f) = sh + sl
+  const mask sub = ax < pack(C::tiny);
+  pack m, e;
+  xmath_frexp(xselect(sub,ax*C::subscale,ax),m,e);
+  e = xselect(sub,e-C::subbits,e);
+  const pack f = m - TYPE(1);
+  pack dh, dl, ph, pl, lh, ll;
+  xmath_twosum(m,one,dh,dl);
+  const pack sh = f/dh;
+  xmath_twoprod(sh,dh,ph,pl);
+  const pack sl = (((f - ph) - pl) - sh*dl)/dh, z = sh*sh;
+  xmath_twosum(e*C::ln2hi,sh+sh,lh,ll);
+  ll = ll + (xfma(sl+sl,z,sl+sl) +
+             xfma(sh*z,xmath_logpoly(z),e*C::ln2lo));
+  xmath_twosum(lh,ll,lh,ll);
+  // y*log(|x|) = yh + yl, and its exp. y is clamped to powymax, which
+  // gives the same overflow or underflow, so that yh and the split of y
+  // without FMA stay finite.
+  const pack yc = xmin(xmax(y,pack(-C::powymax)),pack(C::powymax));
+  pack yh, yl;
+  xmath_twoprod(yc,lh,yh,yl);
+  xmath_twosum(yh,xfma(yc,ll,yl),yh,yl);
+  const pack lo(C::expmin), hi(C::expmax);
+  pack v = xmath_exp(xmin(xmax(yh,lo),hi),yl);
+  v = xselect(yh > hi,pack(inf),v);
+  v = xselect(yh < lo,zero,v);
+
+  // |x| or y 0 or infinite : 0 or inf, from the sign of y*log(|x|)
+  const pack ay = xabs(y);
+  const mask toinf = ((ax > one) & (y > zero)) | ((ax < one) & (y < zero));
+  const mask edge = (ax == zero) | (ax == pack(inf)) | (ay == pack(inf));
+  v = xselect(edge,xselect(toinf,pack(inf),zero),v);
+  // x < 0 or -0 : -|x|^y for odd integers y, NaN for y not an integer
+  const mask yint = xmath_isint(ay);
+  const mask odd = yint & ~xmath_isint(ay*TYPE(0.5));
+  v = xselect((xbitor(xbitand(x,pack(TYPE(-0.0))),one) < zero) & odd,-v,v);
+  v = xselect((x < zero) & (x > pack(-inf)) & ~yint,
+              pack(std::numeric_limits<TYPE>::quiet_NaN()),v);
+  // NaN, and 1 for y = 0, x = 1 (even with the other NaN) and x = -1 with
+  // y infinite
+  v = xselect((x == x) & (y == y),v,x + y);
+  v = xselect((y == zero) | (x == one) | ((ax == one) & (ay == pack(inf))),
+              one,v);
+  return v;
+}
+
+xtem(xaccuracy ACC=ACCURATE, xtn TYPE, szt W) inline
+xpack<TYPE,W> xpow(const xpack<TYPE,W>& x, xtn xpack<TYPE,W>::value_type y)
+{
+  return xpow<ACC>(x,xpack<TYPE,W>(y));
+}
+
+xtem(xaccuracy ACC=ACCURATE, xtn TYPE, szt W) inline
+xpack<TYPE,W> xpow(xtn xpack<TYPE,W>::value_type x, const xpack<TYPE,W>& y)
+{
+  return xpow<ACC>(xpack<TYPE,W>(x),y);
+}
+
+//---------------------------------------------------------------------------//
+// The functions of an f32 or f64, as a pack of width 1
+//---------------------------------------------------------------------------//
+#define XMATH_SCALAR(NAME) \
+xtem(xaccuracy ACC=ACCURATE, xtn TYPE) inline \
+xtn xifreal<TYPE,TYPE>::type NAME(TYPE x) \
+{ \
+  return NAME<ACC>(xpack<TYPE,1>(x))[0]; \
+}
+
+XMATH_SCALAR(xexp)
+XMATH_SCALAR(xlog)
+XMATH_SCALAR(xsin)
+XMATH_SCALAR(xcos)
+XMATH_SCALAR(xtanh)
+
+#undef XMATH_SCALAR
+
+// x^y in f32 for two f32, else in f64, like std::pow but for long double
+xtem(xtn A, xtn B, bool = std::is_arithmetic<A>::value &&
+                          std::is_arithmetic<B>::value)
+struct xpowtype {};
+xtem(xtn A, xtn B)
+struct xpowtype<A,B,true>
+  : std::conditional<std::is_same<A,f32>::value &&
+                     std::is_same<B,f32>::value,f32,f64> {};
+
+xtem(xaccuracy ACC=ACCURATE, xtn A, xtn B) inline
+xtn xpowtype<A,B>::type
+xpow(A x, B y)
+{
+  typedef xtn xpowtype<A,B>::type TYPE;
+  return xpow<ACC>(xpack<TYPE,1>(TYPE(x)),xpack<TYPE,1>(TYPE(y)))[0];
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// NUMA topology
+///////////////////////////////////////////////////////////////////////////////
+//---------------------------------------------------------------------------//
+// On machines of several sockets, each socket (NUMA node) has its own
+// memory, and the memory of another node is read at a fraction of the
+// bandwidth. Linux puts a page on the node of the thread that first writes
+// it (first touch), so an array filled by one thread lives on one node, and
+// a parallel sweep over it runs at the bandwidth of that node alone.
+// + xnuma()        : the nodes and their CPUs, read from /sys on Linux
+// + xpinpolicy     : the CPUs of the threads of the pool (see xpool_init)
+//   NOPIN   : threads are not bound
+//   COMPACT : thread k on the k-th CPU, the CPUs of node 0 first
+//   SCATTER : threads dealt round robin to the nodes
+// + xpagenodes     : no. of pages of some memory on every node
+// + See "First touch" to place the pages of arrays with their threads.
+//---------------------------------------------------------------------------//
+// NOTE : Without /sys/devices/system/node (one socket, or not Linux) there
+// is one node of every CPU the process may run on : pinning still works,
+// and the first touch is an ordinary allocation.
+// NOTE : The CPUs are the Linux CPU ids of the affinity mask of the
+// process, which may be sparse, as with offline CPUs or cgroup cpusets.
+// NOTE : The node indices used here are 0 to nodes()-1, in the order of
+// the node ids of Linux, see xnumatopo::id.
+//---------------------------------------------------------------------------//
+// USE :
+// >> const xnumatopo& topo = xnuma();
+// >> cout<<topo.nodes()<<" nodes, "<<topo.cpus(0).size()<<" CPUs on the "
+// >>     <<"first"<<endl;
+// >> xpool_init(0,SCATTER);            // Or SCICPP_PIN=scatter
+//---------------------------------------------------------------------------//
+enum xpinpolicy { NOPIN, COMPACT, SCATTER };
+
+// CPUs of a list of /sys, like "0-3,8-11"
+inline std::vector<szt> xparse_cpulist(const xstr& s)
+{
+  std::vector<szt> r;
+  const char* p = s.c_str();
+  while(*p) {
+    char* e;
+    const long a = std::strtol(p,&e,10);
+    if(e == p) { ++p; continue; }
+    long b = a;
+    p = e;
+    if(*p == '-') { b = std::strtol(p+1,&e,10); p = e; }
+    for(long k=a;k<=b;++k) r.push_back(static_cast<szt>(k));
+  }
+  return r;
+}
+
+class xnumatopo
+{
+public:
+  xnumatopo()
+  {
+#ifdef __linux__
+    // The CPUs the process may run on, before any thread is pinned
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    const bool aff = sched_getaffinity(0,sizeof(allowed),&allowed) == 0;
+    std::ifstream on("/sys/devices/system/node/online");
+    xstr line;
+    if(on && std::getline(on,line)) {
+      const std::vector<szt> ids = xparse_cpulist(line);
+      for(szt k=0;k<ids.size();++k) {
+        std::ifstream f("/sys/devices/system/node/node"+
+                        std::to_string(ids[k])+"/cpulist");
+        xstr l;
+        std::vector<szt> c;
+        if(f && std::getline(f,l)) c = xparse_cpulist(l);
+        if(aff) {
+          c.erase(std::remove_if(c.begin(),c.end(),[&](szt x) {
+            return x >= CPU_SETSIZE || !CPU_ISSET(x,&allowed); }),c.end());
+        }
+        ids_.push_back(ids[k]);
+        cpus_.push_back(c);
+      }
+    }
+#endif
+    szt ncpu = 0;
+    for(szt k=0;k<cpus_.size();++k) ncpu += cpus_[k].size();
+    if(ncpu == 0) {
+      // One node of every CPU, those of the affinity mask if known
+      ids_.assign(1,0);
+      cpus_.assign(1,std::vector<szt>());
+#ifdef __linux__
+      if(aff)
+        for(szt c=0;c<CPU_SETSIZE;++c)
+          if(CPU_ISSET(c,&allowed)) cpus_[0].push_back(c);
+#endif
+      if(cpus_[0].empty()) {
+        const szt n = std::max(1u,std::thread::hardware_concurrency());
+        for(szt c=0;c<n;++c) cpus_[0].push_back(c);
+      }
+    }
+    for(szt k=0;k<cpus_.size();++k) {
+      if(!cpus_[k].empty()) withcpu_.push_back(k);
+      for(szt j=0;j<cpus_[k].size();++j) {
+        const szt c = cpus_[k][j];
+        if(c >= node_.size()) node_.resize(c+1,-1);
+        node_[c] = s32(k);
+        all_.push_back(c);
+      }
+    }
+  }
+
+  // No. of nodes, the id Linux gives node k, and the CPUs of node k
+  szt nodes() const { return cpus_.size(); }
+  szt id(szt k) const { return ids_[k]; }
+  const std::vector<szt>& cpus(szt k) const { return cpus_[k]; }
+
+  // Node of the CPU C, -1 if unknown
+  s32 node_of_cpu(szt c) const { return c < node_.size() ? node_[c] : -1; }
+
+  // Node index of the Linux node id, -1 if unknown
+  s32 index_of_id(s64 id) const
+  {
+    for(szt k=0;k<ids_.size();++k) if(s64(ids_[k]) == id) return s32(k);
+    return -1;
+  }
+
+  // CPU of thread T of a pool pinned by P
+  szt cpu(szt t, xpinpolicy p) const
+  {
+    if(p == SCATTER) {
+      const std::vector<szt>& c = cpus_[withcpu_[t % withcpu_.size()]];
+      return c[(t/withcpu_.size()) % c.size()];
+    }
+    return all_[t % all_.size()];
+  }
+
+private:
+  std::vector<szt> ids_;
+  std::vector<std::vector<szt> > cpus_;
+  std::vector<szt> withcpu_;            // Nodes that have CPUs
+  std::vector<szt> all_;                // CPUs in node order
+  std::vector<s32> node_;               // Node of every CPU
+};
+
+// The topology of the machine, read once
+inline const xnumatopo& xnuma()
+{
+  static const xnumatopo topo;
+  return topo;
+}
+
+//---------------------------------------------------------------------------//
+// Where the pages of some memory are : pages[k] on node k of xnuma(), and
+// unknown, those not touched yet or whose node the kernel does not give
+//---------------------------------------------------------------------------//
+struct xpageplace
+{
+  std::vector<s64> pages;
+  s64 unknown;
+
+  s64 total() const
+  {
+    return std::accumulate(pages.begin(),pages.end(),unknown);
+  }
+};
+
+inline xpageplace xpagenodes(const void* p, u64 bytes)
+{
+  const xnumatopo& topo = xnuma();
+  xpageplace r;
+  r.pages.assign(topo.nodes(),0);
+  r.unknown = 0;
+  if(bytes == 0) return r;
+#if defined(__linux__) && defined(SYS_move_pages)
+  const u64 ps = u64(sysconf(_SC_PAGESIZE));
+  const u64 a = reinterpret_cast<u64>(p)/ps*ps;
+  const u64 e = reinterpret_cast<u64>(p)+bytes;
+  const s64 n = s64((e-a+ps-1)/ps);
+  // move_pages without target nodes only reports the node of each page
+  const s64 batch = 1024;
+  std::vector<void*> pg(batch);
+  std::vector<int> st(batch);
+  for(s64 i=0;i<n;i+=batch) {
+    const s64 m = std::min(batch,n-i);
+    for(s64 k=0;k<m;++k) pg[k] = reinterpret_cast<void*>(a+u64(i+k)*ps);
+    if(syscall(SYS_move_pages,0,m,pg.data(),0,st.data(),0) != 0) {
+      r.unknown += m;
+      continue;
+    }
+    for(s64 k=0;k<m;++k) {
+      const s32 nd = st[k] >= 0 ? topo.index_of_id(st[k]) : -1;
+      if(nd >= 0) ++r.pages[nd];
+      else ++r.unknown;
+    }
+  }
+#else
+  const u64 ps = 4096;
+  r.unknown = s64((bytes+ps-1)/ps);
+  (void)p;
+#endif
+  return r;
+}
+
+// Prints the share of the pages on every node, like
+// "node 0 : 50.0%, node 1 : 50.0%"
+inline std::ostream& operator<<(std::ostream& os, const xpageplace& pl)
+{
+  const f64 n = f64(std::max<s64>(1,pl.total()));
+  char b[64];
+  for(szt k=0;k<pl.pages.size();++k) {
+    snprintf(b,sizeof(b),"%snode %u : %.1f%%",k ? ", " : "",
+             xnuma().id(k),100.0*f64(pl.pages[k])/n);
+    os<<b;
+  }
+  if(pl.unknown > 0) {
+    snprintf(b,sizeof(b),", unknown : %.1f%%",100.0*f64(pl.unknown)/n);
+    os<<b;
+  }
+  return os;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Parallel loops
+///////////////////////////////////////////////////////////////////////////////
+//---------------------------------------------------------------------------//
+// PARDO is the parallel DO : the iterations I = START to END, inclusive,
+// are shared among the threads of a pool. The pool is started once, when
+// the first parallel loop runs, and its threads wait for the next loop
+// instead of being created again, so a parallel loop in every time step
+// costs only a wake up. It needs no OpenMP.
+//---------------------------------------------------------------------------//
+// NOTE : The body is the body of a lambda that captures by reference.
+// So I is a copy, local to the iteration, return goes to the next iteration,
+// break and continue are not allowed, and the loop is closed by ENDPARDO.
+// NOTE : The type of I is taken from the variable I, like in DO.
+// NOTE : Iterations must be independent. An exception thrown by the body
+// is thrown again by the loop, once all the threads have stopped.
+// NOTE : A parallel loop inside another parallel loop runs serially.
+//---------------------------------------------------------------------------//
+// Threads : set by the environment variable SCICPP_THREADS, or by xpool_init
+// before the first parallel loop, default one per hardware thread.
+// Pinning : with SCICPP_PIN=compact (or 1) or scatter, or xpool_init(n,
+// COMPACT) etc., each thread is bound to one CPU, so it keeps its caches and
+// its NUMA node (Linux only). See xpinpolicy.
+//---------------------------------------------------------------------------//
+// USE : The FTBS step of the 1D nonlinear convection in parallel
+// >> u32 i;
+// >> DO(t,1,nt)
+// >>   af64& un = u.n(); af64& un1 = u.np1();
+// >>   PARDO(i,2,nx)
+// >>     un1[i] = un[i] - un[i]*dtdx*(un[i]-un[i-1]);
+// >>   ENDPARDO
+// >>   u.advance();
+// >> ENDDO
+//---------------------------------------------------------------------------//
+// USE : Schedules
+// >> PARDOS(i,1,n,xsched(STATIC))      // Equal blocks, one per thread
+// >> PARDOS(i,1,n,xsched(STATIC,64))   // Blocks of 64, round robin
+// >> PARDOS(i,1,n,xsched(CHUNKED,64))  // Blocks of 64, to the first free
+// >> PARDOS(i,1,n,xsched(GUIDED,16))   // Shrinking blocks, at least 16
+//---------------------------------------------------------------------------//
+// USE : Reductions, VAR is private to each thread inside the loop and the
+// results of the threads are combined with its value before the loop
+// >> f64 s = 0, lo = 1e30, hi = -1e30, p = 1;
+// >> PARSUM(s,i,1,n) s += x[i]*y[i]; ENDPARDO
+// >> PARMIN(lo,i,1,n) lo = std::min(lo,x[i]); ENDPARDO
+// >> PARMAX(hi,i,1,n) hi = std::max(hi,x[i]); ENDPARDO
+// >> // Any operation, given its identity and how 2 results are combined
+// >> auto prod = xmkreduction(1.0,[](f64 a, f64 b) { return a*b; });
+// >> PARREDUCE(p,prod,xsched(GUIDED),i,1,n) p *= x[i]; ENDPARDO
+//---------------------------------------------------------------------------//
+// NOTE : With STATIC scheduling and the same no. of threads, reductions give
+// the same result on every run. CHUNKED and GUIDED may round differently.
+//---------------------------------------------------------------------------//
+#define  PARDO(I,START,END) \
+  xparloop<decltype(I)>((START),(END),xsched(),[&](decltype(I) I) {
+#define xpardo(I,START,END) \
+  xparloop<decltype(I)>((START),(END),xsched(),[&](decltype(I) I) {
+#define  PARDOS(I,START,END,SCHED) \
+  xparloop<decltype(I)>((START),(END),(SCHED),[&](decltype(I) I) {
+#define xpardos(I,START,END,SCHED) \
+  xparloop<decltype(I)>((START),(END),(SCHED),[&](decltype(I) I) {
+#define  PARREDUCE(VAR,OP,SCHED,I,START,END) \
+  VAR = xparreduce<decltype(I)>((START),(END),(VAR),(OP),(SCHED), \
+    [&](decltype(I) I, xtn std::decay<decltype(VAR)>::type& VAR) {
+#define  PARSUM(VAR,I,START,END) \
+  PARREDUCE(VAR,xreduce_sum<xtn std::decay<decltype(VAR)>::type>(), \
+            xsched(),I,START,END)
+#define xparsum(VAR,I,START,END) PARSUM(VAR,I,START,END)
+#define  PARMIN(VAR,I,START,END) \
+  PARREDUCE(VAR,xreduce_min<xtn std::decay<decltype(VAR)>::type>(), \
+            xsched(),I,START,END)
+#define xparmin(VAR,I,START,END) PARMIN(VAR,I,START,END)
+#define  PARMAX(VAR,I,START,END) \
+  PARREDUCE(VAR,xreduce_max<xtn std::decay<decltype(VAR)>::type>(), \
+            xsched(),I,START,END)
+#define xparmax(VAR,I,START,END) PARMAX(VAR,I,START,END)
+#define ENDPARDO });
+#define xendpardo ENDPARDO
+
+//---------------------------------------------------------------------------//
+// How the iterations of a parallel loop are shared among the threads
+//---------------------------------------------------------------------------//
+// STATIC  : chunk 0 : one equal block per thread.
+//           chunk c : blocks of c iterations, dealt round robin.
+// CHUNKED : blocks of c iterations, each taken by the first free thread.
+//           For iterations of uneven cost. Default c gives 8 per thread.
+// GUIDED  : like CHUNKED, with blocks of the remaining iterations divided
+//           by twice the no. of threads, but at least c (default 1).
+//---------------------------------------------------------------------------//
+enum xschedule { STATIC, CHUNKED, GUIDED };
+
+struct xsched
+{
+  xschedule kind;
+  s64 chunk;
+
+  xsched(xschedule k=STATIC, s64 c=0) : kind(k), chunk(c) {}
+};
+
+//---------------------------------------------------------------------------//
+// Bind the calling thread to the CPU given (Linux only). CPU is a Linux CPU
+// id, one of those xnuma() found the process may run on. Returns false,
+// and prints why, if the thread is not bound.
+//---------------------------------------------------------------------------//
+inline bool xpin_thread(szt cpu)
+{
+#ifdef __linux__
+  if(cpu >= CPU_SETSIZE || xnuma().node_of_cpu(cpu) < 0) {
+    STREAM<<"ERROR :: THREAD NOT PINNED, CPU "<<cpu
+          <<" IS NOT ONE THE PROCESS MAY RUN ON"<<NL;
+    return false;
+  }
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu,&set);
+  const int e = pthread_setaffinity_np(pthread_self(),sizeof(set),&set);
+  if(e != 0) {
+    STREAM<<"ERROR :: THREAD NOT PINNED TO CPU "<<cpu<<" : "
+          <<std::strerror(e)<<NL;
+    return false;
+  }
+  return true;
+#else
+  (void)cpu;
+  return false;
+#endif
+}
+
+// Index of the calling thread in the pool, 0 outside of parallel loops
+inline szt& xthread_id()
+{
+  static thread_local szt id = 0;
+  return id;
+}
+
+// No. of parallel loops the calling thread is inside of
+inline s32& xparallel_depth()
+{
+  static thread_local s32 depth = 0;
+  return depth;
+}
+
+//---------------------------------------------------------------------------//
+// Persistent pool of threads. The caller of run() works as thread 0.
+//---------------------------------------------------------------------------//
+class xthreadpool
+{
+public:
+  // NTHREADS threads in all, including the caller, 0 for one per hardware
+  // thread. Thread k (and the caller as 0) is bound to the CPU xnuma() gives
+  // it for PIN. PIN true is COMPACT.
+  explicit xthreadpool(szt nthreads=0, xpinpolicy pin=NOPIN)
+    : job_(0), call_(0), gen_(0), pending_(0), stop_(false), pin_(pin)
+  {
+    if(nthreads == 0) nthreads = std::max(1u,std::thread::hardware_concurrency());
+    if(pin_ != NOPIN) xpin_thread(xnuma().cpu(0,pin_));
+    for(szt t=1;t<nthreads;++t)
+      workers_.push_back(std::thread(&xthreadpool::work,this,t));
+  }
+
+  ~xthreadpool()
+  {
+    {
+      std::lock_guard<std::mutex> lk(m_);
+      stop_ = true;
+      ++gen_;
+    }
+    wake_.notify_all();
+    for(szt t=0;t<workers_.size();++t) workers_[t].join();
+  }
+
+  xthreadpool(szt nthreads, bool pin)
+    : xthreadpool(nthreads,pin ? COMPACT : NOPIN) {}
+
+  xthreadpool(const xthreadpool&) = delete;
+  xthreadpool& operator=(const xthreadpool&) = delete;
+
+  // No. of threads, including the caller
+  szt size() const { return workers_.size()+1; }
+
+  // How the threads are bound to CPUs
+  xpinpolicy pinning() const { return pin_; }
+
+  // Call f(t) for t = 0 to size()-1, every call on its own thread, and
+  // return when they have all returned.
+  // NOTE : Called from inside a parallel loop, the calls are made in turn
+  // by the caller.
+  xtem(xtn FUNC) void run(const FUNC& f)
+  {
+    if(size() == 1 || xparallel_depth() > 0) {
+      for(szt t=0;t<size();++t) f(t);
+      return;
+    }
+    std::lock_guard<std::mutex> one(run_m_);
+    job_ = &f;
+    call_ = &xthreadpool::call<FUNC>;
+    err_ = std::exception_ptr();
+    pending_.store(workers_.size(),std::memory_order_relaxed);
+    {
+      std::lock_guard<std::mutex> lk(m_);
+      gen_.fetch_add(1,std::memory_order_release);
+    }
+    wake_.notify_all();
+    exec(0);
+    // Wait for the workers, spinning first as they are usually quick
+    for(s32 s=0;s<SPIN && pending_.load(std::memory_order_acquire) > 0;++s)
+      std::this_thread::yield();
+    if(pending_.load(std::memory_order_acquire) > 0) {
+      std::unique_lock<std::mutex> lk(m_);
+      done_.wait(lk,[this] {
+        return pending_.load(std::memory_order_acquire) == 0; });
+    }
+    if(err_) std::rethrow_exception(err_);
+  }
+
+private:
+  static const s32 SPIN = 256;
+
+  xtem(xtn FUNC) static void call(const void* f, szt t)
+  {
+    (*static_cast<const FUNC*>(f))(t);
+  }
+
+  void exec(szt t)
+  {
+    xthread_id() = t;
+    ++xparallel_depth();
+    try {
+      call_(job_,t);
+    } catch(...) {
+      std::lock_guard<std::mutex> lk(m_);
+      if(!err_) err_ = std::current_exception();
+    }
+    --xparallel_depth();
+    xthread_id() = 0;
+  }
+
+  void work(szt t)
+  {
+    if(pin_ != NOPIN) xpin_thread(xnuma().cpu(t,pin_));
+    u64 seen = 0;
+    for(;;) {
+      // Wait for the next job, spinning first so that jobs in quick
+      // succession do not pay for sleeping
+      u64 g = gen_.load(std::memory_order_acquire);
+      for(s32 s=0;s<SPIN && g == seen;++s) {
+        std::this_thread::yield();
+        g = gen_.load(std::memory_order_acquire);
+      }
+      if(g == seen) {
+        std::unique_lock<std::mutex> lk(m_);
+        wake_.wait(lk,[&] {
+          return gen_.load(std::memory_order_acquire) != seen; });
+        g = gen_.load(std::memory_order_acquire);
+      }
+      seen = g;
+      {
+        std::lock_guard<std::mutex> lk(m_);
+        if(stop_) return;
+      }
+      exec(t);
+      if(pending_.fetch_sub(1,std::memory_order_acq_rel) == 1) {
+        std::lock_guard<std::mutex> lk(m_);
+        done_.notify_one();
+      }
+    }
+  }
+
+  std::vector<std::thread> workers_;
+  std::mutex run_m_;                    // One job at a time
+  std::mutex m_;
+  std::condition_variable wake_, done_;
+  const void* job_;                     // The job and how to call it
+  void (*call_)(const void*,szt);
+  std::atomic<u64> gen_;                // No. of jobs started
+  std::atomic<szt> pending_;            // Workers still on the job
+  std::exception_ptr err_;              // First exception of the job
+  bool stop_;
+  xpinpolicy pin_;
+};
+
+//---------------------------------------------------------------------------//
+// The pool used by the parallel loops, and how to set it up
+//---------------------------------------------------------------------------//
+inline std::unique_ptr<xthreadpool>& xpool_ptr()
+{
+  static std::unique_ptr<xthreadpool> pool;
+  return pool;
+}
+
+inline std::mutex& xpool_mutex()
+{
+  static std::mutex m;
+  return m;
+}
+
+// Start the pool with NTHREADS threads (0 : one per hardware thread),
+// pinned to CPUs by PIN (true is COMPACT). Replaces the running pool, if
+// any.
+// NOTE : Must not be called while a parallel loop is running.
+inline void xpool_init(szt nthreads, xpinpolicy pin=NOPIN)
+{
+  std::lock_guard<std::mutex> lk(xpool_mutex());
+  xpool_ptr().reset();
+  xpool_ptr().reset(new xthreadpool(nthreads,pin));
+}
+
+inline void xpool_init(szt nthreads, bool pin)
+{
+  xpool_init(nthreads,pin ? COMPACT : NOPIN);
+}
+
+// Pinning given by SCICPP_PIN : compact or 1, scatter, otherwise none
+inline xpinpolicy xpin_env(const char* s)
+{
+  if(!s) return NOPIN;
+  const xstr v(s);
+  if(v == "scatter" || v == "SCATTER") return SCATTER;
+  if(v == "compact" || v == "COMPACT" || std::atoi(s) != 0) return COMPACT;
+  return NOPIN;
+}
+
+inline xthreadpool& xpool()
+{
+  std::lock_guard<std::mutex> lk(xpool_mutex());
+  std::unique_ptr<xthreadpool>& pool = xpool_ptr();
+  if(!pool) {
+    const char* n = std::getenv("SCICPP_THREADS");
+    const char* pin = std::getenv("SCICPP_PIN");
+    pool.reset(new xthreadpool(n ? static_cast<szt>(std::max(0,std::atoi(n))) : 0,
+                               xpin_env(pin)));
+  }
+  return *pool;
+}
+
+// No. of threads of the parallel loops
+inline szt xnthreads()
+{
+  return xpool().size();
+}
+
+//---------------------------------------------------------------------------//
+// The blocks of iterations [a,b) of 0 to N-1 of each thread, by schedule
+//---------------------------------------------------------------------------//
+class xparchunks
+{
+public:
+  xparchunks(const xsched& sc, s64 n, szt nt)
+    : sc_(sc), n_(n), nt_(nt), next_(0)
+  {
+    if(sc_.kind == CHUNKED && sc_.chunk <= 0)
+      sc_.chunk = std::max<s64>(n/(8*s64(nt)),1);
+    if(sc_.kind == GUIDED && sc_.chunk <= 0) sc_.chunk = 1;
+  }
+
+  // Call g(a,b) for every block of the thread T
+  xtem(xtn FUNC) void each(szt t, const FUNC& g)
+  {
+    const s64 nt = s64(nt_), c = sc_.chunk;
+    if(sc_.kind == STATIC) {
+      if(c <= 0) {
+        const s64 a = n_*s64(t)/nt, b = n_*(s64(t)+1)/nt;
+        if(a < b) g(a,b);
+      } else {
+        for(s64 a=s64(t)*c;a<n_;a+=nt*c) g(a,std::min(a+c,n_));
+      }
+      return;
+    }
+    for(;;) {
+      s64 a, b;
+      if(sc_.kind == CHUNKED) {
+        a = next_.fetch_add(c,std::memory_order_relaxed);
+        if(a >= n_) return;
+        b = std::min(a+c,n_);
+      } else {
+        a = next_.load(std::memory_order_relaxed);
+        do {
+          if(a >= n_) return;
+          b = std::min(a+std::max(c,(n_-a)/(2*nt)),n_);
+        } while(!next_.compare_exchange_weak(a,b,std::memory_order_relaxed));
+      }
+      g(a,b);
+    }
+  }
+
+private:
+  xsched sc_;
+  s64 n_;
+  szt nt_;
+  std::atomic<s64> next_;
+};
+
+//---------------------------------------------------------------------------//
+// Call f(i) for i = START to END, inclusive, in parallel, where i is of
+// type INT. See PARDO.
+//---------------------------------------------------------------------------//
+xtem(xtn INT, xtn FUNC)
+void xparloop(s64 start, s64 end, const xsched& sc, const FUNC& f)
+{
+  if(end < start) return;
+  xthreadpool& pool = xpool();
+  xparchunks ch(sc,end-start+1,pool.size());
+  pool.run([&](szt t) {
+    ch.each(t,[&](s64 a, s64 b) {
+      for(s64 k=a;k<b;++k) f(INT(start+k));
+    });
+  });
+}
+
+//---------------------------------------------------------------------------//
+// Reduction operations : the identity, and how 2 results are combined
+//---------------------------------------------------------------------------//
+xtem(xtn TYPE)
+struct xreduce_sum
+{
+  TYPE identity() const { return TYPE(0); }
+  TYPE operator()(const TYPE& a, const TYPE& b) const { return a+b; }
+};
+
+// min and max keep a NaN of either side, so that a NaN in any chunk gives
+// NaN, whichever thread holds it
+xtem(xtn TYPE)
+struct xreduce_min
+{
+  TYPE identity() const { return std::numeric_limits<TYPE>::max(); }
+  TYPE operator()(const TYPE& a, const TYPE& b) const
+  {
+    return (b != b || b < a) ? b : a;
+  }
+};
+
+xtem(xtn TYPE)
+struct xreduce_max
+{
+  TYPE identity() const { return std::numeric_limits<TYPE>::lowest(); }
+  TYPE operator()(const TYPE& a, const TYPE& b) const
+  {
+    return (b != b || a < b) ? b : a;
+  }
+};
+
+xtem(xtn TYPE, xtn FUNC)
+struct xreduction
+{
+  TYPE id;
+  FUNC f;
+
+  TYPE identity() const { return id; }
+  TYPE operator()(const TYPE& a, const TYPE& b) const { return f(a,b); }
+};
+
+xtem(xtn TYPE, xtn FUNC) inline
+xreduction<TYPE,FUNC> xmkreduction(const TYPE& identity, const FUNC& f)
+{
+  xreduction<TYPE,FUNC> r = {identity,f};
+  return r;
+}
+
+//---------------------------------------------------------------------------//
+// Call f(i,acc) for i = START to END, inclusive, in parallel, where acc is
+// the result of each thread, starting from op.identity().
+// Returns INIT combined with the results of the threads, in thread order.
+//---------------------------------------------------------------------------//
+xtem(xtn INT, xtn TYPE, xtn OP, xtn FUNC)
+TYPE xparreduce(s64 start, s64 end, const TYPE& init, const OP& op,
+                const xsched& sc, const FUNC& f)
+{
+  if(end < start) return init;
+  xthreadpool& pool = xpool();
+  xparchunks ch(sc,end-start+1,pool.size());
+  std::vector<TYPE> part(pool.size(),op.identity());
+  pool.run([&](szt t) {
+    TYPE acc = op.identity();
+    ch.each(t,[&](s64 a, s64 b) {
+      for(s64 k=a;k<b;++k) f(INT(start+k),acc);
+    });
+    part[t] = acc;
+  });
+  TYPE r = init;
+  for(szt t=0;t<part.size();++t) r = op(r,part[t]);
+  return r;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Tasks
+///////////////////////////////////////////////////////////////////////////////
+//---------------------------------------------------------------------------//
+// Work stealing tasks, for irregular work that PARDO shares badly : blocks
+// whose solves cost 10x more than others, recursive domain splitting, etc.
+// Every worker thread keeps the tasks it spawns in its own lock free deque,
+// works on the newest of them, and when it runs out it steals the oldest
+// (the largest, for recursive splitting) from a random other worker.
+// A thread waiting for a task group runs tasks too, instead of sleeping.
+//---------------------------------------------------------------------------//
+// + xtaskgroup g;        : tasks that are waited for together
+// + SPAWN(g) ... ENDSPAWN           : run the block as a task of g
+// + SPAWNCOPY(g,b,...) ... ENDSPAWN : the same, with copies of b,...
+// + SYNC(g)              : wait for all the tasks of g, including those
+//                          spawned by its tasks into g
+// + g.then(h,f)          : spawn f into h when all tasks of g are done,
+//                          without blocking any thread
+// + TASKDO(i,START,END) ... ENDTASKDO : parallel DO, the range is split in
+//                          halves recursively and the halves are stolen
+//---------------------------------------------------------------------------//
+// NOTE : SPAWN captures by reference, like PARDO. A loop variable, or any
+// variable that changes before the task runs, must be given to SPAWNCOPY.
+// NOTE : Threads : SCICPP_THREADS, like for PARDO, or xtasks_init.
+// NOTE : An exception thrown by a task is thrown again by SYNC.
+//---------------------------------------------------------------------------//
+// USE : Blocks of very different cost
+// >> xtaskgroup g;
+// >> DO(b,1,nblocks)
+// >>   SPAWNCOPY(g,b)
+// >>     solve_block(b);
+// >>   ENDSPAWN
+// >> ENDDO
+// >> SYNC(g)
+//---------------------------------------------------------------------------//
+// USE : Recursive domain splitting
+// >> void refine(xtaskgroup& g, s64 lo, s64 hi)
+// >> {
+// >>   IF(hi-lo < 1000)
+// >>     refine_cells(lo,hi);
+// >>   ELSE
+// >>     s64 mid = (lo+hi)/2;
+// >>     SPAWNCOPY(g,lo,mid) refine(g,lo,mid); ENDSPAWN
+// >>     refine(g,mid+1,hi);
+// >>   ENDIF
+// >> }
+// >> xtaskgroup g;
+// >> refine(g,1,ncells);
+// >> SYNC(g)
+//---------------------------------------------------------------------------//
+// USE : Loop over cells whose cost varies, and a continuation
+// >> TASKDO(i,1,ncells)
+// >>   update_cell(i);
+// >> ENDTASKDO
+// >> TASKDOS(i,1,ncells,64)        // At most 64 iterations per task
+// >>   update_cell(i);
+// >> ENDTASKDO
+// >> xtaskgroup solves, fluxes;
+// >> ...                           // SPAWN the solves into solves
+// >> solves.then(fluxes,[&] { correct_fluxes(); });
+// >> ...                           // Other work
+// >> SYNC(fluxes)                  // The solves and the correction
+//---------------------------------------------------------------------------//
+#define  SPAWN(GROUP) (GROUP).spawn([&]() {
+#define xspawn(GROUP) (GROUP).spawn([&]() {
+#define  SPAWNCOPY(GROUP,...) (GROUP).spawn([&,__VA_ARGS__]() {
+#define xspawncopy(GROUP,...) (GROUP).spawn([&,__VA_ARGS__]() {
+#define ENDSPAWN });
+#define xendspawn ENDSPAWN
+#define  SYNC(GROUP) (GROUP).wait();
+#define xsync(GROUP) (GROUP).wait();
+#define  TASKDO(I,START,END) \
+  xtaskloop<decltype(I)>((START),(END),0,[&](decltype(I) I) {
+#define xtaskdo(I,START,END) \
+  xtaskloop<decltype(I)>((START),(END),0,[&](decltype(I) I) {
+#define  TASKDOS(I,START,END,GRAIN) \
+  xtaskloop<decltype(I)>((START),(END),(GRAIN),[&](decltype(I) I) {
+#define xtaskdos(I,START,END,GRAIN) \
+  xtaskloop<decltype(I)>((START),(END),(GRAIN),[&](decltype(I) I) {
+#define ENDTASKDO });
+#define xendtaskdo ENDTASKDO
+
+class xtaskgroup;
+
+//---------------------------------------------------------------------------//
+// A task : the work, and the group that waits for it
+//---------------------------------------------------------------------------//
+struct xtask
+{
+  xtaskgroup* group;
+
+  xtask() : group(0) {}
+  virtual ~xtask() {}
+  virtual void run() = 0;
+};
+
+xtem(xtn FUNC)
+struct xtaskfn : xtask
+{
+  FUNC f;
+
+  explicit xtaskfn(const FUNC& func) : f(func) {}
+  void run() { f(); }
+};
+
+//---------------------------------------------------------------------------//
+// Chase-Lev deque of tasks. The owner pushes and pops at the bottom, any
+// other thread steals from the top. Grows when full.
+//---------------------------------------------------------------------------//
+class xwsdeque
+{
+public:
+  xwsdeque() : top_(0), bottom_(0), ring_(new ring(256)) {}
+
+  ~xwsdeque()
+  {
+    delete ring_.load();
+    for(szt k=0;k<old_.size();++k) delete old_[k];
+  }
+
+  xwsdeque(const xwsdeque&) = delete;
+  xwsdeque& operator=(const xwsdeque&) = delete;
+
+  // Owner only
+  void push(xtask* x)
+  {
+    const s64 b = bottom_.load(), t = top_.load();
+    ring* r = ring_.load();
+    if(b-t >= r->cap) {
+      // Copy to a ring twice as large. The old one may still be read by
+      // thieves, so it is kept until the deque is destroyed.
+      ring* g = new ring(2*r->cap);
+      for(s64 k=t;k<b;++k) g->put(k,r->get(k));
+      old_.push_back(r);
+      ring_.store(g);
+      r = g;
+    }
+    r->put(b,x);
+    bottom_.store(b+1);
+  }
+
+  // Owner only : the newest task, or 0
+  xtask* pop()
+  {
+    const s64 b = bottom_.load()-1;
+    ring* r = ring_.load();
+    bottom_.store(b);
+    s64 t = top_.load();
+    xtask* x = 0;
+    if(t <= b) {
+      x = r->get(b);
+      if(t == b) {
+        // Last task, race the thieves for it
+        if(!top_.compare_exchange_strong(t,t+1)) x = 0;
+        bottom_.store(b+1);
+      }
+    } else {
+      bottom_.store(b+1);
+    }
+    return x;
+  }
+
+  // Any thread : the oldest task, or 0 if there is none or another thread
+  // took it first
+  xtask* steal()
+  {
+    s64 t = top_.load();
+    const s64 b = bottom_.load();
+    if(t >= b) return 0;
+    xtask* x = ring_.load()->get(t);
+    if(!top_.compare_exchange_strong(t,t+1)) return 0;
+    return x;
+  }
+
+private:
+  struct ring
+  {
+    s64 cap;
+    std::atomic<xtask*>* a;
+
+    explicit ring(s64 c) : cap(c), a(new std::atomic<xtask*>[c]) {}
+    ~ring() { delete[] a; }
+    xtask* get(s64 k) const
+    {
+      return a[k & (cap-1)].load(std::memory_order_relaxed);
+    }
+    void put(s64 k, xtask* x)
+    {
+      a[k & (cap-1)].store(x,std::memory_order_relaxed);
+    }
+  };
+
+  std::atomic<s64> top_, bottom_;
+  std::atomic<ring*> ring_;
+  std::vector<ring*> old_;
+};
+
+//---------------------------------------------------------------------------//
+// Worker threads with a deque each, and a locked queue for the tasks
+// spawned by other threads
+//---------------------------------------------------------------------------//
+class xtaskpool
+{
+public:
+  // NTHREADS threads in all, counting the threads that wait for groups,
+  // so NTHREADS-1 workers. 0 for one per hardware thread.
+  explicit xtaskpool(szt nthreads=0)
+    : queued_(0), sleepers_(0), stop_(false)
+  {
+    if(nthreads == 0)
+      nthreads = std::max(1u,std::thread::hardware_concurrency());
+    deques_.resize(nthreads-1);
+    for(szt w=0;w+1<nthreads;++w) deques_[w].reset(new xwsdeque());
+    for(szt w=0;w+1<nthreads;++w)
+      workers_.push_back(std::thread(&xtaskpool::work,this,w));
+  }
+
+  ~xtaskpool()
+  {
+    {
+      std::lock_guard<std::mutex> lk(m_);
+      stop_ = true;
+    }
+    wake_.notify_all();
+    for(szt w=0;w<workers_.size();++w) workers_[w].join();
+  }
+
+  xtaskpool(const xtaskpool&) = delete;
+  xtaskpool& operator=(const xtaskpool&) = delete;
+
+  // No. of threads, counting one waiting thread
+  szt size() const { return workers_.size()+1; }
+
+  void push(xtask* x)
+  {
+    s64 w = worker();
+    if(w >= 0) {
+      deques_[w]->push(x);
+    } else {
+      std::lock_guard<std::mutex> lk(inject_m_);
+      inject_.push_back(x);
+    }
+    queued_.fetch_add(1);
+    if(sleepers_.load() > 0) {
+      std::lock_guard<std::mutex> lk(m_);
+      wake_.notify_one();
+    }
+  }
+
+  // A task to run on the calling thread, or 0 if none was found
+  xtask* take()
+  {
+    const s64 w = worker();
+    xtask* x = 0;
+    if(w >= 0) x = deques_[w]->pop();
+    if(!x && queued_.load() > 0) {
+      {
+        std::lock_guard<std::mutex> lk(inject_m_);
+        if(!inject_.empty()) { x = inject_.front(); inject_.pop_front(); }
+      }
+      // Steal, from a random victim onwards
+      const szt nd = deques_.size();
+      if(!x && nd > 0) {
+        szt& seed = xtask_seed();
+        seed = seed*1103515245u + 12345u;
+        const szt v0 = (seed >> 8) % nd;
+        for(szt k=0;k<nd && !x;++k) {
+          const szt v = (v0+k) % nd;
+          if(s64(v) != w) x = deques_[v]->steal();
+        }
+      }
+    }
+    if(x) queued_.fetch_sub(1);
+    return x;
+  }
+
+  // Index of the calling worker in this pool, -1 for other threads
+  s64 worker() const
+  {
+    return xtask_owner() == this ? xtask_worker() : -1;
+  }
+
+private:
+  static const s32 SPIN = 256;
+
+  static const xtaskpool*& xtask_owner()
+  {
+    static thread_local const xtaskpool* owner = 0;
+    return owner;
+  }
+  static s64& xtask_worker()
+  {
+    static thread_local s64 w = -1;
+    return w;
+  }
+  static szt& xtask_seed()
+  {
+    static thread_local szt seed = 0;
+    return seed;
+  }
+
+  inline void work(szt w);
+
+  std::vector<std::unique_ptr<xwsdeque> > deques_;
+  std::vector<std::thread> workers_;
+  std::mutex inject_m_;
+  std::deque<xtask*> inject_;
+  std::mutex m_;
+  std::condition_variable wake_;
+  std::atomic<s64> queued_;      // Tasks pushed and not yet taken
+  std::atomic<s32> sleepers_;
+  bool stop_;
+};
+
+//---------------------------------------------------------------------------//
+// The pool used by the task groups, and how to set it up
+//---------------------------------------------------------------------------//
+inline std::unique_ptr<xtaskpool>& xtasks_ptr()
+{
+  static std::unique_ptr<xtaskpool> pool;
+  return pool;
+}
+
+// Start the task pool with NTHREADS threads (0 : one per hardware thread).
+// NOTE : Must not be called while tasks are running.
+inline void xtasks_init(szt nthreads)
+{
+  std::lock_guard<std::mutex> lk(xpool_mutex());
+  xtasks_ptr().reset();
+  xtasks_ptr().reset(new xtaskpool(nthreads));
+}
+
+inline xtaskpool& xtasks()
+{
+  std::lock_guard<std::mutex> lk(xpool_mutex());
+  std::unique_ptr<xtaskpool>& pool = xtasks_ptr();
+  if(!pool) {
+    const char* n = std::getenv("SCICPP_THREADS");
+    pool.reset(new xtaskpool(n ? static_cast<szt>(std::max(0,std::atoi(n)))
+                               : 0));
+  }
+  return *pool;
+}
+
+//---------------------------------------------------------------------------//
+// Tasks that are waited for together
+//---------------------------------------------------------------------------//
+class xtaskgroup
+{
+public:
+  explicit xtaskgroup(xtaskpool& pool = xtasks()) : pool_(pool), pending_(0) {}
+
+  // Waits for the tasks that are left
+  ~xtaskgroup()
+  {
+    try { wait(); } catch(...) {}
+  }
+
+  xtaskgroup(const xtaskgroup&) = delete;
+  xtaskgroup& operator=(const xtaskgroup&) = delete;
+
+  // Run f() as a task of this group
+  xtem(xtn FUNC) void spawn(const FUNC& f)
+  {
+    pending_.fetch_add(1);
+    submit(new xtaskfn<FUNC>(f));
+  }
+
+  // Run tasks until all the tasks of this group are done, then throw the
+  // first exception of its tasks, if any
+  void wait()
+  {
+    for(s32 idle=0;pending_.load() > 0;) {
+      if(xtask* x = pool_.take()) {
+        execute(x);
+        idle = 0;
+      } else if(++idle > SPIN) {
+        // Only tasks running on other threads are left
+        std::unique_lock<std::mutex> lk(m_);
+        done_.wait_for(lk,std::chrono::microseconds(100),
+                       [this] { return pending_.load() == 0; });
+      } else {
+        std::this_thread::yield();
+      }
+    }
+    // Taking m_ also waits for the last finish() to let go of the group
+    std::exception_ptr e;
+    {
+      std::lock_guard<std::mutex> lk(m_);
+      std::swap(e,err_);
+    }
+    if(e) std::rethrow_exception(e);
+  }
+
+  // Spawn f() into NEXT once all the tasks of this group are done.
+  // NEXT counts f as pending from now on, so SYNC(next) waits for it.
+  xtem(xtn FUNC) void then(xtaskgroup& next, const FUNC& f)
+  {
+    next.pending_.fetch_add(1);
+    xtask* x = new xtaskfn<FUNC>(f);
+    x->group = &next;
+    {
+      std::lock_guard<std::mutex> lk(m_);
+      if(pending_.load() > 0) { then_.push_back(x); return; }
+    }
+    pool_.push(x);
+  }
+
+  // Run the task X on the calling thread
+  static void execute(xtask* x)
+  {
+    xtaskgroup* g = x->group;
+    try {
+      x->run();
+    } catch(...) {
+      std::lock_guard<std::mutex> lk(g->m_);
+      if(!g->err_) g->err_ = std::current_exception();
+    }
+    delete x;
+    g->finish();
+  }
+
+private:
+  static const s32 SPIN = 1024;
+
+  void submit(xtask* x)
+  {
+    x->group = this;
+    pool_.push(x);
+  }
+
+  // One task of the group is done.
+  // NOTE : Once m_ is released the group may be destroyed by its waiter,
+  // so nothing of it is used after that.
+  void finish()
+  {
+    xtaskpool& pool = pool_;
+    std::vector<xtask*> next;
+    {
+      std::lock_guard<std::mutex> lk(m_);
+      if(pending_.fetch_sub(1) != 1) return;
+      next.swap(then_);
+      done_.notify_all();
+    }
+    for(szt k=0;k<next.size();++k) pool.push(next[k]);
+  }
+
+  xtaskpool& pool_;
+  std::atomic<s64> pending_;      // Tasks spawned and not yet done
+  std::mutex m_;
+  std::condition_variable done_;
+  std::vector<xtask*> then_;      // Spawned when pending_ drops to 0
+  std::exception_ptr err_;
+};
+
+// Worker W : run tasks, and sleep when there are none
+inline void xtaskpool::work(szt w)
+{
+  xtask_owner() = this;
+  xtask_worker() = s64(w);
+  xtask_seed() = w+1;
+  for(;;) {
+    xtask* x = take();
+    for(s32 s=0;!x && s<SPIN;++s) {
+      std::this_thread::yield();
+      x = take();
+    }
+    if(x) {
+      xtaskgroup::execute(x);
+      continue;
+    }
+    std::unique_lock<std::mutex> lk(m_);
+    sleepers_.fetch_add(1);
+    wake_.wait(lk,[this] { return stop_ || queued_.load() > 0; });
+    sleepers_.fetch_sub(1);
+    if(stop_) return;
+  }
+}
+
+//---------------------------------------------------------------------------//
+// Call f(i) for i = A to B, inclusive, splitting off halves as tasks of G
+// while there are more than GRAIN iterations
+//---------------------------------------------------------------------------//
+xtem(xtn INT, xtn FUNC)
+void xtasksplit(xtaskgroup& g, s64 a, s64 b, s64 grain, const FUNC& f)
+{
+  while(b-a+1 > grain) {
+    const s64 m = a+(b-a)/2, e = b;
+    g.spawn([&g,&f,m,e,grain] { xtasksplit<INT>(g,m+1,e,grain,f); });
+    b = m;
+  }
+  for(s64 k=a;k<=b;++k) f(INT(k));
+}
+
+//---------------------------------------------------------------------------//
+// Call f(i) for i = START to END, inclusive, as tasks of at most GRAIN
+// iterations (0 : about 32 tasks per thread). See TASKDO.
+//---------------------------------------------------------------------------//
+xtem(xtn INT, xtn FUNC)
+void xtaskloop(s64 start, s64 end, s64 grain, const FUNC& f)
+{
+  if(end < start) return;
+  xtaskgroup g;
+  if(grain <= 0)
+    grain = std::max<s64>((end-start+1)/(32*s64(xtasks().size())),1);
+  xtasksplit<INT>(g,start,end,grain,f);
+  g.wait();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Array expressions
+///////////////////////////////////////////////////////////////////////////////
+//---------------------------------------------------------------------------//
+// Whole array arithmetic like FORTRAN and Numpy, using expression templates.
+// The right hand side is not computed when it is written, but when it is
+// assigned, in ONE loop over the elements, without temporary arrays.
+//---------------------------------------------------------------------------//
+// USE : FTBS update of u(2:nx), same as the DO loop below
+// >> un1(2,nx) = un(2,nx) - un(2,nx)*dtdx*(un(2,nx)-un(1,nx-1));
+//
+// >> DO(i,2,nx)
+// >>   un1[i] = un[i] - un[i]*dtdx*(un[i]-un[i-1]);
+// >> ENDDO
+//---------------------------------------------------------------------------//
+// NOTE : Operands are matched by position, not by index. So in the example
+// un(2,nx) and un(1,nx-1) are combined as un[i] and un[i-1].
+// NOTE : Operands must have the same size. This is checked with DEBUG.
+// NOTE : If the left hand side overlaps a shifted operand, as in
+// u(2,n) = u(1,n-1), the result is computed in a temporary first, so that
+// the result is the same as in FORTRAN.
+//---------------------------------------------------------------------------//
+//---------------------------------------------------------------------------//
+// Memory layout of a multidimensional array or view
+// ROWMAJOR : C order, the last index is contiguous
+// COLMAJOR : FORTRAN order, the first index is contiguous
+// STRIDED  : No index is known to be contiguous (columns, general slices)
+// NOTE : Contiguous 1D views are always ROWMAJOR.
+//---------------------------------------------------------------------------//
+enum xlayout { ROWMAJOR, COLMAJOR, STRIDED };
+
+xtem(xtn TYPE) class xarray;
+xtem(xtn TYPE, szt RANK, xlayout LAYOUT=STRIDED) class xview;
+xtem(xtn TYPE, szt RANK, xlayout LAYOUT=ROWMAJOR) class xarraynd;
+
+//---------------------------------------------------------------------------//
+// How an operand is held inside an expression.
+// Owning arrays by reference, everything else (views, nodes) by value.
+//---------------------------------------------------------------------------//
+xtem(xtn E) struct xexprref { typedef const E type; };
+xtem(xtn TYPE) struct xexprref<xarray<TYPE> >
+{
+  typedef const xarray<TYPE>& type;
+};
+
+//---------------------------------------------------------------------------//
+// Scalar operand, which has the same value at every position
+//---------------------------------------------------------------------------//
+xtem(xtn TYPE)
+class xscalar : public xexpr<xscalar<TYPE> >
+{
+public:
+  typedef TYPE value_type;
+  explicit xscalar(const TYPE& v) : v_(v) {}
+  s64 size() const { return -1; }
+  TYPE ev(s64) const { return v_; }
+  xtem(xtn PACK) PACK evp(s64) const
+  {
+    return PACK(xtn PACK::value_type(v_));
+  }
+  bool aliases(const void*, const void*, const void*, s64) const
+  {
+    return false;
+  }
+private:
+  TYPE v_;
+};
+
+// Wrap scalars into xscalar, leave expressions as they are
+xtem(xtn TYPE, bool = xisexpr<TYPE>::value)
+struct xoperand
+{
+  typedef TYPE type;
+  static const TYPE& wrap(const TYPE& x) { return x; }
+};
+xtem(xtn TYPE)
+struct xoperand<TYPE,false>
+{
+  typedef xscalar<TYPE> type;
+  static xscalar<TYPE> wrap(const TYPE& x) { return xscalar<TYPE>(x); }
+};
+
+//---------------------------------------------------------------------------//
+// Element wise unary and binary operations
+//---------------------------------------------------------------------------//
+struct xop_add
+{
+  xtem(xtn A, xtn B) static auto ap(A a, B b) -> decltype(a+b) { return a+b; }
+};
+struct xop_sub
+{
+  xtem(xtn A, xtn B) static auto ap(A a, B b) -> decltype(a-b) { return a-b; }
+};
+struct xop_mul
+{
+  xtem(xtn A, xtn B) static auto ap(A a, B b) -> decltype(a*b) { return a*b; }
+};
+struct xop_div
+{
+  xtem(xtn A, xtn B) static auto ap(A a, B b) -> decltype(a/b) { return a/b; }
+};
+struct xop_neg
+{
+  xtem(xtn A) static auto ap(A a) -> decltype(-a) { return -a; }
+};
+struct xop_sq
+{
+  xtem(xtn A) static A ap(A a) { return xsq(a); }
+};
+struct xop_cu
+{
+  xtem(xtn A) static A ap(A a) { return xcu(a); }
+};
+struct xop_abs
+{
+  xtem(xtn A) static A ap(A a) { return xabs(a); }
+};
+xtem(xtn TYPE)
+struct xop_cast
+{
+  xtem(xtn A) static TYPE ap(A a) { return TYPE(a); }
+};
+
+// The elementary functions (see "Elementary functions")
+#define XEXPR_MATH_OP(OP,NAME) \
+xtem(xaccuracy ACC) \
+struct OP \
+{ \
+  xtem(xtn A) static A ap(A a) { return NAME<ACC>(a); } \
+};
+
+XEXPR_MATH_OP(xop_exp,xexp)
+XEXPR_MATH_OP(xop_log,xlog)
+XEXPR_MATH_OP(xop_sin,xsin)
+XEXPR_MATH_OP(xop_cos,xcos)
+XEXPR_MATH_OP(xop_tanh,xtanh)
+
+#undef XEXPR_MATH_OP
+
+xtem(xaccuracy ACC)
+struct xop_pow
+{
+  xtem(xtn A, xtn B) static auto ap(A a, B b) -> decltype(xpow<ACC>(a,b))
+  {
+    return xpow<ACC>(a,b);
+  }
+};
+
+// Apply F to one operand
+xtem(xtn F, xtn A)
+class xunary : public xexpr<xunary<F,A> >
+{
+public:
+  typedef decltype(std::declval<F>()(std::declval<xtn A::value_type>()))
+          value_type;
+  xunary(const A& a, const F& f) : a_(a), f_(f) {}
+  s64 size() const { return a_.size(); }
+  value_type ev(s64 k) const { return f_(a_.ev(k)); }
+  xtem(xtn PACK) PACK evp(s64 k) const
+  {
+    return f_(a_.template evp<PACK>(k));
+  }
+  bool aliases(const void* b, const void* e, const void* p, s64 s) const
+  {
+    return a_.aliases(b,e,p,s);
+  }
+private:
+  xtn xexprref<A>::type a_;
+  F f_;
+};
+
+// Adapts an xop_* to a function object for xunary
+xtem(xtn OP)
+struct xopfunc
+{
+  xtem(xtn A) auto operator()(A a) const -> decltype(OP::ap(a))
+  {
+    return OP::ap(a);
+  }
+};
+
+// Apply OP to two operands
+xtem(xtn OP, xtn A, xtn B)
+class xbinary : public xexpr<xbinary<OP,A,B> >
+{
+public:
+  typedef decltype(OP::ap(std::declval<xtn A::value_type>(),
+                          std::declval<xtn B::value_type>())) value_type;
+  xbinary(const A& a, const B& b) : a_(a), b_(b) {}
+  s64 size() const { return a_.size() >= 0 ? a_.size() : b_.size(); }
+  value_type ev(s64 k) const { return OP::ap(a_.ev(k),b_.ev(k)); }
+  xtem(xtn PACK) PACK evp(s64 k) const
+  {
+    return OP::ap(a_.template evp<PACK>(k),b_.template evp<PACK>(k));
+  }
+  bool aliases(const void* b, const void* e, const void* p, s64 s) const
+  {
+    return a_.aliases(b,e,p,s) || b_.aliases(b,e,p,s);
+  }
+private:
+  xtn xexprref<A>::type a_;
+  xtn xexprref<B>::type b_;
+};
+
+//---------------------------------------------------------------------------//
+// Binary operators, with at least one operand an array expression
+//---------------------------------------------------------------------------//
+xtem(xtn OP, xtn A, xtn B)
+struct xbinaryof
+{
+  typedef xbinary<OP,xtn xoperand<A>::type,xtn xoperand<B>::type> type;
+  static type make(const A& a, const B& b)
+  {
+    return type(xoperand<A>::wrap(a),xoperand<B>::wrap(b));
+  }
+};
+
+#define XEXPR_BINARY_OPERATOR(SYM,OP) \
+xtem(xtn A, xtn B) inline \
+xtn std::enable_if<xisexpr<A>::value || xisexpr<B>::value, \
+                   xtn xbinaryof<OP,A,B>::type>::type \
+operator SYM(const A& a, const B& b) \
+{ \
+  return xbinaryof<OP,A,B>::make(a,b); \
+}
+
+XEXPR_BINARY_OPERATOR(+,xop_add)
+XEXPR_BINARY_OPERATOR(-,xop_sub)
+XEXPR_BINARY_OPERATOR(*,xop_mul)
+XEXPR_BINARY_OPERATOR(/,xop_div)
+
+#undef XEXPR_BINARY_OPERATOR
+
+//---------------------------------------------------------------------------//
+// Unary operations on array expressions
+//---------------------------------------------------------------------------//
+// USE : Any function of one element can be applied with xmap
+// >> y(1,n) = xmap(x(1,n),[](f64 v){ return std::exp(-v); });
+// >> e(1,n) = xabs(u(1,n)-v(1,n)) + xsq(w(1,n));
+// >> r(1,n) = xcast<f64>(x(1,n))*dtdx;   // x of f32, computed in f64
+//---------------------------------------------------------------------------//
+xtem(xtn E, xtn F) inline
+xunary<F,E> xmap(const xexpr<E>& e, const F& f)
+{
+  return xunary<F,E>(e.self(),f);
+}
+
+xtem(xtn E) inline
+xunary<xopfunc<xop_neg>,E> operator-(const xexpr<E>& e)
+{
+  return xmap(e,xopfunc<xop_neg>());
+}
+
+xtem(xtn E) inline
+xunary<xopfunc<xop_sq>,E> xsq(const xexpr<E>& e)
+{
+  return xmap(e,xopfunc<xop_sq>());
+}
+
+xtem(xtn E) inline
+xunary<xopfunc<xop_cu>,E> xcu(const xexpr<E>& e)
+{
+  return xmap(e,xopfunc<xop_cu>());
+}
+
+xtem(xtn E) inline
+xunary<xopfunc<xop_abs>,E> xabs(const xexpr<E>& e)
+{
+  return xmap(e,xopfunc<xop_abs>());
+}
+
+// The elements converted to TYPE, e.g. to compute arrays of f32 in f64
+xtem(xtn TYPE, xtn E) inline
+xunary<xopfunc<xop_cast<TYPE> >,E> xcast(const xexpr<E>& e)
+{
+  return xmap(e,xopfunc<xop_cast<TYPE> >());
+}
+
+//---------------------------------------------------------------------------//
+// Elementary functions of array expressions of f32 or f64, with the
+// accuracy ACC (see "Elementary functions")
+//---------------------------------------------------------------------------//
+// USE : Computed in packs when every operand is contiguous
+// >> y(1,n) = xexp(-xsq(x(1,n)))*xcos<FAST>(w*x(1,n));
+// >> p(1,n) = xpow(rho(1,n),gamma)*kappa;
+//---------------------------------------------------------------------------//
+#define XEXPR_MATH_FUNCTION(NAME,OP) \
+xtem(xaccuracy ACC=ACCURATE, xtn E) inline \
+xunary<xopfunc<OP<ACC> >,E> NAME(const xexpr<E>& e) \
+{ \
+  return xmap(e,xopfunc<OP<ACC> >()); \
+}
+
+XEXPR_MATH_FUNCTION(xexp,xop_exp)
+XEXPR_MATH_FUNCTION(xlog,xop_log)
+XEXPR_MATH_FUNCTION(xsin,xop_sin)
+XEXPR_MATH_FUNCTION(xcos,xop_cos)
+XEXPR_MATH_FUNCTION(xtanh,xop_tanh)
+
+#undef XEXPR_MATH_FUNCTION
+
+// x^y, with x or y or both array expressions
+xtem(xaccuracy ACC=ACCURATE, xtn A, xtn B) inline
+xtn std::enable_if<xisexpr<A>::value || xisexpr<B>::value,
+                   xtn xbinaryof<xop_pow<ACC>,A,B>::type>::type
+xpow(const A& a, const B& b)
+{
+  return xbinaryof<xop_pow<ACC>,A,B>::make(a,b);
+}
+
+//---------------------------------------------------------------------------//
+// Can E be computed in packs of TYPE (see "SIMD packs") ? Its operands
+// must be contiguous arrays or views of TYPE, or scalars converted to TYPE,
+// and its operations those of packs, all with values of TYPE.
+//---------------------------------------------------------------------------//
+xtem(xtn OP) struct xoppacks : std::false_type {};
+template<> struct xoppacks<xop_add> : std::true_type {};
+template<> struct xoppacks<xop_sub> : std::true_type {};
+template<> struct xoppacks<xop_mul> : std::true_type {};
+template<> struct xoppacks<xop_div> : std::true_type {};
+template<> struct xoppacks<xop_neg> : std::true_type {};
+template<> struct xoppacks<xop_sq> : std::true_type {};
+template<> struct xoppacks<xop_cu> : std::true_type {};
+template<> struct xoppacks<xop_abs> : std::true_type {};
+xtem(xaccuracy ACC) struct xoppacks<xop_exp<ACC> > : std::true_type {};
+xtem(xaccuracy ACC) struct xoppacks<xop_log<ACC> > : std::true_type {};
+xtem(xaccuracy ACC) struct xoppacks<xop_sin<ACC> > : std::true_type {};
+xtem(xaccuracy ACC) struct xoppacks<xop_cos<ACC> > : std::true_type {};
+xtem(xaccuracy ACC) struct xoppacks<xop_tanh<ACC> > : std::true_type {};
+xtem(xaccuracy ACC) struct xoppacks<xop_pow<ACC> > : std::true_type {};
+xtem(xtn OP) struct xoppacks<xopfunc<OP> > : xoppacks<OP> {};
+
+xtem(xtn E, xtn TYPE) struct xpackexpr : std::false_type {};
+xtem(xtn TYPE)
+struct xpackexpr<xarray<TYPE>,TYPE>
+  : std::integral_constant<bool,std::is_same<TYPE,f32>::value ||
+                                std::is_same<TYPE,f64>::value> {};
+xtem(xtn S, xtn TYPE)
+struct xpackexpr<xscalar<S>,TYPE>
+  : std::integral_constant<bool,std::is_arithmetic<S>::value &&
+      std::is_same<xtn std::common_type<S,TYPE>::type,TYPE>::value> {};
+xtem(xtn S, xlayout L, xtn TYPE)
+struct xpackexpr<xview<S,1,L>,TYPE>
+  : std::integral_constant<bool,L != STRIDED &&
+      std::is_same<xtn std::remove_const<S>::type,TYPE>::value &&
+      xpackexpr<xarray<TYPE>,TYPE>::value> {};
+xtem(xtn F, xtn A, xtn TYPE)
+struct xpackexpr<xunary<F,A>,TYPE>
+  : std::integral_constant<bool,xoppacks<F>::value &&
+      std::is_same<xtn xunary<F,A>::value_type,TYPE>::value &&
+      xpackexpr<A,TYPE>::value> {};
+xtem(xtn OP, xtn A, xtn B, xtn TYPE)
+struct xpackexpr<xbinary<OP,A,B>,TYPE>
+  : std::integral_constant<bool,xoppacks<OP>::value &&
+      std::is_same<xtn xbinary<OP,A,B>::value_type,TYPE>::value &&
+      xpackexpr<A,TYPE>::value && xpackexpr<B,TYPE>::value> {};
+
+// N contiguous elements at P, one by one or in packs
+xtem(xtn TYPE, xtn E) inline
+void xevaluate_contiguous(TYPE* p, s64 n, const E& x, std::false_type)
+{
+  for(s64 k=0;k<n;++k) p[k] = x.ev(k);
+}
+
+xtem(xtn TYPE, xtn E) inline
+void xevaluate_contiguous(TYPE* p, s64 n, const E& x, std::true_type)
+{
+  typedef xnpack<TYPE> pack;
+  const s64 w = pack::width;
+  if(n < w) {
+    for(s64 k=0;k<n;++k) p[k] = x.ev(k);
+    return;
+  }
+  // The last pack overlaps the others, and is computed before they are
+  // stored, as P may be an operand
+  const pack last = x.template evp<pack>(n-w);
+  for(s64 k=0;k+w<=n;k+=w) x.template evp<pack>(k).storeu(p+k);
+  last.storeu(p+n-w);
+}
+
+//---------------------------------------------------------------------------//
+// Evaluate the expression E into the N elements at P, with stride S.
+// This is the single loop that every array assignment compiles to.
+// NOTE : CONTIGUOUS is true when S is known to be 1. Then E is computed in
+// packs if it can be (see xpackexpr).
+//---------------------------------------------------------------------------//
+xtem(bool CONTIGUOUS, xtn TYPE, xtn E)
+void xevaluate(TYPE* p, s64 n, s64 s, const E& e)
+{
+  ASSERT(e.size() < 0 || e.size() == n,
+         "Array expression of size "<<e.size()<<" assigned to size "<<n);
+  const TYPE* last = p + (n > 0 ? (n-1)*s : 0);
+  if(n > 0 && e.aliases(std::min<const TYPE*>(p,last),
+                        std::max<const TYPE*>(p,last),p,s)) {
+    // The result would depend on the order of the loop : use a temporary
+    xarray<TYPE> tmp(0,n-1);
+    xevaluate<true>(tmp.data(),n,1,e);
+    for(s64 k=0;k<n;++k) p[k*s] = tmp[k];
+    return;
+  }
+  // Local copy, so that the compiler knows stores to P do not change it
+  const E x(e);
+  if(CONTIGUOUS) {
+    xevaluate_contiguous(p,n,x,xpackexpr<E,TYPE>());
+  } else {
+    for(s64 k=0;k<n;++k) p[k*s] = x.ev(k);
+  }
+}
+
+//---------------------------------------------------------------------------//
+// Does the operand at P, with N elements and stride S, overlap the memory
+// [B,E] of the left hand side other than element by element ?
+// LP and LS are the start and stride of the left hand side.
+//---------------------------------------------------------------------------//
+xtem(xtn TYPE) inline
+bool xoverlaps(const TYPE* p, s64 n, s64 s,
+               const void* b, const void* e, const void* lp, s64 ls)
+{
+  if(n <= 0) return false;
+  const TYPE* last = p + (n-1)*s;
+  const void* lo = std::min(p,last);
+  const void* hi = std::max(p,last);
+  if(std::less<const void*>()(e,lo) || std::less<const void*>()(hi,b))
+    return false;
+  return !(p == lp && s == ls);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Arrays
+///////////////////////////////////////////////////////////////////////////////
+//---------------------------------------------------------------------------//
+// Contiguous 1D array with user chosen lower bound, like FORTRAN's x(lo:hi)
+//---------------------------------------------------------------------------//
+// PROPERTIES :
+// + Storage is one block aligned to SIMD_ALIGN bytes.
+// + Storage is padded to a whole number of SIMD_ALIGN blocks.
+// + Elements are NOT initialized on construction for trivial types
+//   (f64,f32,s32 etc). Use the constructor with a value, or fill().
+// + Indexing is with [i] or (i), where lbound() <= i <= ubound().
+// + Copy is a deep copy. Move and swap only exchange pointers, when both
+//   arrays are on the same arena or on the heap.
+// + Storage is from the heap, or from an arena given as first constructor
+//   argument (see "Arenas"). Copies are always on the heap. An array keeps
+//   its arena for life : move assignment and swap of arrays of different
+//   arenas copy the elements, and only a move constructed array takes the
+//   arena of the array it is moved from.
+//---------------------------------------------------------------------------//
+// USE : 1 based array of nx elements, as FORTRAN's x(1:nx)
+// >> u32 i;
+// >> ARR(f64) x(1,nx);
+// >> DO(i,1,nx)
+// >>   x[i] = dx*(i-1);
+// >> ENDDO
+//---------------------------------------------------------------------------//
+// USE : Array with 2 ghost cells on each side, set to 0.0
+// >> ARR(f64) u(-1,nx+2,0.0);
+// >> DBGARR(u,u.lbound(),u.ubound());
+//---------------------------------------------------------------------------//
+xtem(xtn TYPE)
+class xarray : public xexpr<xarray<TYPE> >
+{
+public:
+  typedef TYPE value_type;
+
+  // Empty array
+  xarray() : data_(0), lo_(1), n_(0), cap_(0), arena_(0) {}
+
+  // Array x(1:n)
+  explicit xarray(s64 n) : data_(0), lo_(1), n_(0), cap_(0), arena_(0)
+  {
+    allocate(1,n);
+  }
+
+  // Array x(lo:hi)
+  xarray(s64 lo, s64 hi) : data_(0), lo_(lo), n_(0), cap_(0), arena_(0)
+  {
+    allocate(lo,hi);
+  }
+
+  // Array x(lo:hi) with all elements set to value
+  xarray(s64 lo, s64 hi, const TYPE& value)
+    : data_(0), lo_(lo), n_(0), cap_(0), arena_(0)
+  {
+    allocate(lo,hi);
+    fill(value);
+  }
+
+  // The same on the arena a
+  xarray(xarena& a, s64 lo, s64 hi)
+    : data_(0), lo_(lo), n_(0), cap_(0), arena_(&a)
+  {
+    allocate(lo,hi);
+  }
+
+  xarray(xarena& a, s64 lo, s64 hi, const TYPE& value)
+    : data_(0), lo_(lo), n_(0), cap_(0), arena_(&a)
+  {
+    allocate(lo,hi);
+    fill(value);
+  }
+
+  xarray(const xarray& o) : data_(0), lo_(o.lo_), n_(0), cap_(0), arena_(0)
+  {
+    allocate(o.lbound(),o.ubound());
+    std::copy(o.data_,o.data_+o.n_,data_);
+  }
+
+  xarray(xarray&& o)
+    : data_(o.data_), lo_(o.lo_), n_(o.n_), cap_(o.cap_), arena_(o.arena_)
+  {
+    o.data_ = 0; o.n_ = 0; o.cap_ = 0;
+  }
+
+  // Copy the bounds and values of o.
+  // NOTE : Storage is reused if the bounds are the same, so that
+  // u = v inside a time loop does not allocate.
+  xarray& operator=(const xarray& o)
+  {
+    if(this == &o) return *this;
+    if(lo_ != o.lo_ || n_ != o.n_) allocate(o.lbound(),o.ubound());
+    std::copy(o.data_,o.data_+o.n_,data_);
+    return *this;
+  }
+
+  // Takes the storage of o if it is on the same arena (or both on the
+  // heap), else copies the elements into the storage of this array
+  xarray& operator=(xarray&& o)
+  {
+    if(arena_ == o.arena_) swap(o);
+    else *this = o;
+    return *this;
+  }
+
+  // Whole array assignment of an expression of the same size, or a scalar
+  xtem(xtn E) xarray& operator=(const xexpr<E>& e)
+  {
+    xevaluate<true>(data_,n_,1,e.self());
+    return *this;
+  }
+  xarray& operator=(const TYPE& value) { fill(value); return *this; }
+
+  xtem(xtn E) xarray& operator+=(const E& e) { return *this = *this + e; }
+  xtem(xtn E) xarray& operator-=(const E& e) { return *this = *this - e; }
+  xtem(xtn E) xarray& operator*=(const E& e) { return *this = *this * e; }
+  xtem(xtn E) xarray& operator/=(const E& e) { return *this = *this / e; }
+
+  ~xarray() { deallocate(); }
+
+  // Discard the contents and allocate x(lo:hi)
+  void allocate(s64 lo, s64 hi)
+  {
+    deallocate();
+    lo_ = lo;
+    n_ = (hi >= lo) ? hi-lo+1 : 0;
+    cap_ = xpadded<TYPE>(n_);
+    data_ = arena_ ? arena_->alloc<TYPE>(cap_) : xalloc_elems<TYPE>(cap_);
+  }
+
+  // Release the storage, leaving an empty array
+  void deallocate()
+  {
+    if(!data_) return;
+    if(arena_) xdestroy_elems(data_,cap_);
+    else xfree_elems(data_,cap_);
+    data_ = 0; n_ = 0; cap_ = 0;
+  }
+
+  // Exchange the contents. Each array keeps its arena, so storage of
+  // different arenas is exchanged by copying the elements.
+  void swap(xarray& o)
+  {
+    if(arena_ != o.arena_) {
+      xarray t(o);
+      o = *this;
+      *this = t;
+      return;
+    }
+    std::swap(data_,o.data_); std::swap(lo_,o.lo_);
+    std::swap(n_,o.n_); std::swap(cap_,o.cap_);
+  }
+
+  // Arena of the storage, 0 for the heap
+  xarena* arena() const { return arena_; }
+
+  void fill(const TYPE& value) { std::fill(data_,data_+n_,value); }
+
+  // Element access with FORTRAN indexing
+  TYPE& operator[](s64 i) { return data_[i-lo_]; }
+  const TYPE& operator[](s64 i) const { return data_[i-lo_]; }
+  TYPE& operator()(s64 i) { return data_[i-lo_]; }
+  const TYPE& operator()(s64 i) const { return data_[i-lo_]; }
+
+  // Section x(lo:hi) as a view, for use in array expressions
+  xview<TYPE,1,ROWMAJOR> operator()(s64 lo, s64 hi)
+  {
+    return xview<TYPE,1,ROWMAJOR>(data_+(lo-lo_),lo,hi);
+  }
+  xview<const TYPE,1,ROWMAJOR> operator()(s64 lo, s64 hi) const
+  {
+    return xview<const TYPE,1,ROWMAJOR>(data_+(lo-lo_),lo,hi);
+  }
+
+  // Bounds and sizes
+  s64 lbound() const { return lo_; }
+  s64 ubound() const { return lo_+n_-1; }
+  s64 size() const { return n_; }
+  s64 padded_size() const { return cap_; }
+  bool empty() const { return n_ == 0; }
+
+  // Raw aligned storage, data()[0] is x(lbound())
+  TYPE* data() { return data_; }
+  const TYPE* data() const { return data_; }
+
+  // Iteration over all elements, for use with STL algorithms
+  TYPE* begin() { return data_; }
+  TYPE* end() { return data_+n_; }
+  const TYPE* begin() const { return data_; }
+  const TYPE* end() const { return data_+n_; }
+
+  // Array expression interface, K is the position from 0
+  TYPE ev(s64 k) const { return data_[k]; }
+  xtem(xtn PACK) PACK evp(s64 k) const { return PACK::loadu(data_+k); }
+  bool aliases(const void* b, const void* e, const void* p, s64 s) const
+  {
+    return xoverlaps(data_,n_,1,b,e,p,s);
+  }
+
+private:
+  TYPE* data_;
+  s64 lo_;
+  s64 n_;
+  s64 cap_;
+  xarena* arena_;
+};
+
+//---------------------------------------------------------------------------//
+// 1D array of type TYPE
+//---------------------------------------------------------------------------//
+#define  ARR(...) xarray< __VA_ARGS__ >
+#define xarr(...) xarray< __VA_ARGS__ >
+
+//---------------------------------------------------------------------------//
+// Lower and upper bound of an array or vector, like FORTRAN's LBOUND/UBOUND
+// NOTE : For VEC(...) the lower bound is always 0.
+//---------------------------------------------------------------------------//
+xtem(xtn TYPE) inline s64 xlbound(const xarray<TYPE>& a) { return a.lbound(); }
+xtem(xtn TYPE) inline s64 xubound(const xarray<TYPE>& a) { return a.ubound(); }
+xtem(xtn TYPE, xtn ALLOC) inline
+s64 xlbound(const std::vector<TYPE,ALLOC>&) { return 0; }
+xtem(xtn TYPE, xtn ALLOC) inline
+s64 xubound(const std::vector<TYPE,ALLOC>& v) { return s64(v.size())-1; }
+
+///////////////////////////////////////////////////////////////////////////////
+// Commonly used array types
+///////////////////////////////////////////////////////////////////////////////
+typedef xarray<s32>   as32;
+typedef xarray<u32>   au32;
+typedef xarray<f32>   af32;
+typedef xarray<f64>   af64;
+
+///////////////////////////////////////////////////////////////////////////////
+// Multidimensional arrays
+///////////////////////////////////////////////////////////////////////////////
+//---------------------------------------------------------------------------//
+// Leading dimensions whose size in bytes is a multiple of LD_ALIAS_BYTES are
+// padded by one SIMD_ALIGN block, so that walking along the non-contiguous
+// index does not keep hitting the same cache sets.
+// Default : 1024 bytes
+//---------------------------------------------------------------------------//
+#ifndef LD_ALIAS_BYTES
+#define LD_ALIAS_BYTES 1024
+#endif
+
+xtem(xtn TYPE) inline
+s64 xpadded_ld(s64 n)
+{
+  s64 ld = xpadded<TYPE>(n);
+  if(n > 1 && (ld*s64(SOF(TYPE))) % LD_ALIAS_BYTES == 0)
+    ld += xpadded<TYPE>(1);
+  return ld;
+}
+
+//---------------------------------------------------------------------------//
+// Layout of the view obtained by fixing index D of a RANK dimensional layout
+// NOTE : Contiguous 1D views are always reported as ROWMAJOR.
+//---------------------------------------------------------------------------//
+xtem(szt RANK, xlayout LAYOUT, szt D)
+struct xslicelayout
+{
+  static const xlayout value =
+    (LAYOUT == ROWMAJOR && D != RANK-1) ? ROWMAJOR :
+    (LAYOUT == COLMAJOR && D != 0) ? (RANK == 2 ? ROWMAJOR : COLMAJOR) :
+    STRIDED;
+};
+
+//---------------------------------------------------------------------------//
+// Shape, bounds and strides shared by multidimensional arrays and views.
+// NOTE : Not to be used directly. Use xview or xarraynd.
+//---------------------------------------------------------------------------//
+xtem(xtn TYPE, szt RANK, xlayout LAYOUT)
+class xndshape
+{
+public:
+  static const szt rank = RANK;
+  static const xlayout layout = LAYOUT;
+
+  // Bounds and sizes of dimension D, like FORTRAN's LBOUND/UBOUND/SIZE
+  s64 lbound(szt d) const { return lo_[d]; }
+  s64 ubound(szt d) const { return lo_[d]+n_[d]-1; }
+  s64 size(szt d) const { return n_[d]; }
+
+  // Total no. of elements
+  s64 size() const
+  {
+    s64 n = 1;
+    for(szt d=0;d<RANK;++d) n *= n_[d];
+    return n;
+  }
+
+  bool empty() const { return size() == 0; }
+
+  // Distance in elements between neighbours along dimension D
+  s64 stride(szt d) const
+  {
+    return (LAYOUT != STRIDED && d == cdim()) ? 1 : st_[d];
+  }
+
+protected:
+  // The contiguous dimension
+  static constexpr szt cdim() { return LAYOUT == ROWMAJOR ? RANK-1 : 0; }
+
+  // Offset of the element with the given indices from the first element
+  s64 off(s64 i) const
+  {
+    static_assert(RANK == 1,"1 index given for a multidimensional array");
+    return (i-lo_[0])*stride(0);
+  }
+  s64 off(s64 i, s64 j) const
+  {
+    static_assert(RANK == 2,"2 indices given for a non 2D array");
+    return (i-lo_[0])*stride(0) + (j-lo_[1])*stride(1);
+  }
+  s64 off(s64 i, s64 j, s64 k) const
+  {
+    static_assert(RANK == 3,"3 indices given for a non 3D array");
+    return (i-lo_[0])*stride(0) + (j-lo_[1])*stride(1) +
+           (k-lo_[2])*stride(2);
+  }
+  s64 off(s64 i, s64 j, s64 k, s64 l) const
+  {
+    static_assert(RANK == 4,"4 indices given for a non 4D array");
+    return (i-lo_[0])*stride(0) + (j-lo_[1])*stride(1) +
+           (k-lo_[2])*stride(2) + (l-lo_[3])*stride(3);
+  }
+
+  // View with index D fixed to I, starting at storage P
+  xtem(szt D, xtn U)
+  xview<U,RANK-1,xslicelayout<RANK,LAYOUT,D>::value> slice_(U* p, s64 i) const
+  {
+    static_assert(RANK > 1,"Can not slice a 1D array");
+    static_assert(D < RANK,"Slice dimension out of range");
+    s64 lo[RANK-1], n[RANK-1], st[RANK-1];
+    szt e = 0;
+    for(szt d=0;d<RANK;++d) {
+      if(d == D) continue;
+      lo[e] = lo_[d]; n[e] = n_[d]; st[e] = stride(d); ++e;
+    }
+    return xview<U,RANK-1,xslicelayout<RANK,LAYOUT,D>::value>
+           (p+(i-lo_[D])*stride(D),lo,n,st);
+  }
+
+  // View of the sub-block B = {lo0,hi0,lo1,hi1,...}, starting at storage P
+  // NOTE : The sub-block keeps the indices of the parent.
+  xtem(xtn U)
+  xview<U,RANK,LAYOUT> block_(U* p, const s64* b) const
+  {
+    s64 lo[RANK], n[RANK], st[RANK], o = 0;
+    for(szt d=0;d<RANK;++d) {
+      lo[d] = b[2*d]; n[d] = b[2*d+1]-b[2*d]+1; st[d] = stride(d);
+      if(n[d] < 0) n[d] = 0;
+      o += (lo[d]-lo_[d])*st[d];
+    }
+    return xview<U,RANK,LAYOUT>(p+o,lo,n,st);
+  }
+
+  s64 lo_[RANK];
+  s64 n_[RANK];
+  s64 st_[RANK];
+};
+
+//---------------------------------------------------------------------------//
+// Non-owning view of a multidimensional block of memory.
+// Views are cheap to create and to copy, and never copy the elements.
+//---------------------------------------------------------------------------//
+// USE : Rows, columns and sub-blocks of a 2D array
+// >> ARR2(f64) a(1,nx,1,ny);
+// >> xview<f64,1,ROWMAJOR> r = a.row(3);      // a(3,:), contiguous
+// >> xview<f64,1,STRIDED>  c = a.col(5);      // a(:,5)
+// >> xview<f64,2,ROWMAJOR> b = a.block(2,nx-1,2,ny-1); // interior
+// >> b(2,2) = 1.0;                            // Same as a(2,2) = 1.0
+//---------------------------------------------------------------------------//
+xtem(xtn TYPE, szt RANK, xlayout LAYOUT)
+class xview : public xndshape<TYPE,RANK,LAYOUT>,
+              public xexpr<xview<TYPE,RANK,LAYOUT> >
+{
+  typedef xndshape<TYPE,RANK,LAYOUT> base;
+  template<xtn, szt, xlayout> friend class xview;
+  typedef xtn std::remove_const<TYPE>::type elem_type;
+public:
+  typedef elem_type value_type;
+
+  xview() : p_(0)
+  {
+    for(szt d=0;d<RANK;++d) { this->lo_[d] = 1; this->n_[d] = 0; this->st_[d] = 0; }
+  }
+
+  // View of the storage P, whose first element has indices LO
+  // and which has N[d] elements with stride ST[d] along dimension d
+  xview(TYPE* p, const s64* lo, const s64* n, const s64* st) : p_(p)
+  {
+    for(szt d=0;d<RANK;++d) { this->lo_[d] = lo[d]; this->n_[d] = n[d]; this->st_[d] = st[d]; }
+  }
+
+  xview(const xview&) = default;
+
+  // Contiguous 1D view of P, whose elements have indices LO to HI
+  xview(TYPE* p, s64 lo, s64 hi) : p_(p)
+  {
+    static_assert(RANK == 1,"Bounds constructor is only for 1D views");
+    this->lo_[0] = lo; this->n_[0] = (hi >= lo) ? hi-lo+1 : 0;
+    this->st_[0] = 1;
+  }
+
+  // Mutable views convert to read only views, and any view to a STRIDED one
+  xtem(xtn U, xlayout L)
+  xview(const xview<U,RANK,L>& o) : p_(o.p_)
+  {
+    static_assert(L == LAYOUT || LAYOUT == STRIDED,"Incompatible view layout");
+    for(szt d=0;d<RANK;++d) {
+      this->lo_[d] = o.lbound(d); this->n_[d] = o.size(d);
+      this->st_[d] = o.stride(d);
+    }
+  }
+
+  // Element access with FORTRAN indexing
+  TYPE& operator()(s64 i) const { return p_[this->off(i)]; }
+  TYPE& operator()(s64 i, s64 j, s64 k) const { return p_[this->off(i,j,k)]; }
+  TYPE& operator()(s64 i, s64 j, s64 k, s64 l) const
+  {
+    return p_[this->off(i,j,k,l)];
+  }
+  TYPE& operator[](s64 i) const { return p_[this->off(i)]; }
+
+  // v(i,j) is an element of a 2D view, and the section v(i:j) of a 1D view
+  xtn std::conditional<RANK == 1,xview,TYPE&>::type
+  operator()(s64 i, s64 j) const
+  {
+    return at2(i,j,std::integral_constant<bool,RANK == 1>());
+  }
+
+  // Assigning to a view assigns the elements, like FORTRAN sections.
+  // NOTE : Copying a view (constructor) does NOT copy the elements.
+  xview& operator=(const xview& o)
+  {
+    assign(o);
+    return *this;
+  }
+  xtem(xtn U, xlayout L) xview& operator=(const xview<U,RANK,L>& o)
+  {
+    assignview(o,std::integral_constant<bool,RANK == 1>());
+    return *this;
+  }
+  xtem(xtn E) xview& operator=(const xexpr<E>& e)
+  {
+    assign(e.self());
+    return *this;
+  }
+  xview& operator=(const elem_type& value)
+  {
+    xforeach(*this,[&](TYPE& x){ x = value; });
+    return *this;
+  }
+
+  xtem(xtn E) xview& operator+=(const E& e) { return *this = *this + e; }
+  xtem(xtn E) xview& operator-=(const E& e) { return *this = *this - e; }
+  xtem(xtn E) xview& operator*=(const E& e) { return *this = *this * e; }
+  xtem(xtn E) xview& operator/=(const E& e) { return *this = *this / e; }
+
+  // View with index D fixed to I
+  xtem(szt D)
+  xview<TYPE,RANK-1,xslicelayout<RANK,LAYOUT,D>::value> slice(s64 i) const
+  {
+    return this->template slice_<D>(p_,i);
+  }
+
+  // Row I and column J of a 2D view
+  xview<TYPE,RANK-1,xslicelayout<RANK,LAYOUT,0>::value> row(s64 i) const
+  {
+    return slice<0>(i);
+  }
+  xview<TYPE,RANK-1,xslicelayout<RANK,LAYOUT,1>::value> col(s64 j) const
+  {
+    static_assert(RANK == 2,"col() is only for 2D arrays");
+    return slice<1>(j);
+  }
+
+  // Sub-block with the given bounds along each dimension
+  xview block(s64 l0, s64 h0) const
+  {
+    static_assert(RANK == 1,"2 bounds given for a multidimensional view");
+    const s64 b[] = {l0,h0};
+    return this->block_(p_,b);
+  }
+  xview block(s64 l0, s64 h0, s64 l1, s64 h1) const
+  {
+    static_assert(RANK == 2,"4 bounds given for a non 2D view");
+    const s64 b[] = {l0,h0,l1,h1};
+    return this->block_(p_,b);
+  }
+  xview block(s64 l0, s64 h0, s64 l1, s64 h1, s64 l2, s64 h2) const
+  {
+    static_assert(RANK == 3,"6 bounds given for a non 3D view");
+    const s64 b[] = {l0,h0,l1,h1,l2,h2};
+    return this->block_(p_,b);
+  }
+  xview block(s64 l0, s64 h0, s64 l1, s64 h1,
+              s64 l2, s64 h2, s64 l3, s64 h3) const
+  {
+    static_assert(RANK == 4,"8 bounds given for a non 4D view");
+    const s64 b[] = {l0,h0,l1,h1,l2,h2,l3,h3};
+    return this->block_(p_,b);
+  }
+
+  // Storage of the first element
+  TYPE* data() const { return p_; }
+
+  // NOTE : lbound()/ubound() without dimension only for 1D views
+  s64 lbound() const { return this->lbound(0); }
+  s64 ubound() const { return this->ubound(0); }
+  using base::lbound;
+  using base::ubound;
+  using base::size;
+
+  // Array expression interface for 1D views, K is the position from 0
+  elem_type ev(s64 k) const
+  {
+    static_assert(RANK == 1,"Only 1D views are array expressions");
+    return p_[k*this->stride(0)];
+  }
+  // W elements from K, for contiguous views
+  xtem(xtn PACK) PACK evp(s64 k) const { return PACK::loadu(p_+k); }
+  bool aliases(const void* b, const void* e, const void* p, s64 s) const
+  {
+    return xoverlaps(p_,this->size(),this->stride(0),b,e,p,s);
+  }
+
+private:
+  xview at2(s64 lo, s64 hi, std::true_type) const
+  {
+    return block(lo,hi);
+  }
+  TYPE& at2(s64 i, s64 j, std::false_type) const
+  {
+    return p_[this->off(i,j)];
+  }
+
+  // Element wise assignment of a 1D expression, or of a view of any rank
+  xtem(xtn E) void assign(const E& e)
+  {
+    static_assert(RANK == 1,"Only 1D views are assigned expressions");
+    xevaluate<LAYOUT != STRIDED>(p_,this->size(),this->stride(0),e);
+  }
+  void assign(const xview& o)
+  {
+    assignview(o,std::integral_constant<bool,RANK == 1>());
+  }
+  xtem(xtn V) void assignview(const V& o, std::true_type) { assign<V>(o); }
+  xtem(xtn V) void assignview(const V& o, std::false_type)
+  {
+    if(static_cast<const void*>(o.data()) == p_) return;
+    if(!xviewsoverlap(o,*this)) { xcopyview(o,*this); return; }
+    // Overlapping blocks : copy through a temporary
+    xarraynd<elem_type,RANK,ROWMAJOR> tmp;
+    s64 lo[RANK], hi[RANK];
+    for(szt d=0;d<RANK;++d) { lo[d] = o.lbound(d); hi[d] = o.ubound(d); }
+    tmp.allocate(lo,hi);
+    xcopyview(o,tmp.view());
+    xcopyview(tmp.view(),*this);
+  }
+
+  TYPE* p_;
+};
+
+//---------------------------------------------------------------------------//
+// Owning multidimensional array stored in ONE contiguous aligned block.
+//---------------------------------------------------------------------------//
+// PROPERTIES :
+// + LAYOUT is ROWMAJOR (C order) or COLMAJOR (FORTRAN order).
+// + Every dimension has its own lower bound, default 1.
+// + The contiguous dimension is padded (see xpadded_ld) so that every
+//   row (ROWMAJOR) or column (COLMAJOR) starts SIMD_ALIGN aligned.
+// + Elements are NOT initialized on construction for trivial types.
+// + Copy is a deep copy. Move and swap only exchange pointers, when both
+//   arrays are on the same arena or on the heap.
+// + Storage is from the heap, or from an arena given as first constructor
+//   argument (see "Arenas"). Copies are always on the heap. An array keeps
+//   its arena for life : move assignment and swap of arrays of different
+//   arenas copy the elements, and only a move constructed array takes the
+//   arena of the array it is moved from.
+//---------------------------------------------------------------------------//
+// USE : Constructed from the extents or from the bounds of each dimension
+// >> ARR2(f64) a(nx,ny);                  // a(1:nx,1:ny)
+// >> ARR2(f64,COLMAJOR) b(0,nx+1,0,ny+1); // b(0:nx+1,0:ny+1), FORTRAN order
+// >> ARR3(f32) c(nx,ny,nz);               // c(1:nx,1:ny,1:nz)
+// >> u32 i,j;
+// >> DO(i,1,nx)
+// >>   DO(j,1,ny)
+// >>     a(i,j) = b(i,j) + b(i-1,j);
+// >>   ENDDO
+// >> ENDDO
+// >> DBGARR2(a);
+//---------------------------------------------------------------------------//
+xtem(xtn... ARGS) struct xallint;
+template<> struct xallint<> : std::true_type {};
+xtem(xtn HEAD, xtn... TAIL) struct xallint<HEAD,TAIL...>
+  : std::integral_constant<bool,
+      std::is_integral<xtn std::decay<HEAD>::type>::value &&
+      xallint<TAIL...>::value> {};
+
+xtem(xtn TYPE, szt RANK, xlayout LAYOUT)
+class xarraynd : public xndshape<TYPE,RANK,LAYOUT>
+{
+  static_assert(LAYOUT != STRIDED,"Owning arrays must be ROWMAJOR/COLMAJOR");
+  static_assert(RANK >= 1 && RANK <= 4,"Arrays of rank 1 to 4 are supported");
+  typedef xndshape<TYPE,RANK,LAYOUT> base;
+public:
+  typedef TYPE value_type;
+
+  // Empty array
+  xarraynd() : p_(0), cap_(0), arena_(0)
+  {
+    for(szt d=0;d<RANK;++d) { this->lo_[d] = 1; this->n_[d] = 0; this->st_[d] = 0; }
+  }
+
+  // RANK extents (n0,n1,...) giving a(1:n0,1:n1,...) or
+  // 2*RANK bounds (lo0,hi0,lo1,hi1,...) giving a(lo0:hi0,lo1:hi1,...)
+  xtem(xtn... ARGS, xtn = xtn std::enable_if<xallint<ARGS...>::value>::type)
+  explicit xarraynd(ARGS... args) : p_(0), cap_(0), arena_(0)
+  {
+    const s64 v[] = {s64(args)...};
+    init<sizeof...(ARGS)>(v);
+  }
+
+  // The same on the arena a
+  xtem(xtn... ARGS, xtn = xtn std::enable_if<xallint<ARGS...>::value>::type)
+  xarraynd(xarena& a, ARGS... args) : p_(0), cap_(0), arena_(&a)
+  {
+    const s64 v[] = {s64(args)...};
+    init<sizeof...(ARGS)>(v);
+  }
+
+  xarraynd(const xarraynd& o) : base(o), p_(0), cap_(0), arena_(0)
+  {
+    s64 lo[RANK], hi[RANK];
+    o.bounds(lo,hi);
+    allocate(lo,hi);
+    copy_from(o);
+  }
+
+  xarraynd(xarraynd&& o)
+    : base(o), p_(o.p_), cap_(o.cap_), arena_(o.arena_)
+  {
+    o.p_ = 0; o.cap_ = 0;
+    for(szt d=0;d<RANK;++d) o.n_[d] = 0;
+  }
+
+  // Copy the bounds and values of o, reusing the storage if possible
+  xarraynd& operator=(const xarraynd& o)
+  {
+    if(this == &o) return *this;
+    s64 lo[RANK], hi[RANK];
+    o.bounds(lo,hi);
+    bool same = true;
+    for(szt d=0;d<RANK;++d)
+      same = same && this->lo_[d] == lo[d] && this->n_[d] == o.n_[d];
+    if(!same) allocate(lo,hi);
+    copy_from(o);
+    return *this;
+  }
+
+  // Takes the storage of o if it is on the same arena (or both on the
+  // heap), else copies the elements into the storage of this array
+  xarraynd& operator=(xarraynd&& o)
+  {
+    if(arena_ == o.arena_) swap(o);
+    else *this = o;
+    return *this;
+  }
+
+  ~xarraynd() { deallocate(); }
+
+  // Discard the contents and allocate with bounds lo[d]:hi[d]
+  void allocate(const s64* lo, const s64* hi)
+  {
+    deallocate();
+    for(szt d=0;d<RANK;++d) {
+      this->lo_[d] = lo[d];
+      this->n_[d] = (hi[d] >= lo[d]) ? hi[d]-lo[d]+1 : 0;
+    }
+    // Strides : contiguous dimension first, with padded leading dimension
+    s64 st = 1;
+    for(szt e=0;e<RANK;++e) {
+      szt d = (LAYOUT == ROWMAJOR) ? RANK-1-e : e;
+      this->st_[d] = st;
+      st *= (e == 0) ? xpadded_ld<TYPE>(this->n_[d]) : this->n_[d];
+    }
+    cap_ = xpadded<TYPE>(st);
+    p_ = arena_ ? arena_->alloc<TYPE>(cap_) : xalloc_elems<TYPE>(cap_);
+  }
+
+  // Release the storage, leaving an empty array
+  void deallocate()
+  {
+    if(p_ && arena_) xdestroy_elems(p_,cap_);
+    else if(p_) xfree_elems(p_,cap_);
+    p_ = 0; cap_ = 0;
+    for(szt d=0;d<RANK;++d) this->n_[d] = 0;
+  }
+
+  // Arena of the storage, 0 for the heap
+  xarena* arena() const { return arena_; }
+
+  // Exchange the contents. Each array keeps its arena, so storage of
+  // different arenas is exchanged by copying the elements.
+  void swap(xarraynd& o)
+  {
+    if(arena_ != o.arena_) {
+      xarraynd t(o);
+      o = *this;
+      *this = t;
+      return;
+    }
+    std::swap(p_,o.p_); std::swap(cap_,o.cap_);
+    for(szt d=0;d<RANK;++d) {
+      std::swap(this->lo_[d],o.lo_[d]);
+      std::swap(this->n_[d],o.n_[d]);
+      std::swap(this->st_[d],o.st_[d]);
+    }
+  }
+
+  // Set every element (padding excluded) to value
+  void fill(const TYPE& value) { apply(view(),value); }
+
+  // Element access with FORTRAN indexing
+  TYPE& operator()(s64 i) { return p_[this->off(i)]; }
+  TYPE& operator()(s64 i, s64 j) { return p_[this->off(i,j)]; }
+  TYPE& operator()(s64 i, s64 j, s64 k) { return p_[this->off(i,j,k)]; }
+  TYPE& operator()(s64 i, s64 j, s64 k, s64 l)
+  {
+    return p_[this->off(i,j,k,l)];
+  }
+  const TYPE& operator()(s64 i) const { return p_[this->off(i)]; }
+  const TYPE& operator()(s64 i, s64 j) const { return p_[this->off(i,j)]; }
+  const TYPE& operator()(s64 i, s64 j, s64 k) const
+  {
+    return p_[this->off(i,j,k)];
+  }
+  const TYPE& operator()(s64 i, s64 j, s64 k, s64 l) const
+  {
+    return p_[this->off(i,j,k,l)];
+  }
+
+  // Views of the whole array
+  xview<TYPE,RANK,LAYOUT> view()
+  {
+    return xview<TYPE,RANK,LAYOUT>(p_,this->lo_,this->n_,this->st_);
+  }
+  xview<const TYPE,RANK,LAYOUT> view() const
+  {
+    return xview<const TYPE,RANK,LAYOUT>(p_,this->lo_,this->n_,this->st_);
+  }
+
+  // View with index D fixed to I, and rows/columns of 2D arrays
+  xtem(szt D)
+  xview<TYPE,RANK-1,xslicelayout<RANK,LAYOUT,D>::value> slice(s64 i)
+  {
+    return this->template slice_<D>(p_,i);
+  }
+  xtem(szt D)
+  xview<const TYPE,RANK-1,xslicelayout<RANK,LAYOUT,D>::value>
+  slice(s64 i) const
+  {
+    return this->template slice_<D>(static_cast<const TYPE*>(p_),i);
+  }
+  xview<TYPE,RANK-1,xslicelayout<RANK,LAYOUT,0>::value> row(s64 i)
+  {
+    return view().row(i);
+  }
+  xview<const TYPE,RANK-1,xslicelayout<RANK,LAYOUT,0>::value>
+  row(s64 i) const
+  {
+    return view().row(i);
+  }
+  xview<TYPE,RANK-1,xslicelayout<RANK,LAYOUT,1>::value> col(s64 j)
+  {
+    return view().col(j);
+  }
+  xview<const TYPE,RANK-1,xslicelayout<RANK,LAYOUT,1>::value>
+  col(s64 j) const
+  {
+    return view().col(j);
+  }
+
+  // Sub-blocks, see xview::block
+  xtem(xtn... B) xview<TYPE,RANK,LAYOUT> block(B... b)
+  {
+    return view().block(b...);
+  }
+  xtem(xtn... B) xview<const TYPE,RANK,LAYOUT> block(B... b) const
+  {
+    return view().block(b...);
+  }
+
+  // Padded size of the contiguous dimension, FORTRAN/BLAS's LDA
+  s64 ld() const
+  {
+    if(RANK == 1) return this->n_[0];
+    return this->st_[LAYOUT == ROWMAJOR ? RANK-2 : 1];
+  }
+
+  // Raw aligned storage, data()[0] is the element at the lower bounds
+  TYPE* data() { return p_; }
+  const TYPE* data() const { return p_; }
+
+  // No. of elements allocated, including padding
+  s64 padded_size() const { return cap_; }
+
+private:
+  // Allocate from N extents or bounds
+  xtem(szt N) void init(const s64* v)
+  {
+    static_assert(N == RANK || N == 2*RANK,
+                  "Give RANK extents or 2*RANK bounds");
+    s64 lo[RANK], hi[RANK];
+    for(szt d=0;d<RANK;++d) {
+      if(N == RANK) { lo[d] = 1; hi[d] = v[d]; }
+      else { lo[d] = v[2*d]; hi[d] = v[2*d+1]; }
+    }
+    allocate(lo,hi);
+  }
+
+  void bounds(s64* lo, s64* hi) const
+  {
+    for(szt d=0;d<RANK;++d) { lo[d] = this->lbound(d); hi[d] = this->ubound(d); }
+  }
+
+  // Copy o, which has the same bounds, ignoring the padding
+  void copy_from(const xarraynd& o)
+  {
+    if(cap_ == o.cap_) { std::copy(o.p_,o.p_+cap_,p_); return; }
+    xcopyview(o.view(),view());
+  }
+
+  // Set all elements of the view V to value
+  xtem(xtn V) static void apply(const V& v, const TYPE& value)
+  {
+    xforeach(v,[&](TYPE& x){ x = value; });
+  }
+
+  TYPE* p_;
+  s64 cap_;
+  xarena* arena_;
+};
+
+//---------------------------------------------------------------------------//
+// 2D, 3D and 4D arrays of type TYPE, with optional layout
+//---------------------------------------------------------------------------//
+// USE :
+// >> ARR2(f64) a(nx,ny);            // C order
+// >> ARR2(f64,COLMAJOR) b(nx,ny);   // FORTRAN order
+//---------------------------------------------------------------------------//
+xtem(xtn TYPE, xlayout LAYOUT=ROWMAJOR) using xarray2 = xarraynd<TYPE,2,LAYOUT>;
+xtem(xtn TYPE, xlayout LAYOUT=ROWMAJOR) using xarray3 = xarraynd<TYPE,3,LAYOUT>;
+xtem(xtn TYPE, xlayout LAYOUT=ROWMAJOR) using xarray4 = xarraynd<TYPE,4,LAYOUT>;
+
+#define  ARR2(...) xarray2< __VA_ARGS__ >
+#define xarr2(...) xarray2< __VA_ARGS__ >
+#define  ARR3(...) xarray3< __VA_ARGS__ >
+#define xarr3(...) xarray3< __VA_ARGS__ >
+#define  ARR4(...) xarray4< __VA_ARGS__ >
+#define xarr4(...) xarray4< __VA_ARGS__ >
+
+//---------------------------------------------------------------------------//
+// Call F(x) for every element x of the view V, in memory order
+//---------------------------------------------------------------------------//
+xtem(xtn TYPE, xlayout LAYOUT, xtn FUNC)
+void xforeach(const xview<TYPE,1,LAYOUT>& v, FUNC f)
+{
+  TYPE* p = v.data();
+  const s64 n = v.size(0), s = v.stride(0);
+  if(LAYOUT != STRIDED) { for(s64 k=0;k<n;++k) f(p[k]); }
+  else                  { for(s64 k=0;k<n;++k) f(p[k*s]); }
+}
+
+xtem(xtn TYPE, szt RANK, xlayout LAYOUT, xtn FUNC)
+void xforeach(const xview<TYPE,RANK,LAYOUT>& v, FUNC f)
+{
+  // Outer dimension is the one with the largest stride
+  const szt d = (LAYOUT == COLMAJOR) ? RANK-1 : 0;
+  for(s64 i=v.lbound(d);i<=v.ubound(d);++i) {
+    if(LAYOUT == COLMAJOR) xforeach(v.template slice<RANK-1>(i),f);
+    else                   xforeach(v.template slice<0>(i),f);
+  }
+}
+
+//---------------------------------------------------------------------------//
+// Copy the elements of view A into view B of the same shape
+//---------------------------------------------------------------------------//
+xtem(xtn TA, xlayout LA, xtn TB, xlayout LB)
+void xcopyview(const xview<TA,1,LA>& a, const xview<TB,1,LB>& b)
+{
+  const s64 n = a.size(0), sa = a.stride(0), sb = b.stride(0);
+  TA* pa = a.data(); TB* pb = b.data();
+  for(s64 k=0;k<n;++k) pb[k*sb] = pa[k*sa];
+}
+
+xtem(xtn TA, szt RANK, xlayout LA, xtn TB, xlayout LB)
+void xcopyview(const xview<TA,RANK,LA>& a, const xview<TB,RANK,LB>& b)
+{
+  for(s64 k=0;k<a.size(0);++k)
+    xcopyview(a.template slice<0>(a.lbound(0)+k),
+              b.template slice<0>(b.lbound(0)+k));
+}
+
+//---------------------------------------------------------------------------//
+// Do the memory spans of the views A and B overlap ?
+//---------------------------------------------------------------------------//
+xtem(xtn TA, szt RANK, xlayout LA, xtn TB, xlayout LB)
+bool xviewsoverlap(const xview<TA,RANK,LA>& a, const xview<TB,RANK,LB>& b)
+{
+  if(a.empty() || b.empty()) return false;
+  s64 ea = 0, eb = 0;
+  for(szt d=0;d<RANK;++d) {
+    ea += (a.size(d)-1)*a.stride(d);
+    eb += (b.size(d)-1)*b.stride(d);
+  }
+  const void* a0 = a.data(); const void* a1 = a.data()+ea;
+  const void* b0 = b.data(); const void* b1 = b.data()+eb;
+  std::less<const void*> lt;
+  return !(lt(a1,b0) || lt(b1,a0));
+}
+
+//---------------------------------------------------------------------------//
+// Lower/upper bound of 1D views, so that DBGVEC works on rows and columns
+//---------------------------------------------------------------------------//
+xtem(xtn TYPE, xlayout LAYOUT) inline
+s64 xlbound(const xview<TYPE,1,LAYOUT>& v) { return v.lbound(0); }
+xtem(xtn TYPE, xlayout LAYOUT) inline
+s64 xubound(const xview<TYPE,1,LAYOUT>& v) { return v.ubound(0); }
+
+//---------------------------------------------------------------------------//
+// Print a multidimensional array or view NAME to the stream OS.
+// 2D arrays are printed row by row like DBGVEC2.
+// 3D and 4D arrays are printed as a series of 2D slices NAME(i,:,:).
+// NOTE : Used by DBGARR2 and DBGARRN.
+//---------------------------------------------------------------------------//
+// FIXED holds the indices already fixed, for ex. "2,1," for NAME(2,1,:,:)
+xtem(xtn TYPE, xlayout LAYOUT)
+void xprintnd(std::ostream& os, const xstr& name,
+              const xview<TYPE,2,LAYOUT>& v, const xstr& fixed="")
+{
+  os<<name;
+  if(!fixed.empty()) os<<"("<<fixed<<":,:)";
+  for(s64 i=v.lbound(0);i<=v.ubound(0);++i) {
+    os<<"\t:\t[";
+    for(s64 j=v.lbound(1);j<=v.ubound(1);++j)
+      os<<(j > v.lbound(1) ? "," : "")<<v(i,j);
+    os<<"]"<<nl;
+  }
+}
+
+xtem(xtn TYPE, szt RANK, xlayout LAYOUT)
+void xprintnd(std::ostream& os, const xstr& name,
+              const xview<TYPE,RANK,LAYOUT>& v, const xstr& fixed="")
+{
+  for(s64 i=v.lbound(0);i<=v.ubound(0);++i)
+    xprintnd(os,name,v.template slice<0>(i),fixed+std::to_string(i)+",");
+}
+
+xtem(xtn TYPE, szt RANK, xlayout LAYOUT)
+void xprintnd(std::ostream& os, const xstr& name,
+              const xarraynd<TYPE,RANK,LAYOUT>& a)
+{
+  xprintnd(os,name,a.view());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Commonly used multidimensional array types
+///////////////////////////////////////////////////////////////////////////////
+typedef xarray2<s32>   a2s32;
+typedef xarray2<u32>   a2u32;
+typedef xarray2<f32>   a2f32;
+typedef xarray2<f64>   a2f64;
+typedef xarray3<f32>   a3f32;
+typedef xarray3<f64>   a3f64;
+
+///////////////////////////////////////////////////////////////////////////////
+// First touch
+///////////////////////////////////////////////////////////////////////////////
+//---------------------------------------------------------------------------//
+// Writes the elements of new arrays from the threads that will use them,
+// so that on NUMA machines (see "NUMA topology") the block of every thread
+// lives on the node of that thread.
+// The blocks are those of the parallel loops for the schedule given,
+// default xsched(STATIC) : a PARDO over the whole array, with the same
+// schedule, gives every thread the pages it touched first.
+// + xfirsttouch(a,v) : a = v in parallel, for arrays not written yet
+//   (ARR(f64) x(1,n) allocates without writing, ARR(f64) x(1,n,v) writes)
+// + xnumaalloc<TYPE> : allocator whose storage is first touched in parallel
+//   by the pool, and xnumavec<TYPE> the std::vector of it
+// + xpagenodes(a)    : where the pages of the array are
+//---------------------------------------------------------------------------//
+// NOTE : The threads must stay on their node, so pin the pool (COMPACT or
+// SCATTER), and keep the same no. of threads.
+// NOTE : For xarraynd, the blocks are of the storage, which are those of a
+// PARDO over the slowest index (the first for ROWMAJOR).
+//---------------------------------------------------------------------------//
+// USE : The arrays of the FTBS test, on the nodes of the threads
+// >> xpool_init(0,COMPACT);
+// >> ARR(f64) u(1,nx);
+// >> xfirsttouch(u,1.0);              // Not ARR(f64) u(1,nx,1.0)
+// >> cout<<xpagenodes(u)<<endl;      // node 0 : 50.0%, node 1 : 50.0%
+// >> PARDO(i,2,nx) ... ENDPARDO
+//---------------------------------------------------------------------------//
+xtem(xtn TYPE)
+void xfirsttouch(TYPE* p, s64 n, const TYPE& v, const xsched& sc=xsched())
+{
+  if(n <= 0) return;
+  xthreadpool& pool = xpool();
+  xparchunks ch(sc,n,pool.size());
+  pool.run([&](szt t) {
+    ch.each(t,[&](s64 a, s64 b) { std::fill(p+a,p+b,v); });
+  });
+}
+
+xtem(xtn TYPE) inline
+void xfirsttouch(xarray<TYPE>& a, const TYPE& v, const xsched& sc=xsched())
+{
+  xfirsttouch(a.data(),a.size(),v,sc);
+}
+
+xtem(xtn TYPE, szt RANK, xlayout LAYOUT) inline
+void xfirsttouch(xarraynd<TYPE,RANK,LAYOUT>& a, const TYPE& v,
+                 const xsched& sc=xsched())
+{
+  xfirsttouch(a.data(),a.padded_size(),v,sc);
+}
+
+//---------------------------------------------------------------------------//
+// STL allocator of memory first touched by the pool in STATIC blocks.
+// The elements are zero, and default construction does not write them
+// again, so the vector keeps the placement of the pages.
+//---------------------------------------------------------------------------//
+xtem(xtn TYPE)
+struct xnumaalloc
+{
+  typedef TYPE value_type;
+
+  xnumaalloc() {}
+  xtem(xtn U) xnumaalloc(const xnumaalloc<U>&) {}
+
+  TYPE* allocate(size_t n)
+  {
+    char* p = static_cast<char*>(xaligned_alloc(n*SOF(TYPE)));
+    xfirsttouch(p,s64(n*SOF(TYPE)),char(0));
+    return reinterpret_cast<TYPE*>(p);
+  }
+  void deallocate(TYPE* p, size_t) { xaligned_free(p); }
+
+  // Default construction without value initialization
+  xtem(xtn U) void construct(U* p) { ::new(static_cast<void*>(p)) U; }
+  xtem(xtn U, xtn... ARGS) void construct(U* p, ARGS&&... args)
+  {
+    ::new(static_cast<void*>(p)) U(std::forward<ARGS>(args)...);
+  }
+};
+
+xtem(xtn T, xtn U) inline
+bool operator==(const xnumaalloc<T>&, const xnumaalloc<U>&) { return true; }
+xtem(xtn T, xtn U) inline
+bool operator!=(const xnumaalloc<T>&, const xnumaalloc<U>&) { return false; }
+
+// Vector first touched in parallel, VEC(TYPE,xnumaalloc<TYPE>)
+xtem(xtn TYPE) using xnumavec = std::vector<TYPE,xnumaalloc<TYPE> >;
+
+//---------------------------------------------------------------------------//
+// Where the pages of arrays are, see xpageplace
+//---------------------------------------------------------------------------//
+xtem(xtn TYPE) inline
+xpageplace xpagenodes(const xarray<TYPE>& a)
+{
+  return xpagenodes(a.data(),u64(a.size())*SOF(TYPE));
+}
+
+xtem(xtn TYPE, szt RANK, xlayout LAYOUT) inline
+xpageplace xpagenodes(const xarraynd<TYPE,RANK,LAYOUT>& a)
+{
+  return xpagenodes(a.data(),u64(a.padded_size())*SOF(TYPE));
+}
+
+xtem(xtn TYPE, xtn ALLOC) inline
+xpageplace xpagenodes(const std::vector<TYPE,ALLOC>& v)
+{
+  return xpagenodes(v.data(),u64(v.size())*SOF(TYPE));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Time levels
+///////////////////////////////////////////////////////////////////////////////
+//---------------------------------------------------------------------------//
+// LEVELS copies of a FIELD (array) for the time levels n+1, n, n-1, ...
+// Advancing one time step rotates the levels, it does NOT copy any element.
+//---------------------------------------------------------------------------//
+// LEVELS : 2 for one step schemes (FTBS, FTCS, Runge-Kutta stages aside),
+//          3 for leapfrog or for 2 step Adams-Bashforth histories, etc.
+//---------------------------------------------------------------------------//
+// NOTE : After advance(), np1() holds the stale values of the oldest level.
+// Values that the scheme does not update every step (boundaries, ghost
+// cells) must be set explicitly : either once in every level with
+// replicate(), if they never change, or every step with carry().
+//---------------------------------------------------------------------------//
+// USE : FTBS with u(1) fixed, instead of un = un1 every step
+// >> xtimelevels<af64> u(1,nx);     // Both levels are ARR(f64)(1,nx)
+// >> u.n() = 1.0;                   // Initial condition in level n
+// >> u.replicate();                 // u(1) is now valid in all levels
+// >> DO(t,1,nt)
+// >>   af64& un = u.n(); af64& un1 = u.np1();
+// >>   un1(2,nx) = un(2,nx) - un(2,nx)*dtdx*(un(2,nx)-un(1,nx-1));
+// >>   u.advance();                  // n+1 becomes n
+// >> ENDDO
+// >> DBGVEC(u.n());                  // Solution at the last time step
+//---------------------------------------------------------------------------//
+xtem(xtn FIELD, szt LEVELS=2)
+class xtimelevels
+{
+  static_assert(LEVELS >= 2,"At least 2 time levels are needed");
+public:
+  // Every level is constructed as FIELD(args...)
+  xtem(xtn... ARGS) explicit xtimelevels(const ARGS&... args) : step_(0)
+  {
+    for(szt k=0;k<LEVELS;++k) {
+      f_[k] = FIELD(args...);
+      p_[k] = &f_[k];
+    }
+  }
+
+  xtimelevels(const xtimelevels&) = delete;
+  xtimelevels& operator=(const xtimelevels&) = delete;
+
+  // Level n+1, the one being computed
+  FIELD& np1() { return *p_[0]; }
+  const FIELD& np1() const { return *p_[0]; }
+
+  // Level n, the latest solution
+  FIELD& n() { return *p_[1]; }
+  const FIELD& n() const { return *p_[1]; }
+
+  // Level n-1
+  FIELD& nm1()
+  {
+    static_assert(LEVELS >= 3,"n-1 needs 3 time levels");
+    return *p_[2];
+  }
+  const FIELD& nm1() const
+  {
+    static_assert(LEVELS >= 3,"n-1 needs 3 time levels");
+    return *p_[2];
+  }
+
+  // Level n+K, for K = 1,0,-1,...,2-LEVELS
+  FIELD& level(s32 k) { return *p_[1-k]; }
+  const FIELD& level(s32 k) const { return *p_[1-k]; }
+
+  // Rotate the levels : n+1 becomes n, n becomes n-1, ...
+  // and the oldest level is reused as the new n+1.
+  // NSTEPS is the no. of time steps that took n to n+1 (see xstencil_run)
+  void advance(s64 nsteps=1)
+  {
+    FIELD* oldest = p_[LEVELS-1];
+    for(szt k=LEVELS-1;k>0;--k) p_[k] = p_[k-1];
+    p_[0] = oldest;
+    step_ += nsteps;
+  }
+
+  // Copy level n into every other level.
+  // NOTE : Done once, for ex. after setting the initial condition.
+  void replicate()
+  {
+    for(szt k=0;k<LEVELS;++k) if(k != 1) *p_[k] = *p_[1];
+  }
+
+  // Copy the section given by BOUNDS from level n to level n+1.
+  // BOUNDS are lo,hi for 1D arrays and lo0,hi0,lo1,hi1,... otherwise.
+  // NOTE : Used every step for values the scheme does not compute.
+  xtem(xtn... BOUNDS) void carry(BOUNDS... b)
+  {
+    xsection(np1(),b...) = xsection(n(),b...);
+  }
+
+  // No. of time steps advanced so far
+  s64 step() const { return step_; }
+
+private:
+  FIELD f_[LEVELS];
+  FIELD* p_[LEVELS];
+  s64 step_;
+};
+
+//---------------------------------------------------------------------------//
+// Section of an array as a view : x(lo:hi) for 1D, a block for others
+//---------------------------------------------------------------------------//
+xtem(xtn TYPE) inline
+xview<TYPE,1,ROWMAJOR> xsection(xarray<TYPE>& a, s64 lo, s64 hi)
+{
+  return a(lo,hi);
+}
+xtem(xtn TYPE) inline
+xview<const TYPE,1,ROWMAJOR> xsection(const xarray<TYPE>& a, s64 lo, s64 hi)
+{
+  return a(lo,hi);
+}
+xtem(xtn TYPE, szt RANK, xlayout LAYOUT, xtn... BOUNDS) inline
+xview<TYPE,RANK,LAYOUT> xsection(xarraynd<TYPE,RANK,LAYOUT>& a, BOUNDS... b)
+{
+  return a.block(b...);
+}
+xtem(xtn TYPE, szt RANK, xlayout LAYOUT, xtn... BOUNDS) inline
+xview<const TYPE,RANK,LAYOUT>
+xsection(const xarraynd<TYPE,RANK,LAYOUT>& a, BOUNDS... b)
+{
+  return a.block(b...);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Stencils
+///////////////////////////////////////////////////////////////////////////////
+//---------------------------------------------------------------------------//
+// An explicit scheme is declared ONCE as a stencil : the smallest and the
+// largest offset it reads along each dimension, and a function giving the
+// new value of a point from the old values around it.
+// xstencil_run then advances the solution by many time steps, with
+// + Spatial tiling : the update region is processed in tiles.
+// + Temporal blocking : every tile, grown by the reach of the stencil, is
+//   copied to a small scratch buffer and advanced TSTEPS time steps while it
+//   stays in cache. Only the tile itself is written back, so the whole array
+//   goes through memory once per TSTEPS time steps instead of every step.
+//---------------------------------------------------------------------------//
+// NOTE : The function gets a point u, where u(0) is the old value at the
+// point and u(-1), u(+1) etc. are its neighbours. In 2D and 3D the offsets
+// are u(di,dj) and u(di,dj,dk). u.i[d] is the index of the point along d.
+// NOTE : Points outside the update region are never changed, like u(1) in
+// FTBS. The stencil must not read outside the arrays.
+// NOTE : Multidimensional fields must be ROWMAJOR.
+// NOTE : If the function is a template, it is also called with xstpack,
+// whose u(o) are packs of the values at xnpack<TYPE>::width neighbouring
+// points, and the lines are computed a whole pack at a time.
+// Then u.i[d] is the index of the first of those points.
+//---------------------------------------------------------------------------//
+// USE : Schemes for the 1D nonlinear convection, d(u)/dt + u*d(u)/dx = 0
+// >> typedef xstpoint<f64,1> pt;
+// >> // FTBS, reads u(-1) and u(0)
+// >> auto ftbs = xmkstencil(-1,0,[=](const pt& u) {
+// >>   return u(0) - u(0)*dtdx*(u(0)-u(-1)); });
+// >> // FTCS, reads u(-1) to u(+1)
+// >> auto ftcs = xmkstencil(-1,1,[=](const pt& u) {
+// >>   return u(0) - 0.5*u(0)*dtdx*(u(1)-u(-1)); });
+// >> // Lax-Wendroff for the conservative form, reads u(-1) to u(+1)
+// >> auto lw = xmkstencil(-1,1,[=](const pt& u) {
+// >>   f64 fm = 0.5*xsq(u(-1)), f0 = 0.5*xsq(u(0)), fp = 0.5*xsq(u(1));
+// >>   f64 ap = 0.5*(u(0)+u(1)), am = 0.5*(u(-1)+u(0));
+// >>   return u(0) - 0.5*dtdx*(fp-fm)
+// >>               + 0.5*xsq(dtdx)*(ap*(fp-f0) - am*(f0-fm)); });
+// >> // Higher order (WENO like) schemes just have a larger reach, -3 to 2
+// >> auto weno = xmkstencil(-3,2,[=](const pt& u) { ... });
+// >>
+// >> xtimelevels<af64> u(1,nx);
+// >> ...                              // Initial condition in u.n()
+// >> xstencil_run(ftbs,u,nt,2,nx);    // nt steps of u(2:nx)
+// >> DBGVEC(u.n());
+//---------------------------------------------------------------------------//
+// USE : 2D heat equation with a 5 point stencil, on the interior
+// >> typedef xstpoint<f64,2> pt;
+// >> auto heat = xmkstencil(-1,1,-1,1,[=](const pt& u) {
+// >>   return u(0,0) + r*(u(-1,0)+u(1,0)+u(0,-1)+u(0,1)-4.0*u(0,0)); });
+// >> xtimelevels<a2f64> T(nx,ny);
+// >> xstencil_run(heat,T,nt,2,nx-1,2,ny-1);
+//---------------------------------------------------------------------------//
+// USE : FTBS vectorized with packs, the same for scalars and packs
+// >> struct ftbs_f
+// >> {
+// >>   f64 dtdx;
+// >>   xtem(xtn PT) xtn PT::value_type operator()(const PT& u) const
+// >>   { return u(0) - u(0)*dtdx*(u(0)-u(-1)); }
+// >> };
+// >> ftbs_f fn = {dtdx};
+// >> xstencil_run(xmkstencil(-1,0,fn),u,nt,2,nx);
+//---------------------------------------------------------------------------//
+// Tiling is tuned per stencil with,
+// >> ftbs.tile[0] = 8192;  // Points per tile along dimension 0
+// >> ftbs.tsteps = 32;     // Time steps per block, 1 disables blocking
+//---------------------------------------------------------------------------//
+// Active regions : when most of the solution does not change, like the
+// flat parts around the moving hat of the FTBS test, xstencil_run can be
+// given an xactivity, and then only updates the blocks of the update region
+// that read a value changed in the last step. The other blocks are neither
+// computed nor copied.
+// >> xactivity<1> act(256);           // Blocks of 256 points, exact
+// >> xstencil_run(ftbs,u,nt,act,2,nx);
+// >> cout<<act.fraction()<<endl;      // Fraction of the blocks updated
+// >> ...                              // u.n() changed by the user
+// >> act.reset();                     // Update everything in the next step
+// NOTE : It is exact with tol = 0 (the default), for any function whose
+// result only depends on the values it reads. With tol > 0, a block whose
+// values changed by at most tol is taken as unchanged, and the error is of
+// the order of tol.
+// NOTE : The steps are not blocked in time, tile and tsteps are not used.
+//---------------------------------------------------------------------------//
+//---------------------------------------------------------------------------//
+// Old values around the point being updated, given to the stencil function
+//---------------------------------------------------------------------------//
+xtem(xtn TYPE, szt RANK)
+struct xstpoint
+{
+  typedef TYPE value_type;
+
+  const TYPE* p;  // The point itself
+  s64 s[RANK];    // Strides, s[RANK-1] is 1
+  s64 i[RANK];    // Indices of the point
+
+  const TYPE& operator()(s64 o0) const
+  {
+    static_assert(RANK == 1,"1 offset given for a multidimensional stencil");
+    return p[o0];
+  }
+  const TYPE& operator()(s64 o0, s64 o1) const
+  {
+    static_assert(RANK == 2,"2 offsets given for a non 2D stencil");
+    return p[o0*s[0]+o1];
+  }
+  const TYPE& operator()(s64 o0, s64 o1, s64 o2) const
+  {
+    static_assert(RANK == 3,"3 offsets given for a non 3D stencil");
+    return p[o0*s[0]+o1*s[1]+o2];
+  }
+};
+
+//---------------------------------------------------------------------------//
+// Old values around PACK::width neighbouring points along the last dimension
+//---------------------------------------------------------------------------//
+xtem(xtn PACK, szt RANK)
+struct xstpack
+{
+  typedef PACK value_type;
+  typedef xtn PACK::value_type TYPE;
+
+  const TYPE* p;  // The first point
+  s64 s[RANK];    // Strides, s[RANK-1] is 1
+  s64 i[RANK];    // Indices of the first point
+
+  PACK operator()(s64 o0) const
+  {
+    static_assert(RANK == 1,"1 offset given for a multidimensional stencil");
+    return PACK::loadu(p+o0);
+  }
+  PACK operator()(s64 o0, s64 o1) const
+  {
+    static_assert(RANK == 2,"2 offsets given for a non 2D stencil");
+    return PACK::loadu(p+o0*s[0]+o1);
+  }
+  PACK operator()(s64 o0, s64 o1, s64 o2) const
+  {
+    static_assert(RANK == 3,"3 offsets given for a non 3D stencil");
+    return PACK::loadu(p+o0*s[0]+o1*s[1]+o2);
+  }
+};
+
+// Can the stencil function FUNC be called with the point POINT ?
+xtem(xtn FUNC, xtn POINT)
+struct xstcallable
+{
+  xtem(xtn F) static auto test(int)
+    -> decltype(std::declval<const F&>()(std::declval<const POINT&>()),
+                std::true_type());
+  xtem(xtn F) static std::false_type test(...);
+  typedef decltype(test<FUNC>(0)) type;
+};
+
+//---------------------------------------------------------------------------//
+// Stencil of RANK dimensions, reading offsets lo[d] <= 0 to hi[d] >= 0,
+// with the update function f, and how it is to be executed.
+//---------------------------------------------------------------------------//
+xtem(szt RANK, xtn FUNC)
+struct xstencil
+{
+  s64 lo[RANK];    // Smallest offset read along each dimension
+  s64 hi[RANK];    // Largest offset read along each dimension
+  FUNC f;          // New value of a point, f(xstpoint)
+  s64 tile[RANK];  // Tile size along each dimension
+  s64 tsteps;      // Time steps per temporal block
+
+  xstencil(const s64* l, const s64* h, const FUNC& func) : f(func)
+  {
+    // Default tiles hold 32KB to 64KB of f64, so 2 buffers fit in L2.
+    // The redundant work of the grown tiles rises quickly with the rank,
+    // so fewer steps are blocked in 2D and 3D.
+    const s64 deftile[3][3] = {{4096,0,0},{64,128,0},{16,16,32}};
+    const s64 deftsteps[3] = {16,8,2};
+    tsteps = deftsteps[RANK-1];
+    for(szt d=0;d<RANK;++d) {
+      lo[d] = l[d]; hi[d] = h[d];
+      tile[d] = deftile[RANK-1][d];
+    }
+  }
+};
+
+// Declare 1D, 2D and 3D stencils from their offsets and function
+xtem(xtn FUNC) inline
+xstencil<1,FUNC> xmkstencil(s64 lo0, s64 hi0, const FUNC& f)
+{
+  const s64 l[] = {lo0}, h[] = {hi0};
+  return xstencil<1,FUNC>(l,h,f);
+}
+xtem(xtn FUNC) inline
+xstencil<2,FUNC> xmkstencil(s64 lo0, s64 hi0, s64 lo1, s64 hi1, const FUNC& f)
+{
+  const s64 l[] = {lo0,lo1}, h[] = {hi0,hi1};
+  return xstencil<2,FUNC>(l,h,f);
+}
+xtem(xtn FUNC) inline
+xstencil<3,FUNC> xmkstencil(s64 lo0, s64 hi0, s64 lo1, s64 hi1,
+                            s64 lo2, s64 hi2, const FUNC& f)
+{
+  const s64 l[] = {lo0,lo1,lo2}, h[] = {hi0,hi1,hi2};
+  return xstencil<3,FUNC>(l,h,f);
+}
+
+//---------------------------------------------------------------------------//
+// Whole array as a view, and the part lo[d]:hi[d] of a view
+//---------------------------------------------------------------------------//
+xtem(xtn TYPE) inline
+xview<TYPE,1,ROWMAJOR> xfullview(xarray<TYPE>& a)
+{
+  return a(a.lbound(),a.ubound());
+}
+xtem(xtn TYPE, szt RANK, xlayout LAYOUT) inline
+xview<TYPE,RANK,LAYOUT> xfullview(xarraynd<TYPE,RANK,LAYOUT>& a)
+{
+  return a.view();
+}
+
+xtem(xtn TYPE, szt RANK, xlayout LAYOUT)
+xview<TYPE,RANK,LAYOUT> xsubview(const xview<TYPE,RANK,LAYOUT>& v,
+                                 const s64* lo, const s64* hi)
+{
+  s64 n[RANK], st[RANK], o = 0;
+  for(szt d=0;d<RANK;++d) {
+    n[d] = std::max<s64>(hi[d]-lo[d]+1,0);
+    st[d] = v.stride(d);
+    o += (lo[d]-v.lbound(d))*st[d];
+  }
+  return xview<TYPE,RANK,LAYOUT>(v.data()+o,lo,n,st);
+}
+
+//---------------------------------------------------------------------------//
+// Apply F to the N points of a line starting at PS, writing PD.
+// NOTE : PS and PD are different time levels or scratch buffers, so they
+// never overlap, which lets the loop be vectorized without runtime checks.
+//---------------------------------------------------------------------------//
+// One point at a time
+xtem(xtn TYPE, szt RANK, xtn FUNC) inline
+void xstencil_line(const FUNC& f, const xstpoint<TYPE,RANK>& pt,
+                   const TYPE* __restrict ps, TYPE* __restrict pd, s64 n,
+                   std::false_type)
+{
+  const s64 i0 = pt.i[RANK-1];
+  xstpoint<TYPE,RANK> q = pt;
+  for(s64 k=0;k<n;++k) {
+    q.p = ps+k; q.i[RANK-1] = i0+k;
+    pd[k] = f(q);
+  }
+}
+
+// One pack of points at a time, and the last n%width one at a time
+xtem(xtn TYPE, szt RANK, xtn FUNC) inline
+void xstencil_line(const FUNC& f, const xstpoint<TYPE,RANK>& pt,
+                   const TYPE* __restrict ps, TYPE* __restrict pd, s64 n,
+                   std::true_type)
+{
+  typedef xnpack<TYPE> pack;
+  const s64 w = pack::width, i0 = pt.i[RANK-1];
+  xstpack<pack,RANK> q;
+  for(szt d=0;d<RANK;++d) { q.s[d] = pt.s[d]; q.i[d] = pt.i[d]; }
+  s64 k = 0;
+  for(;k+w<=n;k+=w) {
+    q.p = ps+k; q.i[RANK-1] = i0+k;
+    f(q).storeu(pd+k);
+  }
+  xstpoint<TYPE,RANK> r = pt;
+  r.i[RANK-1] = i0+k;
+  xstencil_line(f,r,ps+k,pd+k,n-k,std::false_type());
+}
+
+xtem(xtn TYPE, szt RANK, xtn FUNC) inline
+void xstencil_line(const FUNC& f, const xstpoint<TYPE,RANK>& pt,
+                   const TYPE* __restrict ps, TYPE* __restrict pd, s64 n)
+{
+  typedef xstpack<xnpack<TYPE>,RANK> packpoint;
+  xstencil_line(f,pt,ps,pd,n,xtn xstcallable<FUNC,packpoint>::type());
+}
+
+//---------------------------------------------------------------------------//
+// One time step of the stencil function F on the points lo[d]:hi[d],
+// reading SRC and writing DST. The innermost loop is over the contiguous
+// last dimension, so that F is inlined and the loop can be vectorized.
+//---------------------------------------------------------------------------//
+xtem(xtn TYPE, szt RANK, xtn FUNC)
+void xstencil_sweep(const FUNC& f,
+                    const xview<const TYPE,RANK,ROWMAJOR>& src,
+                    const xview<TYPE,RANK,ROWMAJOR>& dst,
+                    const s64* lo, const s64* hi)
+{
+  for(szt d=0;d<RANK;++d) if(hi[d] < lo[d]) return;
+  // Local copy, so that the compiler knows stores to DST do not change it
+  const FUNC fl(f);
+  xstpoint<TYPE,RANK> pt;
+  for(szt d=0;d<RANK;++d) { pt.s[d] = src.stride(d); pt.i[d] = lo[d]; }
+  const s64 n = hi[RANK-1]-lo[RANK-1]+1;
+  for(;;) {
+    s64 os = 0, od = 0;
+    pt.i[RANK-1] = lo[RANK-1];
+    for(szt d=0;d<RANK;++d) {
+      os += (pt.i[d]-src.lbound(d))*src.stride(d);
+      od += (pt.i[d]-dst.lbound(d))*dst.stride(d);
+    }
+    xstencil_line(fl,pt,src.data()+os,dst.data()+od,n);
+    // Next line along the outer dimensions
+    bool more = false;
+    for(szt d=RANK-1;d-- > 0;) {
+      if(++pt.i[d] <= hi[d]) { more = true; break; }
+      pt.i[d] = lo[d];
+    }
+    if(!more) return;
+  }
+}
+
+//---------------------------------------------------------------------------//
+// Copy the points outside the update region lo[d]:hi[d] from SRC to DST
+//---------------------------------------------------------------------------//
+xtem(xtn TYPE, szt RANK)
+void xstencil_carry(const xview<const TYPE,RANK,ROWMAJOR>& src,
+                    const xview<TYPE,RANK,ROWMAJOR>& dst,
+                    const s64* ulo, const s64* uhi)
+{
+  for(szt d=0;d<RANK;++d) {
+    s64 lo[RANK], hi[RANK];
+    for(szt e=0;e<RANK;++e) { lo[e] = src.lbound(e); hi[e] = src.ubound(e); }
+    hi[d] = ulo[d]-1;
+    xsubview(dst,lo,hi) = xsubview(src,lo,hi);
+    lo[d] = uhi[d]+1; hi[d] = src.ubound(d);
+    xsubview(dst,lo,hi) = xsubview(src,lo,hi);
+  }
+}
+
+//---------------------------------------------------------------------------//
+// Advance the time levels U by NSTEPS time steps of the stencil ST,
+// updating the region given by BOUNDS : lo0,hi0[,lo1,hi1[,lo2,hi2]].
+// On return u.n() is the solution NSTEPS steps later.
+//---------------------------------------------------------------------------//
+xtem(xtn FIELD, szt RANK, xtn FUNC, xtn... BOUNDS)
+void xstencil_run(const xstencil<RANK,FUNC>& st, xtimelevels<FIELD,2>& u,
+                  s64 nsteps, BOUNDS... bounds)
+{
+  static_assert(sizeof...(BOUNDS) == 2*RANK,"Give lo,hi for each dimension");
+  PROFSCOPE("xstencil_run");
+  typedef xtn FIELD::value_type TYPE;
+  typedef xview<TYPE,RANK,ROWMAJOR> view;
+  typedef xview<const TYPE,RANK,ROWMAJOR> cview;
+  const s64 b[] = {s64(bounds)...};
+  s64 ulo[RANK], uhi[RANK], ntile[RANK];
+  for(szt d=0;d<RANK;++d) {
+    ulo[d] = b[2*d]; uhi[d] = b[2*d+1];
+    if(uhi[d] < ulo[d] || nsteps <= 0) return;
+    ntile[d] = (uhi[d]-ulo[d]+st.tile[d])/st.tile[d];
+  }
+
+  // Scratch buffers for one tile grown by the reach of tb time steps
+  const s64 tb = std::max<s64>(std::min(st.tsteps,nsteps),1);
+  xarraynd<TYPE,RANK,ROWMAJOR> sa, sb;
+  if(tb > 1) {
+    s64 one[RANK], ext[RANK];
+    for(szt d=0;d<RANK;++d) {
+      one[d] = 1;
+      ext[d] = std::min(st.tile[d],uhi[d]-ulo[d]+1) + (st.hi[d]-st.lo[d])*tb;
+    }
+    sa.allocate(one,ext); sb.allocate(one,ext);
+  }
+
+  for(s64 done=0;done<nsteps;) {
+    const s64 nb = std::min(tb,nsteps-done);
+    cview src = xfullview(u.n());
+    view dst = xfullview(u.np1());
+    for(szt d=0;d<RANK;++d) {
+      ASSERT(src.lbound(d) == dst.lbound(d) && src.size(d) == dst.size(d),
+             "Time levels of different shapes");
+      ASSERT(ulo[d]+st.lo[d] >= src.lbound(d) &&
+             uhi[d]+st.hi[d] <= src.ubound(d),
+             "Stencil reads outside the array along dimension "<<d);
+    }
+
+    // Points outside the update region keep their values
+    xstencil_carry<TYPE,RANK>(src,dst,ulo,uhi);
+
+    // Loop over the tiles [a,z]
+    s64 t[RANK];
+    for(szt d=0;d<RANK;++d) t[d] = 0;
+    for(;;) {
+      s64 a[RANK], z[RANK];
+      for(szt d=0;d<RANK;++d) {
+        a[d] = ulo[d] + t[d]*st.tile[d];
+        z[d] = std::min(a[d]+st.tile[d]-1,uhi[d]);
+      }
+      if(nb == 1) {
+        xstencil_sweep<TYPE,RANK>(st.f,src,dst,a,z);
+      } else {
+        // Tile grown by what nb steps of the stencil read, inside the array
+        s64 ga[RANK], gz[RANK], gn[RANK], gs[RANK];
+        for(szt d=0;d<RANK;++d) {
+          ga[d] = std::max(a[d]+st.lo[d]*nb,src.lbound(d));
+          gz[d] = std::min(z[d]+st.hi[d]*nb,src.ubound(d));
+          gn[d] = gz[d]-ga[d]+1; gs[d] = sa.stride(d);
+        }
+        TYPE* pa = sa.data();
+        TYPE* pb = sb.data();
+        view(pa,ga,gn,gs) = xsubview(src,ga,gz);
+        view(pb,ga,gn,gs) = view(pa,ga,gn,gs);
+        for(s64 s=1;s<=nb;++s) {
+          // Points still needed after step s, inside the update region
+          s64 ra[RANK], rz[RANK];
+          for(szt d=0;d<RANK;++d) {
+            ra[d] = std::max(a[d]+st.lo[d]*(nb-s),ulo[d]);
+            rz[d] = std::min(z[d]+st.hi[d]*(nb-s),uhi[d]);
+          }
+          xstencil_sweep<TYPE,RANK>(st.f,cview(view(pa,ga,gn,gs)),
+                                    view(pb,ga,gn,gs),ra,rz);
+          std::swap(pa,pb);
+        }
+        xsubview(dst,a,z) = xsubview(view(pa,ga,gn,gs),a,z);
+      }
+      // Next tile
+      bool more = false;
+      for(szt d=RANK;d-- > 0;) {
+        if(++t[d] < ntile[d]) { more = true; break; }
+        t[d] = 0;
+      }
+      if(!more) break;
+    }
+    u.advance(nb);
+    done += nb;
+  }
+}
+
+//---------------------------------------------------------------------------//
+// Has any point lo[d]:hi[d] of DST changed by more than TOL from SRC ?
+// NOTE : NaN counts as changed.
+//---------------------------------------------------------------------------//
+xtem(xtn TYPE, szt RANK)
+bool xstencil_changed(const xview<const TYPE,RANK,ROWMAJOR>& src,
+                      const xview<TYPE,RANK,ROWMAJOR>& dst,
+                      const s64* lo, const s64* hi, f64 tol)
+{
+  for(szt d=0;d<RANK;++d) if(hi[d] < lo[d]) return false;
+  s64 i[RANK];
+  for(szt d=0;d<RANK;++d) i[d] = lo[d];
+  const s64 n = hi[RANK-1]-lo[RANK-1]+1;
+  for(;;) {
+    s64 os = 0, od = 0;
+    for(szt d=0;d<RANK;++d) {
+      os += (i[d]-src.lbound(d))*src.stride(d);
+      od += (i[d]-dst.lbound(d))*dst.stride(d);
+    }
+    const TYPE* ps = src.data()+os;
+    const TYPE* pd = dst.data()+od;
+    // Whole line without branches, so that it is vectorized
+    bool c = false;
+    for(s64 k=0;k<n;++k) c |= !(ABS(pd[k]-ps[k]) <= tol);
+    if(c) return true;
+    bool more = false;
+    for(szt d=RANK-1;d-- > 0;) {
+      if(++i[d] <= hi[d]) { more = true; break; }
+      i[d] = lo[d];
+    }
+    if(!more) return false;
+  }
+}
+
+//---------------------------------------------------------------------------//
+// Active region of a stencil : the update region split into blocks, with
+// the blocks that changed in the last step. A block is updated in the next
+// step if a block it reads changed, within the reach of the stencil.
+//---------------------------------------------------------------------------//
+xtem(szt RANK)
+class xactivity
+{
+public:
+  // Blocks of BLOCK points along each dimension (0 for 256 in 1D, 32*32 in
+  // 2D and 16*16*16 in 3D). A block changed if one of its values changed
+  // by more than TOL.
+  explicit xactivity(s64 block=0, f64 tol=0.0)
+    : tol_(tol), nblocks_(0), fresh_(true), nactive_(0), done_(0), total_(0)
+  {
+    const s64 defblock[3] = {256,32,16};
+    for(szt d=0;d<RANK;++d) {
+      block_[d] = (block > 0) ? block : defblock[RANK-1];
+      ulo_[d] = 1; uhi_[d] = 0; back_[d] = fwd_[d] = nb_[d] = bs_[d] = 0;
+    }
+  }
+
+  // Take every block as changed, so that all are updated in the next step.
+  // NOTE : Needed after the solution is changed outside of xstencil_run.
+  void reset()
+  {
+    std::fill(changed_.begin(),changed_.end(),char(1));
+    fresh_ = true;
+  }
+
+  f64 tol() const { return tol_; }
+  s64 block(szt d) const { return block_[d]; }
+
+  // No. of blocks of the update region
+  s64 blocks() const { return nblocks_; }
+
+  // Did block b change in the last step ?
+  bool changed(s64 b) const { return changed_[b] != 0; }
+
+  // Blocks updated in the last step
+  s64 nactive() const { return nactive_; }
+
+  // Fraction of the block updates done of all the steps, 1 without skipping
+  f64 fraction() const { return total_ > 0 ? f64(done_)/f64(total_) : 1.0; }
+
+  // Set the update region ULO:UHI and the offsets SLO:SHI the stencil
+  // reads. Any change of them resets the blocks.
+  void bind(const s64* ulo, const s64* uhi, const s64* slo, const s64* shi)
+  {
+    bool same = nblocks_ > 0;
+    for(szt d=0;d<RANK;++d) {
+      const s64 back = (-slo[d]+block_[d]-1)/block_[d];
+      const s64 fwd = (shi[d]+block_[d]-1)/block_[d];
+      same = same && ulo_[d] == ulo[d] && uhi_[d] == uhi[d] &&
+             back_[d] == back && fwd_[d] == fwd;
+      ulo_[d] = ulo[d]; uhi_[d] = uhi[d]; back_[d] = back; fwd_[d] = fwd;
+    }
+    if(same) return;
+    nblocks_ = 1;
+    for(szt d=RANK;d-- > 0;) {
+      nb_[d] = (uhi_[d]-ulo_[d]+block_[d])/block_[d];
+      bs_[d] = nblocks_;
+      nblocks_ *= nb_[d];
+    }
+    changed_.assign(nblocks_,char(1));
+    reset();
+  }
+
+  // Blocks to update in this step : those within the reach of the stencil
+  // of a changed block, along every dimension. Every block is then taken as
+  // unchanged until set() is called for it.
+  const std::vector<s64>& activate()
+  {
+    active_ = changed_;
+    for(szt d=0;d<RANK;++d) {
+      if(back_[d] == 0 && fwd_[d] == 0) continue;
+      tmp_ = active_;
+      for(s64 b=0;b<nblocks_;++b) {
+        const s64 i = (b/bs_[d])%nb_[d];
+        const s64 j0 = std::max<s64>(i-back_[d],0);
+        const s64 j1 = std::min(i+fwd_[d],nb_[d]-1);
+        char a = 0;
+        for(s64 j=j0;j<=j1;++j) a |= tmp_[b+(j-i)*bs_[d]];
+        active_[b] = a;
+      }
+    }
+    list_.clear();
+    for(s64 b=0;b<nblocks_;++b) if(active_[b]) list_.push_back(b);
+    std::fill(changed_.begin(),changed_.end(),char(0));
+    nactive_ = s64(list_.size());
+    done_ += nactive_;
+    total_ += nblocks_;
+    return list_;
+  }
+
+  // Block b changed in this step
+  void set(s64 b) { changed_[b] = 1; }
+
+  // Points a[d]:z[d] of block b
+  void box(s64 b, s64* a, s64* z) const
+  {
+    for(szt d=0;d<RANK;++d) {
+      a[d] = ulo_[d] + ((b/bs_[d])%nb_[d])*block_[d];
+      z[d] = std::min(a[d]+block_[d]-1,uhi_[d]);
+    }
+  }
+
+  // Is this the first step since a reset ? Then the points outside the
+  // update region are copied to the new time level, once.
+  bool fresh() const { return fresh_; }
+  void settle() { fresh_ = false; }
+
+private:
+  f64 tol_;
+  s64 block_[RANK];             // Block size along each dimension
+  s64 ulo_[RANK], uhi_[RANK];   // Update region
+  s64 back_[RANK], fwd_[RANK];  // Reach of the stencil in blocks
+  s64 nb_[RANK], bs_[RANK];     // Blocks along, and stride of, dimension d
+  s64 nblocks_;
+  bool fresh_;
+  s64 nactive_, done_, total_;  // Blocks updated, last step and all steps
+  std::vector<char> changed_;   // Of every block, ROWMAJOR
+  std::vector<char> active_, tmp_;
+  std::vector<s64> list_;       // Blocks to update
+};
+
+//---------------------------------------------------------------------------//
+// Advance the time levels U by NSTEPS time steps of the stencil ST,
+// updating only the active blocks of the region BOUNDS, see xactivity.
+// Steps are taken one at a time, with the blocks on the threads.
+//---------------------------------------------------------------------------//
+xtem(xtn FIELD, szt RANK, xtn FUNC, xtn... BOUNDS)
+void xstencil_run(const xstencil<RANK,FUNC>& st, xtimelevels<FIELD,2>& u,
+                  s64 nsteps, xactivity<RANK>& act, BOUNDS... bounds)
+{
+  static_assert(sizeof...(BOUNDS) == 2*RANK,"Give lo,hi for each dimension");
+  PROFSCOPE("xstencil_run active");
+  typedef xtn FIELD::value_type TYPE;
+  typedef xview<TYPE,RANK,ROWMAJOR> view;
+  typedef xview<const TYPE,RANK,ROWMAJOR> cview;
+  const s64 b[] = {s64(bounds)...};
+  s64 ulo[RANK], uhi[RANK];
+  for(szt d=0;d<RANK;++d) {
+    ulo[d] = b[2*d]; uhi[d] = b[2*d+1];
+    if(uhi[d] < ulo[d] || nsteps <= 0) return;
+  }
+  act.bind(ulo,uhi,st.lo,st.hi);
+
+  xthreadpool& pool = xpool();
+  for(s64 s=0;s<nsteps;++s) {
+    cview src = xfullview(u.n());
+    view dst = xfullview(u.np1());
+    for(szt d=0;d<RANK;++d) {
+      ASSERT(src.lbound(d) == dst.lbound(d) && src.size(d) == dst.size(d),
+             "Time levels of different shapes");
+      ASSERT(ulo[d]+st.lo[d] >= src.lbound(d) &&
+             uhi[d]+st.hi[d] <= src.ubound(d),
+             "Stencil reads outside the array along dimension "<<d);
+    }
+    // Points outside the update region, and blocks that are not updated,
+    // are the same in both time levels after the first step
+    if(act.fresh()) {
+      xstencil_carry<TYPE,RANK>(src,dst,ulo,uhi);
+      act.settle();
+    }
+    const std::vector<s64>& list = act.activate();
+    if(!list.empty()) {
+      xparchunks ch(xsched(),s64(list.size()),pool.size());
+      pool.run([&](szt t) {
+        ch.each(t,[&](s64 k0, s64 k1) {
+          for(s64 k=k0;k<k1;++k) {
+            s64 a[RANK], z[RANK];
+            act.box(list[k],a,z);
+            xstencil_sweep<TYPE,RANK>(st.f,src,dst,a,z);
+            if(xstencil_changed<TYPE,RANK>(src,dst,a,z,act.tol()))
+              act.set(list[k]);
+          }
+        });
+      });
+    }
+    u.advance();
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Structured grids
+///////////////////////////////////////////////////////////////////////////////
+//---------------------------------------------------------------------------//
+// Cartesian grids of cells in 1D, 2D and 3D, with halo (ghost) layers of
+// cells around them, split into blocks that are updated by the threads.
+// + xgrid<RANK>     : the no. of cells, the cell centres, the halo width
+//                     and the boundary condition at every face
+// + xdecomp<RANK>   : the blocks, each a box of cells lo[d]:hi[d] with its
+//                     neighbours, and the arrays of a field, one per block
+//                     with its halo, a(lo0-g:hi0+g,lo1-g:hi1+g,...)
+// + xtransport      : how the blocks send each other their faces.
+//                     xlocaltransport is for blocks on the threads of one
+//                     process, a transport between processes (MPI etc.)
+//                     derives from xtransport
+// + xhaloexchange   : sends the faces of a block (begin), then receives its
+//                     halo and sets it at the boundaries of the grid (end)
+// + xgrid_step      : one update of all the blocks, with the exchange of
+//                     the halos behind the update of the block interiors
+//---------------------------------------------------------------------------//
+// Boundary conditions xbc, at side 0 (xlo) or 1 (xhi) of each dimension
+// + PERIODIC    : the halo is the cells at the other side of the grid,
+//                 PERIODIC at either side makes the dimension periodic
+// + DIRICHLET   : the halo is set to value
+// + EXTRAPOLATE : the halo continues the cells inside, of order 0 (the
+//                 value of the last cell, zero gradient) or 1 (linear)
+//---------------------------------------------------------------------------//
+// NOTE : The arrays have the global indices of the cells, so the update of
+// a block is the same loop as for the whole grid, over the box it is given.
+// NOTE : Only the faces are exchanged, not the edges and the corners of the
+// halo, so an update must read along one dimension at a time, like the 5
+// point stencils in 2D, 7 point in 3D, and dimension by dimension fluxes.
+//---------------------------------------------------------------------------//
+// USE : 2D inviscid Burgers, d(u)/dt + u*d(u)/dx + u*d(u)/dy = 0, FTBS in
+// both dimensions, on 4 blocks
+// >> xgrid<2> g({nx,ny},{0.0,0.0},{2.0,2.0},1);
+// >> g.bc(0,0) = g.bc(0,1) = xbc(PERIODIC);
+// >> g.bc(1,0) = xbc(DIRICHLET,1.0);
+// >> xdecomp<2> dc(g,4);
+// >> std::vector<a2f64> u = dc.fields(1.0), v = dc.fields(1.0);
+// >> xlocaltransport tr(dc.blocks());
+// >> xhaloexchange<2> hx(dc,tr);
+// >> DO(t,1,nt)
+// >>   xgrid_step(hx,u,t,1,[&](szt b, const xbox<2>& r) {
+// >>     a2f64& un = u[b]; a2f64& un1 = v[b];
+// >>     for(s64 i=r.lo[0];i<=r.hi[0];++i)
+// >>       for(s64 j=r.lo[1];j<=r.hi[1];++j)
+// >>         un1(i,j) = un(i,j) - un(i,j)*(dtdx*(un(i,j)-un(i-1,j)) +
+// >>                                       dtdy*(un(i,j)-un(i,j-1)));
+// >>   });
+// >>   std::swap(u,v);
+// >> ENDDO
+//---------------------------------------------------------------------------//
+//---------------------------------------------------------------------------//
+// Boundary condition at a face of the grid
+//---------------------------------------------------------------------------//
+enum xbctype{PERIODIC,DIRICHLET,EXTRAPOLATE};
+
+struct xbc
+{
+  xbctype type;
+  f64 value;     // Halo value of DIRICHLET
+  s32 order;     // Order of EXTRAPOLATE, 0 or 1
+
+  xbc(xbctype t = EXTRAPOLATE, f64 v = 0.0, s32 o = 0)
+    : type(t), value(v), order(o) {}
+};
+
+//---------------------------------------------------------------------------//
+// Box of the cells lo[d]:hi[d]
+//---------------------------------------------------------------------------//
+xtem(szt RANK)
+struct xbox
+{
+  s64 lo[RANK], hi[RANK];
+
+  bool empty() const
+  {
+    for(szt d=0;d<RANK;++d) if(hi[d] < lo[d]) return true;
+    return false;
+  }
+
+  // No. of cells
+  s64 size() const
+  {
+    s64 n = 1;
+    for(szt d=0;d<RANK;++d) n *= std::max<s64>(hi[d]-lo[d]+1,0);
+    return n;
+  }
+};
+
+//---------------------------------------------------------------------------//
+// Grid of the cells 1:n[d] along each dimension d, from xlo[d] to xhi[d],
+// with the halo cells 1-halo:0 and n[d]+1:n[d]+halo.
+// Every face is EXTRAPOLATE of order 0 until set with bc(d,s).
+//---------------------------------------------------------------------------//
+xtem(szt RANK)
+class xgrid
+{
+  static_assert(RANK >= 1 && RANK <= 3,"Grids of rank 1 to 3 are supported");
+public:
+  // Uniform grid, of cells dx[d] = (xhi[d]-xlo[d])/n[d]
+  xgrid(std::initializer_list<s64> n, std::initializer_list<f64> xlo,
+        std::initializer_list<f64> xhi, s64 halo = 1) : g_(halo)
+  {
+    ASSERT(n.size() == RANK && xlo.size() == RANK && xhi.size() == RANK,
+           "Give n, xlo and xhi for each dimension");
+    ASSERT(halo >= 0,"Negative halo width "<<halo);
+    for(szt d=0;d<RANK;++d) {
+      n_[d] = n.begin()[d];
+      lo_[d] = xlo.begin()[d]; hi_[d] = xhi.begin()[d];
+      ASSERT(n_[d] >= 1,"No cells along dimension "<<d);
+      dx_[d] = (hi_[d]-lo_[d])/f64(n_[d]);
+      x_[d].allocate(1-g_,n_[d]+g_);
+      for(s64 i=1-g_;i<=n_[d]+g_;++i) x_[d][i] = lo_[d] + (f64(i)-0.5)*dx_[d];
+    }
+  }
+
+  // No. of cells along dimension d, and the width of the halo
+  s64 n(szt d) const { return n_[d]; }
+  s64 halo() const { return g_; }
+
+  // Extent and the uniform cell size along dimension d
+  f64 xlo(szt d) const { return lo_[d]; }
+  f64 xhi(szt d) const { return hi_[d]; }
+  f64 dx(szt d) const { return dx_[d]; }
+
+  // Centre of the cell i along dimension d, i = 1-halo() to n(d)+halo()
+  f64 x(szt d, s64 i) const { return x_[d][i]; }
+
+  // All the centres along dimension d, to be changed for stretched grids
+  xarray<f64>& coord(szt d) { return x_[d]; }
+  const xarray<f64>& coord(szt d) const { return x_[d]; }
+
+  // Boundary condition at side s, 0 at xlo(d) and 1 at xhi(d)
+  xbc& bc(szt d, szt s) { return bc_[2*d+s]; }
+  const xbc& bc(szt d, szt s) const { return bc_[2*d+s]; }
+
+  bool periodic(szt d) const
+  {
+    return bc_[2*d].type == PERIODIC || bc_[2*d+1].type == PERIODIC;
+  }
+
+private:
+  s64 n_[RANK], g_;
+  f64 lo_[RANK], hi_[RANK], dx_[RANK];
+  xarray<f64> x_[RANK];
+  xbc bc_[2*RANK];
+};
+
+//---------------------------------------------------------------------------//
+// Block of a decomposed grid
+//---------------------------------------------------------------------------//
+xtem(szt RANK)
+struct xgridblock
+{
+  xbox<RANK> box;       // Cells of the block
+  s64 pos[RANK];        // Position among the blocks along each dimension
+  s64 nbr[RANK][2];     // Neighbours at sides 0 and 1, -1 at the boundary
+};
+
+//---------------------------------------------------------------------------//
+// Grid split into blocks of nearly equal no. of cells, numbered with the
+// last dimension fastest. Thread t of the pool updates the blocks of
+// owned(t,...), and first touches their arrays in fields().
+//---------------------------------------------------------------------------//
+xtem(szt RANK)
+class xdecomp
+{
+public:
+  // nblocks blocks, xnthreads() if 0, split along the dimensions so that
+  // the fewest cells are exchanged. If the grid cannot hold nblocks blocks
+  // of at least halo() cells, it is split into fewer, with a warning.
+  explicit xdecomp(const xgrid<RANK>& g, szt nblocks = 0) : g_(g)
+  {
+    if(nblocks == 0) nblocks = xnthreads();
+    s64 p[RANK], best[RANK];
+    for(szt d=0;d<RANK;++d) best[d] = 1;
+    f64 cost = -1.0;
+    s64 nb = static_cast<s64>(nblocks);
+    for(;nb>=1;--nb) {
+      split(0,nb,p,best,cost);
+      if(cost >= 0.0) break;
+    }
+    if(cost < 0.0) {
+      STREAM<<"ERROR :: GRID OF FEWER CELLS THAN THE HALO OF "<<g.halo()
+            <<NL;
+      std::abort();
+    }
+    if(nb < s64(nblocks))
+      STREAM<<"WARNING :: GRID SPLIT INTO "<<nb<<" BLOCKS INSTEAD OF "
+            <<nblocks<<", AS BLOCKS NEED "<<g.halo()<<" CELLS"<<NL;
+    build(best);
+  }
+
+  // p[d] blocks along dimension d
+  xdecomp(const xgrid<RANK>& g, std::initializer_list<s64> p) : g_(g)
+  {
+    ASSERT(p.size() == RANK,"Give the no. of blocks of each dimension");
+    s64 q[RANK];
+    for(szt d=0;d<RANK;++d) q[d] = p.begin()[d];
+    ASSERT(fits(q),"Blocks of fewer cells than the halo");
+    build(q);
+  }
+
+  const xgrid<RANK>& grid() const { return g_; }
+
+  // No. of blocks, in all and along dimension d
+  szt blocks() const { return static_cast<szt>(b_.size()); }
+  s64 blocks(szt d) const { return p_[d]; }
+
+  const xgridblock<RANK>& block(szt b) const { return b_[b]; }
+
+  // Blocks b0 to b1-1, updated by thread t of nt
+  void owned(szt t, szt nt, szt& b0, szt& b1) const
+  {
+    b0 = static_cast<szt>(u64(blocks())*t/nt);
+    b1 = static_cast<szt>(u64(blocks())*(t+1)/nt);
+  }
+
+  // Allocate a as the array of block b with its halo
+  xtem(xtn TYPE) void allocate(szt b, xarraynd<TYPE,RANK>& a) const
+  {
+    s64 lo[RANK], hi[RANK];
+    for(szt d=0;d<RANK;++d) {
+      lo[d] = b_[b].box.lo[d]-g_.halo();
+      hi[d] = b_[b].box.hi[d]+g_.halo();
+    }
+    a.allocate(lo,hi);
+  }
+
+  // Arrays of all the blocks set to value, each by the thread that updates
+  // the block, so that its pages are on the NUMA node of the thread
+  xtem(xtn TYPE)
+  std::vector<xarraynd<TYPE,RANK> > fields(const TYPE& value) const
+  {
+    std::vector<xarraynd<TYPE,RANK> > a(blocks());
+    xthreadpool& pool = xpool();
+    pool.run([&](szt t) {
+      szt b0, b1;
+      owned(t,pool.size(),b0,b1);
+      for(szt b=b0;b<b1;++b) { allocate(b,a[b]); a[b].fill(value); }
+    });
+    return a;
+  }
+
+  // Cells of block b whose neighbours up to reach cells away along each
+  // dimension are in the block, which are updated without the halo
+  xbox<RANK> interior(szt b, s64 reach) const
+  {
+    xbox<RANK> r = b_[b].box;
+    for(szt d=0;d<RANK;++d) { r.lo[d] += reach; r.hi[d] -= reach; }
+    return r;
+  }
+
+  // The other cells of block b, in up to 2*RANK strips along the faces
+  void strips(szt b, s64 reach, std::vector<xbox<RANK> >& s) const
+  {
+    s.clear();
+    xbox<RANK> r = b_[b].box;
+    for(szt d=0;d<RANK && !r.empty();++d) {
+      xbox<RANK> a = r, z = r;
+      a.hi[d] = std::min(r.lo[d]+reach-1,r.hi[d]);
+      z.lo[d] = std::max(r.hi[d]-reach+1,a.hi[d]+1);
+      if(!a.empty()) s.push_back(a);
+      if(!z.empty()) s.push_back(z);
+      r.lo[d] += reach; r.hi[d] -= reach;
+    }
+  }
+
+private:
+  // If every block has at least halo cells, so that its faces are inside
+  bool fits(const s64* p) const
+  {
+    for(szt d=0;d<RANK;++d)
+      if(p[d] < 1 || g_.n(d) < p[d]*std::max<s64>(g_.halo(),1)) return false;
+    return true;
+  }
+
+  // Try every split p with the product left along dimensions d and up,
+  // keeping the one with the smallest faces between the blocks
+  void split(szt d, s64 left, s64* p, s64* best, f64& cost) const
+  {
+    if(d == RANK-1) {
+      p[d] = left;
+      if(!fits(p)) return;
+      f64 c = 0.0;
+      for(szt e=0;e<RANK;++e) {
+        f64 face = 1.0;
+        for(szt f=0;f<RANK;++f) if(f != e) face *= f64(g_.n(f));
+        c += f64(p[e]-1)*face;
+      }
+      if(cost < 0.0 || c < cost) {
+        cost = c;
+        for(szt e=0;e<RANK;++e) best[e] = p[e];
+      }
+      return;
+    }
+    // Splits along the first dimensions first, as their faces are rows
+    for(s64 k=left;k>=1;--k)
+      if(left % k == 0) { p[d] = k; split(d+1,left/k,p,best,cost); }
+  }
+
+  // Blocks of the split p
+  void build(const s64* p)
+  {
+    s64 nb = 1;
+    for(szt d=0;d<RANK;++d) { p_[d] = p[d]; nb *= p[d]; }
+    b_.resize(nb);
+    for(s64 b=0;b<nb;++b) {
+      xgridblock<RANK>& k = b_[b];
+      for(s64 d=RANK-1,r=b;d>=0;--d) { k.pos[d] = r % p[d]; r /= p[d]; }
+      for(szt d=0;d<RANK;++d) {
+        k.box.lo[d] = 1 + g_.n(d)*k.pos[d]/p[d];
+        k.box.hi[d] = g_.n(d)*(k.pos[d]+1)/p[d];
+        for(s64 s=0;s<2;++s) {
+          s64 q = k.pos[d] + (s ? 1 : -1);
+          if((q < 0 || q >= p[d]) && !g_.periodic(d)) {
+            k.nbr[d][s] = -1;
+            continue;
+          }
+          q = (q+p[d]) % p[d];
+          s64 id = 0;
+          for(szt e=0;e<RANK;++e) id = id*p[e] + (e == d ? q : k.pos[e]);
+          k.nbr[d][s] = id;
+        }
+      }
+    }
+  }
+
+  xgrid<RANK> g_;
+  s64 p_[RANK];
+  std::vector<xgridblock<RANK> > b_;
+};
+
+//---------------------------------------------------------------------------//
+// Messages between the blocks. send returns when p can be reused, and recv
+// waits for the message from src to dst with the tag and copies it to p.
+// NOTE : The blocks of another process, e.g. an MPI rank, are reached by
+// deriving a transport that maps the blocks to the processes.
+//---------------------------------------------------------------------------//
+class xtransport
+{
+public:
+  virtual ~xtransport() {}
+  virtual void send(szt src, szt dst, s64 tag, const void* p, u64 bytes) = 0;
+  virtual void recv(szt src, szt dst, s64 tag, void* p, u64 bytes) = 0;
+};
+
+//---------------------------------------------------------------------------//
+// Transport between the blocks on the threads of one process. A message is
+// copied into the mailbox of the receiving block, whose buffers are reused.
+//---------------------------------------------------------------------------//
+class xlocaltransport : public xtransport
+{
+public:
+  explicit xlocaltransport(szt nblocks) : box_(nblocks) {}
+
+  xlocaltransport(const xlocaltransport&) = delete;
+  xlocaltransport& operator=(const xlocaltransport&) = delete;
+
+  void send(szt src, szt dst, s64 tag, const void* p, u64 bytes)
+  {
+    ASSERT(dst < box_.size(),"No block "<<dst);
+    mailbox& m = box_[dst];
+    message a;
+    a.src = src; a.tag = tag;
+    {
+      std::lock_guard<std::mutex> lk(m.m);
+      if(!m.spare.empty()) { a.buf.swap(m.spare.back()); m.spare.pop_back(); }
+    }
+    const char* c = static_cast<const char*>(p);
+    a.buf.assign(c,c+bytes);
+    {
+      std::lock_guard<std::mutex> lk(m.m);
+      m.msgs.push_back(std::move(a));
+    }
+    m.cv.notify_all();
+  }
+
+  void recv(szt src, szt dst, s64 tag, void* p, u64 bytes)
+  {
+    ASSERT(dst < box_.size(),"No block "<<dst);
+    mailbox& m = box_[dst];
+    std::vector<char> buf;
+    {
+      std::unique_lock<std::mutex> lk(m.m);
+      for(;;) {
+        auto it = std::find_if(m.msgs.begin(),m.msgs.end(),
+                               [&](const message& a) {
+                                 return a.src == src && a.tag == tag; });
+        if(it != m.msgs.end()) {
+          buf.swap(it->buf);
+          m.msgs.erase(it);
+          break;
+        }
+        m.cv.wait(lk);
+      }
+    }
+    ASSERT(buf.size() == bytes,"Message of "<<buf.size()
+           <<" bytes, "<<bytes<<" expected");
+    if(bytes) std::memcpy(p,buf.data(),bytes);
+    std::lock_guard<std::mutex> lk(m.m);
+    m.spare.push_back(std::move(buf));
+  }
+
+private:
+  struct message
+  {
+    szt src;
+    s64 tag;
+    std::vector<char> buf;
+  };
+  struct mailbox
+  {
+    std::mutex m;
+    std::condition_variable cv;
+    std::vector<message> msgs;
+    std::vector<std::vector<char> > spare;
+  };
+  std::vector<mailbox> box_;
+};
+
+//---------------------------------------------------------------------------//
+// Exchange of the halos of the blocks of a decomposed grid
+// NOTE : Every field exchanged in a step needs its own tag.
+//---------------------------------------------------------------------------//
+xtem(szt RANK)
+class xhaloexchange
+{
+public:
+  xhaloexchange(const xdecomp<RANK>& dc, xtransport& tr) : dc_(dc), tr_(tr) {}
+
+  const xdecomp<RANK>& decomp() const { return dc_; }
+
+  // Send the halo() layers of cells of block b inside each of its faces
+  // to the neighbour at that face
+  xtem(xtn TYPE) void begin(szt b, const xarraynd<TYPE,RANK>& a, s64 tag)
+  {
+    const xgridblock<RANK>& k = dc_.block(b);
+    for(szt d=0;d<RANK;++d) {
+      for(szt s=0;s<2;++s) {
+        if(k.nbr[d][s] < 0) continue;
+        xbox<RANK> f = face(k,d,s,false);
+        xscratchscope ws;
+        TYPE* p = ws.alloc<TYPE>(f.size());
+        buffer(p,f) = xsubview(a.view(),f.lo,f.hi);
+        tr_.send(b,static_cast<szt>(k.nbr[d][s]),key(tag,d,1-s),p,
+                 u64(f.size())*SOF(TYPE));
+      }
+    }
+  }
+
+  // Receive the halo of block b from its neighbours, and set it at the
+  // boundaries of the grid from the boundary conditions
+  xtem(xtn TYPE) void end(szt b, xarraynd<TYPE,RANK>& a, s64 tag)
+  {
+    const xgridblock<RANK>& k = dc_.block(b);
+    for(szt d=0;d<RANK;++d) {
+      for(szt s=0;s<2;++s) {
+        if(k.nbr[d][s] < 0) { boundary(a,k,d,s); continue; }
+        xbox<RANK> f = face(k,d,s,true);
+        xscratchscope ws;
+        TYPE* p = ws.alloc<TYPE>(f.size());
+        tr_.recv(static_cast<szt>(k.nbr[d][s]),b,key(tag,d,s),p,
+                 u64(f.size())*SOF(TYPE));
+        xsubview(a.view(),f.lo,f.hi) = buffer(p,f);
+      }
+    }
+  }
+
+private:
+  // Tag of the message to the face d,s of the receiving block
+  static s64 key(s64 tag, szt d, szt s) { return tag*s64(2*RANK) + 2*d+s; }
+
+  // Halo layers of block k at face d,s, outside the block if ghost, else
+  // inside. The edges and corners of the halo are not included.
+  xbox<RANK> face(const xgridblock<RANK>& k, szt d, szt s, bool ghost) const
+  {
+    const s64 g = dc_.grid().halo();
+    xbox<RANK> f = k.box;
+    if(s == 0) {
+      f.lo[d] = ghost ? k.box.lo[d]-g : k.box.lo[d];
+      f.hi[d] = f.lo[d]+g-1;
+    } else {
+      f.hi[d] = ghost ? k.box.hi[d]+g : k.box.hi[d];
+      f.lo[d] = f.hi[d]-g+1;
+    }
+    return f;
+  }
+
+  // Contiguous buffer p holding the box f
+  xtem(xtn TYPE)
+  static xview<TYPE,RANK,ROWMAJOR> buffer(TYPE* p, const xbox<RANK>& f)
+  {
+    s64 n[RANK], st[RANK], m = 1;
+    for(szt d=RANK;d-- > 0;) {
+      n[d] = f.hi[d]-f.lo[d]+1; st[d] = m; m *= n[d];
+    }
+    return xview<TYPE,RANK,ROWMAJOR>(p,f.lo,n,st);
+  }
+
+  // Set the halo of block k at face d,s on the boundary of the grid
+  xtem(xtn TYPE)
+  void boundary(xarraynd<TYPE,RANK>& a, const xgridblock<RANK>& k,
+                szt d, szt s) const
+  {
+    const xbc& c = dc_.grid().bc(d,s);
+    const s64 g = dc_.grid().halo();
+    // Last layer of cells, and the distance to the next cell out of it
+    xbox<RANK> r = k.box;
+    r.lo[d] = r.hi[d] = s ? k.box.hi[d] : k.box.lo[d];
+    const s64 sd = s ? a.stride(d) : -a.stride(d);
+    TYPE* p = a.data();
+    s64 i[RANK];
+    for(szt e=0;e<RANK;++e) i[e] = r.lo[e];
+    for(;;) {
+      s64 o = 0;
+      for(szt e=0;e<RANK;++e) o += (i[e]-a.lbound(e))*a.stride(e);
+      for(s64 m=1;m<=g;++m) {
+        TYPE& v = p[o+m*sd];
+        if(c.type == DIRICHLET) v = TYPE(c.value);
+        else if(c.order == 0) v = p[o];
+        else v = p[o] + TYPE(m)*(p[o]-p[o-sd]);
+      }
+      bool more = false;
+      for(szt e=RANK;e-- > 0;) {
+        if(++i[e] <= r.hi[e]) { more = true; break; }
+        i[e] = r.lo[e];
+      }
+      if(!more) return;
+    }
+  }
+
+  const xdecomp<RANK>& dc_;
+  xtransport& tr_;
+};
+
+//---------------------------------------------------------------------------//
+// One update of all the blocks of u by the threads of xpool(), where
+// f(b,r) updates the cells in the box r of block b, reading u[b] at most
+// reach cells away. The halos of u are exchanged with the tag, behind the
+// update of the interiors. Every thread, for its blocks,
+//   1. sends their faces
+//   2. calls f(b,interior), for the cells that do not read the halo
+//   3. receives their halos, setting them at the boundaries of the grid
+//   4. calls f(b,strip) for each strip of cells along the faces
+// NOTE : f must write another field than u, e.g. the next time level.
+//---------------------------------------------------------------------------//
+xtem(szt RANK, xtn TYPE, xtn FUNC)
+void xgrid_step(xhaloexchange<RANK>& hx, std::vector<xarraynd<TYPE,RANK> >& u,
+                s64 tag, s64 reach, const FUNC& f)
+{
+  PROFSCOPE("xgrid_step");
+  const xdecomp<RANK>& dc = hx.decomp();
+  ASSERT(u.size() == dc.blocks(),"Field of "<<u.size()<<" blocks, "
+         <<dc.blocks()<<" expected");
+  ASSERT(reach <= dc.grid().halo(),"Reach "<<reach<<" beyond the halo");
+  auto step = [&](szt b0, szt b1) {
+    std::vector<xbox<RANK> > s;
+    for(szt b=b0;b<b1;++b) hx.begin(b,u[b],tag);
+    for(szt b=b0;b<b1;++b) {
+      xbox<RANK> r = dc.interior(b,reach);
+      if(!r.empty()) f(b,r);
+    }
+    for(szt b=b0;b<b1;++b) {
+      hx.end(b,u[b],tag);
+      dc.strips(b,reach,s);
+      for(const xbox<RANK>& r : s) f(b,r);
+    }
+  };
+  // Inside a parallel loop the pool would call the threads in turn, and the
+  // first would wait for the faces of the others, so one caller does it all
+  xthreadpool& pool = xpool();
+  if(pool.size() == 1 || xparallel_depth() > 0) {
+    step(0,dc.blocks());
+    return;
+  }
+  pool.run([&](szt t) {
+    szt b0, b1;
+    dc.owned(t,pool.size(),b0,b1);
+    step(b0,b1);
+  });
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Adaptive mesh refinement
+///////////////////////////////////////////////////////////////////////////////
+//---------------------------------------------------------------------------//
+// Block structured AMR of a conserved quantity u on an xgrid, solving
+//
+//             d(u)/dt + d(f0(u))/dx0 + d(f1(u))/dx1 + ... = 0
+//
+// with finite volumes, where the user gives the numerical flux at a face.
+// + Levels      : level 0 is the grid, level l+1 refines blocks of level l
+//                 by 2 along every dimension. Every level is split into
+//                 blocks of opt.block cells along each dimension, and each
+//                 block that is present is a patch, with its own contiguous
+//                 array and a halo of 1 cell.
+// + Tagging     : a block is refined if u jumps by more than opt.tagtol
+//                 between 2 of its cells, or to a cell of its halo, and so
+//                 are the opt.buffer blocks around it, so that a shock stays
+//                 in the refined blocks until the next regrid.
+// + Regridding  : every opt.regrid steps of level 0 the levels are tagged
+//                 and rebuilt, from level 0 up. A block is only refined if
+//                 its neighbours are on its level, so the halo of a fine
+//                 patch is always inside the level below.
+// + Prolongation: new fine cells take the coarse value with a minmod
+//                 limited slope, which keeps the coarse mean.
+// + Restriction : after every step of a fine level, the coarse cells it
+//                 covers are set to the mean of their fine cells.
+// + Subcycling  : level l+1 takes 2 steps of dt/2 for each step of level l,
+//                 with its halo from level l interpolated in time.
+// + Flux fixing : the coarse flux at a coarse-fine face is replaced by the
+//                 sum of the fine fluxes of the 2 fine steps, so the sum of
+//                 u over level 0 changes only by the flux through the
+//                 boundaries of the grid.
+// The patches of a level are updated in parallel by the threads of xpool().
+//---------------------------------------------------------------------------//
+// NOTE : flux(d,ul,ur) is the flux along dimension d at the face between
+// the cells of values ul (below) and ur (above). Only the faces are
+// exchanged, as in "Structured grids", and the boundary conditions are
+// those of the grid. The scheme is first order in space and time.
+// NOTE : The no. of cells of the grid along each dimension must be a
+// multiple of opt.block, which must be even.
+//---------------------------------------------------------------------------//
+// USE : 1D Burgers, d(u)/dt + d(u*u/2)/dx = 0, for the hat of the FTBS
+// test, on 200 cells refined twice, as fine as 800 cells at the shock
+// >> xgrid<1> g({200},{0.0},{2.0});
+// >> g.bc(0,0) = xbc(DIRICHLET,1.0);
+// >> xamropts opt;
+// >> opt.maxlevel = 2; opt.tagtol = 0.05;
+// >> xamr<1> amr(g,opt);
+// >> amr.init([](const f64* x) { return (x[0] > 0.075 && x[0] < 0.75) ?
+// >>                                    2.0 : 1.0; });
+// >> // Upwind flux, for u > 0
+// >> auto flux = [](szt, f64 ul, f64) { return 0.5*ul*ul; };
+// >> DO(t,1,nt)
+// >>   amr.step(dt,flux);               // dt of level 0
+// >> ENDDO
+// >> xarraynd<f64,1> u = amr.sample(2); // u on the 800 cells of level 2
+// >> cout<<amr.cells()<<endl;           // Cells of all the levels
+//---------------------------------------------------------------------------//
+//---------------------------------------------------------------------------//
+// How the levels are refined
+//---------------------------------------------------------------------------//
+struct xamropts
+{
+  s64 block;     // Cells of a block along each dimension, even
+  s64 maxlevel;  // Finest level, 0 for the grid alone
+  f64 tagtol;    // Jump of u between neighbour cells that is refined
+  s64 buffer;    // Blocks refined around every tagged block
+  s64 regrid;    // Steps of level 0 between regrids, 0 for none
+
+  xamropts() : block(16), maxlevel(2), tagtol(0.1), buffer(1), regrid(4) {}
+};
+
+//---------------------------------------------------------------------------//
+// Patch of a level : one block of cells with its arrays
+//---------------------------------------------------------------------------//
+xtem(szt RANK)
+struct xamrpatch
+{
+  xbox<RANK> box;                 // Cells of the patch on its level
+  xarraynd<f64,RANK> u;           // u, with a halo of 1 cell
+  xarraynd<f64,RANK> uold;        // u at the start of the step
+  xarraynd<f64,RANK> flux[RANK];  // Fluxes of the step, faces lo:hi+1
+                                  // along d, face i below cell i
+  xarraynd<f64,RANK> freg[RANK];  // dt*flux summed over the steps, at the
+                                  // faces lo (1) and hi+1 (2) along d
+};
+
+//---------------------------------------------------------------------------//
+// Hierarchy of levels of patches over the grid g
+//---------------------------------------------------------------------------//
+xtem(szt RANK)
+class xamr
+{
+  static_assert(RANK >= 1 && RANK <= 3,"AMR of rank 1 to 3 is supported");
+  typedef xarraynd<f64,RANK> field;
+  typedef xamrpatch<RANK> patch_type;
+
+  struct level
+  {
+    std::vector<patch_type> p;
+    std::vector<s64> map;       // Patch of every block, -1 if not present
+    s64 n[RANK];                // Cells along each dimension
+    s64 nb[RANK], bs[RANK];     // Blocks along, and stride of, dimension d
+    f64 dx[RANK];
+    f64 t, told, dt;            // Time, and of the start and size of the
+                                // last step
+  };
+
+public:
+  xamr(const xgrid<RANK>& g, const xamropts& opt = xamropts())
+    : g_(g), opt_(opt), time_(0.0), steps_(0)
+  {
+    ASSERT(opt_.block >= 2 && opt_.block % 2 == 0,
+           "AMR blocks of "<<opt_.block<<" cells, must be even");
+    ASSERT(opt_.maxlevel >= 0,"Negative finest level");
+    for(szt d=0;d<RANK;++d)
+      ASSERT(g_.n(d) % opt_.block == 0,"Cells along dimension "<<d
+             <<" not a multiple of the block, "<<opt_.block);
+  }
+
+  // Set u(x) at the cell centres x[d], refining where it jumps, and take
+  // the coarse cells as the means of the fine ones
+  xtem(xtn FUNC) void init(const FUNC& u0)
+  {
+    lv_.clear();
+    lv_.reserve(opt_.maxlevel+1);
+    time_ = 0.0; steps_ = 0;
+    level c;
+    newlevel(0,c);
+    c.p.reserve(c.map.size());
+    for(s64 b=0;b<s64(c.map.size());++b) addpatch(c,b);
+    lv_.push_back(std::move(c));
+    set(0,u0);
+    std::vector<char> flag;
+    for(szt l=0;l<static_cast<szt>(opt_.maxlevel);++l) {
+      if(!tag(l,flag)) break;
+      refine(l,flag,0);
+      set(l+1,u0);
+    }
+    for(szt l=lv_.size()-1;l-- > 0;) average(l);
+  }
+
+  // One step dt of level 0, and 2^l steps of dt/2^l of every level l,
+  // regridding first every opt.regrid steps
+  xtem(xtn FLUX) void step(f64 dt, const FLUX& flux)
+  {
+    PROFSCOPE("xamr::step");
+    ASSERT(!lv_.empty(),"AMR used before init");
+    if(steps_ > 0 && opt_.regrid > 0 && steps_ % opt_.regrid == 0) regrid();
+    advance(0,dt,flux);
+    time_ += dt;
+    ++steps_;
+  }
+
+  // Tag every level and rebuild the finer levels from level 0 up, keeping
+  // the fine cells of the blocks that stay refined
+  void regrid()
+  {
+    PROFSCOPE("xamr::regrid");
+    std::vector<level> old;
+    old.swap(lv_);
+    lv_.reserve(opt_.maxlevel+1);
+    lv_.push_back(std::move(old[0]));
+    std::vector<char> flag;
+    for(szt l=0;l<static_cast<szt>(opt_.maxlevel);++l) {
+      if(!tag(l,flag)) break;
+      refine(l,flag,(l+1 < old.size()) ? &old[l+1] : 0);
+    }
+  }
+
+  const xgrid<RANK>& grid() const { return g_; }
+  const xamropts& opts() const { return opt_; }
+
+  // Time, and the no. of steps of level 0
+  f64 time() const { return time_; }
+  s64 steps() const { return steps_; }
+
+  // No. of levels present, and the patches of level l
+  szt levels() const { return lv_.size(); }
+  s64 patches(szt l) const { return s64(lv_[l].p.size()); }
+  const patch_type& patch(szt l, s64 k) const { return lv_[l].p[k]; }
+
+  // Cell size of level l along dimension d
+  f64 dx(szt l, szt d) const { return lv_[l].dx[d]; }
+
+  // Cells of level l, and of all the levels
+  s64 cells(szt l) const
+  {
+    s64 n = patches(l);
+    for(szt d=0;d<RANK;++d) n *= opt_.block;
+    return n;
+  }
+  s64 cells() const
+  {
+    s64 n = 0;
+    for(szt l=0;l<levels();++l) n += cells(l);
+    return n;
+  }
+
+  // Integral of u, from level 0, which holds the means of the finer levels
+  f64 total() const
+  {
+    const level& c = lv_[0];
+    f64 v = 1.0, s = 0.0;
+    for(szt d=0;d<RANK;++d) v *= c.dx[d];
+    for(const patch_type& p : c.p)
+      each(p.box,[&](const s64* i) { s += at(p.u,i); });
+    return s*v;
+  }
+
+  // u on the cells 1:n(d)*2^l of level l, from the finest level present at
+  // every cell, constant over the coarser cells
+  field sample(szt l) const
+  {
+    s64 lo[RANK], hi[RANK];
+    xbox<RANK> r;
+    for(szt d=0;d<RANK;++d) {
+      lo[d] = r.lo[d] = 1;
+      hi[d] = r.hi[d] = g_.n(d) << l;
+    }
+    field a;
+    a.allocate(lo,hi);
+    each(r,[&](const s64* i) {
+      for(szt k=std::min(l,levels()-1);;--k) {
+        s64 c[RANK];
+        for(szt d=0;d<RANK;++d) c[d] = ((i[d]-1) >> (l-k)) + 1;
+        const s64 q = find(lv_[k],c);
+        if(q >= 0) { at(a,i) = at(lv_[k].p[q].u,c); return; }
+      }
+    });
+    return a;
+  }
+
+private:
+  //---------------------------------------------------------------------//
+  // Cells of the arrays
+  //---------------------------------------------------------------------//
+  static s64 off(const field& a, const s64* i)
+  {
+    s64 o = 0;
+    for(szt d=0;d<RANK;++d) o += (i[d]-a.lbound(d))*a.stride(d);
+    return o;
+  }
+  static f64& at(field& a, const s64* i) { return a.data()[off(a,i)]; }
+  static f64 at(const field& a, const s64* i) { return a.data()[off(a,i)]; }
+
+  // Call f(i) for every cell i of the box b
+  xtem(xtn FUNC) static void each(const xbox<RANK>& b, const FUNC& f)
+  {
+    if(b.empty()) return;
+    s64 i[RANK];
+    for(szt d=0;d<RANK;++d) i[d] = b.lo[d];
+    for(;;) {
+      f(static_cast<const s64*>(i));
+      bool more = false;
+      for(szt d=RANK;d-- > 0;) {
+        if(++i[d] <= b.hi[d]) { more = true; break; }
+        i[d] = b.lo[d];
+      }
+      if(!more) return;
+    }
+  }
+
+  // Call f(i,n) for the first cell i of every line of the box b along the
+  // last dimension, of n cells
+  xtem(xtn FUNC) static void lines(const xbox<RANK>& b, const FUNC& f)
+  {
+    xbox<RANK> r = b;
+    r.hi[RANK-1] = r.lo[RANK-1];
+    const s64 n = b.hi[RANK-1]-b.lo[RANK-1]+1;
+    each(r,[&](const s64* i) { f(i,n); });
+  }
+
+  // Call f(p) for every patch of level l, on the threads
+  xtem(xtn FUNC) void run(szt l, const FUNC& f)
+  {
+    std::vector<patch_type>& p = lv_[l].p;
+    xthreadpool& pool = xpool();
+    xparchunks ch(xsched(),s64(p.size()),pool.size());
+    pool.run([&](szt t) {
+      ch.each(t,[&](s64 a, s64 b) {
+        for(s64 k=a;k<b;++k) f(p[k]);
+      });
+    });
+  }
+
+  //---------------------------------------------------------------------//
+  // Levels and blocks
+  //---------------------------------------------------------------------//
+  void newlevel(szt l, level& c) const
+  {
+    s64 nb = 1;
+    for(szt d=RANK;d-- > 0;) {
+      c.n[d] = g_.n(d) << l;
+      c.nb[d] = c.n[d]/opt_.block;
+      c.dx[d] = g_.dx(d)/f64(s64(1) << l);
+      c.bs[d] = nb;
+      nb *= c.nb[d];
+    }
+    c.map.assign(nb,-1);
+    c.p.clear();
+    c.t = c.told = time_;
+    c.dt = 0.0;
+  }
+
+  // Add the block b to the level c as a new patch
+  void addpatch(level& c, s64 b) const
+  {
+    patch_type p;
+    s64 lo[RANK], hi[RANK];
+    for(szt d=0;d<RANK;++d) {
+      p.box.lo[d] = ((b/c.bs[d]) % c.nb[d])*opt_.block + 1;
+      p.box.hi[d] = p.box.lo[d] + opt_.block - 1;
+      lo[d] = p.box.lo[d]-1; hi[d] = p.box.hi[d]+1;
+    }
+    p.u.allocate(lo,hi); p.u.fill(0.0);
+    p.uold.allocate(lo,hi); p.uold.fill(0.0);
+    for(szt d=0;d<RANK;++d) {
+      for(szt e=0;e<RANK;++e) { lo[e] = p.box.lo[e]; hi[e] = p.box.hi[e]; }
+      ++hi[d];
+      p.flux[d].allocate(lo,hi); p.flux[d].fill(0.0);
+      lo[d] = 1; hi[d] = 2;
+      p.freg[d].allocate(lo,hi); p.freg[d].fill(0.0);
+    }
+    c.map[b] = s64(c.p.size());
+    c.p.push_back(std::move(p));
+  }
+
+  // Block of the first cell of patch p
+  s64 blockof(const level& c, const patch_type& p) const
+  {
+    s64 b = 0;
+    for(szt d=0;d<RANK;++d) b += ((p.box.lo[d]-1)/opt_.block)*c.bs[d];
+    return b;
+  }
+
+  // Patch holding the cell i, inside the level, -1 if not present
+  s64 find(const level& c, const s64* i) const
+  {
+    s64 b = 0;
+    for(szt d=0;d<RANK;++d) b += ((i[d]-1)/opt_.block)*c.bs[d];
+    return c.map[b];
+  }
+
+  // Bring the cell i into the level across the periodic dimensions.
+  // False if it is outside the grid.
+  bool wrap(const level& c, s64* i) const
+  {
+    for(szt d=0;d<RANK;++d) {
+      if(i[d] >= 1 && i[d] <= c.n[d]) continue;
+      if(!g_.periodic(d)) return false;
+      i[d] = ((i[d]-1) % c.n[d] + c.n[d]) % c.n[d] + 1;
+    }
+    return true;
+  }
+
+  // Set u(x) on level l
+  xtem(xtn FUNC) void set(szt l, const FUNC& u0)
+  {
+    const level& c = lv_[l];
+    run(l,[&](patch_type& p) {
+      each(p.box,[&](const s64* i) {
+        f64 x[RANK];
+        for(szt d=0;d<RANK;++d) x[d] = g_.xlo(d) + (f64(i[d])-0.5)*c.dx[d];
+        at(p.u,i) = u0(static_cast<const f64*>(x));
+      });
+    });
+  }
+
+  //---------------------------------------------------------------------//
+  // Halos : from the patches of the level, else from the level below at
+  // the fraction a of its last step, else from the boundary conditions
+  //---------------------------------------------------------------------//
+  void fillhalo(szt l, f64 a)
+  {
+    run(l,[&](patch_type& p) { fillhalo(l,p,a); });
+  }
+
+  void fillhalo(szt l, patch_type& p, f64 a) const
+  {
+    const level& c = lv_[l];
+    for(szt d=0;d<RANK;++d)
+      for(szt s=0;s<2;++s) {
+        xbox<RANK> f = p.box;
+        f.lo[d] = f.hi[d] = s ? p.box.hi[d] : p.box.lo[d];
+        const s64 sd = s ? p.u.stride(d) : -p.u.stride(d);
+        each(f,[&](const s64* j) {
+          f64* pj = p.u.data()+off(p.u,j);
+          s64 h[RANK];
+          for(szt e=0;e<RANK;++e) h[e] = j[e];
+          h[d] += s ? 1 : -1;
+          if(!wrap(c,h)) {
+            const xbc& bc = g_.bc(d,s);
+            if(bc.type == DIRICHLET) pj[sd] = bc.value;
+            else if(bc.order == 0) pj[sd] = pj[0];
+            else pj[sd] = 2.0*pj[0]-pj[-sd];
+            return;
+          }
+          const s64 k = find(c,h);
+          if(k >= 0) { pj[sd] = at(c.p[k].u,h); return; }
+          ASSERT(l > 0,"Level 0 of the AMR is not complete");
+          const level& cc = lv_[l-1];
+          s64 i[RANK];
+          for(szt e=0;e<RANK;++e) i[e] = (h[e]-1)/2+1;
+          const s64 kc = find(cc,i);
+          ASSERT(kc >= 0,"AMR level "<<l<<" not nested in level "<<l-1);
+          const patch_type& q = cc.p[kc];
+          pj[sd] = (1.0-a)*at(q.uold,i) + a*at(q.u,i);
+        });
+      }
+  }
+
+  //---------------------------------------------------------------------//
+  // Regridding
+  //---------------------------------------------------------------------//
+  // Blocks of level l to refine in flag. False if there are none.
+  bool tag(szt l, std::vector<char>& flag)
+  {
+    fillhalo(l,1.0);
+    level& c = lv_[l];
+    flag.assign(c.map.size(),0);
+    const f64 tol = opt_.tagtol;
+    run(l,[&](patch_type& p) {
+      bool t = false;
+      for(szt d=0;d<RANK;++d) {
+        const s64 sd = p.u.stride(d);
+        lines(p.box,[&](const s64* i, s64 n) {
+          const f64* pu = p.u.data()+off(p.u,i);
+          for(s64 k=0;k<n;++k)
+            t |= (ABS(pu[k+sd]-pu[k]) > tol) || (ABS(pu[k]-pu[k-sd]) > tol);
+        });
+      }
+      flag[blockof(c,p)] = t ? 1 : 0;
+    });
+    // Buffer of blocks around the tagged ones
+    std::vector<char> tmp;
+    for(s64 r=0;r<opt_.buffer;++r)
+      for(szt d=0;d<RANK;++d) {
+        tmp = flag;
+        for(s64 b=0;b<s64(flag.size());++b) {
+          const s64 i = (b/c.bs[d]) % c.nb[d];
+          for(s64 o=-1;o<=1;o+=2) {
+            s64 j = i+o;
+            if(j < 0 || j >= c.nb[d]) {
+              if(!g_.periodic(d)) continue;
+              j = (j+c.nb[d]) % c.nb[d];
+            }
+            if(tmp[b+(j-i)*c.bs[d]]) flag[b] = 1;
+          }
+        }
+      }
+    // Only blocks of the level whose neighbours are on the level
+    bool any = false;
+    for(s64 b=0;b<s64(flag.size());++b) {
+      if(flag[b] && !nested(c,b)) flag[b] = 0;
+      any = any || flag[b];
+    }
+    return any;
+  }
+
+  // Are the block b and the 3^RANK-1 blocks around it on the level ?
+  bool nested(const level& c, s64 b) const
+  {
+    s64 m3 = 1;
+    for(szt d=0;d<RANK;++d) m3 *= 3;
+    for(s64 m=0;m<m3;++m) {
+      s64 nb = 0, r = m;
+      bool inside = true;
+      for(szt d=0;d<RANK;++d, r/=3) {
+        s64 j = (b/c.bs[d]) % c.nb[d] + (r%3) - 1;
+        if(j < 0 || j >= c.nb[d]) {
+          if(!g_.periodic(d)) { inside = false; break; }
+          j = (j+c.nb[d]) % c.nb[d];
+        }
+        nb += j*c.bs[d];
+      }
+      if(inside && c.map[nb] < 0) return false;
+    }
+    return true;
+  }
+
+  // Build level l+1 from the blocks of level l in flag, with the cells of
+  // the old level l+1 where it had the block, else prolonged from level l
+  void refine(szt l, const std::vector<char>& flag, const level* old)
+  {
+    level f;
+    newlevel(l+1,f);
+    const level& c = lv_[l];
+    s64 nchild = 1, nflag = 0;
+    for(szt d=0;d<RANK;++d) nchild *= 2;
+    for(char v : flag) nflag += v ? 1 : 0;
+    f.p.reserve(nflag*nchild);
+    for(s64 b=0;b<s64(flag.size());++b) {
+      if(!flag[b]) continue;
+      for(s64 m=0;m<nchild;++m) {
+        s64 fb = 0;
+        for(szt d=0;d<RANK;++d)
+          fb += (2*((b/c.bs[d]) % c.nb[d]) + ((m >> d) & 1))*f.bs[d];
+        addpatch(f,fb);
+      }
+    }
+    lv_.push_back(std::move(f));
+    level& fl = lv_[l+1];
+    run(l+1,[&](patch_type& p) {
+      const s64 k = old ? old->map[blockof(fl,p)] : -1;
+      if(k >= 0) {
+        const field& src = old->p[k].u;
+        each(p.box,[&](const s64* i) { at(p.u,i) = at(src,i); });
+      } else {
+        prolong(l,p);
+      }
+    });
+  }
+
+  static f64 minmod(f64 a, f64 b)
+  {
+    if(a*b <= 0.0) return 0.0;
+    return (ABS(a) < ABS(b)) ? a : b;
+  }
+
+  // Cells of the patch p of level l+1 from level l, with limited slopes
+  void prolong(szt l, patch_type& p) const
+  {
+    const level& c = lv_[l];
+    each(p.box,[&](const s64* i) {
+      s64 ci[RANK];
+      for(szt d=0;d<RANK;++d) ci[d] = (i[d]-1)/2+1;
+      const s64 k = find(c,ci);
+      ASSERT(k >= 0,"AMR level "<<l+1<<" not nested in level "<<l);
+      const f64 v = at(c.p[k].u,ci);
+      f64 w = v;
+      for(szt d=0;d<RANK;++d) {
+        f64 nv[2];
+        bool ok = true;
+        for(szt s=0;s<2;++s) {
+          s64 j[RANK];
+          for(szt e=0;e<RANK;++e) j[e] = ci[e];
+          j[d] += s ? 1 : -1;
+          const s64 q = wrap(c,j) ? find(c,j) : -1;
+          if(q < 0) { ok = false; break; }
+          nv[s] = at(c.p[q].u,j);
+        }
+        if(!ok) continue;
+        const f64 sl = minmod(nv[1]-v,v-nv[0]);
+        w += ((i[d]-1) % 2 == 0) ? -0.25*sl : 0.25*sl;
+      }
+      at(p.u,i) = w;
+    });
+  }
+
+  //---------------------------------------------------------------------//
+  // Time steps
+  //---------------------------------------------------------------------//
+  // One step dt of level l, then 2 of dt/2 of level l+1 and so on
+  xtem(xtn FLUX) void advance(szt l, f64 dt, const FLUX& flux)
+  {
+    level& c = lv_[l];
+    f64 a = 1.0;
+    if(l > 0) a = (c.t-lv_[l-1].told)/lv_[l-1].dt;
+    c.told = c.t;
+    c.dt = dt;
+    fillhalo(l,a);
+    run(l,[&](patch_type& p) { update(l,p,dt,flux); });
+    c.t = c.told+dt;
+    if(l+1 < levels()) {
+      for(patch_type& p : lv_[l+1].p)
+        for(szt d=0;d<RANK;++d) p.freg[d].fill(0.0);
+      advance(l+1,0.5*dt,flux);
+      advance(l+1,0.5*dt,flux);
+      lv_[l+1].t = c.t;
+      reflux(l);
+      average(l);
+    }
+  }
+
+  // One step dt of the patch p of level l, with the fluxes kept for the
+  // flux correction
+  xtem(xtn FLUX) void update(szt l, patch_type& p, f64 dt,
+                             const FLUX& flux) const
+  {
+    const level& c = lv_[l];
+    p.uold = p.u;
+    const field& u = p.uold;
+    for(szt d=0;d<RANK;++d) {
+      field& fx = p.flux[d];
+      xbox<RANK> fb = p.box;
+      ++fb.hi[d];
+      const s64 sd = u.stride(d);
+      lines(fb,[&](const s64* i, s64 n) {
+        const f64* pu = u.data()+off(u,i);
+        f64* pf = fx.data()+off(fx,i);
+        for(s64 k=0;k<n;++k) pf[k] = flux(d,pu[k-sd],pu[k]);
+      });
+    }
+    lines(p.box,[&](const s64* i, s64 n) {
+      f64* pu = p.u.data()+off(p.u,i);
+      for(szt d=0;d<RANK;++d) {
+        const field& fx = p.flux[d];
+        const f64* pf = fx.data()+off(fx,i);
+        const s64 sf = fx.stride(d);
+        const f64 r = dt/c.dx[d];
+        for(s64 k=0;k<n;++k) pu[k] -= r*(pf[k+sf]-pf[k]);
+      }
+    });
+    if(l == 0) return;
+    for(szt d=0;d<RANK;++d)
+      for(szt s=0;s<2;++s) {
+        xbox<RANK> f = p.box;
+        f.lo[d] = f.hi[d] = s ? p.box.hi[d]+1 : p.box.lo[d];
+        each(f,[&](const s64* i) {
+          s64 j[RANK];
+          for(szt e=0;e<RANK;++e) j[e] = i[e];
+          j[d] = s+1;
+          at(p.freg[d],j) += dt*at(p.flux[d],i);
+        });
+      }
+  }
+
+  // Replace the fluxes of level l at the faces of the patches of level l+1
+  // with the sums of the fine fluxes, in the coarse cells outside them
+  void reflux(szt l)
+  {
+    level& c = lv_[l];
+    const level& f = lv_[l+1];
+    f64 area = 1.0;
+    for(szt d=1;d<RANK;++d) area *= 0.5;
+    for(const patch_type& p : f.p)
+      for(szt d=0;d<RANK;++d)
+        for(szt s=0;s<2;++s) {
+          xbox<RANK> fc = p.box;
+          fc.lo[d] = fc.hi[d] = s ? p.box.hi[d] : p.box.lo[d];
+          each(fc,[&](const s64* j) {
+            s64 h[RANK];
+            for(szt e=0;e<RANK;++e) h[e] = j[e];
+            h[d] += s ? 1 : -1;
+            if(!wrap(f,h) || find(f,h) >= 0) return;
+            s64 ci[RANK], fi[RANK], ri[RANK];
+            for(szt e=0;e<RANK;++e) {
+              ci[e] = fi[e] = (h[e]-1)/2+1;
+              ri[e] = j[e];
+            }
+            // The face is the low face of the coarse cell above the patch,
+            // or the high face of the one below
+            if(!s) ++fi[d];
+            ri[d] = s+1;
+            const s64 k = find(c,ci);
+            ASSERT(k >= 0,"AMR level "<<l+1<<" not nested in level "<<l);
+            patch_type& q = c.p[k];
+            const f64 df = area*(at(p.freg[d],ri) - c.dt*at(q.flux[d],fi));
+            at(q.u,ci) += (s ? df : -df)/c.dx[d];
+          });
+        }
+  }
+
+  // Set the cells of level l under level l+1 to the means of their cells
+  void average(szt l)
+  {
+    level& c = lv_[l];
+    s64 nchild = 1;
+    for(szt d=0;d<RANK;++d) nchild *= 2;
+    const f64 w = 1.0/f64(nchild);
+    run(l+1,[&](patch_type& p) {
+      xbox<RANK> r;
+      for(szt d=0;d<RANK;++d) {
+        r.lo[d] = (p.box.lo[d]-1)/2+1;
+        r.hi[d] = p.box.hi[d]/2;
+      }
+      patch_type& q = c.p[find(c,r.lo)];
+      each(r,[&](const s64* ci) {
+        f64 s = 0.0;
+        for(s64 m=0;m<nchild;++m) {
+          s64 i[RANK];
+          for(szt d=0;d<RANK;++d) i[d] = 2*ci[d]-1 + ((m >> d) & 1);
+          s += at(p.u,i);
+        }
+        at(q.u,ci) = s*w;
+      });
+    });
+  }
+
+  xgrid<RANK> g_;
+  xamropts opt_;
+  std::vector<level> lv_;
+  f64 time_;
+  s64 steps_;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// SIMD kernels
+///////////////////////////////////////////////////////////////////////////////
+//---------------------------------------------------------------------------//
+// Core array operations written with packs (see "SIMD packs"), so that they
+// are vectorized at any optimization level and do not depend on the
+// compiler vectorizing the loop on its own.
+// Every kernel takes the no. of elements N and plain pointers, which need
+// not be aligned, and has an overload for ARR(...).
+//---------------------------------------------------------------------------//
+// NOTE : The reductions add W lanes in 4 independent packs, so the order of
+// the additions, and the last bits of the result, differ from a plain loop.
+//---------------------------------------------------------------------------//
+// USE :
+// >> ARR(f64) x(1,n), y(1,n);
+// >> ...
+// >> xaxpy(0.5,x,y);                  // y = 0.5*x + y
+// >> f64 s = xsum(x);                 // Sum of x(1:n)
+// >> f64 d = xdot(x,y);               // Dot product of x and y
+// >> f64 m = xmaxabs(y);              // Largest |y(i)|, the infinity norm
+// >> f64 a = xasum(y);                // Sum of |y(i)|, the 1-norm
+// >> s64 k = xargmax(y);              // Index of the largest y(i)
+// >> xaxpy(n/2,2.0,&x[1],&y[n/2+1]);  // On parts of the arrays
+//---------------------------------------------------------------------------//
+// With SIMD_DISPATCH, every kernel is compiled for AVX-512, AVX2 and the
+// baseline, on packs of 64 bytes, and the loader picks the best for the CPU.
+#ifdef SIMD_DISPATCH
+#define XSIMD_CLONES \
+  __attribute__((target_clones("arch=x86-64-v4","arch=x86-64-v3","default")))
+xtem(xtn TYPE) using xkpack = xpack<TYPE,(64/SOF(TYPE) > 0) ? 64/SOF(TYPE) : 1>;
+#else
+#define XSIMD_CLONES
+xtem(xtn TYPE) using xkpack = xnpack<TYPE>;
+#endif
+
+//---------------------------------------------------------------------------//
+// y = a*x + y
+//---------------------------------------------------------------------------//
+xtem(xtn TYPE) XSIMD_CLONES
+void xaxpy(s64 n, TYPE a, const TYPE* x, TYPE* y)
+{
+  typedef xkpack<TYPE> pack;
+  const s64 w = pack::width;
+  const pack pa(a);
+  s64 i = 0;
+  for(;i+w<=n;i+=w) xfma(pa,pack::loadu(x+i),pack::loadu(y+i)).storeu(y+i);
+  for(;i<n;++i) y[i] += a*x[i];
+}
+
+xtem(xtn TYPE) inline
+void xaxpy(TYPE a, const xarray<TYPE>& x, xarray<TYPE>& y)
+{
+  ASSERT(x.size() == y.size(),"xaxpy of arrays of different sizes");
+  xaxpy(x.size(),a,x.data(),y.data());
+}
+
+//---------------------------------------------------------------------------//
+// Sum of x
+//---------------------------------------------------------------------------//
+xtem(xtn TYPE) XSIMD_CLONES
+TYPE xsum(s64 n, const TYPE* x)
+{
+  typedef xkpack<TYPE> pack;
+  const s64 w = pack::width;
+  pack s0(TYPE(0)), s1(TYPE(0)), s2(TYPE(0)), s3(TYPE(0));
+  s64 i = 0;
+  for(;i+4*w<=n;i+=4*w) {
+    s0 += pack::loadu(x+i);     s1 += pack::loadu(x+i+w);
+    s2 += pack::loadu(x+i+2*w); s3 += pack::loadu(x+i+3*w);
+  }
+  for(;i+w<=n;i+=w) s0 += pack::loadu(x+i);
+  TYPE s = xhsum((s0+s1)+(s2+s3));
+  for(;i<n;++i) s += x[i];
+  return s;
+}
+
+xtem(xtn TYPE) inline
+TYPE xsum(const xarray<TYPE>& x)
+{
+  return xsum(x.size(),x.data());
+}
+
+//---------------------------------------------------------------------------//
+// Dot product of x and y
+//---------------------------------------------------------------------------//
+xtem(xtn TYPE) XSIMD_CLONES
+TYPE xdot(s64 n, const TYPE* x, const TYPE* y)
+{
+  typedef xkpack<TYPE> pack;
+  const s64 w = pack::width;
+  pack s0(TYPE(0)), s1(TYPE(0)), s2(TYPE(0)), s3(TYPE(0));
+  s64 i = 0;
+  for(;i+4*w<=n;i+=4*w) {
+    s0 = xfma(pack::loadu(x+i),pack::loadu(y+i),s0);
+    s1 = xfma(pack::loadu(x+i+w),pack::loadu(y+i+w),s1);
+    s2 = xfma(pack::loadu(x+i+2*w),pack::loadu(y+i+2*w),s2);
+    s3 = xfma(pack::loadu(x+i+3*w),pack::loadu(y+i+3*w),s3);
+  }
+  for(;i+w<=n;i+=w) s0 = xfma(pack::loadu(x+i),pack::loadu(y+i),s0);
+  TYPE s = xhsum((s0+s1)+(s2+s3));
+  for(;i<n;++i) s += x[i]*y[i];
+  return s;
+}
+
+xtem(xtn TYPE) inline
+TYPE xdot(const xarray<TYPE>& x, const xarray<TYPE>& y)
+{
+  ASSERT(x.size() == y.size(),"xdot of arrays of different sizes");
+  return xdot(x.size(),x.data(),y.data());
+}
+
+//---------------------------------------------------------------------------//
+// Largest absolute value of x, 0 if N is 0, and NaN if x has a NaN, so that
+// a field that has blown up does not give a finite norm
+//---------------------------------------------------------------------------//
+xtem(xtn TYPE) XSIMD_CLONES
+TYPE xmaxabs(s64 n, const TYPE* x)
+{
+  typedef xkpack<TYPE> pack;
+  const s64 w = pack::width;
+  pack m0(TYPE(0)), m1(TYPE(0));
+  // xmax drops NaN, so the lanes that were NaN are kept apart
+  xtn pack::mask nan0 = m0 != m0, nan1 = nan0;
+  s64 i = 0;
+  for(;i+2*w<=n;i+=2*w) {
+    const pack a0 = xabs(pack::loadu(x+i)), a1 = xabs(pack::loadu(x+i+w));
+    m0 = xmax(m0,a0);
+    m1 = xmax(m1,a1);
+    nan0 = nan0 | (a0 != a0);
+    nan1 = nan1 | (a1 != a1);
+  }
+  for(;i+w<=n;i+=w) {
+    const pack a0 = xabs(pack::loadu(x+i));
+    m0 = xmax(m0,a0);
+    nan0 = nan0 | (a0 != a0);
+  }
+  bool nan = xany(nan0 | nan1);
+  TYPE m = xhmax(xmax(m0,m1));
+  for(;i<n;++i) {
+    const TYPE a = TYPE(std::abs(x[i]));
+    nan = nan || a != a;
+    m = std::max(m,a);
+  }
+  return nan ? std::numeric_limits<TYPE>::quiet_NaN() : m;
+}
+
+xtem(xtn TYPE) inline
+TYPE xmaxabs(const xarray<TYPE>& x)
+{
+  return xmaxabs(x.size(),x.data());
+}
+
+//---------------------------------------------------------------------------//
+// Sum of |x|, the 1-norm
+//---------------------------------------------------------------------------//
+xtem(xtn TYPE) XSIMD_CLONES
+TYPE xasum(s64 n, const TYPE* x)
+{
+  typedef xkpack<TYPE> pack;
+  const s64 w = pack::width;
+  pack s0(TYPE(0)), s1(TYPE(0)), s2(TYPE(0)), s3(TYPE(0));
+  s64 i = 0;
+  for(;i+4*w<=n;i+=4*w) {
+    s0 += xabs(pack::loadu(x+i));     s1 += xabs(pack::loadu(x+i+w));
+    s2 += xabs(pack::loadu(x+i+2*w)); s3 += xabs(pack::loadu(x+i+3*w));
+  }
+  for(;i+w<=n;i+=w) s0 += xabs(pack::loadu(x+i));
+  TYPE s = xhsum((s0+s1)+(s2+s3));
+  for(;i<n;++i) s += std::abs(x[i]);
+  return s;
+}
+
+xtem(xtn TYPE) inline
+TYPE xasum(const xarray<TYPE>& x)
+{
+  return xasum(x.size(),x.data());
+}
+
+//---------------------------------------------------------------------------//
+// Smallest and largest element of x, for N >= 1
+//---------------------------------------------------------------------------//
+xtem(xtn TYPE) XSIMD_CLONES
+TYPE xminval(s64 n, const TYPE* x)
+{
+  typedef xkpack<TYPE> pack;
+  const s64 w = pack::width;
+  s64 i = 0;
+  TYPE m = x[0];
+  if(n >= w) {
+    pack m0 = pack::loadu(x), m1 = m0;
+    for(i=w;i+2*w<=n;i+=2*w) {
+      m0 = xmin(m0,pack::loadu(x+i));
+      m1 = xmin(m1,pack::loadu(x+i+w));
+    }
+    for(;i+w<=n;i+=w) m0 = xmin(m0,pack::loadu(x+i));
+    m = xhmin(xmin(m0,m1));
+  }
+  for(;i<n;++i) m = std::min(m,x[i]);
+  return m;
+}
+
+xtem(xtn TYPE) XSIMD_CLONES
+TYPE xmaxval(s64 n, const TYPE* x)
+{
+  typedef xkpack<TYPE> pack;
+  const s64 w = pack::width;
+  s64 i = 0;
+  TYPE m = x[0];
+  if(n >= w) {
+    pack m0 = pack::loadu(x), m1 = m0;
+    for(i=w;i+2*w<=n;i+=2*w) {
+      m0 = xmax(m0,pack::loadu(x+i));
+      m1 = xmax(m1,pack::loadu(x+i+w));
+    }
+    for(;i+w<=n;i+=w) m0 = xmax(m0,pack::loadu(x+i));
+    m = xhmax(xmax(m0,m1));
+  }
+  for(;i<n;++i) m = std::max(m,x[i]);
+  return m;
+}
+
+xtem(xtn TYPE) inline
+TYPE xminval(const xarray<TYPE>& x)
+{
+  ASSERT(x.size() > 0,"xminval of an empty array");
+  return xminval(x.size(),x.data());
+}
+
+xtem(xtn TYPE) inline
+TYPE xmaxval(const xarray<TYPE>& x)
+{
+  ASSERT(x.size() > 0,"xmaxval of an empty array");
+  return xmaxval(x.size(),x.data());
+}
+
+//---------------------------------------------------------------------------//
+// Index of the largest element of x, the first one if it is repeated.
+// From 0 for pointers, and from the lower bound for arrays.
+//---------------------------------------------------------------------------//
+xtem(xtn TYPE) inline
+s64 xargmax(s64 n, const TYPE* x)
+{
+  // The maximum with packs, then the first element equal to it
+  const TYPE m = xmaxval(n,x);
+  s64 i = 0;
+  while(i < n-1 && !(x[i] == m)) ++i;
+  return i;
+}
+
+xtem(xtn TYPE) inline
+s64 xargmax(const xarray<TYPE>& x)
+{
+  ASSERT(x.size() > 0,"xargmax of an empty array");
+  return x.lbound()+xargmax(x.size(),x.data());
+}
+
+//---------------------------------------------------------------------------//
+// xmaxabs in parallel, with the threads of xpool() taking equal blocks.
+// The result is exact, so it does not depend on the no. of threads.
+//---------------------------------------------------------------------------//
+// Elements per thread below which the reductions run serially
+#define XREDUCE_MIN_ELEMS 65536
+
+xtem(xtn TYPE)
+TYPE xparmaxabs(s64 n, const TYPE* x)
+{
+  xthreadpool& pool = xpool();
+  const s64 nt = std::min<s64>(pool.size(),n/XREDUCE_MIN_ELEMS);
+  if(nt <= 1) return xmaxabs(n,x);
+  xscratchscope ws;
+  TYPE* m = ws.alloc<TYPE>(nt);
+  pool.run([&](szt t) {
+    if(s64(t) >= nt) return;
+    const s64 i0 = n*s64(t)/nt, i1 = n*(s64(t)+1)/nt;
+    m[t] = xmaxabs(i1-i0,x+i0);
+  });
+  // The NaN of a block, if any
+  TYPE r = m[0];
+  for(s64 t=1;t<nt && r == r;++t) r = m[t] == m[t] ? std::max(r,m[t]) : m[t];
+  return r;
+}
+
+xtem(xtn TYPE) inline
+TYPE xparmaxabs(const xarray<TYPE>& x)
+{
+  return xparmaxabs(x.size(),x.data());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Reductions
+///////////////////////////////////////////////////////////////////////////////
+//---------------------------------------------------------------------------//
+// Sums, dot products and norms of whole arrays in parallel, for residuals
+// and conservation checks, with the packs of "SIMD kernels" in every
+// thread and the accuracy chosen by an xsummode :
+// + NAIVE    : xsum of one block per thread, added in order. The error
+//              grows like n*eps, and the last bits depend on the no. of
+//              threads.
+// + PAIRWISE : xsum of blocks of XREDUCE_BLOCK elements, added as a binary
+//              tree. As fast, with an error growing like log(n)*eps.
+// + KAHAN    : compensated (Neumaier) sum of one block per thread. The
+//              error does not grow with n, for about twice the work.
+// + REPRO    : compensated sums of blocks of XREDUCE_BLOCK elements, added
+//              as a binary tree, also compensated.
+// PAIRWISE and REPRO give the same bits for any no. of threads, the serial
+// call of small arrays included, so the results of regression tests do not
+// change with SCICPP_THREADS or the machine's cores.
+// + xpartotal, xpardot, xparnorm1, xparnorm2 : with a mode, PAIRWISE if not
+//   given
+// + xparminval, xparmaxval, xparargmax, xparmaxabs : exact, so no mode
+// For reductions of any loop body, see PARREDUCE, whose macros PARSUM,
+// PARMIN and PARMAX take the names xparsum, xparmin and xparmax.
+//---------------------------------------------------------------------------//
+// NOTE : The bits still depend on the width of the SIMD packs, and
+// -ffast-math, which lets the compiler drop the compensation, makes KAHAN
+// and REPRO the same as NAIVE and PAIRWISE.
+// NOTE : The compensated dot product also adds the rounding error of every
+// product, given by xfma, so it is as accurate as a dot product in twice
+// the precision when the hardware has FMA.
+//---------------------------------------------------------------------------//
+// USE : Residual norm and total mass, the same on 1 or 64 threads
+// >> f64 res  = xparnorm2(r,REPRO);
+// >> f64 mass = xpartotal(u,REPRO)*dx;
+// >> s64 imax = xparargmax(u);         // Index of max(u) in u
+//---------------------------------------------------------------------------//
+enum xsummode { NAIVE, PAIRWISE, KAHAN, REPRO };
+
+// Elements per block of the tree sums. Not to be changed between runs that
+// should give the same bits.
+#define XREDUCE_BLOCK 2048
+
+//---------------------------------------------------------------------------//
+// Compensated sum s+c, where c holds the rounding errors of s (Neumaier)
+//---------------------------------------------------------------------------//
+xtem(xtn TYPE)
+struct xcompsum
+{
+  TYPE s, c;
+
+  xcompsum(TYPE x=TYPE(0)) : s(x), c(TYPE(0)) {}
+
+  void add(TYPE x)
+  {
+    const TYPE t = s+x;
+    c += std::abs(s) >= std::abs(x) ? (s-t)+x : (x-t)+s;
+    s = t;
+  }
+  xcompsum& operator+=(const xcompsum& o)
+  {
+    add(o.s); c += o.c;
+    return *this;
+  }
+  TYPE value() const { return s+c; }
+};
+
+// Adds x[i], |x[i]| (MAG) or x[i]*y[i] (DOT) to the sums S of the lanes,
+// and their rounding errors to C
+xtem(bool MAG, bool DOT, xtn P, xtn TYPE) inline
+void xcsum_step(P& s, P& c, const TYPE* x, const TYPE* y, s64 i)
+{
+  P a = P::loadu(x+i);
+  if(DOT) {
+    const P b = P::loadu(y+i), p = a*b;
+    c += xfma(a,b,-p);
+    a = p;
+  }
+  else if(MAG) a = xabs(a);
+  const P t = s+a;
+  c += xselect(xabs(s) >= xabs(a),(s-t)+a,(a-t)+s);
+  s = t;
+}
+
+// Adds the lanes of S and C to R, in order
+xtem(xtn TYPE, xtn P) inline
+void xcsum_lanes(xcompsum<TYPE>& r, const P& s, const P& c)
+{
+  TYPE ts[P::width], tc[P::width];
+  s.storeu(ts); c.storeu(tc);
+  for(szt k=0;k<P::width;++k) { r.add(ts[k]); r.c += tc[k]; }
+}
+
+//---------------------------------------------------------------------------//
+// Compensated xsum (xcsum), xasum (xcasum) and xdot (xcdot)
+//---------------------------------------------------------------------------//
+xtem(bool MAG, bool DOT, xtn TYPE) XSIMD_CLONES
+xcompsum<TYPE> xcsum_kernel(s64 n, const TYPE* x, const TYPE* y)
+{
+  typedef xkpack<TYPE> pack;
+  typedef xpack<TYPE,1> pack1;
+  const s64 w = pack::width;
+  pack s0(TYPE(0)), c0(TYPE(0)), s1(TYPE(0)), c1(TYPE(0));
+  s64 i = 0;
+  for(;i+2*w<=n;i+=2*w) {
+    xcsum_step<MAG,DOT>(s0,c0,x,y,i);
+    xcsum_step<MAG,DOT>(s1,c1,x,y,i+w);
+  }
+  for(;i+w<=n;i+=w) xcsum_step<MAG,DOT>(s0,c0,x,y,i);
+  pack1 st(TYPE(0)), ct(TYPE(0));
+  for(;i<n;++i) xcsum_step<MAG,DOT>(st,ct,x,y,i);
+  xcompsum<TYPE> r;
+  xcsum_lanes(r,s0,c0); xcsum_lanes(r,s1,c1); xcsum_lanes(r,st,ct);
+  return r;
+}
+
+xtem(xtn TYPE) inline
+xcompsum<TYPE> xcsum(s64 n, const TYPE* x)
+{
+  return xcsum_kernel<false,false>(n,x,x);
+}
+
+xtem(xtn TYPE) inline
+xcompsum<TYPE> xcasum(s64 n, const TYPE* x)
+{
+  return xcsum_kernel<true,false>(n,x,x);
+}
+
+xtem(xtn TYPE) inline
+xcompsum<TYPE> xcdot(s64 n, const TYPE* x, const TYPE* y)
+{
+  return xcsum_kernel<false,true>(n,x,y);
+}
+
+//---------------------------------------------------------------------------//
+// Sum over [0,N) of the parts given by PLAIN(i0,i1) or, for KAHAN and
+// REPRO, by the compensated COMP(i0,i1), in the order of MODE.
+// The blocks of the tree are shared among the threads of xpool() in whole
+// blocks, so each block, and the tree, are the same for any no. of threads.
+//---------------------------------------------------------------------------//
+xtem(xtn TYPE, xtn PLAIN, xtn COMP)
+TYPE xparsumblocks(s64 n, xsummode mode, PLAIN plain, COMP comp)
+{
+  const bool tree = mode == PAIRWISE || mode == REPRO;
+  const bool cmp = mode == KAHAN || mode == REPRO;
+  xthreadpool& pool = xpool();
+  const s64 nt = std::min<s64>(pool.size(),n/XREDUCE_MIN_ELEMS);
+  const s64 nb = tree ? std::max<s64>(1,(n+XREDUCE_BLOCK-1)/XREDUCE_BLOCK)
+                      : std::max<s64>(1,nt);
+  xscratchscope ws;
+  xcompsum<TYPE>* p = ws.alloc<xcompsum<TYPE> >(nb);
+  auto blocks = [&](s64 b0, s64 b1) {
+    for(s64 b=b0;b<b1;++b) {
+      const s64 i0 = tree ? b*XREDUCE_BLOCK : n*b/nb;
+      const s64 i1 = tree ? std::min<s64>(n,i0+XREDUCE_BLOCK) : n*(b+1)/nb;
+      p[b] = cmp ? comp(i0,i1) : xcompsum<TYPE>(plain(i0,i1));
+    }
+  };
+  if(nt <= 1) blocks(0,nb);
+  else pool.run([&](szt t) {
+    if(s64(t) >= nt) return;
+    blocks(nb*s64(t)/nt,nb*(s64(t)+1)/nt);
+  });
+  auto join = [&](s64 a, s64 b) {
+    if(cmp) p[a] += p[b];
+    else p[a].s += p[b].s;
+  };
+  if(tree) {
+    // Pairwise, like xhsum
+    for(s64 m=nb;m>1;m=(m+1)/2)
+      for(s64 k=0;k<m/2;++k) join(k,k+(m+1)/2);
+  }
+  else {
+    for(s64 b=1;b<nb;++b) join(0,b);
+  }
+  return p[0].value();
+}
+
+//---------------------------------------------------------------------------//
+// Sum, dot product, 1-norm and 2-norm in parallel
+//---------------------------------------------------------------------------//
+xtem(xtn TYPE)
+TYPE xpartotal(s64 n, const TYPE* x, xsummode mode=PAIRWISE)
+{
+  return xparsumblocks<TYPE>(n,mode,
+    [&](s64 i0, s64 i1) { return xsum(i1-i0,x+i0); },
+    [&](s64 i0, s64 i1) { return xcsum(i1-i0,x+i0); });
+}
+
+xtem(xtn TYPE)
+TYPE xpardot(s64 n, const TYPE* x, const TYPE* y, xsummode mode=PAIRWISE)
+{
+  return xparsumblocks<TYPE>(n,mode,
+    [&](s64 i0, s64 i1) { return xdot(i1-i0,x+i0,y+i0); },
+    [&](s64 i0, s64 i1) { return xcdot(i1-i0,x+i0,y+i0); });
+}
+
+xtem(xtn TYPE)
+TYPE xparnorm1(s64 n, const TYPE* x, xsummode mode=PAIRWISE)
+{
+  return xparsumblocks<TYPE>(n,mode,
+    [&](s64 i0, s64 i1) { return xasum(i1-i0,x+i0); },
+    [&](s64 i0, s64 i1) { return xcasum(i1-i0,x+i0); });
+}
+
+xtem(xtn TYPE)
+TYPE xparnorm2(s64 n, const TYPE* x, xsummode mode=PAIRWISE)
+{
+  return std::sqrt(xpardot(n,x,x,mode));
+}
+
+xtem(xtn TYPE) inline
+TYPE xpartotal(const xarray<TYPE>& x, xsummode mode=PAIRWISE)
+{
+  return xpartotal(x.size(),x.data(),mode);
+}
+
+xtem(xtn TYPE) inline
+TYPE xpardot(const xarray<TYPE>& x, const xarray<TYPE>& y,
+             xsummode mode=PAIRWISE)
+{
+  ASSERT(x.size() == y.size(),"xpardot of arrays of different sizes");
+  return xpardot(x.size(),x.data(),y.data(),mode);
+}
+
+xtem(xtn TYPE) inline
+TYPE xparnorm1(const xarray<TYPE>& x, xsummode mode=PAIRWISE)
+{
+  return xparnorm1(x.size(),x.data(),mode);
+}
+
+xtem(xtn TYPE) inline
+TYPE xparnorm2(const xarray<TYPE>& x, xsummode mode=PAIRWISE)
+{
+  return xparnorm2(x.size(),x.data(),mode);
+}
+
+//---------------------------------------------------------------------------//
+// Smallest and largest element, and the index of the largest, in parallel,
+// for N >= 1, with the threads of xpool() taking equal blocks
+//---------------------------------------------------------------------------//
+xtem(xtn TYPE)
+s64 xparargmax(s64 n, const TYPE* x)
+{
+  xthreadpool& pool = xpool();
+  const s64 nt = std::min<s64>(pool.size(),n/XREDUCE_MIN_ELEMS);
+  if(nt <= 1) return xargmax(n,x);
+  xscratchscope ws;
+  s64* k = ws.alloc<s64>(nt);
+  pool.run([&](szt t) {
+    if(s64(t) >= nt) return;
+    const s64 i0 = n*s64(t)/nt, i1 = n*(s64(t)+1)/nt;
+    k[t] = i0+xargmax(i1-i0,x+i0);
+  });
+  // The first block wins a tie, so the index is the first of the maximum
+  s64 r = k[0];
+  for(s64 t=1;t<nt;++t) if(x[r] < x[k[t]]) r = k[t];
+  return r;
+}
+
+xtem(xtn TYPE)
+TYPE xparminval(s64 n, const TYPE* x)
+{
+  xthreadpool& pool = xpool();
+  const s64 nt = std::min<s64>(pool.size(),n/XREDUCE_MIN_ELEMS);
+  if(nt <= 1) return xminval(n,x);
+  xscratchscope ws;
+  TYPE* m = ws.alloc<TYPE>(nt);
+  pool.run([&](szt t) {
+    if(s64(t) >= nt) return;
+    const s64 i0 = n*s64(t)/nt, i1 = n*(s64(t)+1)/nt;
+    m[t] = xminval(i1-i0,x+i0);
+  });
+  return *std::min_element(m,m+nt);
+}
+
+xtem(xtn TYPE)
+TYPE xparmaxval(s64 n, const TYPE* x)
+{
+  xthreadpool& pool = xpool();
+  const s64 nt = std::min<s64>(pool.size(),n/XREDUCE_MIN_ELEMS);
+  if(nt <= 1) return xmaxval(n,x);
+  xscratchscope ws;
+  TYPE* m = ws.alloc<TYPE>(nt);
+  pool.run([&](szt t) {
+    if(s64(t) >= nt) return;
+    const s64 i0 = n*s64(t)/nt, i1 = n*(s64(t)+1)/nt;
+    m[t] = xmaxval(i1-i0,x+i0);
+  });
+  return *std::max_element(m,m+nt);
+}
+
+xtem(xtn TYPE) inline
+s64 xparargmax(const xarray<TYPE>& x)
+{
+  ASSERT(x.size() > 0,"xparargmax of an empty array");
+  return x.lbound()+xparargmax(x.size(),x.data());
+}
+
+xtem(xtn TYPE) inline
+TYPE xparminval(const xarray<TYPE>& x)
+{
+  ASSERT(x.size() > 0,"xparminval of an empty array");
+  return xparminval(x.size(),x.data());
+}
+
+xtem(xtn TYPE) inline
+TYPE xparmaxval(const xarray<TYPE>& x)
+{
+  ASSERT(x.size() > 0,"xparmaxval of an empty array");
+  return xparmaxval(x.size(),x.data());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Precision
+///////////////////////////////////////////////////////////////////////////////
+//---------------------------------------------------------------------------//
+// Fields stored in one type and computed in another. Bandwidth bound
+// kernels move half the bytes with fields of f32, and computing in f64
+// keeps most of the accuracy of f64 : an element is rounded to f32 only
+// when it is stored, and the reductions sum in f64.
+// + xprecision<STORE,COMPUTE> : the two types, the arrays of STORE, the
+//   conversions load and store, and the reductions total, dot, norm1,
+//   norm2 and maxabs of the elements in COMPUTE
+// + xprecf64, xprecf32    : f64 or f32 for both
+// + xprecmixed            : stored in f32, computed in f64
+// + xprecbf16, xprecf16   : stored in bfloat16 (xbf16) or IEEE half
+//                           precision (xf16), computed in f32
+// + xrkstepper<FIELD,PREC> steps in the COMPUTE type of PREC, see "Time
+//   integration", and xcast<TYPE>(e) computes an array expression in TYPE
+// + xprecision_compare runs a case in several precisions and reports how
+//   far the results are from those of the first
+//---------------------------------------------------------------------------//
+// NOTE : xbf16 and xf16 are converted in software. They convert to f32
+// implicitly, so they are read like f32, and are rounded to the nearest,
+// ties to even, when written. f64 values are rounded to f32 first.
+// NOTE : When STORE and COMPUTE differ, the reductions convert
+// XWIDEN_CHUNK elements at a time to COMPUTE and use its packs.
+//---------------------------------------------------------------------------//
+// USE : One source for every precision
+// >> xtem(xtn P) void solve()
+// >> {
+// >>   typedef xtn P::compute_type C;
+// >>   xtn P::array u(1,nx), r(1,nx);
+// >>   ...
+// >>   DO(i,2,nx)
+// >>     const C w = P::load(u[i]);
+// >>     r[i] = P::store(-w*(w-P::load(u[i-1]))/C(dx));
+// >>   ENDDO
+// >>   C mass = P::total(u,REPRO)*C(dx);
+// >> }
+// >> solve<xprecf64>(); solve<xprecf32>(); solve<xprecmixed>();
+//---------------------------------------------------------------------------//
+// USE : Divergence of f32 and mixed precision from f64, for a functor with
+// a template operator() of the precision, returning the final field
+// >> struct mycase
+// >> {
+// >>   xtem(xtn P) xtn P::array operator()(P) const { ... }
+// >> };
+// >> xprecision_compare<xprecf64,xprecf32,xprecmixed>(mycase());
+//---------------------------------------------------------------------------//
+//---------------------------------------------------------------------------//
+// bfloat16 : the upper half of an f32, 8 bits of exponent and 7 of mantissa
+//---------------------------------------------------------------------------//
+struct xbf16
+{
+  u16 bits;
+
+  xbf16() = default;
+  xtem(xtn T, xtn = xtn std::enable_if<std::is_arithmetic<T>::value>::type)
+  xbf16(T x) : bits(from(f32(x))) {}
+
+  operator f32() const
+  {
+    const u32 u = u32(bits) << 16;
+    f32 x;
+    std::memcpy(&x,&u,SOF(x));
+    return x;
+  }
+
+  // Bits of the nearest bfloat16 of x, NaN kept a quiet NaN
+  static u16 from(f32 x)
+  {
+    u32 u;
+    std::memcpy(&u,&x,SOF(u));
+    if((u & 0x7fffffffu) > 0x7f800000u) return u16((u >> 16) | 0x40u);
+    u += 0x7fffu + ((u >> 16) & 1u);
+    return u16(u >> 16);
+  }
+};
+
+//---------------------------------------------------------------------------//
+// IEEE 754 half precision : 5 bits of exponent and 10 of mantissa, with
+// subnormals, and the largest finite value 65504
+//---------------------------------------------------------------------------//
+struct xf16
+{
+  u16 bits;
+
+  xf16() = default;
+  xtem(xtn T, xtn = xtn std::enable_if<std::is_arithmetic<T>::value>::type)
+  xf16(T x) : bits(from(f32(x))) {}
+
+  operator f32() const
+  {
+    const u32 s = u32(bits & 0x8000u) << 16;
+    u32 e = (bits >> 10) & 0x1fu, m = bits & 0x3ffu, u;
+    if(e == 0x1fu) u = s | 0x7f800000u | (m << 13);
+    else if(e != 0) u = s | ((e+112) << 23) | (m << 13);
+    else if(m == 0) u = s;
+    else {
+      // Subnormal, normalized in f32
+      e = 113;
+      while(!(m & 0x400u)) { m <<= 1; --e; }
+      u = s | (e << 23) | ((m & 0x3ffu) << 13);
+    }
+    f32 x;
+    std::memcpy(&x,&u,SOF(x));
+    return x;
+  }
+
+  // Bits of the nearest half of x, overflowing to infinity
+  static u16 from(f32 x)
+  {
+    u32 u;
+    std::memcpy(&u,&x,SOF(u));
+    const u32 s = (u >> 16) & 0x8000u, a = u & 0x7fffffffu;
+    // Infinity and NaN, and from 65520 up, which round to infinity
+    if(a > 0x7f800000u) return u16(s | 0x7e00u | ((a >> 13) & 0x3ffu));
+    if(a >= 0x477ff000u) return u16(s | 0x7c00u);
+    // Normal
+    if(a >= 0x38800000u)
+      return u16(s | ((a - 0x38000000u + 0xfffu + ((a >> 13) & 1u)) >> 13));
+    // Subnormal, in units of 2^-24, and 0 below 2^-25
+    if(a < 0x33000000u) return u16(s);
+    const u32 sh = 126 - (a >> 23), m = (a & 0x7fffffu) | 0x800000u;
+    u32 r = m >> sh;
+    const u32 rem = m & ((1u << sh) - 1), half = 1u << (sh-1);
+    if(rem > half || (rem == half && (r & 1u))) ++r;
+    return u16(s | r);
+  }
+};
+
+// Name of a type of xprecision
+xtem(xtn TYPE) struct xprecname;
+template<> struct xprecname<f64>
+{
+  static const char* str() { return "f64"; }
+};
+template<> struct xprecname<f32>
+{
+  static const char* str() { return "f32"; }
+};
+template<> struct xprecname<xbf16>
+{
+  static const char* str() { return "bf16"; }
+};
+template<> struct xprecname<xf16>
+{
+  static const char* str() { return "f16"; }
+};
+
+//---------------------------------------------------------------------------//
+// Sum over x, |x| (MAG) or x*y (DOT), of a type TYPE, in the type ACC, with
+// the plain (xsum) or compensated (xcsum, COMP) kernels of ACC.
+// XWIDEN_CHUNK elements at a time are converted to ACC, unless TYPE is
+// ACC (std::true_type).
+//---------------------------------------------------------------------------//
+#define XWIDEN_CHUNK 256
+
+xtem(bool MAG, bool DOT, bool COMP, xtn ACC, xtn TYPE)
+xcompsum<ACC> xwidesum(s64 n, const TYPE* x, const TYPE* y, std::false_type)
+{
+  ACC a[XWIDEN_CHUNK], b[XWIDEN_CHUNK];
+  xcompsum<ACC> r;
+  for(s64 i=0;i<n;i+=XWIDEN_CHUNK) {
+    const s64 m = std::min<s64>(XWIDEN_CHUNK,n-i);
+    for(s64 k=0;k<m;++k) a[k] = ACC(x[i+k]);
+    if(DOT) for(s64 k=0;k<m;++k) b[k] = ACC(y[i+k]);
+    if(COMP) r += xcsum_kernel<MAG,DOT>(m,a,b);
+    else r.s += DOT ? xdot(m,a,b) : MAG ? xasum(m,a) : xsum(m,a);
+  }
+  return r;
+}
+
+xtem(bool MAG, bool DOT, bool COMP, xtn ACC)
+xcompsum<ACC> xwidesum(s64 n, const ACC* x, const ACC* y, std::true_type)
+{
+  if(COMP) return xcsum_kernel<MAG,DOT>(n,x,y);
+  return xcompsum<ACC>(DOT ? xdot(n,x,y) : MAG ? xasum(n,x) : xsum(n,x));
+}
+
+//---------------------------------------------------------------------------//
+// Precision policy : fields stored in STORE and computed in COMPUTE
+//---------------------------------------------------------------------------//
+xtem(xtn STORE, xtn COMPUTE=STORE)
+struct xprecision
+{
+  typedef STORE store_type;
+  typedef COMPUTE compute_type;
+  typedef xarray<STORE> array;
+  xtem(szt RANK) using arraynd = xarraynd<STORE,RANK>;
+
+  static COMPUTE load(const STORE& x) { return COMPUTE(x); }
+  static STORE store(const COMPUTE& x) { return STORE(x); }
+
+  // "f32", or "f32/f64" for f32 computed in f64
+  static xstr name()
+  {
+    xstr s = xprecname<STORE>::str();
+    if(!std::is_same<STORE,COMPUTE>::value)
+      s += xstr("/") + xprecname<COMPUTE>::str();
+    return s;
+  }
+
+  // Sum, dot product, 1-norm and 2-norm in COMPUTE, in parallel, with the
+  // modes of "Reductions". For the same STORE and COMPUTE they are
+  // xpartotal, xpardot, xparnorm1 and xparnorm2.
+  static COMPUTE total(s64 n, const STORE* x, xsummode mode=PAIRWISE)
+  {
+    return sum<false,false>(n,x,x,mode);
+  }
+  static COMPUTE dot(s64 n, const STORE* x, const STORE* y,
+                     xsummode mode=PAIRWISE)
+  {
+    return sum<false,true>(n,x,y,mode);
+  }
+  static COMPUTE norm1(s64 n, const STORE* x, xsummode mode=PAIRWISE)
+  {
+    return sum<true,false>(n,x,x,mode);
+  }
+  static COMPUTE norm2(s64 n, const STORE* x, xsummode mode=PAIRWISE)
+  {
+    return std::sqrt(dot(n,x,x,mode));
+  }
+
+  // Largest |x[i]|, exact, in parallel
+  static COMPUTE maxabs(s64 n, const STORE* x)
+  {
+    return maxabs(n,x,std::is_floating_point<STORE>());
+  }
+
+  static COMPUTE total(const array& x, xsummode mode=PAIRWISE)
+  {
+    return total(x.size(),x.data(),mode);
+  }
+  static COMPUTE dot(const array& x, const array& y, xsummode mode=PAIRWISE)
+  {
+    ASSERT(x.size() == y.size(),"dot of arrays of different sizes");
+    return dot(x.size(),x.data(),y.data(),mode);
+  }
+  static COMPUTE norm1(const array& x, xsummode mode=PAIRWISE)
+  {
+    return norm1(x.size(),x.data(),mode);
+  }
+  static COMPUTE norm2(const array& x, xsummode mode=PAIRWISE)
+  {
+    return norm2(x.size(),x.data(),mode);
+  }
+  static COMPUTE maxabs(const array& x)
+  {
+    return maxabs(x.size(),x.data());
+  }
+
+private:
+  xtem(bool MAG, bool DOT)
+  static COMPUTE sum(s64 n, const STORE* x, const STORE* y, xsummode mode)
+  {
+    const std::is_same<STORE,COMPUTE> same;
+    return xparsumblocks<COMPUTE>(n,mode,
+      [&](s64 i0, s64 i1) {
+        return xwidesum<MAG,DOT,false,COMPUTE>(i1-i0,x+i0,y+i0,same).s; },
+      [&](s64 i0, s64 i1) {
+        return xwidesum<MAG,DOT,true,COMPUTE>(i1-i0,x+i0,y+i0,same); });
+  }
+
+  // With the packs of STORE, or else of COMPUTE, XWIDEN_CHUNK at a time
+  static COMPUTE maxabs(s64 n, const STORE* x, std::true_type)
+  {
+    return COMPUTE(xparmaxabs(n,x));
+  }
+  static COMPUTE maxabs(s64 n, const STORE* x, std::false_type)
+  {
+    const s64 nc = (n+XWIDEN_CHUNK-1)/XWIDEN_CHUNK;
+    return xparreduce<s64>(0,nc-1,COMPUTE(0),xreduce_max<COMPUTE>(),
+                           xsched(),[&](s64 c, COMPUTE& m) {
+      COMPUTE a[XWIDEN_CHUNK];
+      const s64 i = c*XWIDEN_CHUNK, k = std::min<s64>(XWIDEN_CHUNK,n-i);
+      for(s64 j=0;j<k;++j) a[j] = COMPUTE(x[i+j]);
+      // std::max would drop a NaN, which xmaxabs returns
+      const COMPUTE r = xmaxabs(k,a);
+      m = (r != r || r > m) ? r : m;
+    });
+  }
+};
+
+typedef xprecision<f64>       xprecf64;
+typedef xprecision<f32>       xprecf32;
+typedef xprecision<f32,f64>   xprecmixed;
+typedef xprecision<xbf16,f32> xprecbf16;
+typedef xprecision<xf16,f32>  xprecf16;
+
+//---------------------------------------------------------------------------//
+// How far a field is from a reference field of the same size
+//---------------------------------------------------------------------------//
+struct xprecdiff
+{
+  f64 maxabs;   // Largest |a-ref|
+  f64 maxrel;   // The same over the largest |ref|
+  f64 l2rel;    // 2-norm of a-ref over the 2-norm of ref
+  s64 at;       // Index of the largest |a-ref|
+};
+
+xtem(xtn A, xtn B)
+xprecdiff xdivergence(const xarray<A>& a, const xarray<B>& ref)
+{
+  ASSERT(a.size() == ref.size(),"Divergence of arrays of different sizes");
+  xprecdiff r = {0.0,0.0,0.0,ref.lbound()};
+  xcompsum<f64> d2, r2;
+  f64 rmax = 0.0;
+  for(s64 k=0;k<ref.size();++k) {
+    const f64 x = f64(ref.data()[k]), d = std::abs(f64(a.data()[k])-x);
+    if(d > r.maxabs) { r.maxabs = d; r.at = ref.lbound()+k; }
+    rmax = std::max(rmax,std::abs(x));
+    d2.add(d*d); r2.add(x*x);
+  }
+  r.maxrel = rmax > 0.0 ? r.maxabs/rmax : r.maxabs;
+  r.l2rel = r2.value() > 0.0 ? std::sqrt(d2.value()/r2.value())
+                             : std::sqrt(d2.value());
+  return r;
+}
+
+inline std::ostream& operator<<(std::ostream& os, const xprecdiff& d)
+{
+  return os<<"max |diff| = "<<d.maxabs<<" at "<<d.at
+           <<", relative = "<<d.maxrel<<", relative L2 = "<<d.l2rel;
+}
+
+//---------------------------------------------------------------------------//
+// Run the case c in the precision REF, then in each of the precisions PS,
+// and write to os the divergence of the field c returns in each from the
+// field of REF, which are also returned.
+// c(P()) returns the field of P, a P::array.
+//---------------------------------------------------------------------------//
+xtem(xtn REF, xtn... PS, xtn CASE)
+std::vector<xprecdiff> xprecision_compare(const CASE& c,
+                                          std::ostream& os = std::cout)
+{
+  const xtn REF::array ref = c(REF());
+  std::vector<xprecdiff> r;
+  auto one = [&](const xstr& name, const xprecdiff& d) {
+    os<<name<<" vs "<<REF::name()<<" : "<<d<<nl;
+    r.push_back(d);
+  };
+  const s32 run[] = {0,(one(PS::name(),xdivergence(c(PS()),ref)),0)...};
+  (void)run;
+  return r;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Time integration
+///////////////////////////////////////////////////////////////////////////////
+//---------------------------------------------------------------------------//
+// Explicit Runge-Kutta time stepping of du/dt = L(u), with the time step
+// from a CFL number, for the method of lines : the user writes L(u), the
+// spatial discretization, and xrkstepper takes the steps.
+// + SSPRK1, SSPRK2, SSPRK3 : strong stability preserving schemes of order
+//   1 to 3 (Shu-Osher), which keep the TVD property of the spatial
+//   scheme for the same CFL limit as forward Euler. 2 work fields.
+// + LSRK3, LSRK4 : low storage schemes in 2N form, order 3 with 3 stages
+//   (Williamson) and order 4 with 5 stages (Carpenter-Kennedy), with a
+//   single work field. They are not SSP.
+//---------------------------------------------------------------------------//
+// The right hand side is a functor f(t,u,r,a), which must compute
+// r = a*r + L(u) at time t. a is 0 for the SSP schemes, which only need
+// r = L(u), and the elements of r that f does not write (boundaries) stay
+// 0, so the elements of u there do not change.
+// The time step is dt = cfl*dx/smax, for the largest wave speed smax,
+// given by a functor speed(u), like the parallel reduction xparmaxabs.
+//---------------------------------------------------------------------------//
+// NOTE : For SSPRK1-3 and upwind schemes, cfl <= 1 is stable. LSRK3 and
+// LSRK4 are stable to about 1.2 and 1.4 times the forward Euler limit,
+// for central schemes, but use cfl <= 1 for upwind schemes too.
+//---------------------------------------------------------------------------//
+// USE : 1D nonlinear convection, L(u) = -u*du/dx, to time tend
+// >> auto rhs = [&](f64 t, const af64& u, af64& r, f64 a) {
+// >>   r(2,nx) = a*r(2,nx) - u(2,nx)*(u(2,nx)-u(1,nx-1))/dx; };
+// >> auto speed = [](const af64& u) { return xparmaxabs(u); };
+// >> xrkopts opt;
+// >> opt.scheme = SSPRK3; opt.cfl = 0.8;
+// >> xrkstepper<af64> rk(u,opt);
+// >> f64 t = 0.0;
+// >> s64 nsteps = rk.run(u,t,tend,dx,rhs,speed);
+//---------------------------------------------------------------------------//
+// USE : Own time loop, with a fixed dt
+// >> WHILE(t < tend)
+// >>   rk.step(u,t,dt,rhs); t += dt;
+// >> ENDWHILE
+//---------------------------------------------------------------------------//
+// USE : u stored in f32 and the stages computed in f64, see "Precision".
+// a is then an f64, and f should compute in f64 too.
+// >> auto rhs = [&](f64 t, const af32& u, af32& r, f64 a) {
+// >>   r(2,nx) = a*xcast<f64>(r(2,nx)) - ...; };
+// >> xrkstepper<af32,xprecmixed> rk(u,opt);
+//---------------------------------------------------------------------------//
+enum xrkscheme { SSPRK1, SSPRK2, SSPRK3, LSRK3, LSRK4 };
+
+struct xrkopts
+{
+  xrkscheme scheme;  // Runge-Kutta scheme
+  f64 cfl;           // dt = cfl*dx/smax
+  f64 dtmax;         // Largest dt, also used when smax is 0
+  xrkopts() : scheme(SSPRK3), cfl(0.5), dtmax(1e30) {}
+};
+
+//---------------------------------------------------------------------------//
+// Rows of the storage of a field : ROWS rows of LEN contiguous elements,
+// LD elements apart, so that padding is never touched
+//---------------------------------------------------------------------------//
+xtem(xtn TYPE) inline
+void xfield_rows(const xarray<TYPE>& u, s64& rows, s64& len, s64& ld)
+{
+  rows = 1; len = u.size(); ld = len;
+}
+
+xtem(xtn TYPE, szt RANK, xlayout LAYOUT) inline
+void xfield_rows(const xarraynd<TYPE,RANK,LAYOUT>& u, s64& rows, s64& len,
+                 s64& ld)
+{
+  const szt c = LAYOUT == ROWMAJOR ? RANK-1 : 0;
+  len = u.size(c);
+  ld = RANK == 1 ? len : u.stride(LAYOUT == ROWMAJOR ? c-1 : 1);
+  rows = len > 0 ? u.size()/len : 0;
+}
+
+//---------------------------------------------------------------------------//
+// Low storage schemes : stage i is r = A[i]*r + L(u) at t + C[i]*dt,
+// then u = u + B[i]*dt*r
+//---------------------------------------------------------------------------//
+struct xlsrk
+{
+  s32 stages;
+  const f64* A;
+  const f64* B;
+  const f64* C;
+
+  static xlsrk get(xrkscheme s)
+  {
+    static const f64 A3[] = {0.0,-5.0/9.0,-153.0/128.0};
+    static const f64 B3[] = {1.0/3.0,15.0/16.0,8.0/15.0};
+    static const f64 C3[] = {0.0,1.0/3.0,3.0/4.0};
+    static const f64 A4[] = {0.0,
+      -567301805773.0/1357537059087.0,-2404267990393.0/2016746695238.0,
+      -3550918686646.0/2091501179385.0,-1275806237668.0/842570457699.0};
+    static const f64 B4[] = {1432997174477.0/9575080441755.0,
+      5161836677717.0/13612068292357.0,1720146321549.0/2090206949498.0,
+      3134564353537.0/4481467310338.0,2277821191437.0/14882151754819.0};
+    static const f64 C4[] = {0.0,
+      1432997174477.0/9575080441755.0,2526269341429.0/6820363183183.0,
+      2006345519317.0/3224310063776.0,2802321613138.0/2924317926251.0};
+    xlsrk r = {3,A3,B3,C3};
+    if(s == LSRK4) { r.stages = 5; r.A = A4; r.B = B4; r.C = C4; }
+    return r;
+  }
+};
+
+//---------------------------------------------------------------------------//
+// Runge-Kutta stepper for a FIELD (xarray or xarraynd) like u, whose
+// elements are combined in the compute type of PREC
+//---------------------------------------------------------------------------//
+xtem(xtn FIELD, xtn PREC = xprecision<xtn FIELD::value_type>)
+class xrkstepper
+{
+public:
+  typedef xtn FIELD::value_type TYPE;
+  typedef xtn PREC::compute_type CTYPE;
+  static_assert(std::is_same<TYPE,xtn PREC::store_type>::value,
+                "FIELD must hold the store type of PREC");
+
+  xrkstepper(const FIELD& u, const xrkopts& opt = xrkopts())
+    : opt_(opt), r_(u)
+  {
+    r_.fill(TYPE(0));
+    if(opt_.scheme == SSPRK2 || opt_.scheme == SSPRK3) u1_ = u;
+  }
+
+  const xrkopts& opts() const { return opt_; }
+
+  // Stable time step for the largest wave speed smax, and spacing dx.
+  // smax must be finite : a NaN or infinite speed is a solution that has
+  // blown up, not one that allows dtmax.
+  f64 dt(f64 smax, f64 dx) const
+  {
+    ASSERT(std::isfinite(smax),"xrkstepper::dt of the wave speed "<<smax);
+    smax = std::abs(smax);
+    return smax*opt_.dtmax > opt_.cfl*dx ? opt_.cfl*dx/smax : opt_.dtmax;
+  }
+
+  // One step of dt from time t
+  xtem(xtn RHS) void step(FIELD& u, f64 t, f64 dt, const RHS& f)
+  {
+    const CTYPE h = CTYPE(dt);
+    switch(opt_.scheme) {
+    case SSPRK1:
+      f(t,u,r_,CTYPE(0));
+      comb(u,CTYPE(1),u,CTYPE(0),u,h);
+      break;
+    case SSPRK2:
+      f(t,u,r_,CTYPE(0));
+      comb(u1_,CTYPE(1),u,CTYPE(0),u,h);
+      f(t+dt,u1_,r_,CTYPE(0));
+      comb(u,CTYPE(0.5),u,CTYPE(0.5),u1_,h);
+      break;
+    case SSPRK3:
+      f(t,u,r_,CTYPE(0));
+      comb(u1_,CTYPE(1),u,CTYPE(0),u,h);
+      f(t+dt,u1_,r_,CTYPE(0));
+      comb(u1_,CTYPE(0.75),u,CTYPE(0.25),u1_,h);
+      f(t+0.5*dt,u1_,r_,CTYPE(0));
+      comb(u,CTYPE(1.0/3.0),u,CTYPE(2.0/3.0),u1_,h);
+      break;
+    default: {
+      const xlsrk s = xlsrk::get(opt_.scheme);
+      for(s32 i=0;i<s.stages;++i) {
+        f(t+s.C[i]*dt,u,r_,CTYPE(s.A[i]));
+        comb(u,CTYPE(1),u,CTYPE(0),u,CTYPE(s.B[i]*dt));
+      }
+    }
+    }
+  }
+
+  // Steps from time t to tend, each of dt(speed(u),dx), the last one
+  // shortened to end at tend. obs(k,t,u) is called after step k, with t
+  // the time reached. Returns the no. of steps, with t = tend.
+  xtem(xtn RHS, xtn SPEED, xtn OBS)
+  s64 run(FIELD& u, f64& t, f64 tend, f64 dx, const RHS& f,
+          const SPEED& speed, const OBS& obs)
+  {
+    s64 k = 0;
+    while(t < tend) {
+      f64 h = dt(f64(speed(u)),dx);
+      const bool last = t + h >= tend;
+      if(last) h = tend - t;
+      step(u,t,h,f);
+      t = last ? tend : t + h;
+      obs(++k,t,u);
+    }
+    return k;
+  }
+
+  xtem(xtn RHS, xtn SPEED)
+  s64 run(FIELD& u, f64& t, f64 tend, f64 dx, const RHS& f,
+          const SPEED& speed)
+  {
+    return run(u,t,tend,dx,f,speed,[](s64,f64,const FIELD&) {});
+  }
+
+private:
+  // out = a*x + b*(y + h*r), element by element in CTYPE, out may be x
+  // or y
+  void comb(FIELD& out, CTYPE a, const FIELD& x, CTYPE b, const FIELD& y,
+            CTYPE h)
+  {
+    s64 rows, len, ld;
+    xfield_rows(out,rows,len,ld);
+    TYPE* o = out.data();
+    const TYPE* px = x.data();
+    const TYPE* py = y.data();
+    const TYPE* pr = r_.data();
+    for(s64 j=0;j<rows;++j) {
+      const s64 s = j*ld;
+      if(b == CTYPE(0))
+        for(s64 i=s;i<s+len;++i)
+          o[i] = PREC::store(a*PREC::load(px[i]) + h*PREC::load(pr[i]));
+      else
+        for(s64 i=s;i<s+len;++i)
+          o[i] = PREC::store(a*PREC::load(px[i]) +
+                             b*(PREC::load(py[i]) + h*PREC::load(pr[i])));
+    }
+  }
+
+  xrkopts opt_;
+  FIELD r_;    // Right hand side, or the 2N register of LSRK
+  FIELD u1_;   // Stage of SSPRK2/3
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Small matrices
+///////////////////////////////////////////////////////////////////////////////
+//---------------------------------------------------------------------------//
+// Determinants, inverses and solutions of linear systems of 2*2, 3*3 and
+// 4*4 matrices, in closed form (cofactors), without pivoting.
+// xdet<N>, xinv<N> and xsolve<N> work on one row major matrix of scalars,
+// or of packs, which is W matrices at once.
+// xbatchdet<N>, xbatchinv<N> and xbatchsolve<N> work on many matrices in
+// structure of arrays storage : every entry of the matrices is an array,
+// so a pack loads the same entry of W neighbouring matrices.
+//---------------------------------------------------------------------------//
+// Storage of n matrices, with entry (r,c) of matrix k (all 0 based) at
+// a[(r*N+c)*lda + k], so lda >= n, and of n vectors, with entry r of
+// vector k at b[r*ldb + k]. As a 2D array, ARR2(f64) a(N*N,n) has entry
+// (r,c) of matrix k at a(r*N+c+1,k).
+//---------------------------------------------------------------------------//
+// NOTE : Singular matrices give infinite or NaN results, as there is no
+// pivoting. The cofactors are accurate for well conditioned matrices,
+// like the Jacobians of mesh cells, but use an LU with pivoting for
+// badly conditioned ones.
+//---------------------------------------------------------------------------//
+// USE : Jacobian determinants and inverses of the cells of a mesh
+// >> ARR2(f64) J(9,ncells), Jinv(9,ncells);
+// >> ARR(f64) detJ(1,ncells);
+// >> ...                                   // J(3*r+c+1,k) = dx_r/dxi_c
+// >> xbatchinv<3>(J,Jinv,detJ);
+//---------------------------------------------------------------------------//
+// USE : One matrix
+// >> f64 a[4] = {4.0,1.0,
+// >>             2.0,3.0}, b[2] = {1.0,2.0}, x[2];
+// >> f64 d = xdet<2>(a);                    // 10.0
+// >> xsolve<2>(a,b,x);                      // x = {0.1,0.6}
+//---------------------------------------------------------------------------//
+xtem(szt N) struct xsmallmat;
+
+xtem() struct xsmallmat<2>
+{
+  xtem(xtn T) static constexpr T det(const T* a)
+  {
+    return xdet2x2(a[0],a[1],a[2],a[3]);
+  }
+  xtem(xtn T) static XCONSTEXPR14 T inv(const T* a, T* r)
+  {
+    const T d = det(a), id = T(1)/d;
+    r[0] = a[3]*id;  r[1] = -a[1]*id;
+    r[2] = -a[2]*id; r[3] = a[0]*id;
+    return d;
+  }
+};
+
+xtem() struct xsmallmat<3>
+{
+  xtem(xtn T) static constexpr T det(const T* a)
+  {
+    return xdet3x3(a[0],a[1],a[2],a[3],a[4],a[5],a[6],a[7],a[8]);
+  }
+  xtem(xtn T) static XCONSTEXPR14 T inv(const T* a, T* r)
+  {
+    // Cofactors of the first row give the determinant
+    const T c0 = a[4]*a[8]-a[5]*a[7];
+    const T c1 = a[5]*a[6]-a[3]*a[8];
+    const T c2 = a[3]*a[7]-a[4]*a[6];
+    const T d = a[0]*c0+a[1]*c1+a[2]*c2, id = T(1)/d;
+    r[0] = c0*id; r[1] = (a[2]*a[7]-a[1]*a[8])*id;
+    r[2] = (a[1]*a[5]-a[2]*a[4])*id;
+    r[3] = c1*id; r[4] = (a[0]*a[8]-a[2]*a[6])*id;
+    r[5] = (a[2]*a[3]-a[0]*a[5])*id;
+    r[6] = c2*id; r[7] = (a[1]*a[6]-a[0]*a[7])*id;
+    r[8] = (a[0]*a[4]-a[1]*a[3])*id;
+    return d;
+  }
+};
+
+xtem() struct xsmallmat<4>
+{
+  // 2*2 minors of the top rows (s) and of the bottom rows (c)
+  xtem(xtn T) static XCONSTEXPR14 void minors(const T* a, T* s, T* c)
+  {
+    s[0] = a[0]*a[5]-a[4]*a[1];    s[1] = a[0]*a[6]-a[4]*a[2];
+    s[2] = a[0]*a[7]-a[4]*a[3];    s[3] = a[1]*a[6]-a[5]*a[2];
+    s[4] = a[1]*a[7]-a[5]*a[3];    s[5] = a[2]*a[7]-a[6]*a[3];
+    c[0] = a[8]*a[13]-a[12]*a[9];  c[1] = a[8]*a[14]-a[12]*a[10];
+    c[2] = a[8]*a[15]-a[12]*a[11]; c[3] = a[9]*a[14]-a[13]*a[10];
+    c[4] = a[9]*a[15]-a[13]*a[11]; c[5] = a[10]*a[15]-a[14]*a[11];
+  }
+  xtem(xtn T) static XCONSTEXPR14 T det(const T* a)
+  {
+    T s[6] = {}, c[6] = {};
+    minors(a,s,c);
+    return s[0]*c[5]-s[1]*c[4]+s[2]*c[3]+s[3]*c[2]-s[4]*c[1]+s[5]*c[0];
+  }
+  xtem(xtn T) static XCONSTEXPR14 T inv(const T* a, T* r)
+  {
+    T s[6] = {}, c[6] = {};
+    minors(a,s,c);
+    const T d = s[0]*c[5]-s[1]*c[4]+s[2]*c[3]+s[3]*c[2]-s[4]*c[1]+s[5]*c[0];
+    const T id = T(1)/d;
+    r[0]  = ( a[5]*c[5] -a[6]*c[4] +a[7]*c[3])*id;
+    r[1]  = (-a[1]*c[5] +a[2]*c[4] -a[3]*c[3])*id;
+    r[2]  = ( a[13]*s[5]-a[14]*s[4]+a[15]*s[3])*id;
+    r[3]  = (-a[9]*s[5] +a[10]*s[4]-a[11]*s[3])*id;
+    r[4]  = (-a[4]*c[5] +a[6]*c[2] -a[7]*c[1])*id;
+    r[5]  = ( a[0]*c[5] -a[2]*c[2] +a[3]*c[1])*id;
+    r[6]  = (-a[12]*s[5]+a[14]*s[2]-a[15]*s[1])*id;
+    r[7]  = ( a[8]*s[5] -a[10]*s[2]+a[11]*s[1])*id;
+    r[8]  = ( a[4]*c[4] -a[5]*c[2] +a[7]*c[0])*id;
+    r[9]  = (-a[0]*c[4] +a[1]*c[2] -a[3]*c[0])*id;
+    r[10] = ( a[12]*s[4]-a[13]*s[2]+a[15]*s[0])*id;
+    r[11] = (-a[8]*s[4] +a[9]*s[2] -a[11]*s[0])*id;
+    r[12] = (-a[4]*c[3] +a[5]*c[1] -a[6]*c[0])*id;
+    r[13] = ( a[0]*c[3] -a[1]*c[1] +a[2]*c[0])*id;
+    r[14] = (-a[12]*s[3]+a[13]*s[1]-a[14]*s[0])*id;
+    r[15] = ( a[8]*s[3] -a[9]*s[1] +a[10]*s[0])*id;
+    return d;
+  }
+};
+
+// Determinant of the N*N row major matrix a
+xtem(szt N, xtn T) XCONSTEXPR14
+T xdet(const T* a)
+{
+  return xsmallmat<N>::det(a);
+}
+
+// Inverse r of the N*N row major matrix a, returns the determinant of a
+xtem(szt N, xtn T) XCONSTEXPR14
+T xinv(const T* a, T* r)
+{
+  return xsmallmat<N>::inv(a,r);
+}
+
+// Solution x of a*x = b, for the N*N row major matrix a
+xtem(szt N, xtn T) inline
+void xsolve(const T* a, const T* b, T* x)
+{
+  T r[N*N];
+  xsmallmat<N>::inv(a,r);
+  XUNROLL for(szt i=0;i<N;++i) {
+    T s = r[i*N]*b[0];
+    XUNROLL for(szt j=1;j<N;++j) s += r[i*N+j]*b[j];
+    x[i] = s;
+  }
+}
+
+//---------------------------------------------------------------------------//
+// The same for n matrices in structure of arrays storage, a pack of
+// matrices at a time. The loops over the entries are unrolled, as -O2
+// keeps them as loops, which sends every pack through the stack.
+//---------------------------------------------------------------------------//
+xtem(szt N, xtn TYPE) XSIMD_CLONES
+void xbatchdet(s64 n, const TYPE* a, s64 lda, TYPE* det)
+{
+  typedef xkpack<TYPE> pack;
+  const s64 w = pack::width;
+  pack pa[N*N];
+  TYPE sa[N*N];
+  s64 k = 0;
+  for(;k+w<=n;k+=w) {
+    XUNROLL for(szt e=0;e<N*N;++e) pa[e] = pack::loadu(a+e*lda+k);
+    xdet<N>(pa).storeu(det+k);
+  }
+  for(;k<n;++k) {
+    XUNROLL for(szt e=0;e<N*N;++e) sa[e] = a[e*lda+k];
+    det[k] = xdet<N>(sa);
+  }
+}
+
+// Inverses, and the determinants if det is not 0
+xtem(szt N, xtn TYPE) XSIMD_CLONES
+void xbatchinv(s64 n, const TYPE* a, s64 lda, TYPE* r, s64 ldr,
+               TYPE* det = 0)
+{
+  typedef xkpack<TYPE> pack;
+  const s64 w = pack::width;
+  pack pa[N*N], pr[N*N];
+  TYPE sa[N*N], sr[N*N];
+  s64 k = 0;
+  for(;k+w<=n;k+=w) {
+    XUNROLL for(szt e=0;e<N*N;++e) pa[e] = pack::loadu(a+e*lda+k);
+    pack d = xinv<N>(pa,pr);
+    XUNROLL for(szt e=0;e<N*N;++e) pr[e].storeu(r+e*ldr+k);
+    if(det) d.storeu(det+k);
+  }
+  for(;k<n;++k) {
+    XUNROLL for(szt e=0;e<N*N;++e) sa[e] = a[e*lda+k];
+    TYPE d = xinv<N>(sa,sr);
+    XUNROLL for(szt e=0;e<N*N;++e) r[e*ldr+k] = sr[e];
+    if(det) det[k] = d;
+  }
+}
+
+// Solutions of a*x = b
+xtem(szt N, xtn TYPE) XSIMD_CLONES
+void xbatchsolve(s64 n, const TYPE* a, s64 lda, const TYPE* b, s64 ldb,
+                 TYPE* x, s64 ldx)
+{
+  typedef xkpack<TYPE> pack;
+  const s64 w = pack::width;
+  pack pa[N*N], pb[N], px[N];
+  TYPE sa[N*N], sb[N], sx[N];
+  s64 k = 0;
+  for(;k+w<=n;k+=w) {
+    XUNROLL for(szt e=0;e<N*N;++e) pa[e] = pack::loadu(a+e*lda+k);
+    XUNROLL for(szt i=0;i<N;++i) pb[i] = pack::loadu(b+i*ldb+k);
+    xsolve<N>(pa,pb,px);
+    XUNROLL for(szt i=0;i<N;++i) px[i].storeu(x+i*ldx+k);
+  }
+  for(;k<n;++k) {
+    XUNROLL for(szt e=0;e<N*N;++e) sa[e] = a[e*lda+k];
+    XUNROLL for(szt i=0;i<N;++i) sb[i] = b[i*ldb+k];
+    xsolve<N>(sa,sb,sx);
+    XUNROLL for(szt i=0;i<N;++i) x[i*ldx+k] = sx[i];
+  }
+}
+
+//---------------------------------------------------------------------------//
+// The same with the matrices in 2D arrays a(N*N,n), and the vectors in
+// 2D arrays b(N,n), or 1D arrays for n determinants
+//---------------------------------------------------------------------------//
+xtem(szt N, xtn TYPE) inline
+void xbatchdet(const xarraynd<TYPE,2,ROWMAJOR>& a, xarray<TYPE>& det)
+{
+  ASSERT(a.size(0) == s64(N*N) && det.size() == a.size(1),
+         "xbatchdet needs a(N*N,n) and det(n)");
+  xbatchdet<N>(a.size(1),a.data(),a.stride(0),det.data());
+}
+
+xtem(szt N, xtn TYPE) inline
+void xbatchinv(const xarraynd<TYPE,2,ROWMAJOR>& a,
+               xarraynd<TYPE,2,ROWMAJOR>& r)
+{
+  ASSERT(a.size(0) == s64(N*N) && r.size(0) == a.size(0) &&
+         r.size(1) == a.size(1),"xbatchinv needs a(N*N,n) and r(N*N,n)");
+  xbatchinv<N>(a.size(1),a.data(),a.stride(0),r.data(),r.stride(0));
+}
+
+xtem(szt N, xtn TYPE) inline
+void xbatchinv(const xarraynd<TYPE,2,ROWMAJOR>& a,
+               xarraynd<TYPE,2,ROWMAJOR>& r, xarray<TYPE>& det)
+{
+  ASSERT(a.size(0) == s64(N*N) && r.size(0) == a.size(0) &&
+         r.size(1) == a.size(1) && det.size() == a.size(1),
+         "xbatchinv needs a(N*N,n), r(N*N,n) and det(n)");
+  xbatchinv<N>(a.size(1),a.data(),a.stride(0),r.data(),r.stride(0),
+               det.data());
+}
+
+xtem(szt N, xtn TYPE) inline
+void xbatchsolve(const xarraynd<TYPE,2,ROWMAJOR>& a,
+                 const xarraynd<TYPE,2,ROWMAJOR>& b,
+                 xarraynd<TYPE,2,ROWMAJOR>& x)
+{
+  ASSERT(a.size(0) == s64(N*N) && b.size(0) == s64(N) &&
+         x.size(0) == s64(N) && b.size(1) == a.size(1) &&
+         x.size(1) == a.size(1),
+         "xbatchsolve needs a(N*N,n), b(N,n) and x(N,n)");
+  xbatchsolve<N>(a.size(1),a.data(),a.stride(0),b.data(),b.stride(0),
+                 x.data(),x.stride(0));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Small vectors and matrices
+///////////////////////////////////////////////////////////////////////////////
+//---------------------------------------------------------------------------//
+// Vectors xsvec<TYPE,N> and row major matrices xsmat<TYPE,M,N> of compile
+// time size, for the geometry and the algebra of a cell or a face : normals,
+// areas, Jacobians, flux Jacobians. They are plain values, which the
+// compiler keeps in registers, and every operation is a loop of compile
+// time length that is unrolled, so a kernel using them is straight code.
+// Indices are 0 based, v[i] and m(i,j), and the elements are the array e.
+// + Operations : + - (element wise), * / by scalars, m*v, m*m, xdot,
+//   xcross, xnorm, xnorm2, xouter, xtranspose, xtrace, xdet, xinv, xsolve
+// + Element wise xsq and xabs, and DBG, DBGVEC and DBGARR2 print them
+//---------------------------------------------------------------------------//
+// NOTE : All operations are constexpr with -std=c++14 or later (see
+// XCONSTEXPR14), and with C++11 only the constructors and the read access
+// are. xnorm is never constexpr, as std::sqrt is not.
+// xdet, xinv and xsolve are for N = 2, 3 and 4 (see "Small matrices").
+//---------------------------------------------------------------------------//
+// USE : Area and unit normal of a triangle
+// >> sv3f64 a(0.0,0.0,0.0), b(1.0,0.0,0.0), c(0.0,1.0,0.0);
+// >> sv3f64 n = xcross(b-a,c-a);
+// >> f64 area = 0.5*xnorm(n);          // 0.5
+// >> n /= xnorm(n);                    // (0,0,1)
+// >> DBG(n);
+//---------------------------------------------------------------------------//
+// USE : Jacobian of a 2D quad cell, and the gradient in physical space
+// >> sm2f64 J(dxdxi,dxdeta,
+// >>          dydxi,dydeta);
+// >> f64 detJ = xdet(J);
+// >> sv2f64 gradx = xtranspose(xinv(J))*gradxi;
+//---------------------------------------------------------------------------//
+// USE : At compile time, with -std=c++14
+// >> constexpr sm3f64 R(0.0,-1.0,0.0,
+// >>                    1.0, 0.0,0.0,
+// >>                    0.0, 0.0,1.0);
+// >> static_assert(xdet(R) == 1.0,"R is a rotation");
+//---------------------------------------------------------------------------//
+// Are all of ARGS convertible to TYPE ?
+xtem(xtn TYPE, xtn... ARGS) struct xallconv;
+xtem(xtn TYPE) struct xallconv<TYPE> : std::true_type {};
+xtem(xtn TYPE, xtn HEAD, xtn... TAIL) struct xallconv<TYPE,HEAD,TAIL...>
+  : std::integral_constant<bool,
+      std::is_convertible<HEAD,TYPE>::value &&
+      xallconv<TYPE,TAIL...>::value> {};
+
+xtem(xtn TYPE, szt N)
+struct xsvec
+{
+  static_assert(N >= 1,"Vectors have at least 1 element");
+  typedef TYPE value_type;
+  static constexpr szt count = N;
+  TYPE e[N];
+
+  // Zero vector
+  constexpr xsvec() : e{} {}
+
+  // The N elements
+  xtem(xtn... ARGS, xtn = xtn std::enable_if<sizeof...(ARGS) == N &&
+                          xallconv<TYPE,ARGS...>::value>::type)
+  constexpr xsvec(ARGS... args) : e{TYPE(args)...} {}
+
+  // All elements set to x
+  static XCONSTEXPR14 xsvec all(TYPE x)
+  {
+    xsvec r;
+    XUNROLL for(szt i=0;i<N;++i) r.e[i] = x;
+    return r;
+  }
+
+  static constexpr szt size() { return N; }
+  constexpr const TYPE& operator[](szt i) const { return e[i]; }
+  XCONSTEXPR14 TYPE& operator[](szt i) { return e[i]; }
+  TYPE* data() { return e; }
+  const TYPE* data() const { return e; }
+};
+
+xtem(xtn TYPE, szt M, szt N)
+struct xsmat
+{
+  static_assert(M >= 1 && N >= 1,"Matrices have at least 1 element");
+  typedef TYPE value_type;
+  static constexpr szt count = M*N;
+  TYPE e[M*N];
+
+  // Zero matrix
+  constexpr xsmat() : e{} {}
+
+  // The M*N elements, row by row
+  xtem(xtn... ARGS, xtn = xtn std::enable_if<sizeof...(ARGS) == M*N &&
+                          xallconv<TYPE,ARGS...>::value>::type)
+  constexpr xsmat(ARGS... args) : e{TYPE(args)...} {}
+
+  static XCONSTEXPR14 xsmat identity()
+  {
+    static_assert(M == N,"The identity is square");
+    xsmat r;
+    XUNROLL for(szt i=0;i<N;++i) r.e[i*N+i] = TYPE(1);
+    return r;
+  }
+
+  static constexpr szt rows() { return M; }
+  static constexpr szt cols() { return N; }
+  constexpr const TYPE& operator()(szt i, szt j) const { return e[i*N+j]; }
+  XCONSTEXPR14 TYPE& operator()(szt i, szt j) { return e[i*N+j]; }
+  TYPE* data() { return e; }
+  const TYPE* data() const { return e; }
+
+  // Row i and column j
+  XCONSTEXPR14 xsvec<TYPE,N> row(szt i) const
+  {
+    xsvec<TYPE,N> r;
+    XUNROLL for(szt j=0;j<N;++j) r.e[j] = e[i*N+j];
+    return r;
+  }
+  XCONSTEXPR14 xsvec<TYPE,M> col(szt j) const
+  {
+    xsvec<TYPE,M> r;
+    XUNROLL for(szt i=0;i<M;++i) r.e[i] = e[i*N+j];
+    return r;
+  }
+};
+
+//---------------------------------------------------------------------------//
+// Element wise operations, the same for vectors and matrices S, on their
+// elements e[0] to e[S::count-1]
+//---------------------------------------------------------------------------//
+// R if S is a small vector or matrix (see xissmall)
+xtem(xtn S, xtn R = S) struct xifsmall : std::enable_if<xissmall<S>::value,R>
+{};
+
+xtem(xtn S) XCONSTEXPR14
+xtn xifsmall<S>::type operator+(const S& x, const S& y)
+{
+  S r;
+  XUNROLL for(szt k=0;k<S::count;++k) r.e[k] = x.e[k]+y.e[k];
+  return r;
+}
+
+xtem(xtn S) XCONSTEXPR14
+xtn xifsmall<S>::type operator-(const S& x, const S& y)
+{
+  S r;
+  XUNROLL for(szt k=0;k<S::count;++k) r.e[k] = x.e[k]-y.e[k];
+  return r;
+}
+
+xtem(xtn S) XCONSTEXPR14
+xtn xifsmall<S>::type operator-(const S& x)
+{
+  S r;
+  XUNROLL for(szt k=0;k<S::count;++k) r.e[k] = -x.e[k];
+  return r;
+}
+
+xtem(xtn S) XCONSTEXPR14
+xtn xifsmall<S>::type operator*(const S& x, const xtn S::value_type& s)
+{
+  S r;
+  XUNROLL for(szt k=0;k<S::count;++k) r.e[k] = x.e[k]*s;
+  return r;
+}
+
+xtem(xtn S) XCONSTEXPR14
+xtn xifsmall<S>::type operator*(const xtn S::value_type& s, const S& x)
+{
+  return x*s;
+}
+
+xtem(xtn S) XCONSTEXPR14
+xtn xifsmall<S>::type operator/(const S& x, const xtn S::value_type& s)
+{
+  S r;
+  XUNROLL for(szt k=0;k<S::count;++k) r.e[k] = x.e[k]/s;
+  return r;
+}
+
+xtem(xtn S) XCONSTEXPR14
+xtn xifsmall<S,S&>::type operator+=(S& x, const S& y) { return x = x+y; }
+xtem(xtn S) XCONSTEXPR14
+xtn xifsmall<S,S&>::type operator-=(S& x, const S& y) { return x = x-y; }
+xtem(xtn S) XCONSTEXPR14
+xtn xifsmall<S,S&>::type operator*=(S& x, const xtn S::value_type& s)
+{
+  return x = x*s;
+}
+xtem(xtn S) XCONSTEXPR14
+xtn xifsmall<S,S&>::type operator/=(S& x, const xtn S::value_type& s)
+{
+  return x = x/s;
+}
+
+xtem(xtn S) XCONSTEXPR14
+xtn xifsmall<S,bool>::type operator==(const S& x, const S& y)
+{
+  XUNROLL for(szt k=0;k<S::count;++k) if(!(x.e[k] == y.e[k])) return false;
+  return true;
+}
+
+xtem(xtn S) XCONSTEXPR14
+xtn xifsmall<S,bool>::type operator!=(const S& x, const S& y)
+{
+  return !(x == y);
+}
+
+// Squares and absolute values of the elements
+xtem(xtn S) XCONSTEXPR14
+xtn xifsmall<S>::type xsq(const S& x)
+{
+  S r;
+  XUNROLL for(szt k=0;k<S::count;++k) r.e[k] = x.e[k]*x.e[k];
+  return r;
+}
+
+// |x| like std::abs, with +0 for -0, but constexpr
+xtem(xtn S) XCONSTEXPR14
+xtn xifsmall<S>::type xabs(const S& x)
+{
+  typedef xtn S::value_type TYPE;
+  S r;
+  XUNROLL for(szt k=0;k<S::count;++k)
+    r.e[k] = x.e[k] == TYPE(0) ? TYPE(0) : x.e[k] < 0 ? -x.e[k] : x.e[k];
+  return r;
+}
+
+//---------------------------------------------------------------------------//
+// Vector algebra
+//---------------------------------------------------------------------------//
+xtem(xtn TYPE, szt N) XCONSTEXPR14
+TYPE xdot(const xsvec<TYPE,N>& x, const xsvec<TYPE,N>& y)
+{
+  TYPE s = x.e[0]*y.e[0];
+  XUNROLL for(szt i=1;i<N;++i) s += x.e[i]*y.e[i];
+  return s;
+}
+
+// Square of the length, and the length
+xtem(xtn TYPE, szt N) XCONSTEXPR14
+TYPE xnorm2(const xsvec<TYPE,N>& x)
+{
+  return xdot(x,x);
+}
+xtem(xtn TYPE, szt N) inline
+TYPE xnorm(const xsvec<TYPE,N>& x)
+{
+  return std::sqrt(xdot(x,x));
+}
+
+// Cross product, and its z component for 2D vectors
+xtem(xtn TYPE) constexpr
+xsvec<TYPE,3> xcross(const xsvec<TYPE,3>& x, const xsvec<TYPE,3>& y)
+{
+  return xsvec<TYPE,3>(x.e[1]*y.e[2]-x.e[2]*y.e[1],
+                       x.e[2]*y.e[0]-x.e[0]*y.e[2],
+                       x.e[0]*y.e[1]-x.e[1]*y.e[0]);
+}
+xtem(xtn TYPE) constexpr
+TYPE xcross(const xsvec<TYPE,2>& x, const xsvec<TYPE,2>& y)
+{
+  return xdet2x2(x.e[0],x.e[1],y.e[0],y.e[1]);
+}
+
+// Outer product, r(i,j) = x[i]*y[j]
+xtem(xtn TYPE, szt M, szt N) XCONSTEXPR14
+xsmat<TYPE,M,N> xouter(const xsvec<TYPE,M>& x, const xsvec<TYPE,N>& y)
+{
+  xsmat<TYPE,M,N> r;
+  XUNROLL for(szt i=0;i<M;++i)
+    XUNROLL for(szt j=0;j<N;++j) r.e[i*N+j] = x.e[i]*y.e[j];
+  return r;
+}
+
+//---------------------------------------------------------------------------//
+// Matrix algebra
+//---------------------------------------------------------------------------//
+xtem(xtn TYPE, szt M, szt N) XCONSTEXPR14
+xsvec<TYPE,M> operator*(const xsmat<TYPE,M,N>& m, const xsvec<TYPE,N>& x)
+{
+  xsvec<TYPE,M> r;
+  XUNROLL for(szt i=0;i<M;++i) {
+    TYPE s = m.e[i*N]*x.e[0];
+    XUNROLL for(szt j=1;j<N;++j) s += m.e[i*N+j]*x.e[j];
+    r.e[i] = s;
+  }
+  return r;
+}
+
+xtem(xtn TYPE, szt M, szt K, szt N) XCONSTEXPR14
+xsmat<TYPE,M,N> operator*(const xsmat<TYPE,M,K>& x,
+                          const xsmat<TYPE,K,N>& y)
+{
+  xsmat<TYPE,M,N> r;
+  XUNROLL for(szt i=0;i<M;++i)
+    XUNROLL for(szt j=0;j<N;++j) {
+      TYPE s = x.e[i*K]*y.e[j];
+      XUNROLL for(szt k=1;k<K;++k) s += x.e[i*K+k]*y.e[k*N+j];
+      r.e[i*N+j] = s;
+    }
+  return r;
+}
+
+xtem(xtn TYPE, szt M, szt N) XCONSTEXPR14
+xsmat<TYPE,N,M> xtranspose(const xsmat<TYPE,M,N>& m)
+{
+  xsmat<TYPE,N,M> r;
+  XUNROLL for(szt i=0;i<M;++i)
+    XUNROLL for(szt j=0;j<N;++j) r.e[j*M+i] = m.e[i*N+j];
+  return r;
+}
+
+xtem(xtn TYPE, szt N) XCONSTEXPR14
+TYPE xtrace(const xsmat<TYPE,N,N>& m)
+{
+  TYPE s = m.e[0];
+  XUNROLL for(szt i=1;i<N;++i) s += m.e[i*N+i];
+  return s;
+}
+
+// Determinant, inverse and solution of m*x = b, by cofactors
+xtem(xtn TYPE, szt N) XCONSTEXPR14
+TYPE xdet(const xsmat<TYPE,N,N>& m)
+{
+  return xsmallmat<N>::det(m.e);
+}
+
+xtem(xtn TYPE, szt N) XCONSTEXPR14
+xsmat<TYPE,N,N> xinv(const xsmat<TYPE,N,N>& m)
+{
+  xsmat<TYPE,N,N> r;
+  xsmallmat<N>::inv(m.e,r.e);
+  return r;
+}
+
+xtem(xtn TYPE, szt N) XCONSTEXPR14
+xsvec<TYPE,N> xsolve(const xsmat<TYPE,N,N>& m, const xsvec<TYPE,N>& b)
+{
+  return xinv(m)*b;
+}
+
+//---------------------------------------------------------------------------//
+// Printing, as [x,y,z] and [[a,b],[c,d]], and the bounds for DBGVEC
+//---------------------------------------------------------------------------//
+xtem(xtn TYPE, szt N)
+std::ostream& operator<<(std::ostream& os, const xsvec<TYPE,N>& x)
+{
+  os<<"[";
+  for(szt i=0;i<N;++i) os<<(i ? "," : "")<<x.e[i];
+  return os<<"]";
+}
+
+xtem(xtn TYPE, szt M, szt N)
+std::ostream& operator<<(std::ostream& os, const xsmat<TYPE,M,N>& m)
+{
+  os<<"[";
+  for(szt i=0;i<M;++i) os<<(i ? "," : "")<<m.row(i);
+  return os<<"]";
+}
+
+xtem(xtn TYPE, szt N) inline s64 xlbound(const xsvec<TYPE,N>&) { return 0; }
+xtem(xtn TYPE, szt N) inline s64 xubound(const xsvec<TYPE,N>&)
+{
+  return s64(N)-1;
+}
+
+// Row by row, for DBGARR2
+xtem(xtn TYPE, szt M, szt N)
+void xprintnd(std::ostream& os, const xstr& name, const xsmat<TYPE,M,N>& m)
+{
+  os<<name;
+  for(szt i=0;i<M;++i) {
+    os<<"\t:\t[";
+    for(szt j=0;j<N;++j) os<<(j ? "," : "")<<m(i,j);
+    os<<"]"<<nl;
+  }
+}
+
+//---------------------------------------------------------------------------//
+// Commonly used small vector and matrix types
+//---------------------------------------------------------------------------//
+typedef xsvec<f64,2>   sv2f64;
+typedef xsvec<f64,3>   sv3f64;
+typedef xsvec<f64,4>   sv4f64;
+typedef xsvec<f32,2>   sv2f32;
+typedef xsvec<f32,3>   sv3f32;
+typedef xsvec<f32,4>   sv4f32;
+typedef xsmat<f64,2,2> sm2f64;
+typedef xsmat<f64,3,3> sm3f64;
+typedef xsmat<f64,4,4> sm4f64;
+typedef xsmat<f32,2,2> sm2f32;
+typedef xsmat<f32,3,3> sm3f32;
+typedef xsmat<f32,4,4> sm4f32;
+
+///////////////////////////////////////////////////////////////////////////////
+// Banded solvers
+///////////////////////////////////////////////////////////////////////////////
+//---------------------------------------------------------------------------//
+// Direct solvers of tridiagonal and banded systems, for implicit schemes
+// solved line by line (ADI, line relaxation, implicit diffusion in 1D).
+// All of them work in place, without pivoting, so the matrices should be
+// diagonally dominant, like the matrices of implicit schemes are.
+// + xtridiag : the Thomas algorithm, for many systems at once
+// + xtridiag_cyclic : the same for periodic systems (Sherman-Morrison)
+// + xbanded<KL,KU> : KL diagonals below and KU above the main one,
+//   pentadiagonal for xbanded<2,2>
+// + xtridiag_spike : one very long system, in parallel (SPIKE)
+//---------------------------------------------------------------------------//
+// Storage of m systems of n unknowns, interleaved : row i (0 based) of
+// system k is at d[i*ld + k], so ld >= m, and a pack loads the same row of
+// W neighbouring systems. A 2D array ARR2(f64) d(n,m) is this layout with
+// ld = d.stride(0), and its columns are the systems : for a field T(nx,ny),
+// the lines along x are interleaved, and solved all at once.
+// Row i of a tridiagonal system is a[i]*x[i-1] + b[i]*x[i] + c[i]*x[i+1]
+// = d[i], so a[0] and c[n-1] are not used, except by the periodic systems,
+// where they are the corners : x[-1] is x[n-1] and x[n] is x[0].
+// The solution overwrites d, and c is overwritten by the elimination, while
+// a and b are kept, so only c has to be rebuilt for the next solve.
+//---------------------------------------------------------------------------//
+// NOTE : The lines of the contiguous dimension (y of T(nx,ny)) are not
+// interleaved, transpose them first, or use xtridiag_spike for each.
+//---------------------------------------------------------------------------//
+// USE : Implicit diffusion along x of T(nx,ny), r = nu*dt/dx^2
+// >> ARR2(f64) a(nx,ny), b(nx,ny), c(nx,ny), T(nx,ny);
+// >> a.fill(-r); b.fill(1.0+2.0*r); c.fill(-r);
+// >> ...                                   // Boundary rows
+// >> xtridiag(a,b,c,T);                    // T is T at time n+1
+//---------------------------------------------------------------------------//
+// USE : Pentadiagonal, diagonal j = -2 to 2 in band(j+3,i,k)
+// >> xarraynd<f64,3> band(5,nx,ny);
+// >> ...
+// >> xbanded<2,2>(band,T);
+//---------------------------------------------------------------------------//
+
+// Systems per thread below which the batched solvers run serially
+#define XBANDED_MIN_ROWS 32768
+
+//---------------------------------------------------------------------------//
+// Kernels for the W systems of a pack P, rows ld elements apart.
+// P is xpack<TYPE,1> for one system.
+//---------------------------------------------------------------------------//
+xtem(xtn P, xtn TYPE) inline
+void xtridiag_lanes(s64 n, s64 ld, const TYPE* a, const TYPE* b, TYPE* c,
+                    TYPE* d)
+{
+  const P one(TYPE(1));
+  P id = one/P::loadu(b);
+  P cp = P::loadu(c)*id, dp = P::loadu(d)*id;
+  cp.storeu(c); dp.storeu(d);
+  for(s64 i=1;i<n;++i) {
+    const P ai = P::loadu(a+i*ld);
+    id = one/(P::loadu(b+i*ld) - ai*cp);
+    dp = (P::loadu(d+i*ld) - ai*dp)*id;
+    dp.storeu(d+i*ld);
+    if(i < n-1) {
+      cp = P::loadu(c+i*ld)*id;
+      cp.storeu(c+i*ld);
+    }
+  }
+  for(s64 i=n-2;i>=0;--i) {
+    dp = P::loadu(d+i*ld) - P::loadu(c+i*ld)*dp;
+    dp.storeu(d+i*ld);
+  }
+}
+
+// Periodic systems. With g = -b[0], A = T + u*v', for u = (g,0,...,0,
+// c[n-1]) and v = (1,0,...,0,a[0]/g), where T is tridiagonal with
+// b[0]-g and b[n-1]-a[0]*c[n-1]/g on the diagonal. T*y = d and T*z = u
+// share the elimination, and x = y - z*(v.y)/(1+v.z).
+// z holds n rows of the W systems, W elements apart.
+xtem(xtn P, xtn TYPE) inline
+void xtridiag_cyclic_lanes(s64 n, s64 ld, const TYPE* a, const TYPE* b,
+                           TYPE* c, TYPE* d, TYPE* z)
+{
+  const s64 w = P::width;
+  const P one(TYPE(1));
+  const P a0 = P::loadu(a), cn = P::loadu(c+(n-1)*ld);
+  const P g = P(TYPE(0)) - P::loadu(b), ag = a0/g;
+  P id = one/(P::loadu(b) - g);
+  P cp = P::loadu(c)*id, dp = P::loadu(d)*id, zp = g*id;
+  cp.storeu(c); dp.storeu(d); zp.storeu(z);
+  for(s64 i=1;i<n;++i) {
+    const P ai = P::loadu(a+i*ld);
+    P bi = P::loadu(b+i*ld);
+    P ui(TYPE(0));
+    if(i == n-1) { bi = bi - ag*cn; ui = cn; }
+    id = one/(bi - ai*cp);
+    dp = (P::loadu(d+i*ld) - ai*dp)*id;
+    zp = (ui - ai*zp)*id;
+    dp.storeu(d+i*ld); zp.storeu(z+i*w);
+    if(i < n-1) {
+      cp = P::loadu(c+i*ld)*id;
+      cp.storeu(c+i*ld);
+    }
+  }
+  for(s64 i=n-2;i>=0;--i) {
+    const P ci = P::loadu(c+i*ld);
+    dp = P::loadu(d+i*ld) - ci*dp;
+    zp = P::loadu(z+i*w) - ci*zp;
+    dp.storeu(d+i*ld); zp.storeu(z+i*w);
+  }
+  const P y0 = P::loadu(d), yn = P::loadu(d+(n-1)*ld);
+  const P z0 = P::loadu(z), zn = P::loadu(z+(n-1)*w);
+  const P f = (y0 + ag*yn)/(one + z0 + ag*zn);
+  for(s64 i=0;i<n;++i)
+    (P::loadu(d+i*ld) - f*P::loadu(z+i*w)).storeu(d+i*ld);
+}
+
+// Banded systems, diagonal j (-KL to KU) of row i at band[(j+KL)*ldb+i*ld],
+// by Gaussian elimination, which leaves L and U in band
+xtem(szt KL, szt KU, xtn P, xtn TYPE) inline
+void xbanded_lanes(s64 n, s64 ld, TYPE* band, s64 ldb, TYPE* d)
+{
+  const s64 kl = KL, ku = KU;
+  auto at = [&](s64 j, s64 i) { return band+(j+kl)*ldb+i*ld; };
+  for(s64 i=0;i<n;++i) {
+    const P id = P(TYPE(1))/P::loadu(at(0,i));
+    const P di = P::loadu(d+i*ld);
+    for(s64 r=1;r<=kl && i+r<n;++r) {
+      const P l = P::loadu(at(-r,i+r))*id;
+      l.storeu(at(-r,i+r));
+      for(s64 q=1;q<=ku && i+q<n;++q)
+        (P::loadu(at(q-r,i+r)) - l*P::loadu(at(q,i))).storeu(at(q-r,i+r));
+      (P::loadu(d+(i+r)*ld) - l*di).storeu(d+(i+r)*ld);
+    }
+  }
+  for(s64 i=n-1;i>=0;--i) {
+    P s = P::loadu(d+i*ld);
+    for(s64 q=1;q<=ku && i+q<n;++q)
+      s = s - P::loadu(at(q,i))*P::loadu(d+(i+q)*ld);
+    (s/P::loadu(at(0,i))).storeu(d+i*ld);
+  }
+}
+
+//---------------------------------------------------------------------------//
+// Systems k0 to k1-1, in packs and one by one for the rest
+//---------------------------------------------------------------------------//
+xtem(xtn TYPE) XSIMD_CLONES
+void xtridiag_range(s64 n, s64 k0, s64 k1, const TYPE* a, const TYPE* b,
+                    TYPE* c, TYPE* d, s64 ld)
+{
+  typedef xkpack<TYPE> pack;
+  const s64 w = pack::width;
+  s64 k = k0;
+  for(;k+w<=k1;k+=w) xtridiag_lanes<pack>(n,ld,a+k,b+k,c+k,d+k);
+  for(;k<k1;++k) xtridiag_lanes<xpack<TYPE,1> >(n,ld,a+k,b+k,c+k,d+k);
+}
+
+xtem(xtn TYPE) XSIMD_CLONES
+void xtridiag_cyclic_range(s64 n, s64 k0, s64 k1, const TYPE* a,
+                           const TYPE* b, TYPE* c, TYPE* d, s64 ld)
+{
+  typedef xkpack<TYPE> pack;
+  const s64 w = pack::width;
+  xscratchscope ws;
+  TYPE* z = ws.alloc<TYPE>(n*w);
+  s64 k = k0;
+  for(;k+w<=k1;k+=w)
+    xtridiag_cyclic_lanes<pack>(n,ld,a+k,b+k,c+k,d+k,z);
+  for(;k<k1;++k)
+    xtridiag_cyclic_lanes<xpack<TYPE,1> >(n,ld,a+k,b+k,c+k,d+k,z);
+}
+
+xtem(szt KL, szt KU, xtn TYPE) XSIMD_CLONES
+void xbanded_range(s64 n, s64 k0, s64 k1, TYPE* band, s64 ldb, TYPE* d,
+                   s64 ld)
+{
+  typedef xkpack<TYPE> pack;
+  const s64 w = pack::width;
+  s64 k = k0;
+  for(;k+w<=k1;k+=w) xbanded_lanes<KL,KU,pack>(n,ld,band+k,ldb,d+k);
+  for(;k<k1;++k) xbanded_lanes<KL,KU,xpack<TYPE,1> >(n,ld,band+k,ldb,d+k);
+}
+
+// Runs F(k0,k1) for the m systems, split in blocks of whole packs over the
+// threads of xpool() if there are enough rows to share
+xtem(xtn TYPE, xtn F)
+void xbanded_split(s64 n, s64 m, const F& f)
+{
+  const s64 w = xkpack<TYPE>::width;
+  xthreadpool& pool = xpool();
+  const s64 nt = std::min<s64>(pool.size(),(m+w-1)/w);
+  if(nt <= 1 || n*m < nt*XBANDED_MIN_ROWS) {
+    f(0,m);
+    return;
+  }
+  const s64 np = (m+w-1)/w;
+  pool.run([&](szt t) {
+    const s64 p0 = np*s64(t)/nt, p1 = np*(s64(t)+1)/nt;
+    if(p0 < p1) f(p0*w,std::min(m,p1*w));
+  });
+}
+
+//---------------------------------------------------------------------------//
+// m tridiagonal systems of n unknowns (n >= 2), interleaved
+//---------------------------------------------------------------------------//
+xtem(xtn TYPE)
+void xtridiag(s64 n, s64 m, const TYPE* a, const TYPE* b, TYPE* c, TYPE* d,
+              s64 ld)
+{
+  ASSERT(n >= 2 && ld >= m,"xtridiag needs n >= 2 and ld >= m");
+  xbanded_split<TYPE>(n,m,[&](s64 k0, s64 k1) {
+    xtridiag_range(n,k0,k1,a,b,c,d,ld); });
+}
+
+// m periodic tridiagonal systems of n unknowns (n >= 3), interleaved
+xtem(xtn TYPE)
+void xtridiag_cyclic(s64 n, s64 m, const TYPE* a, const TYPE* b, TYPE* c,
+                     TYPE* d, s64 ld)
+{
+  ASSERT(n >= 3 && ld >= m,"xtridiag_cyclic needs n >= 3 and ld >= m");
+  xbanded_split<TYPE>(n,m,[&](s64 k0, s64 k1) {
+    xtridiag_cyclic_range(n,k0,k1,a,b,c,d,ld); });
+}
+
+// m banded systems of n unknowns, interleaved, with diagonal j (-KL to KU)
+// of row i of system k at band[((j+KL)*n + i)*ld + k]
+xtem(szt KL, szt KU, xtn TYPE)
+void xbanded(s64 n, s64 m, TYPE* band, TYPE* d, s64 ld)
+{
+  ASSERT(n >= 1 && ld >= m,"xbanded needs n >= 1 and ld >= m");
+  xbanded_split<TYPE>(n,m,[&](s64 k0, s64 k1) {
+    xbanded_range<KL,KU>(n,k0,k1,band,n*ld,d,ld); });
+}
+
+//---------------------------------------------------------------------------//
+// One tridiagonal system of n unknowns, in parallel : the threads solve
+// their block of rows for d, and for the couplings a[s] and c[e] with the
+// blocks around it (the spikes v and w), then the 2*(nt-1) unknowns at the
+// block ends are solved as a pentadiagonal system, and the blocks updated.
+// NOTE : Does about 2.5 times the flops of xtridiag, so it pays for more
+// than 2 or 3 threads, for systems too long for the caches.
+//---------------------------------------------------------------------------//
+xtem(xtn TYPE)
+void xtridiag_spike(s64 n, const TYPE* a, const TYPE* b, TYPE* c, TYPE* d)
+{
+  typedef xpack<TYPE,1> one;
+  xthreadpool& pool = xpool();
+  const s64 nt = std::min<s64>(pool.size(),n/XBANDED_MIN_ROWS);
+  if(nt <= 1) {
+    xtridiag_lanes<one>(n,1,a,b,c,d);
+    return;
+  }
+  xscratchscope ws;
+  TYPE* v = ws.alloc<TYPE>(n);
+  TYPE* w = ws.alloc<TYPE>(n);
+  auto first = [&](s64 t) { return n*t/nt; };
+  // Blocks with d, v and w in one elimination
+  pool.run([&](szt t) {
+    if(s64(t) >= nt) return;
+    const s64 s = first(t), e = first(t+1)-1;
+    const TYPE ce = c[e];
+    TYPE id = TYPE(1)/b[s];
+    d[s] *= id;
+    v[s] = t > 0 ? a[s]*id : TYPE(0);
+    w[s] = (s == e && s64(t) < nt-1) ? ce*id : TYPE(0);
+    c[s] *= id;
+    for(s64 i=s+1;i<=e;++i) {
+      id = TYPE(1)/(b[i] - a[i]*c[i-1]);
+      d[i] = (d[i] - a[i]*d[i-1])*id;
+      v[i] = -a[i]*v[i-1]*id;
+      w[i] = ((i == e && s64(t) < nt-1 ? ce : TYPE(0)) - a[i]*w[i-1])*id;
+      if(i < e) c[i] *= id;
+    }
+    for(s64 i=e-1;i>=s;--i) {
+      d[i] -= c[i]*d[i+1];
+      v[i] -= c[i]*v[i+1];
+      w[i] -= c[i]*w[i+1];
+    }
+  });
+  // Unknowns e(t) at 2t and s(t+1) at 2t+1, for t = 0 to nt-2
+  const s64 nr = 2*(nt-1);
+  TYPE* band = ws.alloc<TYPE>(5*nr);
+  TYPE* x = ws.alloc<TYPE>(nr);
+  std::fill(band,band+5*nr,TYPE(0));
+  auto at = [&](s64 j, s64 r) -> TYPE& { return band[(j+2)*nr+r]; };
+  for(s64 t=0;t<nt-1;++t) {
+    const s64 e = first(t+1)-1, s = e+1;
+    at(0,2*t) = TYPE(1); at(1,2*t) = w[e]; x[2*t] = d[e];
+    if(t > 0) at(-2,2*t) = v[e];
+    at(0,2*t+1) = TYPE(1); at(-1,2*t+1) = v[s]; x[2*t+1] = d[s];
+    if(t < nt-2) at(2,2*t+1) = w[s];
+  }
+  xbanded_lanes<2,2,one>(nr,1,band,nr,x);
+  // x = y - v*x[e(t-1)] - w*x[s(t+1)]
+  pool.run([&](szt t) {
+    if(s64(t) >= nt) return;
+    const s64 s = first(t), e = first(t+1)-1;
+    const TYPE xl = t > 0 ? x[2*t-2] : TYPE(0);
+    const TYPE xr = s64(t) < nt-1 ? x[2*t+1] : TYPE(0);
+    for(s64 i=s;i<=e;++i) d[i] -= v[i]*xl + w[i]*xr;
+  });
+}
+
+//---------------------------------------------------------------------------//
+// The same for arrays : 1D arrays for one system, 2D arrays (n,m) for m
+// systems, and band(KL+KU+1,n,m) for the banded systems
+//---------------------------------------------------------------------------//
+xtem(xtn TYPE) inline
+void xtridiag(const xarray<TYPE>& a, const xarray<TYPE>& b, xarray<TYPE>& c,
+              xarray<TYPE>& d)
+{
+  ASSERT(a.size() == d.size() && b.size() == d.size() &&
+         c.size() == d.size(),"xtridiag needs a, b, c and d of n");
+  xtridiag(d.size(),1,a.data(),b.data(),c.data(),d.data(),1);
+}
+
+xtem(xtn TYPE) inline
+void xtridiag(const xarraynd<TYPE,2,ROWMAJOR>& a,
+              const xarraynd<TYPE,2,ROWMAJOR>& b,
+              xarraynd<TYPE,2,ROWMAJOR>& c, xarraynd<TYPE,2,ROWMAJOR>& d)
+{
+  ASSERT(a.stride(0) == d.stride(0) && b.stride(0) == d.stride(0) &&
+         c.stride(0) == d.stride(0) && a.size(0) == d.size(0) &&
+         a.size(1) == d.size(1),"xtridiag needs a, b, c and d of (n,m)");
+  xtridiag(d.size(0),d.size(1),a.data(),b.data(),c.data(),d.data(),
+           d.stride(0));
+}
+
+xtem(xtn TYPE) inline
+void xtridiag_cyclic(const xarray<TYPE>& a, const xarray<TYPE>& b,
+                     xarray<TYPE>& c, xarray<TYPE>& d)
+{
+  ASSERT(a.size() == d.size() && b.size() == d.size() &&
+         c.size() == d.size(),"xtridiag_cyclic needs a, b, c and d of n");
+  xtridiag_cyclic(d.size(),1,a.data(),b.data(),c.data(),d.data(),1);
+}
+
+xtem(xtn TYPE) inline
+void xtridiag_cyclic(const xarraynd<TYPE,2,ROWMAJOR>& a,
+                     const xarraynd<TYPE,2,ROWMAJOR>& b,
+                     xarraynd<TYPE,2,ROWMAJOR>& c,
+                     xarraynd<TYPE,2,ROWMAJOR>& d)
+{
+  ASSERT(a.stride(0) == d.stride(0) && b.stride(0) == d.stride(0) &&
+         c.stride(0) == d.stride(0) && a.size(0) == d.size(0) &&
+         a.size(1) == d.size(1),
+         "xtridiag_cyclic needs a, b, c and d of (n,m)");
+  xtridiag_cyclic(d.size(0),d.size(1),a.data(),b.data(),c.data(),d.data(),
+                  d.stride(0));
+}
+
+xtem(szt KL, szt KU, xtn TYPE) inline
+void xbanded(xarraynd<TYPE,3,ROWMAJOR>& band, xarraynd<TYPE,2,ROWMAJOR>& d)
+{
+  ASSERT(band.size(0) == s64(KL+KU+1) && band.size(1) == d.size(0) &&
+         band.size(2) == d.size(1) && band.stride(1) == d.stride(0),
+         "xbanded needs band(KL+KU+1,n,m) and d(n,m)");
+  xbanded_split<TYPE>(d.size(0),d.size(1),[&](s64 k0, s64 k1) {
+    xbanded_range<KL,KU>(d.size(0),k0,k1,band.data(),band.stride(0),
+                         d.data(),d.stride(0)); });
+}
+
+xtem(xtn TYPE) inline
+void xtridiag_spike(const xarray<TYPE>& a, const xarray<TYPE>& b,
+                    xarray<TYPE>& c, xarray<TYPE>& d)
+{
+  ASSERT(a.size() == d.size() && b.size() == d.size() &&
+         c.size() == d.size(),"xtridiag_spike needs a, b, c and d of n");
+  xtridiag_spike(d.size(),a.data(),b.data(),c.data(),d.data());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Sparse matrices
+///////////////////////////////////////////////////////////////////////////////
+//---------------------------------------------------------------------------//
+// Sparse matrices for implicit schemes, and Krylov solvers for them.
+// + xcoo  : Entries (i,j,value) added in any order, duplicates are summed
+// + xcsr  : Compressed sparse rows, built from an xcoo. When the entries
+//           of every time step are added in the same order, update()
+//           refills the values without sorting again.
+// + xbsr  : Block sparse rows of dense B*B blocks, built from an xcsr, for
+//           systems of B equations per cell. Products are B*B at a time.
+// + xspmv : y = A*x, in parallel with the threads of xpool(), which get
+//           rows with about the same no. of entries.
+// + xcg, xbicgstab, xgmres : Krylov solvers of A*x = b, with the
+//           preconditioners xnoprec, xjacobi and xilu0. xjacobi takes an
+//           xcsr or an xbsr, xilu0 only an xcsr : for an xbsr, factor the
+//           xcsr it was built from, as the solvers take A and M apart.
+// Rows and columns have the bounds of the vectors, like FORTRAN, so
+// xcoo<f64> c(1,nx) is for the arrays ARR(f64) x(1,nx).
+//---------------------------------------------------------------------------//
+// USE : Implicit (backward Euler) upwind steps of the nonlinear convection,
+// linearized with u at time n, stable for any dt
+// >> xcoo<f64> c(1,nx);
+// >> xcsr<f64> A;
+// >> DO(t,1,nt)
+// >>   c.clear();
+// >>   c.add(1,1,1.0);
+// >>   DO(i,2,nx)
+// >>     f64 s = dt/dx*u.n()[i];
+// >>     c.add(i,i-1,-s); c.add(i,i,1.0+s);
+// >>   ENDDO
+// >>   IF(t == 1) A.assemble(c); ELSE A.update(c); ENDIF
+// >>   xilu0<f64> M(A);
+// >>   xkrylovinfo info = xbicgstab(A,u.n(),u.np1(),M);
+// >>   ASSERT(info.converged,"No convergence, residual "<<info.resid);
+// >>   u.advance();
+// >> ENDDO
+//---------------------------------------------------------------------------//
+// USE : Options of the solvers
+// >> xkrylovopts opt;
+// >> opt.tol = 1e-10; opt.maxit = 500; opt.restart = 50;
+// >> xkrylovinfo info = xgmres(A,b,x,xjacobi<f64>(A),opt);
+// >> cout<<info.iters<<" iterations, residual "<<info.resid<<endl;
+//---------------------------------------------------------------------------//
+// USE : An xbsr with ILU(0) of its xcsr
+// >> xbsr<f64,3> A3(A);
+// >> xkrylovinfo info = xbicgstab(A3,b,x,xilu0<f64>(A));
+//---------------------------------------------------------------------------//
+// NOTE : Column indices are stored in 32 bits, which allows 2^31 columns
+// and makes xspmv move 12 bytes per entry of f64 instead of 16.
+// NOTE : xspmv of an xcsr is a scalar loop, with 2 sums to overlap the
+// loads of x. It is bound by the 12 bytes per entry, and the rows of
+// stencils are about as short as a pack, so gathering x by packs measured
+// no faster with SSE2 nor with AVX-512. The B*B products of xbsr load x
+// once per block and are unrolled, and are the way to more flops per byte.
+//---------------------------------------------------------------------------//
+// Entries of a sparse matrix, in any order
+xtem(xtn TYPE)
+class xcoo
+{
+public:
+  // Matrix with rows and columns lo:hi
+  xcoo(s64 lo, s64 hi) : rlo_(lo), clo_(lo), nr_(hi-lo+1), nc_(hi-lo+1) {}
+
+  // Matrix with rows rlo:rhi and columns clo:chi
+  xcoo(s64 rlo, s64 rhi, s64 clo, s64 chi)
+    : rlo_(rlo), clo_(clo), nr_(rhi-rlo+1), nc_(chi-clo+1) {}
+
+  // Add v to entry (i,j)
+  void add(s64 i, s64 j, const TYPE& v)
+  {
+    ASSERT(i >= rlo_ && i < rlo_+nr_ && j >= clo_ && j < clo_+nc_,
+           "xcoo entry ("<<i<<","<<j<<") out of bounds");
+    i_.push_back(static_cast<s32>(i-rlo_));
+    j_.push_back(static_cast<s32>(j-clo_));
+    v_.push_back(v);
+  }
+
+  // Remove the entries, keeping the memory for the next ones
+  void clear() { i_.clear(); j_.clear(); v_.clear(); }
+
+  void reserve(s64 n) { i_.reserve(n); j_.reserve(n); v_.reserve(n); }
+
+  s64 size() const { return v_.size(); }
+  s64 rows() const { return nr_; }
+  s64 cols() const { return nc_; }
+  s64 rlbound() const { return rlo_; }
+  s64 clbound() const { return clo_; }
+
+  // Entry k, with 0 based row and column
+  s32 row(s64 k) const { return i_[k]; }
+  s32 col(s64 k) const { return j_[k]; }
+  const TYPE& value(s64 k) const { return v_[k]; }
+
+private:
+  s64 rlo_, clo_, nr_, nc_;
+  std::vector<s32> i_, j_;
+  std::vector<TYPE> v_;
+};
+
+//---------------------------------------------------------------------------//
+// Rows of the threads, split[t] to split[t+1]-1 for thread t, with about
+// the same no. of entries, from the row pointers ptr of n rows
+//---------------------------------------------------------------------------//
+inline void xnnzsplit(const s64* ptr, s64 n, szt nt, std::vector<s64>& split)
+{
+  split.resize(nt+1);
+  split[0] = 0;
+  for(szt t=1;t<nt;++t) {
+    const s64 target = ptr[0] + (ptr[n]-ptr[0])*s64(t)/s64(nt);
+    split[t] = std::lower_bound(ptr,ptr+n,target)-ptr;
+  }
+  split[nt] = n;
+}
+
+//---------------------------------------------------------------------------//
+// Compressed sparse rows, with 0 based rows r and columns c internally.
+// The entries of row r are at ptr[r] to ptr[r+1]-1, sorted by column.
+//---------------------------------------------------------------------------//
+xtem(xtn TYPE)
+class xcsr
+{
+public:
+  typedef TYPE value_type;
+
+  xcsr() : rlo_(1), clo_(1), nr_(0), nc_(0), ptr_(1,0) {}
+
+  explicit xcsr(const xcoo<TYPE>& c) { assemble(c); }
+
+  // Pattern and values from the entries of c
+  void assemble(const xcoo<TYPE>& c)
+  {
+    rlo_ = c.rlbound(); clo_ = c.clbound();
+    nr_ = c.rows(); nc_ = c.cols();
+    const s64 n = c.size();
+    // Entries by row, then sorted by column within each row
+    ptr_.assign(nr_+1,0);
+    for(s64 k=0;k<n;++k) ptr_[c.row(k)+1]++;
+    for(s64 r=0;r<nr_;++r) ptr_[r+1] += ptr_[r];
+    std::vector<s64> at(ptr_.begin(),ptr_.end()-1), perm(n);
+    for(s64 k=0;k<n;++k) perm[at[c.row(k)]++] = k;
+    // Merge the duplicates, and remember where every entry went
+    map_.resize(n);
+    col_.clear(); val_.clear();
+    col_.reserve(n); val_.reserve(n);
+    s64 start = 0;
+    for(s64 r=0;r<nr_;++r) {
+      const s64 end = ptr_[r+1];
+      std::sort(perm.begin()+start,perm.begin()+end,
+                [&](s64 a, s64 b) { return c.col(a) < c.col(b); });
+      ptr_[r] = col_.size();
+      for(s64 q=start;q<end;++q) {
+        const s64 k = perm[q];
+        if(q == start || c.col(k) != col_.back()) {
+          col_.push_back(c.col(k));
+          val_.push_back(TYPE(0));
+        }
+        val_.back() += c.value(k);
+        map_[k] = val_.size()-1;
+      }
+      start = end;
+    }
+    ptr_[nr_] = col_.size();
+    split_.clear();
+  }
+
+  // New values from entries added in the same order as those assembled,
+  // without changing the pattern. Assembles again if their no. differs.
+  void update(const xcoo<TYPE>& c)
+  {
+    if(c.size() != s64(map_.size()) || c.rows() != nr_ || c.cols() != nc_) {
+      assemble(c);
+      return;
+    }
+    zero();
+    for(s64 k=0;k<c.size();++k) val_[map_[k]] += c.value(k);
+  }
+
+  // Set all values to 0, keeping the pattern
+  void zero() { std::fill(val_.begin(),val_.end(),TYPE(0)); }
+
+  // Position of entry (i,j) in values(), -1 if not in the pattern
+  s64 find(s64 i, s64 j) const
+  {
+    const s64 r = i-rlo_;
+    const s32 cc = static_cast<s32>(j-clo_);
+    const s32* b = col_.data()+ptr_[r];
+    const s32* e = col_.data()+ptr_[r+1];
+    const s32* p = std::lower_bound(b,e,cc);
+    return (p != e && *p == cc) ? p-col_.data() : -1;
+  }
+
+  // Add v to entry (i,j), which must be in the pattern
+  void add(s64 i, s64 j, const TYPE& v)
+  {
+    const s64 k = find(i,j);
+    ASSERT(k >= 0,"xcsr entry ("<<i<<","<<j<<") not in the pattern");
+    val_[k] += v;
+  }
+
+  // Entry (i,j), 0 if not in the pattern
+  TYPE operator()(s64 i, s64 j) const
+  {
+    const s64 k = find(i,j);
+    return k >= 0 ? val_[k] : TYPE(0);
+  }
+
+  s64 rows() const { return nr_; }
+  s64 cols() const { return nc_; }
+  s64 nnz() const { return val_.size(); }
+  s64 rlbound() const { return rlo_; }
+  s64 clbound() const { return clo_; }
+
+  const s64* rowptr() const { return ptr_.data(); }
+  const s32* colind() const { return col_.data(); }
+  const TYPE* values() const { return val_.data(); }
+  TYPE* values() { return val_.data(); }
+
+  // Rows of every thread of NT threads, see xnnzsplit
+  const std::vector<s64>& split(szt nt) const
+  {
+    if(split_.size() != nt+1) xnnzsplit(ptr_.data(),nr_,nt,split_);
+    return split_;
+  }
+
+private:
+  s64 rlo_, clo_, nr_, nc_;
+  std::vector<s64> ptr_;
+  std::vector<s32> col_;
+  std::vector<TYPE> val_;
+  std::vector<s64> map_;              // Entry k of the xcoo is val_[map_[k]]
+  mutable std::vector<s64> split_;
+};
+
+//---------------------------------------------------------------------------//
+// Block sparse rows of dense B*B blocks, stored row major, block k at
+// values()+k*B*B. Rows and columns are block rows and columns internally.
+//---------------------------------------------------------------------------//
+xtem(xtn TYPE, szt B)
+class xbsr
+{
+public:
+  typedef TYPE value_type;
+  static constexpr szt block = B;
+
+  xbsr() : rlo_(1), clo_(1), nbr_(0), nbc_(0), ptr_(1,0) {}
+
+  // From a matrix whose rows and columns are multiples of B. Every block
+  // with an entry in the pattern of a is stored whole.
+  explicit xbsr(const xcsr<TYPE>& a) { assign(a); }
+
+  void assign(const xcsr<TYPE>& a)
+  {
+    ASSERT(a.rows() % s64(B) == 0 && a.cols() % s64(B) == 0,
+           "xbsr of a matrix whose size is not a multiple of "<<B);
+    rlo_ = a.rlbound(); clo_ = a.clbound();
+    nbr_ = a.rows()/B; nbc_ = a.cols()/B;
+    const s64* p = a.rowptr();
+    const s32* c = a.colind();
+    const TYPE* v = a.values();
+    val_.clear();
+    // Block columns of every block row
+    std::vector<s64> slot(nbc_,-1);
+    ptr_.assign(nbr_+1,0);
+    col_.clear();
+    for(s64 br=0;br<nbr_;++br) {
+      const s64 first = col_.size();
+      for(s64 r=br*B;r<(br+1)*s64(B);++r)
+        for(s64 k=p[r];k<p[r+1];++k)
+          if(slot[c[k]/B] < 0) {
+            slot[c[k]/B] = 0;
+            col_.push_back(c[k]/B);
+          }
+      std::sort(col_.begin()+first,col_.end());
+      for(s64 q=first;q<nnzb();++q) slot[col_[q]] = q;
+      ptr_[br+1] = col_.size();
+      // Values, and the slots cleared for the next block row
+      val_.resize(col_.size()*B*B,TYPE(0));
+      for(s64 r=br*B;r<(br+1)*s64(B);++r)
+        for(s64 k=p[r];k<p[r+1];++k)
+          val_[slot[c[k]/B]*B*B + (r-br*B)*B + c[k]%B] = v[k];
+      for(s64 q=first;q<nnzb();++q) slot[col_[q]] = -1;
+    }
+    split_.clear();
+  }
+
+  s64 rows() const { return nbr_*B; }
+  s64 cols() const { return nbc_*B; }
+  s64 brows() const { return nbr_; }
+  s64 nnzb() const { return col_.size(); }
+  s64 rlbound() const { return rlo_; }
+  s64 clbound() const { return clo_; }
+
+  const s64* rowptr() const { return ptr_.data(); }
+  const s32* colind() const { return col_.data(); }
+  const TYPE* values() const { return val_.data(); }
+  TYPE* values() { return val_.data(); }
+
+  const std::vector<s64>& split(szt nt) const
+  {
+    if(split_.size() != nt+1) xnnzsplit(ptr_.data(),nbr_,nt,split_);
+    return split_;
+  }
+
+private:
+  s64 rlo_, clo_, nbr_, nbc_;
+  std::vector<s64> ptr_;
+  std::vector<s32> col_;
+  std::vector<TYPE> val_;
+  mutable std::vector<s64> split_;
+};
+
+//---------------------------------------------------------------------------//
+// y = A*x for rows r0 to r1-1, x and y 0 based
+//---------------------------------------------------------------------------//
+xtem(xtn TYPE)
+void xspmv_rows(const xcsr<TYPE>& A, s64 r0, s64 r1,
+                const TYPE* __restrict x, TYPE* __restrict y)
+{
+  const s64* p = A.rowptr();
+  const s32* c = A.colind();
+  const TYPE* v = A.values();
+  for(s64 r=r0;r<r1;++r) {
+    // 2 sums, to overlap the latencies of the loads of x
+    TYPE s0 = TYPE(0), s1 = TYPE(0);
+    s64 k = p[r];
+    const s64 e = p[r+1];
+    for(;k+1<e;k+=2) { s0 += v[k]*x[c[k]]; s1 += v[k+1]*x[c[k+1]]; }
+    if(k < e) s0 += v[k]*x[c[k]];
+    y[r] = s0+s1;
+  }
+}
+
+xtem(xtn TYPE, szt B)
+void xspmv_rows(const xbsr<TYPE,B>& A, s64 r0, s64 r1,
+                const TYPE* __restrict x, TYPE* __restrict y)
+{
+  const s64* p = A.rowptr();
+  const s32* c = A.colind();
+  const TYPE* v = A.values();
+  for(s64 br=r0;br<r1;++br) {
+    TYPE s[B];
+    for(szt i=0;i<B;++i) s[i] = TYPE(0);
+    for(s64 k=p[br];k<p[br+1];++k) {
+      const TYPE* blk = v+k*B*B;
+      const TYPE* xb = x+s64(c[k])*B;
+      XUNROLL for(szt i=0;i<B;++i)
+        XUNROLL for(szt j=0;j<B;++j) s[i] += blk[i*B+j]*xb[j];
+    }
+    for(szt i=0;i<B;++i) y[br*B+i] = s[i];
+  }
+}
+
+// Entries per thread below which xspmv is not worth running in parallel
+#define XSPMV_MIN_NNZ 32768
+
+// No. of rows of row pointers, block rows for xbsr
+xtem(xtn TYPE) inline s64 xspmv_nrows(const xcsr<TYPE>& A)
+{
+  return A.rows();
+}
+xtem(xtn TYPE, szt B) inline s64 xspmv_nrows(const xbsr<TYPE,B>& A)
+{
+  return A.brows();
+}
+
+//---------------------------------------------------------------------------//
+// y = A*x, for x and y of A.cols() and A.rows() elements
+//---------------------------------------------------------------------------//
+xtem(xtn MATRIX, xtn TYPE)
+void xspmv(const MATRIX& A, const TYPE* x, TYPE* y)
+{
+  const s64 nrows = xspmv_nrows(A);
+  xthreadpool& pool = xpool();
+  const szt nt = pool.size();
+  if(nt == 1 || A.rowptr()[nrows] < s64(nt)*XSPMV_MIN_NNZ) {
+    xspmv_rows(A,0,nrows,x,y);
+    return;
+  }
+  const std::vector<s64>& sp = A.split(nt);
+  pool.run([&](szt t) { xspmv_rows(A,sp[t],sp[t+1],x,y); });
+}
+
+xtem(xtn MATRIX, xtn TYPE)
+void xspmv(const MATRIX& A, const xarray<TYPE>& x, xarray<TYPE>& y)
+{
+  ASSERT(x.size() == A.cols() && y.size() == A.rows(),
+         "xspmv sizes : A "<<A.rows()<<"*"<<A.cols()<<", x "<<x.size()
+         <<", y "<<y.size());
+  xspmv(A,x.data(),y.data());
+}
+
+//---------------------------------------------------------------------------//
+// Preconditioners : z = M^-1 * r, for r and z of n elements
+//---------------------------------------------------------------------------//
+// None
+xtem(xtn TYPE)
+struct xnoprec
+{
+  xnoprec() : n(0) {}
+  xtem(xtn MATRIX) explicit xnoprec(const MATRIX& A) : n(A.rows()) {}
+  void operator()(const TYPE* r, TYPE* z) const
+  {
+    std::copy(r,r+n,z);
+  }
+  s64 n;
+};
+
+// Inverse of the diagonal
+xtem(xtn TYPE)
+class xjacobi
+{
+public:
+  explicit xjacobi(const xcsr<TYPE>& A) : d_(A.rows())
+  {
+    for(s64 r=0;r<A.rows();++r) {
+      const s64 k = A.find(r+A.rlbound(),r+A.clbound());
+      ASSERT(k >= 0 && A.values()[k] != TYPE(0),"xjacobi : zero diagonal");
+      d_[r] = (k >= 0 && A.values()[k] != TYPE(0)) ?
+              TYPE(1)/A.values()[k] : TYPE(1);
+    }
+  }
+  // The same with the diagonals of the diagonal blocks
+  xtem(szt B) explicit xjacobi(const xbsr<TYPE,B>& A) : d_(A.rows())
+  {
+    const s64* p = A.rowptr();
+    const s32* c = A.colind();
+    for(s64 br=0;br<A.brows();++br) {
+      const s32* q = std::lower_bound(c+p[br],c+p[br+1],s32(br));
+      const bool diag = q != c+p[br+1] && *q == br;
+      for(szt i=0;i<B;++i) {
+        const TYPE a = diag ? A.values()[(q-c)*B*B+i*B+i] : TYPE(0);
+        ASSERT(a != TYPE(0),"xjacobi : zero diagonal");
+        d_[br*B+i] = a != TYPE(0) ? TYPE(1)/a : TYPE(1);
+      }
+    }
+  }
+  void operator()(const TYPE* r, TYPE* z) const
+  {
+    for(szt i=0;i<d_.size();++i) z[i] = d_[i]*r[i];
+  }
+private:
+  std::vector<TYPE> d_;
+};
+
+// Incomplete LU factorization with the pattern of A, L with a unit
+// diagonal and U stored together in the values of a copy of A.
+// NOTE : Every row needs its diagonal entry. good() is false if a pivot
+// is 0, and the pivot is then taken as 1.
+xtem(xtn TYPE)
+class xilu0
+{
+public:
+  explicit xilu0(const xcsr<TYPE>& A) : lu_(A), diag_(A.rows()), good_(true)
+  {
+    const s64 n = lu_.rows();
+    const s64* p = lu_.rowptr();
+    const s32* c = lu_.colind();
+    TYPE* v = lu_.values();
+    std::vector<s64> at(n,-1);      // Position of column j in row i
+    for(s64 i=0;i<n;++i) {
+      for(s64 k=p[i];k<p[i+1];++k) at[c[k]] = k;
+      diag_[i] = at[i];
+      ASSERT(diag_[i] >= p[i],"xilu0 : row "<<i<<" has no diagonal entry");
+      if(diag_[i] < p[i]) { good_ = false; diag_[i] = -1; }
+      // Eliminate the entries left of the diagonal, with the rows above
+      for(s64 k=p[i];k<p[i+1] && c[k]<i;++k) {
+        const s64 j = c[k];
+        if(diag_[j] < 0) continue;
+        v[k] /= v[diag_[j]];
+        for(s64 q=diag_[j]+1;q<p[j+1];++q)
+          if(at[c[q]] >= 0) v[at[c[q]]] -= v[k]*v[q];
+      }
+      if(diag_[i] >= 0 && v[diag_[i]] == TYPE(0)) {
+        good_ = false;
+        v[diag_[i]] = TYPE(1);
+      }
+      for(s64 k=p[i];k<p[i+1];++k) at[c[k]] = -1;
+    }
+  }
+
+  bool good() const { return good_; }
+
+  // z = U^-1 L^-1 r
+  void operator()(const TYPE* r, TYPE* z) const
+  {
+    const s64 n = lu_.rows();
+    const s64* p = lu_.rowptr();
+    const s32* c = lu_.colind();
+    const TYPE* v = lu_.values();
+    for(s64 i=0;i<n;++i) {
+      TYPE s = r[i];
+      for(s64 k=p[i];k<p[i+1] && c[k]<i;++k) s -= v[k]*z[c[k]];
+      z[i] = s;
+    }
+    for(s64 i=n-1;i>=0;--i) {
+      if(diag_[i] < 0) continue;
+      TYPE s = z[i];
+      for(s64 k=diag_[i]+1;k<p[i+1];++k) s -= v[k]*z[c[k]];
+      z[i] = s/v[diag_[i]];
+    }
+  }
+
+private:
+  xcsr<TYPE> lu_;
+  std::vector<s64> diag_;
+  bool good_;
+};
+
+//---------------------------------------------------------------------------//
+// Options and results of the Krylov solvers
+//---------------------------------------------------------------------------//
+struct xkrylovopts
+{
+  f64 tol;         // Relative residual |b-A*x|/|b| to reach
+  s64 maxit;       // Most iterations
+  s64 restart;     // Krylov vectors kept by GMRES before it restarts
+  xkrylovopts() : tol(1e-8), maxit(1000), restart(30) {}
+};
+
+struct xkrylovinfo
+{
+  bool converged;  // Was the tolerance reached ?
+  s64 iters;       // Iterations done
+  f64 resid;       // Relative residual |b-A*x|/|b| of the x returned
+};
+
+// Relative residual |b-A*x|/|b|, using r as work space
+xtem(xtn MATRIX, xtn TYPE)
+f64 xkrylov_resid(const MATRIX& A, const TYPE* b, const TYPE* x, TYPE* r,
+                  f64 bnorm)
+{
+  const s64 n = A.rows();
+  xspmv(A,x,r);
+  for(s64 i=0;i<n;++i) r[i] = b[i]-r[i];
+  return std::sqrt(f64(xdot(n,r,r)))/bnorm;
+}
+
+//---------------------------------------------------------------------------//
+// Conjugate gradients, for symmetric positive definite A and M.
+// x is the initial guess, and the solution on return.
+//---------------------------------------------------------------------------//
+xtem(xtn MATRIX, xtn TYPE, xtn PREC)
+xkrylovinfo xcg(const MATRIX& A, const xarray<TYPE>& b, xarray<TYPE>& x,
+                const PREC& M, const xkrylovopts& opt = xkrylovopts())
+{
+  ASSERT(A.rows() == A.cols() && b.size() == A.rows() &&
+         x.size() == A.rows(),"xcg sizes do not match");
+  const s64 n = A.rows();
+  xscratchscope ws;
+  const xarenaalloc<TYPE> al(ws.arena());
+  xscratchvec<TYPE> r(n,TYPE(0),al), z(n,TYPE(0),al), p(n,TYPE(0),al),
+                    q(n,TYPE(0),al);
+  TYPE* X = x.data();
+  xkrylovinfo info = {false,0,0.0};
+  f64 bn = std::sqrt(f64(xdot(b,b)));
+  if(bn == 0.0) { x = TYPE(0); info.converged = true; return info; }
+  f64 res = xkrylov_resid(A,b.data(),X,r.data(),bn);
+  M(r.data(),z.data());
+  p = z;
+  TYPE rz = xdot(n,r.data(),z.data());
+  while(res > opt.tol && info.iters < opt.maxit) {
+    info.iters++;
+    xspmv(A,p.data(),q.data());
+    const TYPE alpha = rz/xdot(n,p.data(),q.data());
+    xaxpy(n,alpha,p.data(),X);
+    xaxpy(n,-alpha,q.data(),r.data());
+    res = std::sqrt(f64(xdot(n,r.data(),r.data())))/bn;
+    M(r.data(),z.data());
+    const TYPE rz1 = xdot(n,r.data(),z.data());
+    const TYPE beta = rz1/rz;
+    rz = rz1;
+    for(s64 i=0;i<n;++i) p[i] = z[i]+beta*p[i];
+  }
+  info.resid = xkrylov_resid(A,b.data(),X,r.data(),bn);
+  info.converged = info.resid <= opt.tol;
+  return info;
+}
+
+//---------------------------------------------------------------------------//
+// Stabilized biconjugate gradients, for any nonsingular A, preconditioned
+// on the right
+//---------------------------------------------------------------------------//
+xtem(xtn MATRIX, xtn TYPE, xtn PREC)
+xkrylovinfo xbicgstab(const MATRIX& A, const xarray<TYPE>& b,
+                      xarray<TYPE>& x, const PREC& M,
+                      const xkrylovopts& opt = xkrylovopts())
+{
+  ASSERT(A.rows() == A.cols() && b.size() == A.rows() &&
+         x.size() == A.rows(),"xbicgstab sizes do not match");
+  const s64 n = A.rows();
+  xscratchscope ws;
+  const xarenaalloc<TYPE> al(ws.arena());
+  xscratchvec<TYPE> r(n,TYPE(0),al), rh(n,TYPE(0),al), p(n,TYPE(0),al),
+                    v(n,TYPE(0),al), s(n,TYPE(0),al), t(n,TYPE(0),al),
+                    ph(n,TYPE(0),al), sh(n,TYPE(0),al);
+  TYPE* X = x.data();
+  xkrylovinfo info = {false,0,0.0};
+  f64 bn = std::sqrt(f64(xdot(b,b)));
+  if(bn == 0.0) { x = TYPE(0); info.converged = true; return info; }
+  f64 res = xkrylov_resid(A,b.data(),X,r.data(),bn);
+  rh = r;
+  TYPE rho = TYPE(1), alpha = TYPE(1), omega = TYPE(1);
+  while(res > opt.tol && info.iters < opt.maxit) {
+    info.iters++;
+    const TYPE rho1 = xdot(n,rh.data(),r.data());
+    if(rho1 == TYPE(0)) break;
+    const TYPE beta = (rho1/rho)*(alpha/omega);
+    for(s64 i=0;i<n;++i) p[i] = r[i]+beta*(p[i]-omega*v[i]);
+    M(p.data(),ph.data());
+    xspmv(A,ph.data(),v.data());
+    alpha = rho1/xdot(n,rh.data(),v.data());
+    for(s64 i=0;i<n;++i) s[i] = r[i]-alpha*v[i];
+    if(std::sqrt(f64(xdot(n,s.data(),s.data())))/bn <= opt.tol) {
+      xaxpy(n,alpha,ph.data(),X);
+      break;
+    }
+    M(s.data(),sh.data());
+    xspmv(A,sh.data(),t.data());
+    const TYPE tt = xdot(n,t.data(),t.data());
+    omega = tt != TYPE(0) ? xdot(n,t.data(),s.data())/tt : TYPE(0);
+    for(s64 i=0;i<n;++i) {
+      X[i] += alpha*ph[i]+omega*sh[i];
+      r[i] = s[i]-omega*t[i];
+    }
+    res = std::sqrt(f64(xdot(n,r.data(),r.data())))/bn;
+    rho = rho1;
+    if(omega == TYPE(0)) break;
+  }
+  info.resid = xkrylov_resid(A,b.data(),X,r.data(),bn);
+  info.converged = info.resid <= opt.tol;
+  return info;
+}
+
+//---------------------------------------------------------------------------//
+// Restarted generalized minimal residuals, GMRES(opt.restart), for any
+// nonsingular A, preconditioned on the right, with modified Gram-Schmidt
+// and Givens rotations
+//---------------------------------------------------------------------------//
+xtem(xtn MATRIX, xtn TYPE, xtn PREC)
+xkrylovinfo xgmres(const MATRIX& A, const xarray<TYPE>& b, xarray<TYPE>& x,
+                   const PREC& M, const xkrylovopts& opt = xkrylovopts())
+{
+  ASSERT(A.rows() == A.cols() && b.size() == A.rows() &&
+         x.size() == A.rows(),"xgmres sizes do not match");
+  const s64 n = A.rows(), m = std::max<s64>(opt.restart,1);
+  xscratchscope ws;
+  const xarenaalloc<TYPE> al(ws.arena());
+  xscratchvec<TYPE> V((m+1)*n,TYPE(0),al), H((m+1)*m,TYPE(0),al),
+                    cs(m,TYPE(0),al), sn(m,TYPE(0),al), g(m+1,TYPE(0),al),
+                    y(m,TYPE(0),al), w(n,TYPE(0),al), z(n,TYPE(0),al);
+  TYPE* X = x.data();
+  xkrylovinfo info = {false,0,0.0};
+  f64 bn = std::sqrt(f64(xdot(b,b)));
+  if(bn == 0.0) { x = TYPE(0); info.converged = true; return info; }
+  f64 res = xkrylov_resid(A,b.data(),X,w.data(),bn);
+  while(res > opt.tol && info.iters < opt.maxit) {
+    // V_0 = r/|r|
+    const TYPE beta = TYPE(res*bn);
+    for(s64 i=0;i<n;++i) V[i] = w[i]/beta;
+    std::fill(g.begin(),g.end(),TYPE(0));
+    g[0] = beta;
+    s64 k = 0;
+    while(k < m && info.iters < opt.maxit) {
+      info.iters++;
+      TYPE* vk = &V[k*n];
+      TYPE* vk1 = &V[(k+1)*n];
+      M(vk,z.data());
+      xspmv(A,z.data(),vk1);
+      for(s64 j=0;j<=k;++j) {
+        const TYPE h = xdot(n,&V[j*n],vk1);
+        H[j*m+k] = h;
+        xaxpy(n,-h,&V[j*n],vk1);
+      }
+      const TYPE h1 = std::sqrt(xdot(n,vk1,vk1));
+      if(h1 != TYPE(0)) for(s64 i=0;i<n;++i) vk1[i] /= h1;
+      // Rotate the new column of H, and make the rotation of its last entry
+      for(s64 j=0;j<k;++j) {
+        const TYPE a = H[j*m+k], c = H[(j+1)*m+k];
+        H[j*m+k] = cs[j]*a+sn[j]*c;
+        H[(j+1)*m+k] = -sn[j]*a+cs[j]*c;
+      }
+      const TYPE d = std::sqrt(H[k*m+k]*H[k*m+k]+h1*h1);
+      cs[k] = d != TYPE(0) ? H[k*m+k]/d : TYPE(1);
+      sn[k] = d != TYPE(0) ? h1/d : TYPE(0);
+      H[k*m+k] = d;
+      g[k+1] = -sn[k]*g[k];
+      g[k] = cs[k]*g[k];
+      ++k;
+      res = std::abs(f64(g[k]))/bn;
+      if(res <= opt.tol || h1 == TYPE(0)) break;
+    }
+    // x += M^-1 V y, with H y = g
+    for(s64 j=k-1;j>=0;--j) {
+      TYPE s = g[j];
+      for(s64 q=j+1;q<k;++q) s -= H[j*m+q]*y[q];
+      y[j] = s/H[j*m+j];
+    }
+    std::fill(w.begin(),w.end(),TYPE(0));
+    for(s64 j=0;j<k;++j) xaxpy(n,y[j],&V[j*n],w.data());
+    M(w.data(),z.data());
+    xaxpy(n,TYPE(1),z.data(),X);
+    res = xkrylov_resid(A,b.data(),X,w.data(),bn);
+  }
+  info.resid = res;
+  info.converged = info.resid <= opt.tol;
+  return info;
+}
+
+// Without a preconditioner
+xtem(xtn MATRIX, xtn TYPE)
+xkrylovinfo xcg(const MATRIX& A, const xarray<TYPE>& b, xarray<TYPE>& x)
+{
+  return xcg(A,b,x,xnoprec<TYPE>(A));
+}
+xtem(xtn MATRIX, xtn TYPE)
+xkrylovinfo xbicgstab(const MATRIX& A, const xarray<TYPE>& b,
+                      xarray<TYPE>& x)
+{
+  return xbicgstab(A,b,x,xnoprec<TYPE>(A));
+}
+xtem(xtn MATRIX, xtn TYPE)
+xkrylovinfo xgmres(const MATRIX& A, const xarray<TYPE>& b, xarray<TYPE>& x)
+{
+  return xgmres(A,b,x,xnoprec<TYPE>(A));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Snapshots
+///////////////////////////////////////////////////////////////////////////////
+//---------------------------------------------------------------------------//
+// Binary snapshots of fields, for output during the time loop.
+// xsnapwriter copies the fields of a snapshot to a staging buffer and
+// returns, while a background thread writes the buffer to the file.
+// With 2 buffers (the default), the time loop only waits if a snapshot
+// is still being written when the one after the next is taken.
+// xsnapreader maps the file into memory, and gives the fields as views,
+// without reading or converting them.
+//---------------------------------------------------------------------------//
+// File format, all little endian on little endian machines :
+// + File header, 64 bytes : magic "XSNAP01", 0x01020304, version, padding
+// + Snapshots, one after another, each with
+//   - Header, 64 bytes : "SNAP", nfields u32, step s64, time f64,
+//     bytes u64 (size of the snapshot), padding
+//   - nfields descriptors, 128 bytes each : name char[40], dtype char[8]
+//     (numpy style, like "<f8"), rank u32, padding u32, shape s64[4],
+//     lbound s64[4] (FORTRAN lower bounds), offset u64 (of the data, from
+//     the start of the snapshot)
+//   - The data of each field, in row major order, at 64 byte boundaries
+// The data can be loaded in Python with numpy.memmap, see
+// visualize_nonlinear_convection.py.
+//---------------------------------------------------------------------------//
+// USE : Write u every 100 steps
+// >> xsnapwriter snap("run.xsnap");
+// >> snap.write(0,0.0,{xsnapfield("x",x),xsnapfield("u",u.n())});
+// >> DO(t,1,nt)
+// >>   ...
+// >>   IF(t % 100 == 0)
+// >>     snap.write(t,t*dt,{xsnapfield("u",u.n())});
+// >>   ENDIF
+// >> ENDDO
+// >> snap.close();                     // Or when snap goes out of scope
+//---------------------------------------------------------------------------//
+// USE : Read it back
+// >> xsnapreader in("run.xsnap");
+// >> DO(k,1,in.nsnaps())
+// >>   xview<const f64,1,ROWMAJOR> u = in.field<f64>(k,"u");
+// >>   cout<<in.step(k)<<" "<<in.time(k)<<" "<<u(1)<<endl;
+// >> ENDDO
+// >> auto T = in.field<f64,2>(1,"T");  // 2D fields keep their bounds
+//---------------------------------------------------------------------------//
+struct xsnapfilehead
+{
+  char magic[8];
+  u32 endian;
+  u32 version;
+  char pad[48];
+};
+
+struct xsnaphead
+{
+  char tag[4];
+  u32 nfields;
+  s64 step;
+  f64 time;
+  u64 bytes;
+  char pad[32];
+};
+
+struct xsnapdesc
+{
+  char name[40];
+  char dtype[8];
+  u32 rank;
+  u32 pad;
+  s64 shape[4];
+  s64 lbound[4];
+  u64 offset;
+};
+
+static_assert(SOF(xsnapfilehead) == 64 && SOF(xsnaphead) == 64 &&
+              SOF(xsnapdesc) == 128,"Snapshot headers must not be padded");
+
+// Numpy style name of TYPE, like "<f8" for f64 on little endian machines
+xtem(xtn TYPE) inline
+xstr xdtype()
+{
+  static_assert(std::is_arithmetic<TYPE>::value,"Only numbers have a dtype");
+  const u32 one = 1;
+  char c[4];
+  c[0] = (*reinterpret_cast<const char*>(&one) == 1) ? '<' : '>';
+  c[1] = std::is_floating_point<TYPE>::value ? 'f' :
+         std::is_signed<TYPE>::value ? 'i' : 'u';
+  c[2] = char('0'+SOF(TYPE));
+  c[3] = 0;
+  return xstr(c);
+}
+
+//---------------------------------------------------------------------------//
+// A field of a snapshot : its name, an array or a view of up to 4
+// dimensions, which must stay valid until xsnapwriter::write returns
+//---------------------------------------------------------------------------//
+struct xsnapfield
+{
+  xstr name;
+  xstr dtype;
+  szt rank;
+  s64 shape[4];
+  s64 lbound[4];
+  s64 bytes;
+  std::function<void(char*)> copy;  // Writes the elements in row major order
+
+  xtem(xtn TYPE, szt RANK, xlayout LAYOUT)
+  xsnapfield(const xstr& nm, const xview<TYPE,RANK,LAYOUT>& v)
+  {
+    static_assert(RANK <= 4,"Snapshots hold fields of up to 4 dimensions");
+    typedef xtn std::remove_const<TYPE>::type elem;
+    name = nm;
+    dtype = xdtype<elem>();
+    rank = RANK;
+    bytes = SOF(elem);
+    s64 lo[RANK], n[RANK], st[RANK];
+    for(szt d=0;d<4;++d) { shape[d] = 1; lbound[d] = 1; }
+    for(szt d=0;d<RANK;++d) {
+      lo[d] = lbound[d] = v.lbound(d);
+      n[d] = shape[d] = v.size(d);
+      bytes *= n[d];
+    }
+    for(szt d=RANK;d-- > 0;) st[d] = (d == RANK-1) ? 1 : st[d+1]*n[d+1];
+    const xview<const elem,RANK,LAYOUT> src(v);
+    // Only the view is captured, not the elements : the array must not
+    // change nor be destroyed until write() has copied it to its buffer
+    copy = [src,lo,n,st](char* p) {
+      xcopyview(src,xview<elem,RANK,ROWMAJOR>(reinterpret_cast<elem*>(p),
+                                              lo,n,st));
+    };
+  }
+
+  xtem(xtn TYPE)
+  xsnapfield(const xstr& nm, const xarray<TYPE>& a)
+    : xsnapfield(nm,a(a.lbound(),a.ubound())) {}
+
+  xtem(xtn TYPE, szt RANK, xlayout LAYOUT)
+  xsnapfield(const xstr& nm, const xarraynd<TYPE,RANK,LAYOUT>& a)
+    : xsnapfield(nm,a.view()) {}
+};
+
+//---------------------------------------------------------------------------//
+// Writes snapshots to a file from a background thread
+//---------------------------------------------------------------------------//
+class xsnapwriter
+{
+public:
+  // Creates the file PATH, with NBUFFERS staging buffers
+  explicit xsnapwriter(const xstr& path, szt nbuffers=2)
+    : f_(std::fopen(path.c_str(),"wb")), buf_(std::max(nbuffers,1u)),
+      used_(buf_.size(),0), stop_(false), fail_(false)
+  {
+    if(!f_) { fail_ = true; return; }
+    xsnapfilehead fh;
+    std::memset(&fh,0,SOF(fh));
+    std::memcpy(fh.magic,"XSNAP01",8);
+    fh.endian = 0x01020304u;
+    fh.version = 1;
+    if(std::fwrite(&fh,SOF(fh),1,f_) != 1) fail_ = true;
+    for(szt k=0;k<buf_.size();++k) free_.push_back(k);
+    th_ = std::thread(&xsnapwriter::work,this);
+  }
+
+  ~xsnapwriter() { close(); }
+
+  xsnapwriter(const xsnapwriter&) = delete;
+  xsnapwriter& operator=(const xsnapwriter&) = delete;
+
+  // Was the file created ?
+  bool is_open() const { return f_ != 0; }
+
+  // Has everything so far been written without errors ?
+  bool good() const { return !fail_; }
+
+  // Stage the snapshot of FIELDS at STEP and TIME, to be written later.
+  // Waits only if all the staging buffers are still being written.
+  void write(s64 step, f64 time, const std::vector<xsnapfield>& fields)
+  {
+    if(!f_) return;
+    PROFSCOPE("xsnapwriter::write");
+    // Layout of the snapshot
+    const u64 align = 64;
+    u64 off = SOF(xsnaphead) + fields.size()*SOF(xsnapdesc);
+    std::vector<u64> at(fields.size());
+    for(szt k=0;k<fields.size();++k) {
+      off = (off+align-1)/align*align;
+      at[k] = off;
+      off += u64(fields[k].bytes);
+    }
+    const u64 total = (off+align-1)/align*align;
+
+    szt b;
+    {
+      std::unique_lock<std::mutex> lk(m_);
+      cv_.wait(lk,[this] { return !free_.empty(); });
+      b = free_.front();
+      free_.pop_front();
+    }
+    std::vector<char>& buf = buf_[b];
+    if(buf.size() < total) buf.resize(total);
+    char* p = buf.data();
+    std::memset(p,0,at.empty() ? total : at[0]);
+
+    xsnaphead sh;
+    std::memset(&sh,0,SOF(sh));
+    std::memcpy(sh.tag,"SNAP",4);
+    sh.nfields = u32(fields.size());
+    sh.step = step;
+    sh.time = time;
+    sh.bytes = total;
+    std::memcpy(p,&sh,SOF(sh));
+    for(szt k=0;k<fields.size();++k) {
+      const xsnapfield& fk = fields[k];
+      ASSERT(fk.name.size() < 40,"Snapshot field name too long : "<<fk.name);
+      xsnapdesc d;
+      std::memset(&d,0,SOF(d));
+      std::strncpy(d.name,fk.name.c_str(),39);
+      std::strncpy(d.dtype,fk.dtype.c_str(),7);
+      d.rank = fk.rank;
+      for(szt e=0;e<4;++e) { d.shape[e] = fk.shape[e]; d.lbound[e] = fk.lbound[e]; }
+      d.offset = at[k];
+      std::memcpy(p+SOF(xsnaphead)+k*SOF(xsnapdesc),&d,SOF(d));
+      // Padding up to the next field, then the data
+      const u64 end = at[k]+u64(fk.bytes);
+      const u64 next = (k+1 < fields.size()) ? at[k+1] : total;
+      fk.copy(p+at[k]);
+      std::memset(p+end,0,next-end);
+    }
+
+    {
+      std::lock_guard<std::mutex> lk(m_);
+      used_[b] = total;
+      full_.push_back(b);
+    }
+    cv_.notify_all();
+  }
+
+  // Wait until every staged snapshot is in the file
+  void flush()
+  {
+    if(!f_) return;
+    std::unique_lock<std::mutex> lk(m_);
+    cv_.wait(lk,[this] { return free_.size() == buf_.size(); });
+    if(std::fflush(f_) != 0) fail_ = true;
+  }
+
+  // Write what is left and close the file
+  void close()
+  {
+    if(!f_) return;
+    flush();
+    {
+      std::lock_guard<std::mutex> lk(m_);
+      stop_ = true;
+    }
+    cv_.notify_all();
+    th_.join();
+    if(std::fclose(f_) != 0) fail_ = true;
+    f_ = 0;
+  }
+
+private:
+  // Background thread : write the full buffers in order
+  void work()
+  {
+    for(;;) {
+      szt b;
+      {
+        std::unique_lock<std::mutex> lk(m_);
+        cv_.wait(lk,[this] { return stop_ || !full_.empty(); });
+        if(full_.empty()) return;
+        b = full_.front();
+        full_.pop_front();
+      }
+      if(std::fwrite(buf_[b].data(),1,used_[b],f_) != used_[b]) fail_ = true;
+      {
+        std::lock_guard<std::mutex> lk(m_);
+        free_.push_back(b);
+      }
+      cv_.notify_all();
+    }
+  }
+
+  std::FILE* f_;
+  std::vector<std::vector<char> > buf_;  // Staging buffers
+  std::vector<u64> used_;                // Bytes of each buffer to write
+  std::deque<szt> free_, full_;          // Buffers by state, in order
+  std::mutex m_;
+  std::condition_variable cv_;
+  std::thread th_;
+  bool stop_;
+  std::atomic<bool> fail_;
+};
+
+//---------------------------------------------------------------------------//
+// Reads a snapshot file by mapping it into memory
+//---------------------------------------------------------------------------//
+class xsnapreader
+{
+public:
+  explicit xsnapreader(const xstr& path)
+    : p_(0), n_(0), mapped_(false), valid_(false)
+  {
+#if defined(__unix__) || defined(__APPLE__)
+    const int fd = ::open(path.c_str(),O_RDONLY);
+    if(fd < 0) return;
+    struct stat s;
+    if(::fstat(fd,&s) == 0 && s.st_size > 0) {
+      void* m = ::mmap(0,size_t(s.st_size),PROT_READ,MAP_SHARED,fd,0);
+      if(m != MAP_FAILED) {
+        p_ = static_cast<const char*>(m);
+        n_ = u64(s.st_size);
+        mapped_ = true;
+      }
+    }
+    ::close(fd);
+#else
+    std::FILE* f = std::fopen(path.c_str(),"rb");
+    if(!f) return;
+    char chunk[1<<16];
+    for(size_t r;(r = std::fread(chunk,1,SOF(chunk),f)) > 0;)
+      copy_.insert(copy_.end(),chunk,chunk+r);
+    std::fclose(f);
+    p_ = copy_.data();
+    n_ = copy_.size();
+#endif
+    index();
+  }
+
+  ~xsnapreader()
+  {
+#if defined(__unix__) || defined(__APPLE__)
+    if(mapped_) ::munmap(const_cast<char*>(p_),size_t(n_));
+#endif
+  }
+
+  xsnapreader(const xsnapreader&) = delete;
+  xsnapreader& operator=(const xsnapreader&) = delete;
+
+  // Is the file a snapshot file that could be read ?
+  bool is_open() const { return valid_; }
+
+  // No. of complete snapshots, numbered 1 to nsnaps()
+  s64 nsnaps() const { return s64(snaps_.size()); }
+
+  s64 step(s64 k) const { return head(k).step; }
+  f64 time(s64 k) const { return head(k).time; }
+
+  // Does snapshot K have the field NAME ?
+  bool has(s64 k, const xstr& name) const { return find(k,name) != 0; }
+
+  // Field NAME of snapshot K as a read only view with its original bounds,
+  // or an empty view if there is no such field
+  xtem(xtn TYPE, szt RANK=1)
+  xview<const TYPE,RANK,ROWMAJOR> field(s64 k, const xstr& name) const
+  {
+    const xsnapdesc* d = find(k,name);
+    if(!d) return xview<const TYPE,RANK,ROWMAJOR>();
+    ASSERT(d->rank == RANK,"Field "<<name<<" has rank "<<d->rank);
+    ASSERT(xstr(d->dtype) == xdtype<TYPE>(),
+           "Field "<<name<<" is of type "<<d->dtype);
+    s64 n[RANK], lo[RANK], st[RANK];
+    for(szt e=RANK;e-- > 0;) {
+      n[e] = d->shape[e]; lo[e] = d->lbound[e];
+      st[e] = (e == RANK-1) ? 1 : st[e+1]*n[e+1];
+    }
+    const TYPE* data = reinterpret_cast<const TYPE*>(snaps_[k-1]+d->offset);
+    return xview<const TYPE,RANK,ROWMAJOR>(data,lo,n,st);
+  }
+
+private:
+  // Find where every complete snapshot starts
+  void index()
+  {
+    if(n_ < SOF(xsnapfilehead) || std::memcmp(p_,"XSNAP01",8) != 0) return;
+    valid_ = true;
+    u64 at = SOF(xsnapfilehead);
+    while(at+SOF(xsnaphead) <= n_) {
+      const xsnaphead* h = reinterpret_cast<const xsnaphead*>(p_+at);
+      if(std::memcmp(h->tag,"SNAP",4) != 0 || h->bytes == 0 ||
+         at+h->bytes > n_) break;
+      snaps_.push_back(p_+at);
+      at += h->bytes;
+    }
+  }
+
+  const xsnaphead& head(s64 k) const
+  {
+    ASSERT(k >= 1 && k <= nsnaps(),"No snapshot "<<k);
+    return *reinterpret_cast<const xsnaphead*>(snaps_[k-1]);
+  }
+
+  const xsnapdesc* find(s64 k, const xstr& name) const
+  {
+    const xsnaphead& h = head(k);
+    const xsnapdesc* d =
+      reinterpret_cast<const xsnapdesc*>(snaps_[k-1]+SOF(xsnaphead));
+    for(u32 f=0;f<h.nfields;++f)
+      if(std::strncmp(d[f].name,name.c_str(),40) == 0) return d+f;
+    return 0;
+  }
+
+  const char* p_;
+  u64 n_;
+  bool mapped_;
+  bool valid_;
+  std::vector<char> copy_;            // File contents, without mmap
+  std::vector<const char*> snaps_;    // Start of every snapshot
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Ensembles
+///////////////////////////////////////////////////////////////////////////////
+//---------------------------------------------------------------------------//
+// An ensemble advances K independent runs (members) of the same explicit
+// 1D scheme together, like a parameter sweep of different dt, initial
+// conditions or domain sizes, in one process.
+// The members are interleaved : u(i,k) is point i of member k, and the
+// members of a point are contiguous, so every load of the stencil gives
+// the same point of K members, and the loop over the members is vectorized.
+// + Parameters : the function gets the member k of the point, and takes
+//   its parameters from arrays over the members, u.param(a) is a(k).
+// + Domain size : member k updates the points lo:last(k), those after
+//   last(k) are not changed.
+// + Early termination : member k stops after maxsteps(k) steps, or when
+//   stop(k) is called, for ex. when it reaches its end time or diverges.
+//   Stopped members keep their values, and the ensemble runs until every
+//   member is stopped.
+// + Snapshots : the whole ensemble is one snapshot, with the field "u" of
+//   all the members and the field "steps" of the steps each has taken.
+//---------------------------------------------------------------------------//
+// NOTE : The function gets a point u, where u(0) is the old value of the
+// member at the point and u(-1), u(+1) etc. are the old values of the same
+// member at its neighbours. u.i is the index of the point and u.k of the
+// member. The stencil must not read outside the arrays.
+// NOTE : If the function is a template, it is also called with xenspack,
+// whose u(o) and u.param(a) are packs of xnpack<TYPE>::width neighbouring
+// members, and u.k is the first of them, like for xstencil_run.
+// NOTE : The points are updated by the threads of the pool, so the
+// function must not change anything shared.
+// NOTE : A member count that is a multiple of the pack width keeps every
+// load of a point aligned and leaves no member to the scalar loop.
+//---------------------------------------------------------------------------//
+// USE : 64 runs of the FTBS test of main.cpp to t = 0.45, each with its own
+// dt and initial hat
+// >> struct ftbs_f
+// >> {
+// >>   const af64& dtdx;                 // dt/dx of each member
+// >>   xtem(xtn PT) xtn PT::value_type operator()(const PT& u) const
+// >>   { return u(0) - u(0)*u.param(dtdx)*(u(0)-u(-1)); }
+// >> };
+// >> xensemble<f64> e(64,1,nx);
+// >> af64 dtdx(1,64);
+// >> DO(k,1,64)
+// >>   f64 dt = ...;
+// >>   dtdx[k] = dt/dx;
+// >>   e.maxsteps(k) = s64(0.45/dt+0.5);
+// >>   DO(i,1,nx)
+// >>     e.u()(i,k) = (i >= hat0[k] && i <= hat1[k]) ? 2.0 : 1.0;
+// >>   ENDDO
+// >> ENDDO
+// >> ftbs_f fn = {dtdx};
+// >> xsnapwriter snap("sweep.xsnap");
+// >> e.run(2,fn,[&](xensemble<f64>& en) {
+// >>   IF(en.step() % 500 == 0)
+// >>     en.snapshot(snap,0.0);          // u(1:nx,1:64) and steps(1:64)
+// >>   ENDIF
+// >> });
+//---------------------------------------------------------------------------//
+//---------------------------------------------------------------------------//
+// Old values of one member around the point being updated (xenspoint), or
+// of PACK::width neighbouring members (xenspack)
+//---------------------------------------------------------------------------//
+xtem(xtn TYPE)
+struct xenspoint
+{
+  typedef TYPE value_type;
+
+  const TYPE* p;  // The point of the member
+  s64 ld;         // Distance between the points of a member
+  s64 i, k;       // Indices of the point and the member
+
+  const TYPE& operator()(s64 o) const { return p[o*ld]; }
+
+  // Parameter of the member, from the array a(1:K) of all the members
+  const TYPE& param(const xarray<TYPE>& a) const { return a[k]; }
+};
+
+xtem(xtn PACK)
+struct xenspack
+{
+  typedef PACK value_type;
+  typedef xtn PACK::value_type TYPE;
+
+  const TYPE* p;  // The point of the first member
+  s64 ld;         // Distance between the points of a member
+  s64 i, k;       // Indices of the point and the first member
+
+  PACK operator()(s64 o) const { return PACK::loadu(p+o*ld); }
+
+  PACK param(const xarray<TYPE>& a) const { return PACK::loadu(&a[k]); }
+};
+
+//---------------------------------------------------------------------------//
+// Apply F to the N members of the point PT, from the row PS of the old
+// values to the row PD. Members with UNTIL < i keep their old values, and
+// UNTIL = 0 updates every member.
+// NOTE : Every member is computed and the result selected, without
+// branches, so that the loop is vectorized.
+//---------------------------------------------------------------------------//
+// One member at a time
+xtem(xtn TYPE, xtn FUNC) inline
+void xensemble_row(const FUNC& f, const xenspoint<TYPE>& pt,
+                   const TYPE* __restrict ps, TYPE* __restrict pd,
+                   const TYPE* until, s64 n, std::false_type)
+{
+  const TYPE fi = TYPE(pt.i);
+  xenspoint<TYPE> q = pt;
+  if(!until) {
+    for(s64 k=0;k<n;++k) {
+      q.p = ps+k; q.k = pt.k+k;
+      pd[k] = f(q);
+    }
+    return;
+  }
+  for(s64 k=0;k<n;++k) {
+    q.p = ps+k; q.k = pt.k+k;
+    const TYPE v = f(q);
+    pd[k] = (fi <= until[k]) ? v : ps[k];
+  }
+}
+
+// One pack of members at a time, and the last n%width one at a time
+xtem(xtn TYPE, xtn FUNC) inline
+void xensemble_row(const FUNC& f, const xenspoint<TYPE>& pt,
+                   const TYPE* __restrict ps, TYPE* __restrict pd,
+                   const TYPE* until, s64 n, std::true_type)
+{
+  typedef xnpack<TYPE> pack;
+  const s64 w = pack::width;
+  const pack fi(TYPE(pt.i));
+  xenspack<pack> q;
+  q.ld = pt.ld; q.i = pt.i;
+  s64 k = 0;
+  if(!until) {
+    for(;k+w<=n;k+=w) {
+      q.p = ps+k; q.k = pt.k+k;
+      f(q).storeu(pd+k);
+    }
+  } else {
+    for(;k+w<=n;k+=w) {
+      q.p = ps+k; q.k = pt.k+k;
+      xselect(fi <= pack::loadu(until+k),f(q),
+              pack::loadu(ps+k)).storeu(pd+k);
+    }
+  }
+  xenspoint<TYPE> r = pt;
+  r.k = pt.k+k;
+  xensemble_row(f,r,ps+k,pd+k,until ? until+k : until,n-k,
+                std::false_type());
+}
+
+//---------------------------------------------------------------------------//
+// K members of a 1D field of the points lo:hi, advanced together
+//---------------------------------------------------------------------------//
+xtem(xtn TYPE)
+class xensemble
+{
+public:
+  typedef TYPE value_type;
+  typedef xarraynd<TYPE,2,ROWMAJOR> field;
+  typedef xview<TYPE,1,xslicelayout<2,ROWMAJOR,1>::value> member_view;
+
+  // MEMBERS members of the points LO:HI, all 0, updating every point up to
+  // HI with no limit of steps
+  xensemble(s64 members, s64 lo, s64 hi)
+    : u_(lo,hi,s64(1),members), until_(1,members),
+      last_(1,members,hi),
+      maxsteps_(1,members,std::numeric_limits<s64>::max()),
+      steps_(1,members,0), on_(1,members,1)
+  {
+    ASSERT(members > 0 && hi >= lo,"Empty ensemble");
+    u_.n().fill(TYPE(0));
+    u_.np1().fill(TYPE(0));
+  }
+
+  xensemble(const xensemble&) = delete;
+  xensemble& operator=(const xensemble&) = delete;
+
+  // No. of members K
+  s64 members() const { return u_.n().size(1); }
+
+  // Bounds of the points
+  s64 lbound() const { return u_.n().lbound(0); }
+  s64 ubound() const { return u_.n().ubound(0); }
+
+  // Latest values of all the members, u()(i,k)
+  field& u() { return u_.n(); }
+  const field& u() const { return u_.n(); }
+
+  // Latest values of member k, along the points
+  member_view member(s64 k) { return u_.n().col(k); }
+
+  // Last point updated by member k
+  s64& last(s64 k) { return last_[k]; }
+  s64 last(s64 k) const { return last_[k]; }
+
+  // Steps after which member k stops
+  s64& maxsteps(s64 k) { return maxsteps_[k]; }
+  s64 maxsteps(s64 k) const { return maxsteps_[k]; }
+
+  // Steps taken by member k
+  s64 steps(s64 k) const { return steps_[k]; }
+
+  // Is member k still running ?
+  bool active(s64 k) const { return on_[k] && steps_[k] < maxsteps_[k]; }
+
+  // Stop member k, its values are kept from now on
+  void stop(s64 k) { on_[k] = 0; }
+
+  // No. of members still running
+  s64 nactive() const
+  {
+    s64 c = 0;
+    for(s64 k=1;k<=members();++k) c += active(k) ? 1 : 0;
+    return c;
+  }
+
+  // No. of steps of the ensemble, those of its longest running member
+  s64 step() const { return u_.step(); }
+
+  // One step of the function F on the points LO:last(k) of every active
+  // member. Returns false, without a step, if no member is active.
+  xtem(xtn FUNC) bool advance(s64 lo, const FUNC& f)
+  {
+    PROFSCOPE("xensemble::advance");
+    const s64 nk = members(), lb = lbound();
+    // Points lo:all are updated in every member, then lo:hi in some
+    s64 hi = lo-1, all = ubound();
+    for(s64 k=1;k<=nk;++k) {
+      ASSERT(last_[k] <= ubound(),"Member "<<k<<" updates past the points");
+      if(active(k)) {
+        until_[k] = TYPE(last_[k]);
+        hi = std::max(hi,last_[k]);
+        all = std::min(all,last_[k]);
+        ++steps_[k];
+      } else {
+        until_[k] = TYPE(lo-1);
+        all = lo-1;
+      }
+    }
+    if(hi < lo) return false;
+    ASSERT(lo >= lb,"Ensemble updates before its first point");
+
+    const field& un = u_.n();
+    field& un1 = u_.np1();
+    const s64 ld = un.stride(0);
+    const TYPE* src = &un(lb,1);
+    TYPE* dst = &un1(lb,1);
+    // Points that no member updates keep their values
+    for(s64 i=lb;i<=ubound();++i)
+      if(i < lo || i > hi)
+        std::copy(src+(i-lb)*ld,src+(i-lb)*ld+nk,dst+(i-lb)*ld);
+
+    // Points lo:hi, the rows of all the members, on the threads of the pool
+    typedef xenspack<xnpack<TYPE> > packpoint;
+    const FUNC fl(f);
+    const TYPE* until = until_.data();
+    xthreadpool& pool = xpool();
+    xparchunks ch(xsched(),hi-lo+1,pool.size());
+    pool.run([&](szt t) {
+      ch.each(t,[&](s64 a, s64 b) {
+        xenspoint<TYPE> pt;
+        pt.ld = ld; pt.k = 1;
+        for(s64 i=lo+a;i<lo+b;++i) {
+          pt.i = i;
+          xensemble_row(fl,pt,src+(i-lb)*ld,dst+(i-lb)*ld,
+                        i <= all ? 0 : until,nk,
+                        xtn xstcallable<FUNC,packpoint>::type());
+        }
+      });
+    });
+    u_.advance();
+    return true;
+  }
+
+  // Advance every member from the point LO until all are stopped, calling
+  // OBS(*this) after every step, where it can stop members or take
+  // snapshots. Returns the no. of steps.
+  xtem(xtn FUNC, xtn OBS) s64 run(s64 lo, const FUNC& f, const OBS& obs)
+  {
+    s64 n = 0;
+    while(advance(lo,f)) { ++n; obs(*this); }
+    return n;
+  }
+
+  xtem(xtn FUNC) s64 run(s64 lo, const FUNC& f)
+  {
+    return run(lo,f,[](xensemble&) {});
+  }
+
+  // Write every member as one snapshot at step() and TIME : the field "u"
+  // of the points and members, "steps" of the steps of each member, and
+  // the EXTRA fields given, for ex. the time of each member
+  void snapshot(xsnapwriter& w, f64 time,
+                const std::vector<xsnapfield>& extra =
+                  std::vector<xsnapfield>()) const
+  {
+    std::vector<xsnapfield> fields;
+    fields.push_back(xsnapfield("u",u_.n()));
+    fields.push_back(xsnapfield("steps",steps_));
+    fields.insert(fields.end(),extra.begin(),extra.end());
+    w.write(step(),time,fields);
+  }
+
+private:
+  xtimelevels<field> u_;
+  xarray<TYPE> until_;   // Last point updated by each member in this step
+  xarray<s64> last_;
+  xarray<s64> maxsteps_;
+  xarray<s64> steps_;
+  xarray<s64> on_;       // 0 for stopped members
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Benchmarks
+///////////////////////////////////////////////////////////////////////////////
+//---------------------------------------------------------------------------//
+// Timing of kernels, for the benchmark suite bench.cpp and for users.
+// xbench calls a kernel until it is warm (caches, page faults, clocks),
+// then measures a number of samples, each of as many calls as needed to
+// last at least mintime seconds, so timer resolution does not matter even
+// for problems that fit in L1. The times of one call are summarized by
+// their minimum, median, mean and standard deviation.
+// The bytes and flops of one call, given by the user, turn the median
+// time into ns/element, elements/s, GB/s and GFLOP/s. Bytes are the least
+// memory traffic the kernel needs, i.e. every array read or written once.
+//---------------------------------------------------------------------------//
+// USE : Bandwidth of axpy, compared to the measured peak of the machine
+// >> xbenchreport rep;
+// >> rep.peak = xbench_peak_bandwidth();
+// >> rep.add(xbench("axpy",n,24.0*n,2.0*n,[&]{ xaxpy(n,a,x,y); }));
+// >> rep.write_table(cout);
+// >> rep.write("axpy.csv");          // Or "axpy.json"
+//---------------------------------------------------------------------------//
+// NOTE : Pass the results of a kernel to xdonotoptimize, or the compiler
+// may remove the work whose result is never used.
+// >> rep.add(xbench("sum",n,8.0*n,n,[&]{ xdonotoptimize(xsum(x)); }));
+//---------------------------------------------------------------------------//
+// Keep V, and everything V may point to, alive for the compiler
+xtem(xtn TYPE) inline
+void xdonotoptimize(const TYPE& v)
+{
+#if defined(__GNUC__)
+  asm volatile("" : : "g"(&v) : "memory");
+#else
+  static volatile const void* sink;
+  sink = &v;
+#endif
+}
+
+// Wall clock time in seconds, from an arbitrary start
+inline f64 xwtime()
+{
+  return std::chrono::duration<f64>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// How a kernel is measured
+struct xbenchopts
+{
+  s64 samples;     // No. of timed samples
+  f64 mintime;     // Least seconds per sample
+  f64 warmtime;    // Least seconds of warm-up calls
+  xbenchopts() : samples(11), mintime(1e-3), warmtime(1e-2) {}
+};
+
+// Time of one call of a kernel, and what it does
+struct xbenchresult
+{
+  xstr name;       // Kernel
+  s64 n;           // Elements processed by one call
+  f64 bytes;       // Memory traffic of one call
+  f64 flops;       // Floating point operations of one call
+  s64 calls;       // Calls per sample
+  s64 samples;     // No. of samples
+  f64 tmin;        // Seconds per call : minimum,
+  f64 tmedian;     // median,
+  f64 tmean;       // mean,
+  f64 tstddev;     // and standard deviation over the samples
+
+  f64 ns_per_element() const { return 1e9*tmedian/n; }
+  f64 elements_per_second() const { return n/tmedian; }
+  f64 gbps() const { return 1e-9*bytes/tmedian; }
+  f64 gflops() const { return 1e-9*flops/tmedian; }
+};
+
+//---------------------------------------------------------------------------//
+// Measure the kernel F, which processes N elements, moving BYTES bytes and
+// doing FLOPS floating point operations per call
+//---------------------------------------------------------------------------//
+xtem(xtn FUNC)
+xbenchresult xbench(const xstr& name, s64 n, f64 bytes, f64 flops,
+                    FUNC f, const xbenchopts& opt = xbenchopts())
+{
+  // Warm up, and estimate the time of one call
+  s64 warm = 0;
+  f64 t0 = xwtime(), t = 0.0;
+  do { f(); ++warm; t = xwtime()-t0; } while(t < opt.warmtime);
+  s64 calls = std::max<s64>(1,static_cast<s64>(std::ceil(opt.mintime*warm/t)));
+
+  std::vector<f64> ts(std::max<s64>(opt.samples,1));
+  for(szt s=0;s<ts.size();++s) {
+    t0 = xwtime();
+    for(s64 c=0;c<calls;++c) f();
+    ts[s] = (xwtime()-t0)/calls;
+  }
+  std::sort(ts.begin(),ts.end());
+
+  xbenchresult r;
+  r.name = name; r.n = n; r.bytes = bytes; r.flops = flops;
+  r.calls = calls; r.samples = ts.size();
+  const szt m = ts.size();
+  r.tmin = ts[0];
+  r.tmedian = (m % 2) ? ts[m/2] : 0.5*(ts[m/2-1]+ts[m/2]);
+  r.tmean = std::accumulate(ts.begin(),ts.end(),0.0)/m;
+  f64 var = 0.0;
+  for(szt s=0;s<m;++s) var += xsq(ts[s]-r.tmean);
+  r.tstddev = (m > 1) ? std::sqrt(var/(m-1)) : 0.0;
+  return r;
+}
+
+//---------------------------------------------------------------------------//
+// Memory bandwidth of the machine in GB/s, the best of the STREAM copy,
+// scale, add and triad kernels on arrays of N f64, run by all the threads
+// of xpool(). N should make the arrays much larger than the last level
+// cache, the default is 3 arrays of 32MB.
+//---------------------------------------------------------------------------//
+inline f64 xbench_peak_bandwidth(s64 n = s64(1) << 22)
+{
+  xarray<f64> a(1,n), b(1,n), c(1,n);
+  const xsched sc(STATIC);
+  const f64 q = 3.0;
+  // First touch by the threads which use the pages
+  xfirsttouch(a,1.0,sc); xfirsttouch(b,2.0,sc); xfirsttouch(c,0.0,sc);
+  const f64 B = SOF(f64)*f64(n);
+  f64 peak = 0.0;
+  peak = std::max(peak,xbench("copy",n,2*B,0,[&]{
+    xparloop<s64>(1,n,sc,[&](s64 i){ c[i] = a[i]; }); }).gbps());
+  peak = std::max(peak,xbench("scale",n,2*B,n,[&]{
+    xparloop<s64>(1,n,sc,[&](s64 i){ b[i] = q*c[i]; }); }).gbps());
+  peak = std::max(peak,xbench("add",n,3*B,n,[&]{
+    xparloop<s64>(1,n,sc,[&](s64 i){ c[i] = a[i]+b[i]; }); }).gbps());
+  peak = std::max(peak,xbench("triad",n,3*B,2*n,[&]{
+    xparloop<s64>(1,n,sc,[&](s64 i){ a[i] = b[i]+q*c[i]; }); }).gbps());
+  return peak;
+}
+
+//---------------------------------------------------------------------------//
+// Results of a benchmark run, as a table, CSV or JSON
+//---------------------------------------------------------------------------//
+class xbenchreport
+{
+public:
+  f64 peak;                           // Peak bandwidth in GB/s, 0 if unknown
+  std::vector<xbenchresult> results;
+
+  xbenchreport() : peak(0.0) {}
+
+  void add(const xbenchresult& r) { results.push_back(r); }
+
+  // Aligned columns, for people
+  void write_table(std::ostream& os) const
+  {
+    char line[160];
+    std::snprintf(line,SOF(line),"%-14s %12s %10s %10s %10s %10s %8s %7s\n",
+                  "kernel","n","ns/elem","Melem/s","GB/s","GFLOP/s","%peak",
+                  "cv%");
+    os<<line;
+    for(szt k=0;k<results.size();++k) {
+      const xbenchresult& r = results[k];
+      std::snprintf(line,SOF(line),
+                    "%-14s %12lld %10.3f %10.1f %10.3f %10.3f %8.1f %7.2f\n",
+                    r.name.c_str(),static_cast<long long>(r.n),
+                    r.ns_per_element(),1e-6*r.elements_per_second(),
+                    r.gbps(),r.gflops(),
+                    peak > 0.0 ? 100.0*r.gbps()/peak : 0.0,
+                    100.0*r.tstddev/r.tmean);
+      os<<line;
+    }
+  }
+
+  // One line per result, with a header line
+  void write_csv(std::ostream& os) const
+  {
+    os<<"kernel,n,bytes,flops,calls,samples,tmin,tmedian,tmean,tstddev,"
+        "ns_per_element,elements_per_second,gbps,gflops,peak_gbps,simd,"
+        "threads\n";
+    const std::streamsize p = os.precision(9);
+    for(szt k=0;k<results.size();++k) {
+      const xbenchresult& r = results[k];
+      os<<r.name<<","<<r.n<<","<<r.bytes<<","<<r.flops<<","<<r.calls<<","
+        <<r.samples<<","<<r.tmin<<","<<r.tmedian<<","<<r.tmean<<","
+        <<r.tstddev<<","<<r.ns_per_element()<<","
+        <<r.elements_per_second()<<","<<r.gbps()<<","
+        <<r.gflops()<<","<<peak<<","<<xsimd_name()<<","<<xnthreads()<<"\n";
+    }
+    os.precision(p);
+  }
+
+  // An object with the machine, and an array of results
+  void write_json(std::ostream& os) const
+  {
+    const std::streamsize p = os.precision(9);
+    os<<"{\n  \"simd\": \""<<xsimd_name()<<"\",\n"
+      <<"  \"cpu_simd\": \""<<xsimd_cpu_name()<<"\",\n"
+      <<"  \"threads\": "<<xnthreads()<<",\n"
+      <<"  \"peak_gbps\": "<<peak<<",\n"
+      <<"  \"results\": [";
+    for(szt k=0;k<results.size();++k) {
+      const xbenchresult& r = results[k];
+      os<<(k ? ",\n" : "\n")
+        <<"    {\"kernel\": \""<<r.name<<"\", \"n\": "<<r.n
+        <<", \"bytes\": "<<r.bytes<<", \"flops\": "<<r.flops
+        <<", \"calls\": "<<r.calls<<", \"samples\": "<<r.samples
+        <<", \"tmin\": "<<r.tmin<<", \"tmedian\": "<<r.tmedian
+        <<", \"tmean\": "<<r.tmean<<", \"tstddev\": "<<r.tstddev
+        <<", \"ns_per_element\": "<<r.ns_per_element()
+        <<", \"elements_per_second\": "<<r.elements_per_second()
+        <<", \"gbps\": "<<r.gbps()<<", \"gflops\": "<<r.gflops()<<"}";
+    }
+    os<<"\n  ]\n}\n";
+    os.precision(p);
+  }
+
+  // Write to PATH, as JSON if it ends with .json and as CSV otherwise
+  bool write(const xstr& path) const
+  {
+    std::ofstream f(path.c_str());
+    if(!f.is_open()) return false;
+    const bool json = path.size() >= 5 &&
+                      path.compare(path.size()-5,5,".json") == 0;
+    if(json) write_json(f); else write_csv(f);
+    return f.good();
+  }
+};
+
 ///////////////////////////////////////////////////////////////////////////////
 // Decorations
 ///////////////////////////////////////////////////////////////////////////////
@@ -1,11 +1,42 @@
 import numpy as np
 import matplotlib.pyplot as plt
-title = "1D Non-Linear Convection"
-data = np.loadtxt(fname="input.dat",dtype=np.float64)
-plt.plot(data[:,0],data[:,1],label="initial condition")
 
-data = np.loadtxt(fname="output.dat",dtype=np.float64)
-plt.plot(data[:,0],data[:,1],label="final condition")
+# Layout of the snapshot file written by xsnapwriter, see scicpp.hpp
+SNAP = np.dtype([("tag","S4"),("nfields","<u4"),("step","<i8"),
+                 ("time","<f8"),("bytes","<u8"),("pad","S32")])
+FIELD = np.dtype([("name","S40"),("dtype","S8"),("rank","<u4"),
+                  ("pad","<u4"),("shape","<i8",4),("lbound","<i8",4),
+                  ("offset","<u8")])
+
+# Returns a list of snapshots, each a dict with the step, the time, and the
+# fields as arrays mapped from the file, nothing is read or converted
+def read_snapshots(fname):
+    raw = np.memmap(fname,dtype=np.uint8,mode="r")
+    assert raw[:7].tobytes() == b"XSNAP01", fname+" is not a snapshot file"
+    snaps = []
+    at = 64
+    while at + SNAP.itemsize <= raw.size:
+        head = raw[at:at+SNAP.itemsize].view(SNAP)[0]
+        descs = raw[at+SNAP.itemsize:
+                    at+SNAP.itemsize+head["nfields"]*FIELD.itemsize].view(FIELD)
+        fields = {}
+        for d in descs:
+            shape = tuple(d["shape"][:d["rank"]])
+            dtype = np.dtype(d["dtype"].decode())
+            start = at + int(d["offset"])
+            count = int(np.prod(shape))
+            fields[d["name"].decode()] = \
+                raw[start:start+count*dtype.itemsize].view(dtype).reshape(shape)
+        snaps.append({"step":int(head["step"]),"time":float(head["time"]),
+                      "fields":fields})
+        at += int(head["bytes"])
+    return snaps
+
+title = "1D Non-Linear Convection"
+snaps = read_snapshots("nonlinear_convection.xsnap")
+x = snaps[0]["fields"]["x"]
+plt.plot(x,snaps[0]["fields"]["u"],label="initial condition")
+plt.plot(x,snaps[-1]["fields"]["u"],label="final condition")
 
 plt.title(title)
 plt.xlabel("space(x)")
@@ -15,4 +46,3 @@ plt.grid()
 
 
 plt.show()
-